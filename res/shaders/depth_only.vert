@@ -0,0 +1,22 @@
+#version 450
+
+layout (location = 0) in vec3 in_position;
+
+// same transform as textured.vert, the main pass tests equal against it
+invariant gl_Position;
+
+layout (push_constant) uniform Push {
+    mat4 model;
+    vec4 color;
+} push;
+
+layout (binding = 0) uniform UBO {
+    mat4 view;
+    mat4 projection;
+    vec3 light_pos;
+} ubo;
+
+void main() {
+    vec4 world_pos = push.model * vec4(in_position, 1.0);
+    gl_Position = ubo.projection * ubo.view * world_pos;
+}
@@ -0,0 +1,54 @@
+#version 450
+
+layout (location = 0) in vec3 in_color;
+layout (location = 1) in vec2 in_uv;
+layout (location = 2) in vec3 in_normal;
+layout (location = 3) in vec3 in_camera_pos;
+layout (location = 4) in vec3 in_light_pos;
+
+layout (location = 0) out vec4 out_frag_color;
+
+// set per pipeline variant, every branch on them is folded away when the
+// variant compiles
+const uint LIGHTING_UNLIT = 0u;
+const uint LIGHTING_DIFFUSE = 1u;
+const uint LIGHTING_BANDED = 2u;
+const uint COLOR_SOURCE_PUSH = 0u;
+const uint COLOR_SOURCE_VERTEX = 1u;
+
+layout (constant_id = 0) const uint LIGHTING = 0u;      // LIGHTING_*
+layout (constant_id = 1) const bool TEXTURED = false;
+layout (constant_id = 2) const uint COLOR_SOURCE = 0u;  // COLOR_SOURCE_*
+
+layout (push_constant) uniform Push {
+    mat4 model;
+    vec4 color;
+} push;
+
+// only read by textured variants, the set stays in the layout for all
+layout (set = 1, binding = 0) uniform sampler2D sampler_texture;
+
+float banded(vec3 normal, vec3 light, vec3 camera) {
+    vec3 reflection = reflect(light, normal);
+    if (pow(max(dot(reflection, camera), 0.0), 5.0) > 0.5) return 1.0;
+    if (dot(-camera, normal) < 0.5) return 0.1;
+    if (max(dot(normal, light), 0.0) >= 0.1) return 0.5;
+    return 0.3;
+}
+
+void main() {
+    vec3 color = COLOR_SOURCE == COLOR_SOURCE_VERTEX ? in_color : vec3(push.color);
+    if (TEXTURED) color *= texture(sampler_texture, in_uv).rgb;
+
+    if (LIGHTING != LIGHTING_UNLIT) {
+        vec3 normal = normalize(in_normal);
+        vec3 light = normalize(in_light_pos);
+        if (LIGHTING == LIGHTING_DIFFUSE) {
+            color *= 0.1 + 0.9 * max(dot(normal, light), 0.0);
+        } else {
+            color *= banded(normal, light, normalize(in_camera_pos));
+        }
+    }
+
+    out_frag_color = vec4(color, push.color.a);
+}
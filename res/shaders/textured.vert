@@ -11,6 +11,9 @@ layout (location = 2) out vec3 out_normal;
 layout (location = 3) out vec3 out_camera_pos;
 layout (location = 4) out vec3 out_light_pos;
 
+// bit exact with depth_only.vert for the equal test after a depth pre-pass
+invariant gl_Position;
+
 layout (push_constant) uniform Push {
     mat4 model;
     vec4 color;
@@ -1,4 +1,5 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
 layout (location = 0) in vec3 in_color;
 layout (location = 1) in vec2 in_uv;
@@ -11,12 +12,13 @@ layout (location = 0) out vec4 out_frag_color;
 layout (push_constant) uniform Push {
     mat4 model;
     vec4 color;
+    uint texture_index;
 } push;
 
-layout (set = 1, binding = 0) uniform sampler2D sampler_texture;
+layout (set = 1, binding = 0) uniform sampler2D textures[];
 
 void main() {
-    //out_frag_color = texture(sampler_texture, in_uv);
+    vec4 base_color = texture(textures[nonuniformEXT(push.texture_index)], in_uv);
     
     vec3 normal = normalize(in_normal);
     vec3 light = normalize(in_light_pos);
@@ -25,11 +27,7 @@ void main() {
 
     if (pow(max(dot(reflection, camera), 0.0), 5.0) > 0.5) {
         out_frag_color = vec4(vec3(push.color), 1.0);
-    } else if (dot(-camera, normal) < 0.5) {
-        //out_frag_color = vec4(vec3(push.color) * 0.1, 1.0);
-    } else if (max(dot(normal, light), 0.0) >= 0.1) {
-        //out_frag_color = vec4(vec3(push.color) * 0.5, 1.0);
     } else {
-        //out_frag_color = vec4(vec3(push.color) * 0.3, 1.0);
+        out_frag_color = base_color;
     }
 }
@@ -0,0 +1,34 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout (location = 0) in vec3 in_color;
+layout (location = 1) in vec2 in_uv;
+layout (location = 2) in vec3 in_normal;
+layout (location = 3) in vec3 in_camera_pos;
+layout (location = 4) in vec3 in_light_pos;
+layout (location = 5) flat in uint in_texture_index;
+
+layout (location = 0) out vec4 out_frag_color;
+
+layout (push_constant) uniform Push {
+    mat4 model;
+    vec4 color;
+    uint object_buffer;
+} push;
+
+layout (set = 1, binding = 0) uniform sampler2D textures[];
+
+void main() {
+    vec4 base_color = texture(textures[nonuniformEXT(in_texture_index)], in_uv);
+    
+    vec3 normal = normalize(in_normal);
+    vec3 light = normalize(in_light_pos);
+    vec3 camera = normalize(in_camera_pos);
+    vec3 reflection = reflect(light, normal);
+
+    if (pow(max(dot(reflection, camera), 0.0), 5.0) > 0.5) {
+        out_frag_color = vec4(vec3(push.color), 1.0);
+    } else {
+        out_frag_color = base_color;
+    }
+}
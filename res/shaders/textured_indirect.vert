@@ -0,0 +1,58 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout (location = 0) in vec3 in_position;
+layout (location = 1) in vec3 in_color;
+layout (location = 2) in vec2 in_uv;
+layout (location = 3) in vec3 in_normal;
+
+layout (location = 0) out vec3 out_color;
+layout (location = 1) out vec2 out_uv;
+layout (location = 2) out vec3 out_normal;
+layout (location = 3) out vec3 out_camera_pos;
+layout (location = 4) out vec3 out_light_pos;
+layout (location = 5) flat out uint out_texture_index;
+
+invariant gl_Position;
+
+struct object_data {
+    mat4 model;
+    vec4 sphere;
+    uint first_index;
+    uint index_count;
+    int vertex_offset;
+    uint texture_index;
+};
+
+// same range as the other bindless shaders, model is unused, objects carry
+// their own
+layout (push_constant) uniform Push {
+    mat4 model;
+    vec4 color;
+    uint object_buffer;
+} push;
+
+layout (binding = 0) uniform UBO {
+    mat4 view;
+    mat4 projection;
+    vec3 light_pos;
+} ubo;
+
+layout (std430, set = 1, binding = 1) readonly buffer Objects {
+    object_data objects[];
+} object_buffers[];
+
+void main() {
+    // the indirect command's first instance is the object index
+    object_data object = object_buffers[push.object_buffer].objects[gl_InstanceIndex];
+
+    vec4 world_pos = object.model * vec4(in_position, 1.0);
+    gl_Position = ubo.projection * ubo.view * world_pos;
+    
+    out_color = in_color;
+    out_uv = in_uv;
+    out_normal = mat3(ubo.view) * mat3(object.model) * in_normal;
+    out_camera_pos = (ubo.view * world_pos).xyz;
+    out_light_pos = mat3(ubo.view) * (ubo.light_pos - vec3(world_pos));
+    out_texture_index = object.texture_index;
+}
@@ -5,16 +5,17 @@ layout (location = 1) in vec3 in_color;
 layout (location = 2) in vec2 in_uv;
 layout (location = 3) in vec3 in_normal;
 
+// per instance, binding 1
+layout (location = 4) in mat4 in_model;
+layout (location = 8) in vec4 in_normal_matrix[3];
+
 layout (location = 0) out vec3 out_color;
 layout (location = 1) out vec2 out_uv;
 layout (location = 2) out vec3 out_normal;
 layout (location = 3) out vec3 out_camera_pos;
 layout (location = 4) out vec3 out_light_pos;
 
-layout (push_constant) uniform Push {
-    mat4 model;
-    vec4 color;
-} push;
+invariant gl_Position;
 
 layout (binding = 0) uniform UBO {
     mat4 view;
@@ -23,12 +24,13 @@ layout (binding = 0) uniform UBO {
 } ubo;
 
 void main() {
-    vec4 world_pos = push.model * vec4(in_position, 1.0);
+    vec4 world_pos = in_model * vec4(in_position, 1.0);
     gl_Position = ubo.projection * ubo.view * world_pos;
-    
+
+    mat3 normal_matrix = mat3(in_normal_matrix[0].xyz, in_normal_matrix[1].xyz, in_normal_matrix[2].xyz);
     out_color = in_color;
     out_uv = in_uv;
-    out_normal = mat3(ubo.view) * mat3(push.model) * in_normal;
+    out_normal = mat3(ubo.view) * normal_matrix * in_normal;
     out_camera_pos = (ubo.view * world_pos).xyz;
     out_light_pos = mat3(ubo.view) * (ubo.light_pos - vec3(world_pos));
 }
@@ -0,0 +1,37 @@
+#version 450
+
+layout (location = 0) in vec2 in_uv;
+
+layout (location = 0) out vec4 out_color;
+
+// the scene target at full size, only the corner uv_scale covers was drawn
+layout (binding = 0) uniform sampler2D scene;
+
+layout (push_constant) uniform Push {
+    vec2 uv_scale;
+    vec2 texel_size;
+    float sharpness;
+} push;
+
+void main() {
+    // half a texel in from the edge so the filter never reads outside the
+    // rendered region
+    vec2 low = push.texel_size * 0.5;
+    vec2 high = push.uv_scale - push.texel_size * 0.5;
+    vec2 uv = clamp(in_uv * push.uv_scale, low, high);
+    vec3 color = texture(scene, uv).rgb;
+
+    // unsharp mask over the four neighbours, gives back some of what the
+    // bilinear stretch blurs
+    if (push.sharpness > 0.0) {
+        vec2 dx = vec2(push.texel_size.x, 0.0);
+        vec2 dy = vec2(0.0, push.texel_size.y);
+        vec3 neighbours = texture(scene, clamp(uv + dx, low, high)).rgb +
+                          texture(scene, clamp(uv - dx, low, high)).rgb +
+                          texture(scene, clamp(uv + dy, low, high)).rgb +
+                          texture(scene, clamp(uv - dy, low, high)).rgb;
+        color = clamp(color + (color - neighbours * 0.25) * push.sharpness, 0.0, 1.0);
+    }
+
+    out_color = vec4(color, 1.0);
+}
@@ -0,0 +1,113 @@
+#include "ex_atlas_packer.h"
+
+void
+ex::atlas_packer::create(uint32_t width, uint32_t height) {
+    m_width = width;
+    m_height = height;
+    reset();
+}
+
+void
+ex::atlas_packer::reset() {
+    m_skyline.clear();
+    m_skyline.push_back({0, 0, m_width});
+    m_used_area = 0;
+}
+
+bool
+ex::atlas_packer::pack(uint32_t width, uint32_t height, rect *out_rect) {
+    if (width == 0 || height == 0 || width > m_width || height > m_height) return false;
+    
+    size_t best_index = m_skyline.size();
+    uint32_t best_top = UINT32_MAX;
+    uint32_t best_width = UINT32_MAX;
+    uint32_t best_y = 0;
+
+    // lowest resulting top edge wins, the narrower segment breaks ties
+    for (size_t i = 0; i < m_skyline.size(); i++) {
+        uint32_t y = 0;
+        if (!fit(i, width, height, &y)) continue;
+
+        uint32_t top = y + height;
+        if (top < best_top || (top == best_top && m_skyline[i].width < best_width)) {
+            best_index = i;
+            best_top = top;
+            best_width = m_skyline[i].width;
+            best_y = y;
+        }
+    }
+
+    if (best_index == m_skyline.size()) return false;
+
+    out_rect->x = m_skyline[best_index].x;
+    out_rect->y = best_y;
+    out_rect->width = width;
+    out_rect->height = height;
+    add_level(best_index, out_rect->x, out_rect->y, width, height);
+    m_used_area += static_cast<uint64_t>(width) * height;
+    
+    return true;
+}
+
+float
+ex::atlas_packer::occupancy() {
+    if (m_width == 0 || m_height == 0) return 0.0f;
+    return (float) m_used_area / ((float) m_width * (float) m_height);
+}
+
+bool
+ex::atlas_packer::fit(size_t index,
+                      uint32_t width,
+                      uint32_t height,
+                      uint32_t *out_y) {
+    uint32_t x = m_skyline[index].x;
+    if (x + width > m_width) return false;
+
+    uint32_t y = 0;
+    uint32_t remaining = width;
+    for (size_t i = index; remaining > 0; i++) {
+        if (i == m_skyline.size()) return false;
+        if (m_skyline[i].y > y) y = m_skyline[i].y;
+        if (y + height > m_height) return false;
+        remaining = m_skyline[i].width >= remaining ? 0 : remaining - m_skyline[i].width;
+    }
+
+    *out_y = y;
+    return true;
+}
+
+void
+ex::atlas_packer::add_level(size_t index,
+                            uint32_t x,
+                            uint32_t y,
+                            uint32_t width,
+                            uint32_t height) {
+    m_skyline.insert(m_skyline.begin() + index, {x, y + height, width});
+
+    // shrink or drop the segments the new one now covers
+    for (size_t i = index + 1; i < m_skyline.size(); i++) {
+        skyline_node &previous = m_skyline[i - 1];
+        skyline_node &node = m_skyline[i];
+        uint32_t previous_end = previous.x + previous.width;
+        if (node.x >= previous_end) break;
+
+        uint32_t shrink = previous_end - node.x;
+        if (node.width <= shrink) {
+            m_skyline.erase(m_skyline.begin() + i);
+            i--;
+        } else {
+            node.x += shrink;
+            node.width -= shrink;
+            break;
+        }
+    }
+
+    // merge neighbours at the same height
+    for (size_t i = 0; i + 1 < m_skyline.size(); i++) {
+        if (m_skyline[i].y == m_skyline[i + 1].y) {
+            m_skyline[i].width += m_skyline[i + 1].width;
+            m_skyline.erase(m_skyline.begin() + i + 1);
+            i--;
+        }
+    }
+}
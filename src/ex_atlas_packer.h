@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace ex {
+    // Skyline bottom-left rectangle packer. Callers add their own padding to
+    // the requested size, the packer only places rectangles.
+    class atlas_packer {
+    public:
+        struct rect {
+            uint32_t x;
+            uint32_t y;
+            uint32_t width;
+            uint32_t height;
+        };
+        
+    public:
+        void create(uint32_t width, uint32_t height);
+        void reset();
+        bool pack(uint32_t width, uint32_t height, rect *out_rect);
+
+        float occupancy();
+        uint32_t width() { return m_width; }
+        uint32_t height() { return m_height; }
+        
+    private:
+        struct skyline_node {
+            uint32_t x;
+            uint32_t y;
+            uint32_t width;
+        };
+
+        bool fit(size_t index, uint32_t width, uint32_t height, uint32_t *out_y);
+        void add_level(size_t index, uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+        
+    private:
+        std::vector<skyline_node> m_skyline;
+        uint32_t m_width;
+        uint32_t m_height;
+        uint64_t m_used_area;
+    };
+}
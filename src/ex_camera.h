@@ -26,6 +26,8 @@ namespace ex {
         
         glm::mat4 get_view() { return m_view; }
         glm::mat4 get_projection() { return m_projection; }
+        glm::vec3 get_position() { return m_position; }
+        float get_far() { return m_zfar; }
         
     public:
         glm::vec3 m_position;
@@ -0,0 +1,196 @@
+#include "ex_frame_stats.h"
+#include "ex_logger.h"
+
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <stdio.h>
+
+void
+ex::frame_stats::create(uint32_t window_size) {
+    m_window_size = std::max(window_size, 1u);
+    m_series.resize(SERIES_TYPE_MAX_COUNT);
+    clear();
+}
+
+void
+ex::frame_stats::set_hitch_thresholds(const std::vector<float> &thresholds_ms) {
+    m_hitch_thresholds = thresholds_ms;
+    std::sort(m_hitch_thresholds.begin(), m_hitch_thresholds.end());
+}
+
+void
+ex::frame_stats::set_histogram(float bucket_ms, uint32_t bucket_count) {
+    m_histogram_bucket_ms = std::max(bucket_ms, 0.001f);
+    m_histogram_bucket_count = std::max(bucket_count, 1u);
+}
+
+void
+ex::frame_stats::add_frame(float cpu_ms, float gpu_ms) {
+    push(m_series[SERIES_CPU], cpu_ms);
+    if (gpu_ms > 0.0f) push(m_series[SERIES_GPU], gpu_ms);
+    m_frame_count++;
+}
+
+void
+ex::frame_stats::clear() {
+    for (series &target : m_series) {
+        target.samples.assign(m_window_size, 0.0f);
+        target.next = 0;
+        target.count = 0;
+    }
+    m_frame_count = 0;
+}
+
+ex::frame_stats::summary
+ex::frame_stats::get_summary(series_type series) {
+    summary out = {};
+    out.hitches.assign(m_hitch_thresholds.size(), 0);
+
+    std::vector<float> sorted = sorted_samples(series);
+    out.count = static_cast<uint32_t>(sorted.size());
+    if (sorted.empty()) return out;
+
+    // nearest rank, the value at least p percent of frames are under
+    auto percentile = [&sorted](float p) {
+        size_t rank = static_cast<size_t>(std::ceil(p / 100.0f * sorted.size()));
+        return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+    };
+
+    out.average_ms = std::accumulate(sorted.begin(), sorted.end(), 0.0f) / sorted.size();
+    out.p50_ms = percentile(50.0f);
+    out.p95_ms = percentile(95.0f);
+    out.p99_ms = percentile(99.0f);
+    out.max_ms = sorted.back();
+
+    for (uint32_t i = 0; i < m_hitch_thresholds.size(); i++) {
+        auto first_over = std::upper_bound(sorted.begin(), sorted.end(), m_hitch_thresholds[i]);
+        out.hitches[i] = static_cast<uint32_t>(sorted.end() - first_over);
+    }
+
+    return out;
+}
+
+std::vector<uint32_t>
+ex::frame_stats::get_histogram(series_type series) {
+    std::vector<uint32_t> buckets(m_histogram_bucket_count, 0);
+
+    const ex::frame_stats::series &source = m_series[series];
+    for (uint32_t i = 0; i < source.count; i++) {
+        uint32_t bucket = static_cast<uint32_t>(source.samples[i] / m_histogram_bucket_ms);
+        buckets[std::min(bucket, m_histogram_bucket_count - 1)]++;
+    }
+
+    return buckets;
+}
+
+void
+ex::frame_stats::print() {
+    EXINFO("-=+FRAME_STATS+=-");
+    for (uint32_t s = 0; s < SERIES_TYPE_MAX_COUNT; s++) {
+        series_type series = static_cast<series_type>(s);
+        summary stats = get_summary(series);
+        if (stats.count == 0) {
+            EXINFO("%s: no samples", series_name(series));
+            continue;
+        }
+
+        EXINFO("%s: %u frames avg %.3fms p50 %.3fms p95 %.3fms p99 %.3fms max %.3fms",
+               series_name(series), stats.count, stats.average_ms,
+               stats.p50_ms, stats.p95_ms, stats.p99_ms, stats.max_ms);
+        for (uint32_t i = 0; i < m_hitch_thresholds.size(); i++) {
+            EXINFO("%s: %u hitches over %.1fms", series_name(series), stats.hitches[i], m_hitch_thresholds[i]);
+        }
+    }
+}
+
+bool
+ex::frame_stats::write(const std::string &path, output_format format) {
+    FILE *file = fopen(path.c_str(), "w");
+    if (!file) {
+        EXERROR("Failed to open frame stats output: %s", path.c_str());
+        return false;
+    }
+
+    if (format == OUTPUT_FORMAT_CSV) {
+        fprintf(file, "series,count,average_ms,p50_ms,p95_ms,p99_ms,max_ms");
+        for (float threshold : m_hitch_thresholds) fprintf(file, ",hitches_over_%.1fms", threshold);
+        fprintf(file, "\n");
+
+        for (uint32_t s = 0; s < SERIES_TYPE_MAX_COUNT; s++) {
+            series_type series = static_cast<series_type>(s);
+            summary stats = get_summary(series);
+            fprintf(file, "%s,%u,%.4f,%.4f,%.4f,%.4f,%.4f",
+                    series_name(series), stats.count, stats.average_ms,
+                    stats.p50_ms, stats.p95_ms, stats.p99_ms, stats.max_ms);
+            for (uint32_t hitches : stats.hitches) fprintf(file, ",%u", hitches);
+            fprintf(file, "\n");
+        }
+    } else {
+        fprintf(file, "{\n");
+        fprintf(file, "  \"frames\": %u,\n", m_frame_count);
+        fprintf(file, "  \"window\": %u,\n", m_window_size);
+        fprintf(file, "  \"histogram_bucket_ms\": %.4f,\n", m_histogram_bucket_ms);
+        for (uint32_t s = 0; s < SERIES_TYPE_MAX_COUNT; s++) {
+            series_type series = static_cast<series_type>(s);
+            summary stats = get_summary(series);
+            fprintf(file, "  \"%s\": {\n", series_name(series));
+            fprintf(file, "    \"count\": %u,\n", stats.count);
+            fprintf(file, "    \"average_ms\": %.4f,\n", stats.average_ms);
+            fprintf(file, "    \"p50_ms\": %.4f,\n", stats.p50_ms);
+            fprintf(file, "    \"p95_ms\": %.4f,\n", stats.p95_ms);
+            fprintf(file, "    \"p99_ms\": %.4f,\n", stats.p99_ms);
+            fprintf(file, "    \"max_ms\": %.4f,\n", stats.max_ms);
+
+            fprintf(file, "    \"hitches\": [");
+            for (uint32_t i = 0; i < m_hitch_thresholds.size(); i++) {
+                fprintf(file, "%s{ \"threshold_ms\": %.1f, \"count\": %u }",
+                        i ? ", " : "", m_hitch_thresholds[i], stats.hitches[i]);
+            }
+            fprintf(file, "],\n");
+
+            std::vector<uint32_t> histogram = get_histogram(series);
+            fprintf(file, "    \"histogram\": [");
+            for (uint32_t i = 0; i < histogram.size(); i++) {
+                fprintf(file, "%s%u", i ? ", " : "", histogram[i]);
+            }
+            fprintf(file, "]\n");
+            fprintf(file, "  }%s\n", s + 1 < SERIES_TYPE_MAX_COUNT ? "," : "");
+        }
+        fprintf(file, "}\n");
+    }
+
+    fclose(file);
+    EXINFO("Frame stats written to %s", path.c_str());
+    return true;
+}
+
+bool
+ex::frame_stats::write(const std::string &path) {
+    bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+    return write(path, json ? OUTPUT_FORMAT_JSON : OUTPUT_FORMAT_CSV);
+}
+
+const char *
+ex::frame_stats::series_name(series_type series) {
+    switch (series) {
+    case SERIES_CPU: return "cpu";
+    case SERIES_GPU: return "gpu";
+    default: return "unknown";
+    }
+}
+
+void
+ex::frame_stats::push(series &target, float ms) {
+    target.samples[target.next] = ms;
+    target.next = (target.next + 1) % m_window_size;
+    target.count = std::min(target.count + 1, m_window_size);
+}
+
+std::vector<float>
+ex::frame_stats::sorted_samples(series_type series) {
+    const ex::frame_stats::series &source = m_series[series];
+    std::vector<float> sorted(source.samples.begin(), source.samples.begin() + source.count);
+    std::sort(sorted.begin(), sorted.end());
+    return sorted;
+}
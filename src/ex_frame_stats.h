@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+namespace ex {
+    // Rolling window of cpu and gpu frame times. Averages hide stutter, so
+    // the summary reports percentiles, the worst frame and how many frames
+    // went over each hitch threshold.
+    class frame_stats {
+    public:
+        enum output_format {
+            OUTPUT_FORMAT_CSV = 0,
+            OUTPUT_FORMAT_JSON = 1,
+        };
+
+        enum series_type {
+            SERIES_CPU = 0,
+            SERIES_GPU = 1,
+            SERIES_TYPE_MAX_COUNT,
+        };
+
+        struct summary {
+            uint32_t count;
+            float average_ms;
+            float p50_ms;
+            float p95_ms;
+            float p99_ms;
+            float max_ms;
+            std::vector<uint32_t> hitches; // one per threshold
+        };
+
+    public:
+        void create(uint32_t window_size);
+        // frames longer than a threshold count as a hitch against it
+        void set_hitch_thresholds(const std::vector<float> &thresholds_ms);
+        void set_histogram(float bucket_ms, uint32_t bucket_count);
+
+        // a gpu time of 0 means no timestamps and isn't recorded
+        void add_frame(float cpu_ms, float gpu_ms);
+        void clear();
+
+        summary get_summary(series_type series);
+        // frames per bucket, the last bucket collects everything above
+        std::vector<uint32_t> get_histogram(series_type series);
+        uint32_t frame_count() { return m_frame_count; }
+
+        void print();
+        bool write(const std::string &path, output_format format);
+        // picks the format from the extension, csv unless it ends in .json
+        bool write(const std::string &path);
+
+    private:
+        struct series {
+            std::vector<float> samples; // ring buffer
+            uint32_t next;
+            uint32_t count;
+        };
+
+        static const char *series_name(series_type series);
+        void push(series &target, float ms);
+        std::vector<float> sorted_samples(series_type series);
+
+    private:
+        std::vector<series> m_series;
+        uint32_t m_window_size {0};
+        uint32_t m_frame_count {0};
+        std::vector<float> m_hitch_thresholds {16.7f, 33.3f, 50.0f};
+        float m_histogram_bucket_ms {1.0f};
+        uint32_t m_histogram_bucket_count {50};
+    };
+}
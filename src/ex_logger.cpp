@@ -22,6 +22,6 @@ ex::logger::log_output(ex_log_level level, const char *message, ...) {
 	va_end(arg_ptr);
 
 	char out_message[1024];
-	sprintf_s(out_message, "%s%s\n", levels[level], text);
+	snprintf(out_message, sizeof(out_message), "%s%s\n", levels[level], text);
 	fputs(out_message, stdout);
 }
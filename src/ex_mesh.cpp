@@ -1,6 +1,7 @@
 #include "ex_mesh.h"
 #include "ex_logger.h"
 #include "ex_utils.hpp"
+#include "ex_profiler.h"
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tinyobjloader/tiny_obj_loader.h>
@@ -9,6 +10,7 @@
 #include <glm/gtx/hash.hpp>
 
 #include <unordered_map>
+#include <algorithm>
 #include <stdexcept>
 
 namespace std {
@@ -24,6 +26,7 @@ namespace std {
 
 void
 ex::mesh::load_file(const char *path) {
+    EXPROFILE_FUNCTION();
     tinyobj::attrib_t attributes;
     std::vector<tinyobj::shape_t> shapes;
     std::vector<tinyobj::material_t> materials;
@@ -86,3 +89,16 @@ ex::mesh::load_array(std::vector<ex::vertex> &vertices,
     m_vertices = vertices;
     m_indices = indices;
 }
+
+void
+ex::mesh::remap_uvs(glm::vec4 uv_transform) {
+    // uv_transform packs scale in xy and offset in zw, as emitted by the texture atlas
+    bool repeats = std::any_of(m_vertices.begin(), m_vertices.end(), [](const ex::vertex &vertex) {
+        return vertex.uv.x < 0.0f || vertex.uv.x > 1.0f || vertex.uv.y < 0.0f || vertex.uv.y > 1.0f;
+    });
+    if (repeats) EXWARN("Remapping uvs outside 0-1, the mesh will sample its atlas neighbours");
+
+    for (ex::vertex &vertex : m_vertices) {
+        vertex.uv = vertex.uv * glm::vec2(uv_transform.x, uv_transform.y) + glm::vec2(uv_transform.z, uv_transform.w);
+    }
+}
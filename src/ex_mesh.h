@@ -10,12 +10,20 @@ namespace ex {
     public:
         void load_file(const char *file_path);
         void load_array(std::vector<ex::vertex> &vertices, std::vector<uint32_t> &indices);
+        // uvs have to stay inside 0-1, a repeating mesh would sample the
+        // neighbouring atlas entries
+        void remap_uvs(glm::vec4 uv_transform);
+        // array atlas page the remapped uvs point into, vertices carry no
+        // layer so the draw passes it along
+        void set_texture_layer(uint32_t layer) { m_texture_layer = layer; }
         
         std::vector<ex::vertex> vertices() { return m_vertices; }
         std::vector<uint32_t> indices() { return m_indices; }
+        uint32_t texture_layer() { return m_texture_layer; }
         
     private:
         std::vector<ex::vertex> m_vertices;
         std::vector<uint32_t> m_indices;
+        uint32_t m_texture_layer {0};
     };
 }
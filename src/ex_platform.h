@@ -5,6 +5,7 @@
 #include <string>
 #include <cstdint>
 
+#ifdef _WIN32
 #ifndef WIN32_LEAN_AND_MEAN
 #define WIN32_LEAN_AND_MEAN
 #endif
@@ -14,6 +15,9 @@
 
 #include <vulkan/vulkan.h>
 #include <vulkan/vulkan_win32.h>
+#else
+#include <vulkan/vulkan.h>
+#endif
 
 enum ex_window_mode {
     EX_WINDOW_MODE_WINDOWED = 0,
@@ -53,11 +57,13 @@ namespace ex::platform {
         
         bool create_vulkan_surface(VkInstance instance, VkAllocationCallbacks *allocator, VkSurfaceKHR *surface);
         
+#ifdef _WIN32
     private:
         static LRESULT process_message_setup(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam);
         static LRESULT process_message_redirect(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam);
 
         LRESULT process_message(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam);
+#endif
 
     private:
         struct ex_window_info {
@@ -82,11 +88,13 @@ namespace ex::platform {
     private:
         ex::input *m_pinput;
 
+#ifdef _WIN32
         ATOM m_atom;
         HWND m_handle;
         HCURSOR m_cursor;
         HINSTANCE m_instance;
         //WINDOWPLACEMENT m_window_placement;
+#endif
         
         ex_window_info m_window_info;
         ex_window_state m_current_state;
@@ -102,6 +110,6 @@ namespace ex::platform {
         uint64_t get_frequency();
         
     private:
-        LARGE_INTEGER m_counter_frequency;
+        uint64_t m_counter_frequency;
     };
 }
@@ -0,0 +1,150 @@
+#include "ex_profiler.h"
+#include "ex_logger.h"
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <stdio.h>
+
+namespace {
+    struct event {
+        const char *name;
+        uint64_t start_ns;
+        uint64_t end_ns;
+    };
+
+    // written by its thread only, the exporter reads [0, count)
+    struct thread_buffer {
+        uint32_t thread_id;
+        std::string name;
+        std::vector<event> events;
+        std::atomic<uint32_t> count {0};
+        std::atomic<uint32_t> generation {0};
+        uint32_t dropped;
+    };
+
+    constexpr uint32_t events_per_thread = 64 * 1024;
+
+    std::atomic<bool> g_capturing {false};
+    // bumped by start(), buffers notice and rewind on their next record
+    std::atomic<uint32_t> g_generation {0};
+    uint64_t g_capture_start_ns = 0;
+
+    std::mutex g_buffers_mutex;
+    std::vector<std::unique_ptr<thread_buffer>> g_buffers;
+    thread_local thread_buffer *t_buffer = nullptr;
+
+    thread_buffer *
+    get_thread_buffer() {
+        if (t_buffer) return t_buffer;
+
+        // once per thread, the only lock a recording thread ever takes
+        std::lock_guard<std::mutex> lock(g_buffers_mutex);
+        std::unique_ptr<thread_buffer> buffer = std::make_unique<thread_buffer>();
+        buffer->thread_id = static_cast<uint32_t>(g_buffers.size());
+        buffer->name = "thread " + std::to_string(buffer->thread_id);
+        buffer->events.resize(events_per_thread);
+        buffer->generation.store(g_generation.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        buffer->dropped = 0;
+        t_buffer = buffer.get();
+        g_buffers.push_back(std::move(buffer));
+        return t_buffer;
+    }
+
+    void
+    write_escaped(FILE *file, const char *text) {
+        for (const char *c = text; *c; c++) {
+            if (*c == '"' || *c == '\\') fputc('\\', file);
+            fputc(*c, file);
+        }
+    }
+}
+
+void
+ex::profiler::start() {
+    g_capture_start_ns = now();
+    g_generation.fetch_add(1, std::memory_order_relaxed);
+    g_capturing.store(true, std::memory_order_release);
+}
+
+void
+ex::profiler::stop() {
+    g_capturing.store(false, std::memory_order_release);
+}
+
+bool
+ex::profiler::capturing() {
+    return g_capturing.load(std::memory_order_relaxed);
+}
+
+void
+ex::profiler::set_thread_name(const std::string &name) {
+    get_thread_buffer()->name = name;
+}
+
+void
+ex::profiler::record(const char *name, uint64_t start_ns, uint64_t end_ns) {
+    thread_buffer *buffer = get_thread_buffer();
+
+    uint32_t generation = g_generation.load(std::memory_order_relaxed);
+    if (buffer->generation.load(std::memory_order_relaxed) != generation) {
+        buffer->generation.store(generation, std::memory_order_relaxed);
+        buffer->dropped = 0;
+        buffer->count.store(0, std::memory_order_relaxed);
+    }
+
+    uint32_t index = buffer->count.load(std::memory_order_relaxed);
+    if (index >= events_per_thread) {
+        buffer->dropped++;
+        return;
+    }
+
+    buffer->events[index] = { name, start_ns, end_ns };
+    buffer->count.store(index + 1, std::memory_order_release);
+}
+
+bool
+ex::profiler::write_trace(const std::string &path) {
+    FILE *file = fopen(path.c_str(), "w");
+    if (!file) {
+        EXERROR("Failed to open trace output: %s", path.c_str());
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(g_buffers_mutex);
+    uint32_t generation = g_generation.load(std::memory_order_relaxed);
+    uint32_t event_count = 0;
+    bool first = true;
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (const std::unique_ptr<thread_buffer> &buffer : g_buffers) {
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"",
+                first ? "" : ",\n", buffer->thread_id);
+        write_escaped(file, buffer->name.c_str());
+        fprintf(file, "\"}}");
+        first = false;
+
+        // a buffer from an older capture hasn't recorded since start()
+        if (buffer->generation.load(std::memory_order_relaxed) != generation) continue;
+        if (buffer->dropped) EXWARN("Profiler: %s dropped %u events", buffer->name.c_str(), buffer->dropped);
+
+        uint32_t count = buffer->count.load(std::memory_order_acquire);
+        for (uint32_t i = 0; i < count; i++) {
+            const event &scope_event = buffer->events[i];
+            // microseconds since start(), scopes opened before it clamp to 0
+            uint64_t start_ns = scope_event.start_ns > g_capture_start_ns ? scope_event.start_ns - g_capture_start_ns : 0;
+            uint64_t duration_ns = scope_event.end_ns - scope_event.start_ns;
+            fprintf(file, ",\n{\"name\":\"");
+            write_escaped(file, scope_event.name);
+            fprintf(file, "\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                    buffer->thread_id, start_ns / 1000.0, duration_ns / 1000.0);
+        }
+        event_count += count;
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+
+    EXINFO("Trace with %u events written to %s", event_count, path.c_str());
+    return true;
+}
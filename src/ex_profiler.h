@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+#include <chrono>
+#include <cstdint>
+
+#if defined(EXCALIBUR_DEBUG) || defined(EXCALIBUR_PROFILE)
+#define EX_PROFILE_ENABLED 1
+#endif
+
+namespace ex::profiler {
+    // Every thread appends to its own buffer, nothing is shared on the
+    // recording path. Scopes are written as complete events when they close,
+    // nesting comes back from the timestamps in the trace viewer. Names are
+    // kept by pointer, use literals.
+
+    void start();
+    void stop();
+    bool capturing();
+    // thread name shown in the viewer, call once from the thread itself
+    void set_thread_name(const std::string &name);
+    // chrome://tracing / ui.perfetto.dev json, call while the recording
+    // threads are idle (between frames, after stop)
+    bool write_trace(const std::string &path);
+
+    void record(const char *name, uint64_t start_ns, uint64_t end_ns);
+
+    inline uint64_t
+    now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    class scope {
+    public:
+        scope(const char *name) : m_name(name), m_start(capturing() ? now() : 0) {}
+        ~scope() { if (m_start) record(m_name, m_start, now()); }
+
+        scope(const scope &) = delete;
+        scope &operator=(const scope &) = delete;
+
+    private:
+        const char *m_name;
+        uint64_t m_start;
+    };
+}
+
+#define EX_PROFILE_CONCAT_INNER(a, b) a##b
+#define EX_PROFILE_CONCAT(a, b) EX_PROFILE_CONCAT_INNER(a, b)
+
+#if EX_PROFILE_ENABLED == 1
+#define EXPROFILE_SCOPE(name) ex::profiler::scope EX_PROFILE_CONCAT(ex_profile_scope_, __LINE__)(name);
+#define EXPROFILE_FUNCTION() EXPROFILE_SCOPE(__func__)
+#define EXPROFILE_THREAD(name) ex::profiler::set_thread_name(name);
+#else
+#define EXPROFILE_SCOPE(name)
+#define EXPROFILE_FUNCTION()
+#define EXPROFILE_THREAD(name)
+#endif
@@ -0,0 +1,74 @@
+#include "ex_range_allocator.h"
+
+void
+ex::range_allocator::create(uint64_t size) {
+    m_size = size;
+    m_used = 0;
+    m_free_ranges.clear();
+    if (size > 0) m_free_ranges[0] = size;
+}
+
+uint64_t
+ex::range_allocator::allocate(uint64_t size, uint64_t alignment) {
+    if (size == 0) return invalid_offset;
+    if (alignment == 0) alignment = 1;
+
+    for (auto it = m_free_ranges.begin(); it != m_free_ranges.end(); ++it) {
+        uint64_t range_offset = it->first;
+        uint64_t range_size = it->second;
+        uint64_t aligned = (range_offset + alignment - 1) / alignment * alignment;
+        uint64_t padding = aligned - range_offset;
+        if (padding + size > range_size) continue;
+
+        m_free_ranges.erase(it);
+        if (padding > 0) m_free_ranges[range_offset] = padding;
+
+        uint64_t tail = range_size - padding - size;
+        if (tail > 0) m_free_ranges[aligned + size] = tail;
+
+        m_used += size;
+        return aligned;
+    }
+
+    return invalid_offset;
+}
+
+void
+ex::range_allocator::free(uint64_t offset, uint64_t size) {
+    if (offset == invalid_offset || size == 0) return;
+    m_used -= size;
+
+    auto next = m_free_ranges.lower_bound(offset);
+    if (next != m_free_ranges.end() && offset + size == next->first) {
+        size += next->second;
+        next = m_free_ranges.erase(next);
+    }
+
+    if (next != m_free_ranges.begin()) {
+        auto previous = std::prev(next);
+        if (previous->first + previous->second == offset) {
+            previous->second += size;
+            return;
+        }
+    }
+
+    m_free_ranges[offset] = size;
+}
+
+void
+ex::range_allocator::grow(uint64_t size) {
+    if (size <= m_size) return;
+    uint64_t old_size = m_size;
+    m_size = size;
+    m_used += size - old_size;
+    free(old_size, size - old_size);
+}
+
+uint64_t
+ex::range_allocator::largest_free() {
+    uint64_t out_largest = 0;
+    for (const auto &range : m_free_ranges) {
+        if (range.second > out_largest) out_largest = range.second;
+    }
+    return out_largest;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <map>
+#include <cstdint>
+
+namespace ex {
+    // First-fit free list over [0, size) with coalescing. Knows nothing about
+    // what the ranges are, the caller keeps offsets and sizes.
+    class range_allocator {
+    public:
+        static constexpr uint64_t invalid_offset = UINT64_MAX;
+        
+    public:
+        void create(uint64_t size);
+        uint64_t allocate(uint64_t size, uint64_t alignment = 1);
+        void free(uint64_t offset, uint64_t size);
+        void grow(uint64_t size);
+
+        uint64_t size() { return m_size; }
+        uint64_t used() { return m_used; }
+        uint64_t largest_free();
+        bool empty() { return m_used == 0; }
+        
+    private:
+        std::map<uint64_t, uint64_t> m_free_ranges; // offset -> size
+        uint64_t m_size;
+        uint64_t m_used;
+    };
+}
@@ -0,0 +1,72 @@
+#include "ex_thread_pool.h"
+#include "ex_profiler.h"
+
+void
+ex::thread_pool::create(uint32_t thread_count) {
+    m_running = true;
+    for (uint32_t i = 0; i < thread_count; i++) {
+        m_threads.emplace_back(&ex::thread_pool::worker_main, this, i);
+    }
+}
+
+void
+ex::thread_pool::destroy() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running = false;
+    }
+    m_work_condition.notify_all();
+
+    for (std::thread &thread : m_threads) {
+        if (thread.joinable()) thread.join();
+    }
+    m_threads.clear();
+}
+
+void
+ex::thread_pool::dispatch(uint32_t task_count, std::function<void(uint32_t, uint32_t)> task) {
+    if (task_count == 0) return;
+    
+    // no workers, run inline as worker 0
+    if (m_threads.empty()) {
+        for (uint32_t i = 0; i < task_count; i++) task(i, 0);
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_task = task;
+    m_task_count = task_count;
+    m_next_task = 0;
+    m_finished_tasks = 0;
+    m_generation++;
+    m_work_condition.notify_all();
+
+    m_done_condition.wait(lock, [this]() { return m_finished_tasks == m_task_count; });
+    m_task = nullptr;
+}
+
+void
+ex::thread_pool::worker_main(uint32_t worker) {
+    EXPROFILE_THREAD("worker " + std::to_string(worker));
+    uint64_t generation = 0;
+    
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_work_condition.wait(lock, [this, generation]() {
+            return !m_running || m_generation != generation;
+        });
+        if (!m_running) return;
+        generation = m_generation;
+
+        while (m_next_task < m_task_count) {
+            uint32_t task = m_next_task++;
+            lock.unlock();
+            m_task(task, worker);
+            lock.lock();
+
+            if (++m_finished_tasks == m_task_count) {
+                m_done_condition.notify_one();
+            }
+        }
+    }
+}
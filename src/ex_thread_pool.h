@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstdint>
+
+namespace ex {
+    // Fixed set of worker threads running one batch of tasks at a time. The
+    // worker index handed to a task is stable, so callers can keep per-thread
+    // state (command pools) indexed by it.
+    class thread_pool {
+    public:
+        void create(uint32_t thread_count);
+        void destroy();
+
+        // runs task(index, worker) for every index in [0, task_count) and
+        // returns once all of them finished
+        void dispatch(uint32_t task_count, std::function<void(uint32_t, uint32_t)> task);
+
+        uint32_t thread_count() { return static_cast<uint32_t>(m_threads.size()); }
+        
+    private:
+        void worker_main(uint32_t worker);
+        
+    private:
+        std::vector<std::thread> m_threads;
+        std::mutex m_mutex;
+        std::condition_variable m_work_condition;
+        std::condition_variable m_done_condition;
+        std::function<void(uint32_t, uint32_t)> m_task;
+        uint32_t m_task_count {0};
+        uint32_t m_next_task {0};
+        uint32_t m_finished_tasks {0};
+        uint64_t m_generation {0};
+        bool m_running {false};
+    };
+}
@@ -1,9 +1,13 @@
 #include "ex_platform.h"
+
+#ifdef _WIN32
 #include <mmsystem.h>
 
 void
 ex::platform::timer::init() {
-    QueryPerformanceFrequency(&m_counter_frequency);
+    LARGE_INTEGER counter_frequency;
+    QueryPerformanceFrequency(&counter_frequency);
+    m_counter_frequency = counter_frequency.QuadPart;
 }
 
 uint64_t
@@ -12,8 +16,24 @@ ex::platform::timer::get_time() {
     QueryPerformanceCounter(&out_counter);
     return out_counter.QuadPart;
 }
+#else
+#include <time.h>
+
+void
+ex::platform::timer::init() {
+    // clock_gettime counts nanoseconds
+    m_counter_frequency = 1000000000ull;
+}
+
+uint64_t
+ex::platform::timer::get_time() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ull + static_cast<uint64_t>(now.tv_nsec);
+}
+#endif
 
 uint64_t
 ex::platform::timer::get_frequency() {
-    return m_counter_frequency.QuadPart;
+    return m_counter_frequency;
 }
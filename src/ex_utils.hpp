@@ -1,6 +1,9 @@
 #pragma once
 
 #include <functional>
+#include <type_traits>
+#include <utility>
+#include <cstddef>
 
 namespace ex::utils {
     template <typename T, typename... Rest>
@@ -8,4 +11,31 @@ namespace ex::utils {
         seed ^= std::hash<T>{}(v) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
         (hash_combine(seed, rest), ...);
     };
+
+    // non owning view of contiguous elements, what std::span is in c++20.
+    // binds to lvalue arrays and containers only, so a temporary can't
+    // go away under it
+    template <typename T>
+    class span {
+    public:
+        constexpr span() = default;
+        constexpr span(T *data, std::size_t size) : m_data(data), m_size(size) {}
+
+        template <std::size_t N>
+        constexpr span(T (&array)[N]) : m_data(array), m_size(N) {}
+
+        template <typename C, typename = std::enable_if_t<std::is_convertible_v<decltype(std::declval<C &>().data()), T *>>>
+        constexpr span(C &container) : m_data(container.data()), m_size(container.size()) {}
+
+        constexpr T *data() const { return m_data; }
+        constexpr std::size_t size() const { return m_size; }
+        constexpr bool empty() const { return m_size == 0; }
+        constexpr T &operator[](std::size_t index) const { return m_data[index]; }
+        constexpr T *begin() const { return m_data; }
+        constexpr T *end() const { return m_data + m_size; }
+
+    private:
+        T *m_data {nullptr};
+        std::size_t m_size {0};
+    };
 }
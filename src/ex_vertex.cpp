@@ -33,3 +33,46 @@ ex::vertex::get_attribute_descriptions() {
             
     return attribute_descriptions;
 }
+
+std::vector<VkVertexInputBindingDescription>
+ex::vertex::get_position_binding_descriptions() {
+    std::vector<VkVertexInputBindingDescription> binding_descriptions;
+    binding_descriptions.push_back({0, sizeof(glm::vec3), VK_VERTEX_INPUT_RATE_VERTEX});
+
+    return binding_descriptions;
+}
+
+std::vector<VkVertexInputAttributeDescription>
+ex::vertex::get_position_attribute_descriptions() {
+    std::vector<VkVertexInputAttributeDescription> attribute_descriptions;
+    attribute_descriptions.push_back({0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0});
+
+    return attribute_descriptions;
+}
+
+ex::instance::instance(const glm::mat4 &model)
+    : model(model) {
+    glm::mat3 normal_matrix = glm::transpose(glm::inverse(glm::mat3(model)));
+    for (uint32_t i = 0; i < 3; i++) normal[i] = glm::vec4(normal_matrix[i], 0.0f);
+}
+
+std::vector<VkVertexInputBindingDescription>
+ex::instance::get_binding_descriptions() {
+    std::vector<VkVertexInputBindingDescription> binding_descriptions;
+    binding_descriptions.push_back({1, sizeof(ex::instance), VK_VERTEX_INPUT_RATE_INSTANCE});
+
+    return binding_descriptions;
+}
+
+std::vector<VkVertexInputAttributeDescription>
+ex::instance::get_attribute_descriptions() {
+    std::vector<VkVertexInputAttributeDescription> attribute_descriptions;
+    for (uint32_t i = 0; i < 4; i++) {
+        attribute_descriptions.push_back({4 + i, 1, VK_FORMAT_R32G32B32A32_SFLOAT, static_cast<uint32_t>(offsetof(ex::instance, model) + sizeof(glm::vec4) * i)});
+    }
+    for (uint32_t i = 0; i < 3; i++) {
+        attribute_descriptions.push_back({8 + i, 1, VK_FORMAT_R32G32B32A32_SFLOAT, static_cast<uint32_t>(offsetof(ex::instance, normal) + sizeof(glm::vec4) * i)});
+    }
+
+    return attribute_descriptions;
+}
@@ -15,6 +15,9 @@ namespace ex {
         
         static std::vector<VkVertexInputBindingDescription> get_binding_descriptions();
         static std::vector<VkVertexInputAttributeDescription> get_attribute_descriptions();
+        // deinterleaved positions only, 12 bytes a vertex for depth passes
+        static std::vector<VkVertexInputBindingDescription> get_position_binding_descriptions();
+        static std::vector<VkVertexInputAttributeDescription> get_position_attribute_descriptions();
         
     public:
         glm::vec3 position;
@@ -22,4 +25,20 @@ namespace ex {
         glm::vec2 uv;
         glm::vec3 normal;
     };
+
+    // per instance vertex data, read at binding 1 one step per instance
+    class instance {
+    public:
+        instance() = default;
+        instance(const glm::mat4 &model);
+
+        static std::vector<VkVertexInputBindingDescription> get_binding_descriptions();
+        // locations 4-7 model columns, 8-10 normal matrix columns
+        static std::vector<VkVertexInputAttributeDescription> get_attribute_descriptions();
+
+    public:
+        glm::mat4 model;
+        // inverse transpose of the upper 3x3, columns padded to vec4
+        glm::vec4 normal[3];
+    };
 }
@@ -1,6 +1,8 @@
 #include "ex_platform.h"
 #include "ex_logger.h"
 
+#ifdef _WIN32
+
 void
 ex::platform::window::create(ex::platform::window::create_info *create_info) {
     m_window_info.title = create_info->title;
@@ -358,3 +360,4 @@ ex::platform::window::process_message(HWND hwnd, UINT msg, WPARAM wparam, LPARAM
 
     return DefWindowProcA(hwnd, msg, wparam, lparam);
 }
+#endif
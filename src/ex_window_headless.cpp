@@ -0,0 +1,105 @@
+#include "ex_platform.h"
+#include "ex_logger.h"
+
+#ifndef _WIN32
+#include <time.h>
+
+// no windowing system yet outside of win32. the window keeps its size and
+// state so the sample runs, the backend has to be initialized headless
+
+void
+ex::platform::window::create(ex::platform::window::create_info *create_info) {
+    m_window_info.title = create_info->title;
+    m_pinput = create_info->pinput;
+
+    m_window_info.windowed_width = create_info->width;
+    m_window_info.windowed_height = create_info->height;
+    m_window_info.fullscreen_width = create_info->width;
+    m_window_info.fullscreen_height = create_info->height;
+    m_window_info.current_width = create_info->width;
+    m_window_info.current_height = create_info->height;
+    m_window_info.xpos = 0;
+    m_window_info.ypos = 0;
+
+    m_current_state = EX_WINDOW_STATE_HIDDEN;
+    m_current_mode = create_info->mode;
+    m_hide_cursor = false;
+}
+
+void
+ex::platform::window::destroy() {
+}
+
+void
+ex::platform::window::update() {
+}
+
+void
+ex::platform::window::show() {
+    m_current_state = EX_WINDOW_STATE_ACTIVE;
+}
+
+void
+ex::platform::window::close() {
+    m_current_state = EX_WINDOW_STATE_CLOSED;
+}
+
+void
+ex::platform::window::sleep(uint64_t ms) {
+    timespec duration;
+    duration.tv_sec = static_cast<time_t>(ms / 1000);
+    duration.tv_nsec = static_cast<long>((ms % 1000) * 1000000);
+    nanosleep(&duration, nullptr);
+}
+
+bool
+ex::platform::window::closed() {
+    return m_current_state == EX_WINDOW_STATE_CLOSED;
+}
+
+bool
+ex::platform::window::inactive() {
+    return m_current_state == EX_WINDOW_STATE_INACTIVE;
+}
+
+uint32_t
+ex::platform::window::width() {
+    return m_window_info.current_width;
+}
+
+uint32_t
+ex::platform::window::height() {
+    return m_window_info.current_height;
+}
+
+int8_t
+ex::platform::window::get_key(int32_t /*key_code*/) {
+    return 0;
+}
+
+void
+ex::platform::window::toggle_fullscreen() {
+}
+
+void
+ex::platform::window::change_title(std::string title) {
+    m_window_info.title = title;
+}
+
+void
+ex::platform::window::set_cursor_pos(uint32_t /*x*/, uint32_t /*y*/) {
+}
+
+void
+ex::platform::window::hide_cursor(bool hide) {
+    m_hide_cursor = hide;
+}
+
+bool
+ex::platform::window::create_vulkan_surface(VkInstance /*instance*/,
+                                            VkAllocationCallbacks */*allocator*/,
+                                            VkSurfaceKHR */*surface*/) {
+    EXERROR("No surface support on this platform, use the headless backend");
+    return false;
+}
+#endif
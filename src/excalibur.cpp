@@ -1,8 +1,8 @@
 #include "ex_logger.h"
 #include "ex_input.h"
 #include "ex_platform.h"
-
-#include "ex_memory.h"
+#include "ex_frame_stats.h"
+#include "ex_profiler.h"
 
 #include "ex_camera.h"
 #include "ex_mesh.h"
@@ -11,11 +11,20 @@
 #include "ex_entity.hpp"
 
 #include "vk_backend.h"
+#include "vk_geometry_arena.h"
 #include "vk_model.h"
 #include "vk_texture.h"
 #include "vk_shader.h"
 #include "vk_descriptor.h"
 #include "vk_pipeline.h"
+#include "vk_pipeline_manager.h"
+#include "vk_render_graph.h"
+#include "vk_occlusion_culler.h"
+#include "vk_indirect_renderer.h"
+#include "vk_instance_batcher.h"
+#include "vk_render_queue.h"
+#include "vk_resolution_scaler.h"
+#include "vk_common.h"
 
 #include <cmath>
 #include <memory>
@@ -23,6 +32,12 @@
 #include <thread>
 #include <sstream>
 #include <iomanip>
+#include <array>
+#include <cstring>
+#include <cstdlib>
+#include <cstddef>
+#include <algorithm>
+#include <atomic>
 
 // TODO: custom memory allocator
 // TODO: asset manager
@@ -40,11 +55,15 @@ struct engine_stats {
     uint32_t frames_per_second;
 } _stats;
 
+static ex::frame_stats _frame_stats;
+
 struct meshes {
     ex::mesh floor;    
     ex::mesh monkey;
 } _meshes;
 
+static ex::vulkan::geometry_arena _geometry;
+
 struct vulkan_models {
     ex::vulkan::model floor;
     ex::vulkan::model monkey;
@@ -56,24 +75,94 @@ struct vulkan_textures {
 } _textures;
 
 struct vulkan_shaders {
-    ex::vulkan::shader solid_color;
-    ex::vulkan::shader textured;
+    ex::vulkan::shader forward;
+    ex::vulkan::shader textured_bindless;
+    ex::vulkan::shader depth_only;
+    ex::vulkan::shader textured_indirect;
+    ex::vulkan::shader textured_instanced;
 } _shaders;
 
 struct vulkan_pipelines {
-    ex::vulkan::pipeline solid_color;
-    ex::vulkan::pipeline textured;
+    ex::vulkan::pipeline forward;
+    ex::vulkan::pipeline textured_bindless;
 } _pipelines;
 
+// bindless permutations and forward variants go through the manager, each
+// family shares one layout so any member can stand in while another compiles
+static ex::vulkan::pipeline_manager _pipeline_manager;
+
+struct pipeline_ids {
+    uint32_t bindless {ex::vulkan::pipeline_manager::invalid_id};
+    uint32_t bindless_double_sided {ex::vulkan::pipeline_manager::invalid_id};
+    uint32_t depth_prepass {ex::vulkan::pipeline_manager::invalid_id};
+    uint32_t depth_prepass_double_sided {ex::vulkan::pipeline_manager::invalid_id};
+    uint32_t bindless_equal {ex::vulkan::pipeline_manager::invalid_id};
+    uint32_t bindless_equal_double_sided {ex::vulkan::pipeline_manager::invalid_id};
+    uint32_t indirect {ex::vulkan::pipeline_manager::invalid_id};
+    uint32_t indirect_double_sided {ex::vulkan::pipeline_manager::invalid_id};
+    uint32_t instanced {ex::vulkan::pipeline_manager::invalid_id};
+    uint32_t instanced_double_sided {ex::vulkan::pipeline_manager::invalid_id};
+    uint32_t forward_fill_base {ex::vulkan::pipeline_manager::invalid_id};
+    uint32_t forward_fill {ex::vulkan::pipeline_manager::invalid_id};
+    uint32_t forward_line {ex::vulkan::pipeline_manager::invalid_id};
+} _pipeline_ids;
+
+// one uniform buffer per frame in flight, the cpu writes the next frame's
+// while the gpu still reads the previous one
+struct vulkan_uniforms {
+    std::array<ex::vulkan::buffer, ex::vulkan::backend::max_frames_in_flight> buffers;
+} _uniforms;
+
+// the sets come from the backend's transient sets, looked up again every
+// frame so resources the defragmenter moved are picked up without
+// rewriting a set an earlier frame may still be reading
 struct vulkan_descriptor_sets {
-    ex::vulkan::descriptor_set uniform;
-    ex::vulkan::descriptor_set textures;
+    ex::vulkan::descriptor_set_layout uniform_layout;
+    ex::vulkan::descriptor_set_layout texture_layout;
+    VkDescriptorSet uniform {};
 } _descriptor_sets;
 
+struct draw_item {
+    ex::entity *entity;
+    uint32_t texture_index;
+    // the forward pipelines' texture set, draws of one texture share it
+    VkDescriptorSet material;
+};
+
+// offscreen view of the scene, rendered by the graph before the main pass
+// and shown on the floor
+static ex::vulkan::render_graph _graph;
+
+struct preview_target {
+    uint32_t color {ex::vulkan::render_graph::invalid_id};
+    uint32_t depth {ex::vulkan::render_graph::invalid_id};
+    uint32_t pass {ex::vulkan::render_graph::invalid_id};
+    VkSampler sampler {};
+    uint32_t bindless_index {ex::vulkan::bindless_table::invalid_index};
+} _preview;
+
+// hi-z passes in the same graph, they test against last frame's depth
+static ex::vulkan::occlusion_culler _occlusion;
+
+// compute culled indirect draws, the scene is uploaded once and the cpu
+// records the same few commands however many objects there are
+static ex::vulkan::indirect_renderer _indirect;
+
+// draws sharing a model and texture become one instanced call
+static ex::vulkan::instance_batcher _instances;
+
+// the per-entity bindless fill, sorted by state before it is recorded
+static ex::vulkan::render_queue _render_queue;
+
+// moves the render scale to hold a gpu frame time and upscales to the
+// swapchain
+static ex::vulkan::resolution_scaler _scaler;
+
 namespace vulkan {
     struct push_constants {
         glm::mat4 model;
         glm::vec4 color;
+        uint32_t texture_index;
     };
 
     struct ubo {
@@ -81,6 +170,32 @@ namespace vulkan {
         glm::mat4 projection;
         glm::vec3 light_pos;
     };
+
+    // specialization constant ids of forward.frag and their values
+    enum forward_constant : uint32_t {
+        FORWARD_LIGHTING = 0,
+        FORWARD_TEXTURED = 1,
+        FORWARD_COLOR_SOURCE = 2,
+    };
+
+    enum forward_lighting : uint32_t {
+        LIGHTING_UNLIT = 0,
+        LIGHTING_DIFFUSE = 1,
+        LIGHTING_BANDED = 2,
+        LIGHTING_COUNT,
+    };
+
+    enum forward_color_source : uint32_t {
+        COLOR_SOURCE_PUSH = 0,
+        COLOR_SOURCE_VERTEX = 1,
+    };
+
+    struct forward_variant {
+        forward_lighting lighting;
+        bool textured;
+        forward_color_source color_source;
+        bool wireframe;
+    };
 }
 
 // bool
@@ -104,8 +219,208 @@ namespace vulkan {
 //              bottom >= otop || top <= obottom);
 // }
 
-int main() {
+static const char *
+present_policy_name(ex::vulkan::backend::present_policy policy) {
+    switch (policy) {
+    case ex::vulkan::backend::PRESENT_POLICY_VSYNC: return "vsync";
+    case ex::vulkan::backend::PRESENT_POLICY_MAILBOX: return "mailbox";
+    case ex::vulkan::backend::PRESENT_POLICY_IMMEDIATE: return "immediate";
+    case ex::vulkan::backend::PRESENT_POLICY_LOW_LATENCY: return "latency";
+    }
+    return "unknown";
+}
+
+// the pre-pass lays down depth from the position stream, the shading pass
+// after it only runs where it tests equal and writes no depth
+static void
+request_prepass_pipelines(VkCullModeFlags cull_mode, uint32_t *depth_id, uint32_t *equal_id) {
+    ex::vulkan::pipeline_state depth_state = _pipelines.textured_bindless.state(&_backend, &_shaders.depth_only);
+    depth_state.stream = ex::vulkan::pipeline_state::VERTEX_STREAM_POSITION;
+    depth_state.color_write = false;
+    depth_state.cull_mode = cull_mode;
+    *depth_id = _pipeline_manager.request(depth_state);
+
+    ex::vulkan::pipeline_state equal_state = _pipelines.textured_bindless.state(&_backend, &_shaders.textured_bindless);
+    equal_state.depth_write = false;
+    equal_state.depth_compare = VK_COMPARE_OP_EQUAL;
+    equal_state.cull_mode = cull_mode;
+    *equal_id = _pipeline_manager.request(equal_state);
+}
+
+static const char *
+lighting_name(vulkan::forward_lighting lighting) {
+    switch (lighting) {
+    case vulkan::LIGHTING_UNLIT: return "unlit";
+    case vulkan::LIGHTING_DIFFUSE: return "diffuse";
+    case vulkan::LIGHTING_BANDED: return "banded";
+    default: break;
+    }
+    return "unknown";
+}
+
+// forward.frag specialised for one combination, compiled in the background
+// with the fallback drawing until it lands
+static uint32_t
+forward_pipeline(const vulkan::forward_variant &variant, uint32_t fallback = ex::vulkan::pipeline_manager::invalid_id) {
+    ex::vulkan::pipeline_state state = _pipelines.forward.state(&_backend, &_shaders.forward);
+    state.constants.set(vulkan::FORWARD_LIGHTING, variant.lighting);
+    state.constants.set(vulkan::FORWARD_TEXTURED, variant.textured ? VK_TRUE : VK_FALSE);
+    state.constants.set(vulkan::FORWARD_COLOR_SOURCE, variant.color_source);
+    if (variant.wireframe) {
+        state.polygon_mode = VK_POLYGON_MODE_LINE;
+        state.cull_mode = VK_CULL_MODE_NONE;
+    }
+    return _pipeline_manager.request(state, fallback);
+}
+
+// model sphere moved into the world, scaled by the largest axis
+static glm::vec4
+world_sphere(ex::entity *entity) {
+    glm::vec4 sphere = entity->model->bounding_sphere();
+    glm::vec3 center = glm::vec3(entity->transform.matrix() * glm::vec4(glm::vec3(sphere), 1.0f));
+    glm::vec3 scale = glm::abs(entity->transform.scale);
+    return glm::vec4(center, sphere.w * std::max(scale.x, std::max(scale.y, scale.z)));
+}
+
+static VkDescriptorSet
+material_set(ex::vulkan::texture *texture) {
+    ex::vulkan::descriptor_set_cache::write write = {};
+    write.binding = 0;
+    write.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    write.image_info = *texture->get_descriptor_info();
+    return _backend.transient_set(_descriptor_sets.texture_layout.handle(), { &write, 1 });
+}
+
+// rewrites set_count material sets rounds times, once through
+// VkWriteDescriptorSet lists and once through an update template, and
+// prints the cpu time of both. nothing is drawn with the sets
+static void
+benchmark_descriptor_updates(uint32_t set_count, uint32_t rounds) {
+    ex::vulkan::descriptor_set_layout material_layout;
+    material_layout.add_binding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT);
+    material_layout.add_binding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT);
+    material_layout.create(&_backend);
+
+    struct material_descriptors {
+        VkDescriptorBufferInfo uniforms;
+        VkDescriptorImageInfo texture;
+    };
+
+    ex::vulkan::descriptor_update_template material_template;
+    material_template.add_buffer(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, offsetof(material_descriptors, uniforms));
+    material_template.add_image(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, offsetof(material_descriptors, texture));
+    material_template.create(&_backend, &material_layout);
+
+    // own pools, gone with the benchmark
+    ex::vulkan::descriptor_allocator allocator;
+    std::vector<ex::vulkan::descriptor_set> sets(set_count);
+    for (ex::vulkan::descriptor_set &set : sets) set.allocate(&_backend, &allocator, &material_layout);
+
+    // every round switches texture so each update really changes the set
+    std::array<VkDescriptorImageInfo, 2> textures = {
+        *_textures.goreshit.get_descriptor_info(),
+        *_textures.paris.get_descriptor_info(),
+    };
+    VkDescriptorBufferInfo uniforms = *_uniforms.buffers[0].get_descriptor_info();
+
+    // plain writes, descriptor_set::update itself goes through the layout's
+    // template once a set is fully written
+    std::array<VkWriteDescriptorSet, 2> writes = {};
+    for (VkWriteDescriptorSet &write_descriptor_set : writes) {
+        write_descriptor_set.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write_descriptor_set.descriptorCount = 1;
+    }
+    writes[0].dstBinding = 0;
+    writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    writes[0].pBufferInfo = &uniforms;
+    writes[1].dstBinding = 1;
+    writes[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+
+    auto generic_start = std::chrono::steady_clock::now();
+    for (uint32_t round = 0; round < rounds; round++) {
+        writes[1].pImageInfo = &textures[round % 2];
+        for (ex::vulkan::descriptor_set &set : sets) {
+            writes[0].dstSet = set.handle();
+            writes[1].dstSet = set.handle();
+            vkUpdateDescriptorSets(_backend.logical_device(), static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+        }
+    }
+    auto generic_end = std::chrono::steady_clock::now();
+
+    material_descriptors packed = {};
+    packed.uniforms = uniforms;
+    for (uint32_t round = 0; round < rounds; round++) {
+        packed.texture = textures[round % 2];
+        for (ex::vulkan::descriptor_set &set : sets) material_template.update(&_backend, set.handle(), &packed);
+    }
+    auto template_end = std::chrono::steady_clock::now();
+
+    float generic_ms = std::chrono::duration<float, std::milli>(generic_end - generic_start).count();
+    float template_ms = std::chrono::duration<float, std::milli>(template_end - generic_end).count();
+    float updates = static_cast<float>(set_count) * static_cast<float>(rounds);
+    EXINFO("-=+DESCRIPTOR_BENCHMARK+=-");
+    EXINFO("%u sets, %u rounds", set_count, rounds);
+    EXINFO("Generic: %.2fms, %.3fus per set", generic_ms, generic_ms * 1000.0f / updates);
+    EXINFO("Template: %.2fms, %.3fus per set", template_ms, template_ms * 1000.0f / updates);
+    if (template_ms > 0.0f) EXINFO("Template speedup: %.2fx", generic_ms / template_ms);
+
+    material_template.destroy(&_backend);
+    allocator.destroy(&_backend);
+    material_layout.destroy(&_backend);
+}
+
+int main(int argc, char **argv) {
     EXFATAL("-+=+EXCALIBUR+=+-");
+
+    ex::vulkan::backend::present_policy present_policy = ex::vulkan::backend::PRESENT_POLICY_IMMEDIATE;
+    bool headless = false;
+    bool stress = false;
+    bool prepass = false;
+    bool occlusion = false;
+    bool gpu_driven = false;
+    bool instancing = false;
+    bool descriptor_benchmark = false;
+    bool dynamic_resolution = false;
+    float target_frame_ms = 16.0f;
+    uint32_t benchmark_frames = 1000;
+    std::string stats_path;
+    std::string trace_path;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--headless") == 0) headless = true;
+        if (strcmp(argv[i], "--stress") == 0) stress = true;
+        if (strcmp(argv[i], "--prepass") == 0) prepass = true;
+        if (strcmp(argv[i], "--occlusion") == 0) occlusion = true;
+        if (strcmp(argv[i], "--gpu-driven") == 0) gpu_driven = true;
+        if (strcmp(argv[i], "--instancing") == 0) instancing = true;
+        if (strcmp(argv[i], "--descriptor-benchmark") == 0) descriptor_benchmark = true;
+        if (strcmp(argv[i], "--dynamic-resolution") == 0) {
+            dynamic_resolution = true;
+            // optional target gpu time in ms
+            if (i + 1 < argc && atof(argv[i + 1]) > 0.0) target_frame_ms = static_cast<float>(atof(argv[++i]));
+        }
+        if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) stats_path = argv[++i];
+        if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) trace_path = argv[++i];
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            benchmark_frames = static_cast<uint32_t>(std::max(1, atoi(argv[++i])));
+        }
+        if (strcmp(argv[i], "--present") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            bool found = false;
+            for (uint32_t p = 0; p <= ex::vulkan::backend::PRESENT_POLICY_LOW_LATENCY; p++) {
+                auto policy = static_cast<ex::vulkan::backend::present_policy>(p);
+                if (strcmp(name, present_policy_name(policy)) == 0) {
+                    present_policy = policy;
+                    found = true;
+                }
+            }
+            if (!found) EXWARN("Unknown present policy: %s", name);
+        }
+    }
+
+    // capture from the start so loading shows up in the trace
+    EXPROFILE_THREAD("main");
+    if (!trace_path.empty()) ex::profiler::start();
+
     _input.initialize();
 
     ex::platform::window::create_info window_create_info = {};
@@ -115,79 +430,182 @@ int main() {
     window_create_info.mode = EX_WINDOW_MODE_WINDOWED;
     window_create_info.pinput = &_input;
     _window.create(&window_create_info);
-    _window.show();
-    
-    if (!_backend.initialize(&_window)) {
+    if (!headless) _window.show();
+
+    _backend.set_bindless(true);
+    _backend.set_defragmentation(true, 16 * 1024 * 1024, 0.5f);
+    _backend.set_present_policy(present_policy);
+    _backend.set_frame_latency(1);
+    _backend.set_depth_sampled(true);
+    _backend.set_dynamic_resolution(dynamic_resolution);
+    bool initialized = headless ? _backend.initialize_headless(_window.width(), _window.height())
+                                : _backend.initialize(&_window);
+    if (!initialized) {
         EXFATAL("Failed to initialize vulkan backend");
         return -1;
     }
         
     // load assets
-    _meshes.floor.load_file("res/meshes/floor.obj");
-    _meshes.monkey.load_file("res/meshes/monkey_smooth.obj");
+    {
+        EXPROFILE_SCOPE("load assets");
+        _meshes.floor.load_file("res/meshes/floor.obj");
+        _meshes.monkey.load_file("res/meshes/monkey_smooth.obj");
     
-    _models.floor.create(&_backend, &_meshes.floor);
-    _models.monkey.create(&_backend, &_meshes.monkey);
+        _geometry.create(&_backend);
+        _models.floor.create(&_backend, &_geometry, &_meshes.floor);
+        _models.monkey.create(&_backend, &_geometry, &_meshes.monkey);
 
-    _textures.goreshit.create(&_backend, "res/textures/goreshit.jpg");
-    _textures.paris.create(&_backend, "res/textures/parisx.jpg");
+        _textures.goreshit.create(&_backend, "res/textures/goreshit.jpg");
+        _textures.paris.create(&_backend, "res/textures/parisx.jpg");
+    }
     
     // create resources
-    ex::vulkan::buffer uniform_buffer;
-    uniform_buffer.set_usage(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
-    uniform_buffer.set_properties(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-    uniform_buffer.build(&_backend, sizeof(vulkan::ubo));
-    uniform_buffer.bind(&_backend);
-
-    // create descriptors
-    ex::vulkan::descriptor_pool descriptor_pool;
-    descriptor_pool.add_size(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1);
-    descriptor_pool.add_size(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1);
-    descriptor_pool.create(&_backend, 3);
-
-    ex::vulkan::descriptor_set_layout uniform_buffer_layout;
-    uniform_buffer_layout.add_binding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT);
-    uniform_buffer_layout.create(&_backend);
+    for (ex::vulkan::buffer &uniform_buffer : _uniforms.buffers) {
+        uniform_buffer.set_usage(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+        uniform_buffer.set_properties(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        uniform_buffer.build(&_backend, sizeof(vulkan::ubo));
+        uniform_buffer.bind(&_backend);
+    }
 
-    ex::vulkan::descriptor_set_layout texture_layout;
-    texture_layout.add_binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT);
-    texture_layout.create(&_backend);
-    
-    _descriptor_sets.uniform.allocate(&_backend, &descriptor_pool, &uniform_buffer_layout);
-    _descriptor_sets.uniform.write_buffer(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, uniform_buffer.get_descriptor_info());
-    _descriptor_sets.uniform.update(&_backend);
-    
-    _descriptor_sets.textures.allocate(&_backend, &descriptor_pool, &texture_layout);
-    _descriptor_sets.textures.write_image(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, _textures.goreshit.get_descriptor_info());
-    _descriptor_sets.textures.update(&_backend);
+    // create descriptor layouts, the sets are looked up per frame
+    _descriptor_sets.uniform_layout.add_binding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT);
+    _descriptor_sets.uniform_layout.create(&_backend);
+
+    _descriptor_sets.texture_layout.add_binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT);
+    _descriptor_sets.texture_layout.create(&_backend);
+
+    if (descriptor_benchmark) benchmark_descriptor_updates(4096, 64);
+
+    if (dynamic_resolution) {
+        _scaler.set_target_frame_time(target_frame_ms);
+        _scaler.set_scale_range(0.5f, 1.0f);
+        _scaler.create(&_backend);
+    }
 
     // create pipelines
-    _pipelines.solid_color.push_descriptor_set_layout(uniform_buffer_layout.handle());
-    _pipelines.solid_color.set_push_constant_range((VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT), 0, sizeof(vulkan::push_constants));
-    _pipelines.solid_color.build_layout(&_backend);
-    _pipelines.solid_color.set_topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
-    _pipelines.solid_color.set_polygon_mode(VK_POLYGON_MODE_LINE);
-    _pipelines.solid_color.set_cull_mode(VK_CULL_MODE_NONE);
-    _pipelines.solid_color.set_front_face(VK_FRONT_FACE_CLOCKWISE);
-
-    _shaders.solid_color.create(&_backend, "res/shaders/solid_color.vert.spv", "res/shaders/solid_color.frag.spv");
-    _pipelines.solid_color.build(&_backend, &_shaders.solid_color);
-    _shaders.solid_color.destroy(&_backend);
-
-    _pipelines.textured.push_descriptor_set_layout(uniform_buffer_layout.handle());
-    _pipelines.textured.push_descriptor_set_layout(texture_layout.handle());
-    _pipelines.textured.set_push_constant_range((VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT), 0, sizeof(vulkan::push_constants));
-    _pipelines.textured.build_layout(&_backend);
-    _pipelines.textured.set_topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
-    _pipelines.textured.set_polygon_mode(VK_POLYGON_MODE_FILL);
-    _pipelines.textured.set_cull_mode(VK_CULL_MODE_BACK_BIT);
-    _pipelines.textured.set_front_face(VK_FRONT_FACE_CLOCKWISE);
-
-    _shaders.textured.create(&_backend, "res/shaders/textured.vert.spv", "res/shaders/textured.frag.spv");
-    _pipelines.textured.build(&_backend, &_shaders.textured);
-    _shaders.textured.destroy(&_backend);
+    // the fill and the wireframe without bindless come from one source,
+    // what they shade is picked per variant
+    _pipelines.forward.push_descriptor_set_layout(_descriptor_sets.uniform_layout.handle());
+    _pipelines.forward.push_descriptor_set_layout(_descriptor_sets.texture_layout.handle());
+    _pipelines.forward.set_push_constant_range((VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT), 0, sizeof(vulkan::push_constants));
+    _pipelines.forward.build_layout(&_backend);
+    _pipelines.forward.set_topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+    _pipelines.forward.set_polygon_mode(VK_POLYGON_MODE_FILL);
+    _pipelines.forward.set_cull_mode(VK_CULL_MODE_BACK_BIT);
+    _pipelines.forward.set_front_face(VK_FRONT_FACE_CLOCKWISE);
+
+    // the modules stay alive, variants are compiled from them later
+    _shaders.forward.create(&_backend, "res/shaders/textured.vert.spv", "res/shaders/forward.frag.spv");
+    _pipeline_manager.create(&_backend);
+    if (!_backend.bindless_enabled()) {
+        _pipeline_ids.forward_fill_base = forward_pipeline({ vulkan::LIGHTING_DIFFUSE, true, vulkan::COLOR_SOURCE_PUSH, false });
+        _pipeline_ids.forward_fill = _pipeline_ids.forward_fill_base;
+    }
+    _pipeline_ids.forward_line = forward_pipeline({ vulkan::LIGHTING_UNLIT, false, vulkan::COLOR_SOURCE_PUSH, true });
+
+    if (_backend.bindless_enabled()) {
+        _pipelines.textured_bindless.push_descriptor_set_layout(_descriptor_sets.uniform_layout.handle());
+        _pipelines.textured_bindless.push_descriptor_set_layout(_backend.bindless()->layout());
+        _pipelines.textured_bindless.set_push_constant_range((VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT), 0, sizeof(vulkan::push_constants));
+        _pipelines.textured_bindless.build_layout(&_backend);
+        _pipelines.textured_bindless.set_topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+        _pipelines.textured_bindless.set_polygon_mode(VK_POLYGON_MODE_FILL);
+        _pipelines.textured_bindless.set_cull_mode(VK_CULL_MODE_BACK_BIT);
+        _pipelines.textured_bindless.set_front_face(VK_FRONT_FACE_CLOCKWISE);
+
+        // the modules stay alive, permutations are compiled from them later
+        _shaders.textured_bindless.create(&_backend, "res/shaders/textured.vert.spv", "res/shaders/textured_bindless.frag.spv");
+        _pipeline_ids.bindless = _pipeline_manager.request(_pipelines.textured_bindless.state(&_backend, &_shaders.textured_bindless));
+
+        _shaders.depth_only.create(&_backend, "res/shaders/depth_only.vert.spv", "");
+        request_prepass_pipelines(VK_CULL_MODE_BACK_BIT, &_pipeline_ids.depth_prepass, &_pipeline_ids.bindless_equal);
+
+        _shaders.textured_indirect.create(&_backend, "res/shaders/textured_indirect.vert.spv", "res/shaders/textured_indirect.frag.spv");
+        _pipeline_ids.indirect = _pipeline_manager.request(_pipelines.textured_bindless.state(&_backend, &_shaders.textured_indirect));
+
+        _shaders.textured_instanced.create(&_backend, "res/shaders/textured_instanced.vert.spv", "res/shaders/textured_bindless.frag.spv");
+        ex::vulkan::pipeline_state instanced_state = _pipelines.textured_bindless.state(&_backend, &_shaders.textured_instanced);
+        instanced_state.stream = ex::vulkan::pipeline_state::VERTEX_STREAM_INSTANCED;
+        _pipeline_ids.instanced = _pipeline_manager.request(instanced_state);
+        _instances.create(&_backend);
+        _render_queue.create(&_pipeline_manager, &_geometry);
+    }
+    _pipeline_manager.wait_idle();
+
+    // create render graph
+    ex::entity *preview_subject = nullptr;
+    if (_backend.bindless_enabled()) {
+        ex::vulkan::render_graph::image_desc preview_desc = {};
+        preview_desc.format = _backend.swapchain_format();
+        preview_desc.extent = { 512, 512 };
+        _preview.color = _graph.create_image("preview_color", preview_desc);
+        preview_desc.format = _backend.depth_format();
+        _preview.depth = _graph.create_image("preview_depth", preview_desc);
+
+        // same attachment formats as the main pass, so the main pipelines
+        // are compatible with it
+        _preview.pass = _graph.add_pass("preview", ex::vulkan::render_graph::PASS_GRAPHICS, [&preview_subject](VkCommandBuffer command_buffer) {
+            if (!preview_subject || !_pipeline_manager.bind(command_buffer, _pipeline_ids.bindless)) return;
+
+            std::array<VkDescriptorSet, 2> sets = {
+                _descriptor_sets.uniform,
+                _backend.bindless()->handle(),
+            };
+            _geometry.bind(command_buffer);
+            _pipelines.textured_bindless.update_dynamic(command_buffer, { 512, 512 });
+            _pipelines.textured_bindless.bind_descriptor_sets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, sets);
+
+            vulkan::push_constants constants = {};
+            constants.model = preview_subject->transform.matrix();
+            constants.color = glm::vec4(1.0f);
+            constants.texture_index = _textures.goreshit.bindless_index();
+            _pipelines.textured_bindless.push_constants(command_buffer, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, &constants);
+            preview_subject->model->draw(command_buffer);
+        });
+
+        VkClearValue color_clear = {};
+        color_clear.color = { { 0.1f, 0.1f, 0.2f, 1.0f } };
+        VkClearValue depth_clear = {};
+        depth_clear.depthStencil = { 1.0f, 0 };
+        _graph.write(_preview.pass, _preview.color, ex::vulkan::render_graph::ACCESS_COLOR_ATTACHMENT, color_clear);
+        _graph.write(_preview.pass, _preview.depth, ex::vulkan::render_graph::ACCESS_DEPTH_ATTACHMENT, depth_clear);
+        _graph.set_output(_preview.color, ex::vulkan::render_graph::ACCESS_SAMPLED_FRAGMENT);
+    }
+    // monkey, floor and the stress grid
+    const uint32_t stress_grid_size = 128;
+    _occlusion.set_max_objects(2 + stress_grid_size * stress_grid_size);
+    _occlusion.create(&_backend, &_graph);
+    _occlusion.set_enabled(occlusion);
+    _indirect.set_max_objects(2 + stress_grid_size * stress_grid_size);
+    _indirect.create(&_backend, &_graph);
+    _indirect.set_enabled(gpu_driven);
+    _graph.compile(&_backend);
+    _occlusion.bind_graph(&_backend);
+
+    if (_backend.bindless_enabled()) {
+        VkSamplerCreateInfo sampler_create_info = {};
+        sampler_create_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        sampler_create_info.pNext = nullptr;
+        sampler_create_info.flags = 0;
+        sampler_create_info.magFilter = VK_FILTER_LINEAR;
+        sampler_create_info.minFilter = VK_FILTER_LINEAR;
+        sampler_create_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        sampler_create_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        sampler_create_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        sampler_create_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        sampler_create_info.maxLod = 0.0f;
+        sampler_create_info.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+        VK_CHECK(vkCreateSampler(_backend.logical_device(), &sampler_create_info, _backend.allocator(), &_preview.sampler));
+
+        VkDescriptorImageInfo preview_image_info = {};
+        preview_image_info.sampler = _preview.sampler;
+        preview_image_info.imageView = _graph.view(_preview.color);
+        preview_image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        _preview.bindless_index = _backend.bindless()->add_texture(&_backend, &preview_image_info);
+    }
 
     EXINFO("-=+INITIALIZED+=-");
+    _backend.print_memory_stats();
     ex::entity floor;
     floor.model = &_models.floor;
     floor.transform.translation = glm::vec3(0.0f);
@@ -199,6 +617,7 @@ int main() {
     monkey.transform.translation = glm::vec3(0.0f, 2.0f, 0.0f);
     monkey.transform.rotation = glm::vec3(0.0f, 180.0f, 0.0f);
     monkey.transform.scale = glm::vec3(0.8f);
+    preview_subject = &monkey;
 
     // TODO: refactor this shitty as camera
     // NOTE: camera is flipped
@@ -212,21 +631,126 @@ int main() {
 
     bool render_fill = true;
     bool render_line = false;
+    bool render_stress = stress;
+    bool render_double_sided = false;
+    bool render_preview = false;
+    bool render_prepass = prepass;
+    bool render_instancing = instancing;
+    vulkan::forward_lighting fill_lighting = vulkan::LIGHTING_DIFFUSE;
+
+    // thousands of small monkeys to load the recording threads
+    std::vector<ex::entity> stress_grid(stress_grid_size * stress_grid_size);
+    for (uint32_t z = 0; z < stress_grid_size; z++) {
+        for (uint32_t x = 0; x < stress_grid_size; x++) {
+            ex::entity &entity = stress_grid[z * stress_grid_size + x];
+            entity.model = &_models.monkey;
+            entity.transform.translation = glm::vec3(((float) x - stress_grid_size * 0.5f) * 0.3f, 0.2f,
+                                                     ((float) z - stress_grid_size * 0.5f) * 0.3f);
+            entity.transform.rotation = glm::vec3(0.0f, 180.0f, 0.0f);
+            entity.transform.scale = glm::vec3(0.1f);
+        }
+    }
 
+    // everything the occlusion culler tests, indices stay fixed so results
+    // from older frames still line up
+    std::vector<ex::entity *> scene = { &monkey, &floor };
+    for (ex::entity &entity : stress_grid) scene.push_back(&entity);
+    std::vector<glm::vec4> scene_spheres(scene.size());
+    if (_indirect.supported()) {
+        for (ex::entity *entity : scene) {
+            uint32_t texture_index = entity == &floor ? _textures.paris.bindless_index() : _textures.goreshit.bindless_index();
+            _indirect.add_object(entity->model, entity->transform.matrix(), texture_index);
+        }
+    }
+    glm::mat4 last_view_projection = glm::mat4(1.0f);
+    uint32_t drawn_count = 0;
+    uint32_t fill_call_count = 0;
+    uint32_t skipped_bind_count = 0;
+
+    // headless runs a fixed number of frames as fast as the gpu allows and
+    // keeps all of them, interactive runs keep the last minute or so
+    _frame_stats.create(headless ? benchmark_frames : 4096);
+    
     _timer.init();
     uint64_t last_time = _timer.get_time();
+    uint64_t benchmark_start = last_time;
     float time_counter = 0.0f;
 
     while (!_window.closed()) {
+        EXPROFILE_SCOPE("frame");
         _window.update();
         
         uint64_t start = _timer.get_time();
         
         if (_input.key_pressed(EX_KEY_ESCAPE)) _window.close();
         if (_input.key_pressed(EX_KEY_F1)) _window.toggle_fullscreen();
+        if (_input.key_pressed(EX_KEY_F2)) {
+            present_policy = static_cast<ex::vulkan::backend::present_policy>((present_policy + 1) % (ex::vulkan::backend::PRESENT_POLICY_LOW_LATENCY + 1));
+            _backend.set_present_policy(present_policy);
+            EXINFO("Present policy: %s", present_policy_name(present_policy));
+        }
 
         if (_input.key_pressed(EX_KEY_1)) render_fill = !render_fill;
         if (_input.key_pressed(EX_KEY_2)) render_line = !render_line;
+        if (_input.key_pressed(EX_KEY_3)) render_stress = !render_stress;
+        if (_input.key_pressed(EX_KEY_5) && _backend.bindless_enabled()) render_preview = !render_preview;
+        if (_input.key_pressed(EX_KEY_4) && _backend.bindless_enabled()) {
+            render_double_sided = !render_double_sided;
+            // first use compiles in the background, the culled variant
+            // draws in the meantime
+            ex::vulkan::pipeline_state state = _pipelines.textured_bindless.state(&_backend, &_shaders.textured_bindless);
+            state.cull_mode = VK_CULL_MODE_NONE;
+            _pipeline_ids.bindless_double_sided = _pipeline_manager.request(state, _pipeline_ids.bindless);
+            request_prepass_pipelines(VK_CULL_MODE_NONE, &_pipeline_ids.depth_prepass_double_sided, &_pipeline_ids.bindless_equal_double_sided);
+
+            ex::vulkan::pipeline_state indirect_state = _pipelines.textured_bindless.state(&_backend, &_shaders.textured_indirect);
+            indirect_state.cull_mode = VK_CULL_MODE_NONE;
+            _pipeline_ids.indirect_double_sided = _pipeline_manager.request(indirect_state, _pipeline_ids.indirect);
+
+            ex::vulkan::pipeline_state instanced_state = _pipelines.textured_bindless.state(&_backend, &_shaders.textured_instanced);
+            instanced_state.stream = ex::vulkan::pipeline_state::VERTEX_STREAM_INSTANCED;
+            instanced_state.cull_mode = VK_CULL_MODE_NONE;
+            _pipeline_ids.instanced_double_sided = _pipeline_manager.request(instanced_state, _pipeline_ids.instanced);
+        }
+        if (_input.key_pressed(EX_KEY_7)) {
+            _occlusion.set_enabled(!_occlusion.enabled());
+            EXINFO("Occlusion culling: %s", _occlusion.enabled() ? "on" : "off");
+        }
+        if (_input.key_pressed(EX_KEY_9) && _backend.bindless_enabled()) {
+            render_instancing = !render_instancing;
+            EXINFO("Instancing: %s", render_instancing ? "on" : "off");
+        }
+        if (_input.key_pressed(EX_KEY_8) && _indirect.supported()) {
+            _indirect.set_enabled(!_indirect.enabled());
+            EXINFO("GPU driven draws: %s", _indirect.enabled() ? "on" : "off");
+        }
+        if (_input.key_pressed(EX_KEY_0) && dynamic_resolution) {
+            _scaler.set_enabled(!_scaler.enabled());
+            EXINFO("Dynamic resolution: %s", _scaler.enabled() ? "on" : "off");
+        }
+        if (_input.key_pressed(EX_KEY_6) && _backend.bindless_enabled()) {
+            render_prepass = !render_prepass;
+            EXINFO("Depth pre-pass: %s", render_prepass ? "on" : "off");
+        }
+        if (_input.key_pressed(EX_KEY_F7)) {
+            fill_lighting = static_cast<vulkan::forward_lighting>((fill_lighting + 1) % vulkan::LIGHTING_COUNT);
+            EXINFO("Fill lighting: %s", lighting_name(fill_lighting));
+            // the diffuse base draws until the new variant has compiled
+            if (!_backend.bindless_enabled()) {
+                _pipeline_ids.forward_fill = forward_pipeline({ fill_lighting, true, vulkan::COLOR_SOURCE_PUSH, false }, _pipeline_ids.forward_fill_base);
+            }
+        }
+        if (_input.key_pressed(EX_KEY_F3)) _backend.print_memory_stats();
+        if (_input.key_pressed(EX_KEY_F4)) _backend.print_gpu_zones();
+        if (_input.key_pressed(EX_KEY_F6)) {
+            // the recording threads are idle between frames
+            ex::profiler::write_trace(trace_path.empty() ? "trace.json" : trace_path);
+            ex::profiler::start();
+        }
+        if (_input.key_pressed(EX_KEY_F5)) {
+            _frame_stats.print();
+            _frame_stats.write(stats_path.empty() ? "frame_stats.csv" : stats_path);
+        }
 
         camera.update_matrix(_backend.swapchain_extent().width, _backend.swapchain_extent().height);
         camera.update_input(&_input, _stats.delta_time);
@@ -240,64 +764,260 @@ int main() {
         ubo.projection = camera.get_projection();
         ubo.light_pos = glm::vec3(0.0f, 4.0f, 0.0f);
 
-        uniform_buffer.map(&_backend);
-        uniform_buffer.copy_to(&ubo, sizeof(vulkan::ubo));
-        uniform_buffer.unmap(&_backend);
-
         if (!_window.inactive()) {
-            _backend.begin_render();
+            _backend.begin_frame();
+
+            // picks the scale this frame's main pass draws at
+            if (dynamic_resolution) _scaler.update(_backend.last_frame_timings().gpu_ms);
+
+            // the frame slot is only free once begin_render waited on its fence
+            uint32_t frame = _backend.frame_index();
+            _uniforms.buffers[frame].map(&_backend);
+            _uniforms.buffers[frame].copy_to(&ubo, sizeof(vulkan::ubo));
+            _uniforms.buffers[frame].unmap(&_backend);
+
+            ex::vulkan::descriptor_set_cache::write uniform_write = {};
+            uniform_write.binding = 0;
+            uniform_write.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+            uniform_write.buffer_info = *_uniforms.buffers[frame].get_descriptor_info();
+            _descriptor_sets.uniform = _backend.transient_set(_descriptor_sets.uniform_layout.handle(), { &uniform_write, 1 });
+
+            // the passes read the depth the previous frame drew, test with
+            // the matrices it drew with
+            for (uint32_t i = 0; i < scene.size(); i++) scene_spheres[i] = world_sphere(scene[i]);
+            _occlusion.update(scene_spheres, last_view_projection);
+            last_view_projection = ubo.projection * ubo.view;
+
+            uint32_t floor_texture = render_preview ? _preview.bindless_index : _textures.paris.bindless_index();
+            uint32_t draw_object_count = render_stress ? static_cast<uint32_t>(scene.size()) : 2;
+
+            // indirect objects were added in scene order, the floor is 1
+            uint32_t indirect_pipeline_id = render_double_sided ? _pipeline_ids.indirect_double_sided : _pipeline_ids.indirect;
+            bool use_gpu_driven = render_fill && _indirect.enabled() && _pipeline_manager.ready(indirect_pipeline_id);
+            if (_indirect.supported()) {
+                _indirect.set_texture(1, floor_texture);
+                _indirect.set_active_count(use_gpu_driven ? draw_object_count : 0);
+                _indirect.update(ubo.projection * ubo.view);
+            }
+
+            // the gpu driven fill needs no list, only the wireframe does
+            std::vector<draw_item> draws;
+            if (!use_gpu_driven || render_line) {
+                EXPROFILE_SCOPE("build draws");
+                // only the forward pipelines read sets, the bindless paths
+                // go by texture_index. one lookup per material
+                bool forward_sets = !_backend.bindless_enabled() || render_line;
+                VkDescriptorSet monkey_material = forward_sets ? material_set(&_textures.goreshit) : VK_NULL_HANDLE;
+                VkDescriptorSet floor_material = forward_sets ? material_set(&_textures.paris) : VK_NULL_HANDLE;
+
+                draws.reserve(draw_object_count);
+                for (uint32_t i = 0; i < draw_object_count; i++) {
+                    if (!_occlusion.visible(i)) continue;
+                    bool is_floor = scene[i] == &floor;
+                    uint32_t texture_index = is_floor ? floor_texture : _textures.goreshit.bindless_index();
+                    draws.push_back({ scene[i], texture_index, is_floor ? floor_material : monkey_material });
+                }
+            }
+            drawn_count = use_gpu_driven ? _indirect.draw_count() : static_cast<uint32_t>(draws.size());
+
+            uint32_t instanced_pipeline_id = render_double_sided ? _pipeline_ids.instanced_double_sided : _pipeline_ids.instanced;
+            bool use_instancing = render_instancing && render_fill && !use_gpu_driven && _backend.bindless_enabled() &&
+                _pipeline_manager.ready(instanced_pipeline_id);
+            if (use_instancing) {
+                EXPROFILE_SCOPE("build instances");
+                _instances.begin();
+                for (const draw_item &draw : draws) _instances.add(draw.entity->model, draw.entity->transform.matrix(), draw.texture_index);
+                _instances.end();
+            }
+            fill_call_count = use_gpu_driven ? 1 :
+                use_instancing ? static_cast<uint32_t>(_instances.groups().size()) : static_cast<uint32_t>(draws.size());
+
+            // both halves have to be compiled, an equal test against a
+            // cleared depth buffer would draw nothing
+            uint32_t depth_pipeline_id = render_double_sided ? _pipeline_ids.depth_prepass_double_sided : _pipeline_ids.depth_prepass;
+            uint32_t equal_pipeline_id = render_double_sided ? _pipeline_ids.bindless_equal_double_sided : _pipeline_ids.bindless_equal;
+            bool use_prepass = render_prepass && render_fill && !use_gpu_driven && !use_instancing && _backend.bindless_enabled() &&
+                _pipeline_manager.ready(depth_pipeline_id) && _pipeline_manager.ready(equal_pipeline_id);
+
+            // pre-pass draws sort ahead of the shading ones, so every
+            // slice's depth lands before any slice shades
+            bool use_queue = render_fill && !use_gpu_driven && !use_instancing && _backend.bindless_enabled();
+            _render_queue.clear();
+            if (use_queue) {
+                EXPROFILE_SCOPE("fill queue");
+                uint32_t pipeline_id = render_double_sided ? _pipeline_ids.bindless_double_sided : _pipeline_ids.bindless;
+                if (use_prepass) pipeline_id = equal_pipeline_id;
+                for (const draw_item &draw : draws) {
+                    glm::mat4 transform = draw.entity->transform.matrix();
+                    float depth = glm::length(draw.entity->transform.translation - camera.get_position()) / camera.get_far();
+                    if (use_prepass) {
+                        _render_queue.push(ex::vulkan::render_queue::PASS_DEPTH, depth_pipeline_id,
+                                           ex::vulkan::pipeline_state::VERTEX_STREAM_POSITION, 0,
+                                           draw.entity->model, transform, depth);
+                    }
+                    _render_queue.push(ex::vulkan::render_queue::PASS_OPAQUE, pipeline_id,
+                                       ex::vulkan::pipeline_state::VERTEX_STREAM_INTERLEAVED, draw.texture_index,
+                                       draw.entity->model, transform, depth);
+                }
+                _render_queue.sort();
+            }
+
+            _graph.execute(_backend.current_frame());
+            // state calls the recording contexts dropped, summed over slices
+            std::atomic<uint32_t> skipped_binds {0};
+            uint32_t main_pass_zone = _backend.begin_gpu_zone(_backend.current_frame(), "main pass");
+            _backend.begin_main_pass(VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+            // slices start unbound, the queue only binds what changes
+            if (use_queue) {
+                _backend.record_parallel(_render_queue.size(), [&](VkCommandBuffer command_buffer, uint32_t first, uint32_t last) {
+                    ex::vulkan::command_context context(command_buffer);
+                    std::array<VkDescriptorSet, 2> sets = {
+                        _descriptor_sets.uniform,
+                        _backend.bindless()->handle(),
+                    };
+
+                    uint32_t zone = _backend.begin_gpu_zone(command_buffer, "queued draws");
+                    _pipelines.textured_bindless.update_dynamic(context, _backend.render_extent());
+                    _pipelines.textured_bindless.bind_descriptor_sets(context, VK_PIPELINE_BIND_POINT_GRAPHICS, sets);
+
+                    vulkan::push_constants constants = {};
+                    constants.color = glm::vec4(1.0f);
+                    _render_queue.record(context, first, last, [&](VkCommandBuffer draw_buffer, const ex::vulkan::render_queue::draw &queued) {
+                        constants.model = queued.transform;
+                        constants.texture_index = queued.material;
+                        _pipelines.textured_bindless.push_constants(draw_buffer, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, &constants);
+                        queued.model->draw(draw_buffer);
+                    });
+                    _backend.end_gpu_zone(command_buffer, zone);
+                    skipped_binds += context.get_stats().skipped;
+                });
+            }
+
+            // one secondary whatever the object count, the cull pass already
+            // wrote the commands
+            if (use_gpu_driven) {
+                _backend.record_parallel(1, [&](VkCommandBuffer command_buffer, uint32_t, uint32_t) {
+                    ex::vulkan::command_context context(command_buffer);
+                    std::array<VkDescriptorSet, 2> sets = {
+                        _descriptor_sets.uniform,
+                        _backend.bindless()->handle(),
+                    };
+
+                    if (!_pipeline_manager.bind(context, indirect_pipeline_id)) return;
+                    uint32_t zone = _backend.begin_gpu_zone(command_buffer, "indirect draws");
+                    _geometry.bind(context);
+                    _pipelines.textured_bindless.update_dynamic(context, _backend.render_extent());
+                    _pipelines.textured_bindless.bind_descriptor_sets(context, VK_PIPELINE_BIND_POINT_GRAPHICS, sets);
+
+                    // the indirect shaders read the object buffer where the
+                    // others read a texture
+                    vulkan::push_constants constants = {};
+                    constants.model = glm::mat4(1.0f);
+                    constants.color = glm::vec4(1.0f);
+                    constants.texture_index = _indirect.object_buffer_index();
+                    _pipelines.textured_bindless.push_constants(command_buffer, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, &constants);
+                    _indirect.draw(command_buffer);
+                    _backend.end_gpu_zone(command_buffer, zone);
+                });
+            }
+
+            // workers split the groups, each group is one draw
+            if (use_instancing) {
+                const std::vector<ex::vulkan::instance_batcher::group> &groups = _instances.groups();
+                _backend.record_parallel(static_cast<uint32_t>(groups.size()), [&](VkCommandBuffer command_buffer, uint32_t first, uint32_t last) {
+                    ex::vulkan::command_context context(command_buffer);
+                    std::array<VkDescriptorSet, 2> sets = {
+                        _descriptor_sets.uniform,
+                        _backend.bindless()->handle(),
+                    };
+
+                    if (!_pipeline_manager.bind(context, instanced_pipeline_id)) return;
+                    uint32_t zone = _backend.begin_gpu_zone(command_buffer, "instanced draws");
+                    _geometry.bind(context);
+                    _instances.bind(context);
+                    _pipelines.textured_bindless.update_dynamic(context, _backend.render_extent());
+                    _pipelines.textured_bindless.bind_descriptor_sets(context, VK_PIPELINE_BIND_POINT_GRAPHICS, sets);
+
+                    vulkan::push_constants constants = {};
+                    constants.model = glm::mat4(1.0f);
+                    constants.color = glm::vec4(1.0f);
+                    for (uint32_t i = first; i < last; i++) {
+                        constants.texture_index = groups[i].texture_index;
+                        _pipelines.textured_bindless.push_constants(command_buffer, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, &constants);
+                        _instances.draw(command_buffer, i);
+                    }
+                    _backend.end_gpu_zone(command_buffer, zone);
+                    skipped_binds += context.get_stats().skipped;
+                });
+            }
+
+            // every worker records a slice of the draw list into its own
+            // secondary, state isn't inherited so each slice binds its own
+            _backend.record_parallel(static_cast<uint32_t>(draws.size()), [&](VkCommandBuffer command_buffer, uint32_t first, uint32_t last) {
+                ex::vulkan::command_context context(command_buffer);
+                // vertex/index bindings survive pipeline changes, every
+                // model lives in the arena so one bind covers the slice
+                _geometry.bind(context);
+                
+                // every forward variant has the texture set after the
+                // uniforms, untextured ones just don't read it. the context
+                // drops the bind while the material stays the same
+                std::array<VkDescriptorSet, 2> sets = {
+                    _descriptor_sets.uniform,
+                    VK_NULL_HANDLE,
+                };
+
+                if (render_fill && _backend.bindless_enabled()) {
+                    // recorded above by the queue, the instance batcher or
+                    // the indirect renderer
+                } else if (render_fill) {
+                    vulkan::push_constants constants = {};
+                    constants.color = glm::vec4(1.0f);
             
-            std::vector<VkDescriptorSet> sets = {
-                _descriptor_sets.uniform.handle(),
-            };
+                    uint32_t zone = _backend.begin_gpu_zone(command_buffer, "textured draws");
+                    _pipeline_manager.bind(context, _pipeline_ids.forward_fill);
+                    _pipelines.forward.update_dynamic(context, _backend.render_extent());
+
+                    for (uint32_t i = first; i < last; i++) {
+                        sets[1] = draws[i].material;
+                        _pipelines.forward.bind_descriptor_sets(context, VK_PIPELINE_BIND_POINT_GRAPHICS, sets);
+                        constants.model = draws[i].entity->transform.matrix();
+                        _pipelines.forward.push_constants(command_buffer, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, &constants);
+                        draws[i].entity->model->draw(command_buffer);
+                    }
+                    _backend.end_gpu_zone(command_buffer, zone);
+                }
 
-            if (render_fill) {
-                vulkan::push_constants constants = {};
-                constants.color = glm::vec4(1.0f);
+                if (render_line) {
+                    vulkan::push_constants constants = {};
+                    constants.color = glm::vec4(1.0f, 0.0f, 1.0f, 1.0f);
             
-                _pipelines.textured.bind(_backend.current_frame(), VK_PIPELINE_BIND_POINT_GRAPHICS);
-                _pipelines.textured.update_dynamic(_backend.current_frame(), _backend.swapchain_extent());
-                _pipelines.textured.bind_descriptor_sets(_backend.current_frame(), VK_PIPELINE_BIND_POINT_GRAPHICS, sets);
-    
-                constants.model = monkey.transform.matrix();
-                _pipelines.textured.push_constants(_backend.current_frame(), VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, &constants);
-
-                sets.push_back(_descriptor_sets.textures.handle());
-                _pipelines.textured.bind_descriptor_sets(_backend.current_frame(), VK_PIPELINE_BIND_POINT_GRAPHICS, sets);
-                monkey.model->bind(_backend.current_frame());
-                monkey.model->draw(_backend.current_frame());
-                sets.pop_back();
-        
-                constants.model = floor.transform.matrix();
-                _pipelines.textured.push_constants(_backend.current_frame(), VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, &constants);
-        
-                sets.push_back(_descriptor_sets.textures.handle());
-                _pipelines.textured.bind_descriptor_sets(_backend.current_frame(), VK_PIPELINE_BIND_POINT_GRAPHICS, sets);
-                floor.model->bind(_backend.current_frame());
-                floor.model->draw(_backend.current_frame());
-                sets.pop_back();
-            }
+                    uint32_t zone = _backend.begin_gpu_zone(command_buffer, "line draws");
+                    _pipeline_manager.bind(context, _pipeline_ids.forward_line);
+                    _pipelines.forward.update_dynamic(context, _backend.render_extent());
 
-            if (render_line) {
-                vulkan::push_constants constants = {};
-                constants.color = glm::vec4(1.0f, 0.0f, 1.0f, 1.0f);
+                    for (uint32_t i = first; i < last; i++) {
+                        sets[1] = draws[i].material;
+                        _pipelines.forward.bind_descriptor_sets(context, VK_PIPELINE_BIND_POINT_GRAPHICS, sets);
+                        constants.model = draws[i].entity->transform.matrix();
+                        _pipelines.forward.push_constants(command_buffer, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, &constants);
+                        draws[i].entity->model->draw(command_buffer);
+                    }
+                    _backend.end_gpu_zone(command_buffer, zone);
+                }
+                skipped_binds += context.get_stats().skipped;
+            });
+            skipped_bind_count = skipped_binds.load();
             
-                _pipelines.solid_color.bind(_backend.current_frame(), VK_PIPELINE_BIND_POINT_GRAPHICS);
-                _pipelines.solid_color.update_dynamic(_backend.current_frame(), _backend.swapchain_extent());
-                _pipelines.solid_color.bind_descriptor_sets(_backend.current_frame(), VK_PIPELINE_BIND_POINT_GRAPHICS, sets);
-    
-                constants.model = monkey.transform.matrix();
-                _pipelines.solid_color.push_constants(_backend.current_frame(), VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, &constants);
-                monkey.model->bind(_backend.current_frame());
-                monkey.model->draw(_backend.current_frame());
-        
-                constants.model = floor.transform.matrix();
-                _pipelines.solid_color.push_constants(_backend.current_frame(), VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, &constants);
-                floor.model->bind(_backend.current_frame());
-                floor.model->draw(_backend.current_frame());
+            _backend.end_main_pass();
+            _backend.end_gpu_zone(_backend.current_frame(), main_pass_zone);
+            if (dynamic_resolution) {
+                uint32_t upscale_zone = _backend.begin_gpu_zone(_backend.current_frame(), "upscale");
+                _scaler.record(_backend.current_frame());
+                _backend.end_gpu_zone(_backend.current_frame(), upscale_zone);
             }
-            
-            _backend.end_render();
+            _backend.end_frame();
         }
         
         _input.update();
@@ -308,12 +1028,28 @@ int main() {
         _stats.frame_time = ((1000.0f * (float)elapsed) / (float)_timer.get_frequency());
         _stats.frames_per_second++;
         last_time = end;
+
+        // frame to frame time, a hitch anywhere in the loop shows up. the
+        // gpu time belongs to an older frame, the first slots have none
+        _frame_stats.add_frame(_stats.delta_time * 1000.0f, _backend.last_frame_timings().gpu_ms);
+        if (headless && _frame_stats.frame_count() >= benchmark_frames) _window.close();
         
         time_counter += _stats.delta_time;
         if (time_counter >= 1.0f) {
             std::stringstream ss;
+            const ex::vulkan::backend::frame_timings &timings = _backend.last_frame_timings();
+            ex::vulkan::render_queue::stats queue_stats = _render_queue.get_stats();
             ss << std::fixed << std::setprecision(2) << _stats.frame_time << "ms "
-               << std::fixed << std::setprecision(2) << _stats.frames_per_second << "fps";
+               << std::fixed << std::setprecision(2) << _stats.frames_per_second << "fps "
+               << present_policy_name(_backend.get_present_policy()) << " "
+               << "acquire " << timings.acquire_wait_ms << "ms "
+               << "present " << timings.present_wait_ms << "ms "
+               << "gpu " << timings.gpu_ms << "ms "
+               << "draws " << drawn_count << " "
+               << "calls " << fill_call_count << " "
+               << "binds " << queue_stats.pipeline_binds + queue_stats.vertex_binds << " "
+               << "skipped " << skipped_bind_count;
+            if (dynamic_resolution) ss << " scale " << _backend.render_scale();
             std::string title = "EXCALIBUR | " + ss.str();
             _window.change_title(title);
             
@@ -325,22 +1061,53 @@ int main() {
         //_window.sleep(1);
     }
     
-    EXINFO("-=+SHUTTING_DOWN+=-");
     _backend.wait_idle();
-    _pipelines.textured.destroy(&_backend);
-    _pipelines.solid_color.destroy(&_backend);
+    if (headless && _frame_stats.frame_count() > 0) {
+        float seconds = (float)(_timer.get_time() - benchmark_start) / (float)_timer.get_frequency();
+        EXINFO("-=+BENCHMARK+=-");
+        EXINFO("Frames: %u in %.2fs, %.1f fps", _frame_stats.frame_count(), seconds, (float)_frame_stats.frame_count() / seconds);
+        _frame_stats.print();
+        _backend.print_gpu_zones();
+    }
+    if (!stats_path.empty()) _frame_stats.write(stats_path);
+    if (!trace_path.empty()) {
+        ex::profiler::stop();
+        ex::profiler::write_trace(trace_path);
+    }
+    
+    EXINFO("-=+SHUTTING_DOWN+=-");
+    if (_backend.bindless_enabled()) {
+        _backend.bindless()->remove_texture(_preview.bindless_index);
+        vkDestroySampler(_backend.logical_device(), _preview.sampler, _backend.allocator());
+    }
+    if (dynamic_resolution) _scaler.destroy(&_backend);
+    _indirect.destroy(&_backend);
+    _occlusion.destroy(&_backend);
+    _graph.destroy(&_backend);
+    _pipeline_manager.destroy(&_backend);
+    if (_backend.bindless_enabled()) {
+        _render_queue.destroy();
+        _instances.destroy(&_backend);
+        _shaders.textured_instanced.destroy(&_backend);
+        _shaders.textured_indirect.destroy(&_backend);
+        _shaders.depth_only.destroy(&_backend);
+        _shaders.textured_bindless.destroy(&_backend);
+        _pipelines.textured_bindless.destroy(&_backend);
+    }
+    _pipelines.forward.destroy(&_backend);
+    _shaders.forward.destroy(&_backend);
                         
-    texture_layout.destroy(&_backend);
-    uniform_buffer_layout.destroy(&_backend);
-    descriptor_pool.destroy(&_backend);
+    _descriptor_sets.texture_layout.destroy(&_backend);
+    _descriptor_sets.uniform_layout.destroy(&_backend);
 
-    uniform_buffer.destroy(&_backend);
+    for (ex::vulkan::buffer &uniform_buffer : _uniforms.buffers) uniform_buffer.destroy(&_backend);
     
     _textures.paris.destroy(&_backend);
     _textures.goreshit.destroy(&_backend);
     
     _models.monkey.destroy(&_backend);
     _models.floor.destroy(&_backend);
+    _geometry.destroy(&_backend);
     _backend.shutdown();
     
     _window.destroy();
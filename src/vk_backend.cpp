@@ -1,9 +1,16 @@
 #include "vk_backend.h"
+#include "vk_buffer.h"
+#include "vk_image.h"
 #include "vk_common.h"
+#include "ex_profiler.h"
 
 #include <cstdint>
 #include <vector>
 #include <array>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <utility>
 
 static VKAPI_ATTR VkBool32 VKAPI_CALL
 vulkan_debug_callback(VkDebugUtilsMessageSeverityFlagBitsEXT message_severity,
@@ -29,10 +36,66 @@ vulkan_debug_callback(VkDebugUtilsMessageSeverityFlagBitsEXT message_severity,
     return VK_FALSE;
 }
 
+void
+ex::vulkan::backend::set_bindless(bool enable) {
+    m_bindless_requested = enable;
+}
+
+void
+ex::vulkan::backend::set_depth_sampled(bool sampled) {
+    m_depth_sampled = sampled;
+}
+
+void
+ex::vulkan::backend::set_dynamic_resolution(bool enable) {
+    m_dynamic_resolution = enable;
+}
+
+void
+ex::vulkan::backend::set_render_scale(float scale) {
+    m_render_scale = std::clamp(scale, min_render_scale, 1.0f);
+}
+
+void
+ex::vulkan::backend::set_worker_count(uint32_t worker_count) {
+    m_worker_count_requested = worker_count;
+}
+
+void
+ex::vulkan::backend::set_present_policy(present_policy policy) {
+    m_present_policy = policy;
+    m_swapchain_dirty = m_swapchain != VK_NULL_HANDLE;
+}
+
+void
+ex::vulkan::backend::set_frame_latency(uint32_t frames) {
+    m_frame_latency = std::clamp(frames, 1u, max_frames_in_flight);
+    m_swapchain_dirty = m_swapchain != VK_NULL_HANDLE;
+}
+
+void
+ex::vulkan::backend::set_swapchain_image_count(uint32_t image_count) {
+    m_swapchain_image_count_requested = image_count;
+    m_swapchain_dirty = m_swapchain != VK_NULL_HANDLE;
+}
+
 bool
 ex::vulkan::backend::initialize(ex::platform::window *pwindow) {
     m_pwindow = pwindow;
-    
+    m_headless = false;
+    return initialize_vulkan();
+}
+
+bool
+ex::vulkan::backend::initialize_headless(uint32_t width, uint32_t height) {
+    m_pwindow = nullptr;
+    m_headless = true;
+    m_headless_extent = { width, height };
+    return initialize_vulkan();
+}
+
+bool
+ex::vulkan::backend::initialize_vulkan() {
     if (!create_instance()) {
         EXERROR("Failed to create vulkan instance");
         return false;
@@ -40,7 +103,7 @@ ex::vulkan::backend::initialize(ex::platform::window *pwindow) {
 
     setup_debug_messenger();
 
-    if (!pwindow->create_vulkan_surface(m_instance, m_allocator, &m_surface)) {
+    if (!m_headless && !m_pwindow->create_vulkan_surface(m_instance, m_allocator, &m_surface)) {
         EXERROR("Failed to create vulkan surface");
         return false;
     }
@@ -56,13 +119,24 @@ ex::vulkan::backend::initialize(ex::platform::window *pwindow) {
     }
 
     create_command_pool();
+
+    if (m_bindless_enabled) {
+        m_bindless.create(this);
+    }
     
-    create_swapchain(pwindow->width(), pwindow->height());
+    VkExtent2D extent = target_extent();
+    if (m_headless) {
+        create_offscreen_targets(extent.width, extent.height);
+    } else {
+        create_swapchain(extent.width, extent.height);
+    }
     create_depth_resources();
     create_render_pass();
     create_framebuffers();
+    if (m_dynamic_resolution) create_scene_targets();
     create_sync_structures();
     allocate_command_buffers();
+    create_workers();
     
     return true;
 }
@@ -70,11 +144,17 @@ ex::vulkan::backend::initialize(ex::platform::window *pwindow) {
 void
 ex::vulkan::backend::shutdown() {
     vkDeviceWaitIdle(m_logical_device);
-
-    if (!m_command_buffers.empty()) vkFreeCommandBuffers(m_logical_device, m_command_pool, m_command_buffers.size(), m_command_buffers.data());
-    if (m_semaphore_render) vkDestroySemaphore(m_logical_device, m_semaphore_render, m_allocator);
-    if (m_semaphore_present) vkDestroySemaphore(m_logical_device, m_semaphore_present, m_allocator);
-    if (m_fence) vkDestroyFence(m_logical_device, m_fence, m_allocator);
+    flush_deferred_destroys();
+    destroy_workers();
+
+    for (frame_context &frame : m_frames) {
+        if (frame.command_buffer) vkFreeCommandBuffers(m_logical_device, m_command_pool, 1, &frame.command_buffer);
+        if (frame.semaphore_acquire) vkDestroySemaphore(m_logical_device, frame.semaphore_acquire, m_allocator);
+        if (frame.fence) vkDestroyFence(m_logical_device, frame.fence, m_allocator);
+        if (frame.timestamp_pool) vkDestroyQueryPool(m_logical_device, frame.timestamp_pool, m_allocator);
+        frame.transient_descriptors.destroy(this);
+    }
+    destroy_render_semaphores();
     
     if (!m_swapchain_framebuffers.empty()) {
         for (uint32_t i = 0; i < m_swapchain_framebuffers.size(); i++) {
@@ -82,6 +162,13 @@ ex::vulkan::backend::shutdown() {
         }
     }
     
+    for (VkFramebuffer framebuffer : m_present_framebuffers) vkDestroyFramebuffer(m_logical_device, framebuffer, m_allocator);
+    if (m_scene_framebuffer) vkDestroyFramebuffer(m_logical_device, m_scene_framebuffer, m_allocator);
+    if (m_scene_color_view) vkDestroyImageView(m_logical_device, m_scene_color_view, m_allocator);
+    if (m_scene_color_image) vkDestroyImage(m_logical_device, m_scene_color_image, m_allocator);
+    if (m_scene_color_memory.memory) free_memory(m_scene_color_memory);
+    if (m_present_render_pass) vkDestroyRenderPass(m_logical_device, m_present_render_pass, m_allocator);
+    if (m_scene_render_pass) vkDestroyRenderPass(m_logical_device, m_scene_render_pass, m_allocator);
     if (m_render_pass) vkDestroyRenderPass(m_logical_device, m_render_pass, m_allocator);
     destroy_depth_resources();
     
@@ -92,7 +179,20 @@ ex::vulkan::backend::shutdown() {
     }
     
     if (m_swapchain) vkDestroySwapchainKHR(m_logical_device, m_swapchain, m_allocator);
+    if (m_headless) destroy_offscreen_targets();
+    if (m_bindless_enabled) m_bindless.destroy(this);
+    m_descriptors.destroy(this);
+    m_descriptor_layouts.destroy(this);
     if (m_command_pool) vkDestroyCommandPool(m_logical_device, m_command_pool, m_allocator);
+
+    if (m_memory_stats.allocation_count > 0) {
+        EXWARN("%u device memory allocations still alive at shutdown", m_memory_stats.allocation_count);
+    }
+    for (auto &block : m_memory_blocks) {
+        free_device_memory(block->memory, block->memory_type_index, block->ranges.size());
+    }
+    m_memory_blocks.clear();
+    
     if (m_logical_device) vkDestroyDevice(m_logical_device, m_allocator);    
     if (m_surface) vkDestroySurfaceKHR(m_instance, m_surface, m_allocator);    
 #ifdef EXCALIBUR_DEBUG
@@ -107,92 +207,399 @@ ex::vulkan::backend::shutdown() {
 }
 
 void
-ex::vulkan::backend::begin_render() {
-    if (m_pwindow->width() == 0 || m_pwindow->height() == 0) return;
+ex::vulkan::backend::begin_render(VkSubpassContents contents) {
+    begin_frame();
+    begin_main_pass(contents);
+}
+
+void
+ex::vulkan::backend::end_render() {
+    end_main_pass();
+    end_frame();
+}
+
+void
+ex::vulkan::backend::begin_frame() {
+    EXPROFILE_FUNCTION();
+    VkExtent2D extent = target_extent();
+    if (extent.width == 0 || extent.height == 0) return;
+
+    if (m_swapchain_dirty) {
+        // policy changes may change the frames in flight and with them the
+        // slot rotation, they are explicit and rare so they get the stall
+        m_swapchain_dirty = false;
+        vkDeviceWaitIdle(m_logical_device);
+        recreate_swapchain(extent.width, extent.height);
+        flush_deferred_destroys();
+        m_frame_index = 0;
+    }
+
+    frame_context &frame = m_frames[m_frame_index];
     
-    VK_CHECK(vkWaitForFences(m_logical_device,
-                             1,
-                             &m_fence,
-                             VK_TRUE,
-                             UINT64_MAX));
+    auto fence_start = std::chrono::steady_clock::now();
+    {
+        EXPROFILE_SCOPE("wait frame fence");
+        VK_CHECK(vkWaitForFences(m_logical_device,
+                                 1,
+                                 &frame.fence,
+                                 VK_TRUE,
+                                 UINT64_MAX));
+    }
+    auto fence_end = std::chrono::steady_clock::now();
+
+    // the fence covers the timestamps too, no need to wait on the results.
+    // zones that were never closed have no end value and are skipped
+    if (!frame.gpu_zone_names.empty()) {
+        uint32_t query_count = static_cast<uint32_t>(frame.gpu_zone_names.size()) * 2;
+        std::vector<uint64_t> results(query_count * 2);
+        vkGetQueryPoolResults(m_logical_device,
+                              frame.timestamp_pool,
+                              0,
+                              query_count,
+                              results.size() * sizeof(uint64_t),
+                              results.data(),
+                              2 * sizeof(uint64_t),
+                              VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+        m_gpu_zone_timings.clear();
+        for (uint32_t i = 0; i < frame.gpu_zone_names.size(); i++) {
+            // value and availability per query
+            const uint64_t *begin = &results[i * 4];
+            const uint64_t *end = &results[i * 4 + 2];
+            if (!begin[1] || !end[1]) continue;
+
+            // bits above timestampValidBits are undefined, the masked
+            // difference also survives the counter wrapping
+            uint64_t ticks = ((end[0] & m_timestamp_mask) - (begin[0] & m_timestamp_mask)) & m_timestamp_mask;
+
+            // zones opened under one name from several threads add up
+            float ms = static_cast<float>(ticks) * m_timestamp_period / 1000000.0f;
+            auto found = std::find_if(m_gpu_zone_timings.begin(), m_gpu_zone_timings.end(), [&](const gpu_zone_timing &timing) {
+                return !strcmp(timing.name, frame.gpu_zone_names[i]);
+            });
+            if (found != m_gpu_zone_timings.end()) {
+                found->ms += ms;
+                continue;
+            }
+
+            gpu_zone_timing timing = {};
+            timing.name = frame.gpu_zone_names[i];
+            timing.ms = ms;
+            m_gpu_zone_timings.push_back(timing);
+        }
+        m_frame_timings.gpu_ms = m_gpu_zone_timings.empty() ? 0.0f : m_gpu_zone_timings[0].ms;
+        frame.gpu_zone_names.clear();
+    }
+
+    // frame boundary: this slot's previous frame is done with its resources
+    flush_frame_destroys(m_frame_index);
+    check_memory_budget();
+    frame.transient_descriptors.reset(this);
+    frame.transient_sets.clear();
+    uint32_t worker_count = m_thread_pool.thread_count();
+    for (uint32_t i = 0; i < worker_count; i++) {
+        worker_context &worker = m_workers[m_frame_index * worker_count + i];
+        VK_CHECK(vkResetCommandPool(m_logical_device, worker.command_pool, 0));
+        worker.used_command_buffers = 0;
+    }
+
+    // the window changed size since the swapchain was made, don't wait for
+    // the driver to report it out of date (some never do)
+    if (!m_headless && (extent.width != m_swapchain_requested_extent.width || extent.height != m_swapchain_requested_extent.height)) {
+        recreate_swapchain(extent.width, extent.height);
+    }
+
+    auto acquire_start = std::chrono::steady_clock::now();
+    if (m_headless) {
+        // offscreen targets belong to frame slots, nothing to acquire
+        m_next_image_index = m_frame_index;
+    } else {
+        EXPROFILE_SCOPE("acquire");
+        VkResult result = vkAcquireNextImageKHR(m_logical_device,
+                                                m_swapchain,
+                                                UINT64_MAX,
+                                                frame.semaphore_acquire,
+                                                nullptr,
+                                                &m_next_image_index);
+        if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+            // nothing was acquired and the semaphore wasn't touched, try
+            // again on the new swapchain
+            recreate_swapchain(extent.width, extent.height);
+            result = vkAcquireNextImageKHR(m_logical_device,
+                                           m_swapchain,
+                                           UINT64_MAX,
+                                           frame.semaphore_acquire,
+                                           nullptr,
+                                           &m_next_image_index);
+        }
+        if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+            EXFATAL("Failed to acquire swapchain image");
+            throw std::runtime_error("Failed to acquire swapchain image");
+        }
+    }
 
-    VkResult result = vkAcquireNextImageKHR(m_logical_device,
-                                            m_swapchain,
-                                            UINT64_MAX,
-                                            m_semaphore_present,
-                                            nullptr,
-                                            &m_next_image_index);
-    if (result == VK_ERROR_OUT_OF_DATE_KHR) {
-        recreate_swapchain(m_pwindow->width(), m_pwindow->height());
-    } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
-        EXFATAL("Failed to acquire swapchain image");
-        throw std::runtime_error("Failed to acquire swapchain image");
+    // with fewer images than frames in flight an older slot may still be
+    // rendering into the image we just got
+    if (m_image_fences[m_next_image_index] != VK_NULL_HANDLE) {
+        VK_CHECK(vkWaitForFences(m_logical_device,
+                                 1,
+                                 &m_image_fences[m_next_image_index],
+                                 VK_TRUE,
+                                 UINT64_MAX));
     }
+    m_image_fences[m_next_image_index] = frame.fence;
+    auto acquire_end = std::chrono::steady_clock::now();
 
-    VK_CHECK(vkResetFences(m_logical_device, 1, &m_fence));
-    VK_CHECK(vkResetCommandBuffer(m_command_buffers[m_next_image_index], 0));
+    m_frame_timings.fence_wait_ms = std::chrono::duration<float, std::milli>(fence_end - fence_start).count();
+    m_frame_timings.acquire_wait_ms = std::chrono::duration<float, std::milli>(acquire_end - acquire_start).count();
+
+    VK_CHECK(vkResetFences(m_logical_device, 1, &frame.fence));
+    VK_CHECK(vkResetCommandBuffer(frame.command_buffer, 0));
     
     VkCommandBufferBeginInfo command_buffer_begin_info = {};
     command_buffer_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     command_buffer_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-    VK_CHECK(vkBeginCommandBuffer(m_command_buffers[m_next_image_index], &command_buffer_begin_info));
+    VK_CHECK(vkBeginCommandBuffer(frame.command_buffer, &command_buffer_begin_info));
+
+    // resets have to happen outside a render pass, so the whole pool is
+    // reset up front and zones only write
+    if (m_timestamps_supported) {
+        vkCmdResetQueryPool(frame.command_buffer, frame.timestamp_pool, 0, max_gpu_zones * 2);
+    }
+    // opened before the defrag copies so the frame's gpu time includes them
+    m_frame_gpu_zone = begin_gpu_zone(frame.command_buffer, "frame");
+    if (m_defrag_enabled) {
+        uint32_t zone = begin_gpu_zone(frame.command_buffer, "defragment");
+        defragment(frame.command_buffer, m_defrag_bytes_per_frame);
+        end_gpu_zone(frame.command_buffer, zone);
+    }
+}
+
+void
+ex::vulkan::backend::begin_main_pass(VkSubpassContents contents) {
+    EXPROFILE_FUNCTION();
+    VkExtent2D extent = target_extent();
+    if (extent.width == 0 || extent.height == 0) return;
 
     std::array<VkClearValue, 2> clear_values{};
     //clear_values[0].color = { 0.0f, 1.0f, 0.0f, 1.0f };
     clear_values[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
     clear_values[1].depthStencil = { 1.0f, 0 };
     
+    // with dynamic resolution only the scaled corner of the scene target
+    // is drawn, the present pass scales it back up
+    m_last_render_extent = render_extent();
     VkRenderPassBeginInfo render_pass_begin_info = {};
     render_pass_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    render_pass_begin_info.renderPass = m_render_pass;
-    render_pass_begin_info.framebuffer = m_swapchain_framebuffers[m_next_image_index];
+    render_pass_begin_info.renderPass = m_dynamic_resolution ? m_scene_render_pass : m_render_pass;
+    render_pass_begin_info.framebuffer = m_dynamic_resolution ? m_scene_framebuffer : m_swapchain_framebuffers[m_next_image_index];
     render_pass_begin_info.renderArea.offset = { 0, 0 };
-    render_pass_begin_info.renderArea.extent = m_swapchain_extent;
+    render_pass_begin_info.renderArea.extent = m_last_render_extent;
     render_pass_begin_info.clearValueCount = static_cast<uint32_t>(clear_values.size());
     render_pass_begin_info.pClearValues = clear_values.data();
     
-    vkCmdBeginRenderPass(m_command_buffers[m_next_image_index],
+    m_subpass_contents = contents;
+    vkCmdBeginRenderPass(m_frames[m_frame_index].command_buffer,
                          &render_pass_begin_info,
-                         VK_SUBPASS_CONTENTS_INLINE);    
+                         contents);
 }
 
 void
-ex::vulkan::backend::end_render() {
-    if (m_pwindow->width() == 0 || m_pwindow->height() == 0) return;
+ex::vulkan::backend::end_main_pass() {
+    VkExtent2D extent = target_extent();
+    if (extent.width == 0 || extent.height == 0) return;
     
-    vkCmdEndRenderPass(m_command_buffers[m_next_image_index]);
-    VK_CHECK(vkEndCommandBuffer(m_command_buffers[m_next_image_index]));
+    vkCmdEndRenderPass(m_frames[m_frame_index].command_buffer);
+}
+
+void
+ex::vulkan::backend::begin_present_pass() {
+    VkExtent2D extent = target_extent();
+    if (extent.width == 0 || extent.height == 0 || !m_dynamic_resolution) return;
+
+    // every pixel is written, nothing to clear
+    VkRenderPassBeginInfo render_pass_begin_info = {};
+    render_pass_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    render_pass_begin_info.renderPass = m_present_render_pass;
+    render_pass_begin_info.framebuffer = m_present_framebuffers[m_next_image_index];
+    render_pass_begin_info.renderArea.offset = { 0, 0 };
+    render_pass_begin_info.renderArea.extent = m_swapchain_extent;
+    render_pass_begin_info.clearValueCount = 0;
+    render_pass_begin_info.pClearValues = nullptr;
+    vkCmdBeginRenderPass(m_frames[m_frame_index].command_buffer,
+                         &render_pass_begin_info,
+                         VK_SUBPASS_CONTENTS_INLINE);
+}
+
+void
+ex::vulkan::backend::end_present_pass() {
+    VkExtent2D extent = target_extent();
+    if (extent.width == 0 || extent.height == 0 || !m_dynamic_resolution) return;
+
+    vkCmdEndRenderPass(m_frames[m_frame_index].command_buffer);
+}
+
+void
+ex::vulkan::backend::end_frame() {
+    EXPROFILE_FUNCTION();
+    VkExtent2D extent = target_extent();
+    if (extent.width == 0 || extent.height == 0) return;
+
+    frame_context &frame = m_frames[m_frame_index];
+    end_gpu_zone(frame.command_buffer, m_frame_gpu_zone);
+    VK_CHECK(vkEndCommandBuffer(frame.command_buffer));
 
     VkSubmitInfo submit_info = {};
     submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submit_info.waitSemaphoreCount = 1;
-    submit_info.pWaitSemaphores = &m_semaphore_present;
+    submit_info.waitSemaphoreCount = m_headless ? 0 : 1;
+    submit_info.pWaitSemaphores = &frame.semaphore_acquire;
     
     VkPipelineStageFlags wait_stage_mask[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
     submit_info.pWaitDstStageMask = wait_stage_mask;
     
     submit_info.commandBufferCount = 1;
-    submit_info.pCommandBuffers = &m_command_buffers[m_next_image_index];
+    submit_info.pCommandBuffers = &frame.command_buffer;
     
-    submit_info.signalSemaphoreCount = 1;
-    submit_info.pSignalSemaphores = &m_semaphore_render;
-    VK_CHECK(vkQueueSubmit(m_graphics_queue, 1, &submit_info, m_fence));
+    submit_info.signalSemaphoreCount = m_headless ? 0 : 1;
+    submit_info.pSignalSemaphores = &m_semaphores_render[m_next_image_index];
+    {
+        EXPROFILE_SCOPE("submit");
+        VK_CHECK(vkQueueSubmit(m_graphics_queue, 1, &submit_info, frame.fence));
+    }
+
+    if (m_headless) {
+        m_frame_timings.present_wait_ms = 0.0f;
+        m_frame_index = (m_frame_index + 1) % m_frames_in_flight;
+        return;
+    }
 
     VkPresentInfoKHR present_info = {};
     present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
     present_info.waitSemaphoreCount = 1;
-    present_info.pWaitSemaphores = &m_semaphore_render;
+    present_info.pWaitSemaphores = &m_semaphores_render[m_next_image_index];
     present_info.swapchainCount = 1;
     present_info.pSwapchains = &m_swapchain;
     present_info.pImageIndices = &m_next_image_index;
+
+    auto present_start = std::chrono::steady_clock::now();
+    VkResult result = VK_SUCCESS;
+    {
+        EXPROFILE_SCOPE("present");
+        result = vkQueuePresentKHR(m_graphics_queue, &present_info);
+    }
+    auto present_end = std::chrono::steady_clock::now();
+    m_frame_timings.present_wait_ms = std::chrono::duration<float, std::milli>(present_end - present_start).count();
     
-    VkResult result = vkQueuePresentKHR(m_graphics_queue, &present_info);
     if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
-        recreate_swapchain(m_pwindow->width(), m_pwindow->height());
+        recreate_swapchain(extent.width, extent.height);
     } else if (result != VK_SUCCESS) {
         EXFATAL("Failed to present swapchain image");
         throw std::runtime_error("Failed to present swapchain image");
     }
+
+    m_frame_index = (m_frame_index + 1) % m_frames_in_flight;
+}
+
+void
+ex::vulkan::backend::record_parallel(uint32_t draw_count,
+                                     std::function<void(VkCommandBuffer, uint32_t, uint32_t)> record,
+                                     uint32_t min_draws_per_task) {
+    EXPROFILE_FUNCTION();
+    if (draw_count == 0) return;
+    VkExtent2D extent = target_extent();
+    if (extent.width == 0 || extent.height == 0) return;
+    
+    if (m_subpass_contents != VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS) {
+        record(m_frames[m_frame_index].command_buffer, 0, draw_count);
+        return;
+    }
+
+    // small lists aren't worth a secondary per thread
+    uint32_t worker_count = m_thread_pool.thread_count();
+    uint32_t task_count = (draw_count + min_draws_per_task - 1) / std::max(min_draws_per_task, 1u);
+    task_count = std::clamp(task_count, 1u, worker_count);
+
+    VkCommandBufferInheritanceInfo inheritance_info = {};
+    inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritance_info.pNext = nullptr;
+    inheritance_info.renderPass = m_dynamic_resolution ? m_scene_render_pass : m_render_pass;
+    inheritance_info.subpass = m_pipeline_subpass;
+    inheritance_info.framebuffer = m_dynamic_resolution ? m_scene_framebuffer : m_swapchain_framebuffers[m_next_image_index];
+    inheritance_info.occlusionQueryEnable = VK_FALSE;
+    inheritance_info.queryFlags = 0;
+    inheritance_info.pipelineStatistics = 0;
+
+    std::vector<VkCommandBuffer> secondary_command_buffers(task_count);
+    m_thread_pool.dispatch(task_count, [&](uint32_t task, uint32_t worker) {
+        EXPROFILE_SCOPE("record slice");
+        worker_context &context = m_workers[m_frame_index * worker_count + worker];
+        if (context.used_command_buffers == context.command_buffers.size()) {
+            VkCommandBufferAllocateInfo command_buffer_allocate_info = {};
+            command_buffer_allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            command_buffer_allocate_info.pNext = nullptr;
+            command_buffer_allocate_info.commandPool = context.command_pool;
+            command_buffer_allocate_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+            command_buffer_allocate_info.commandBufferCount = 1;
+
+            VkCommandBuffer command_buffer;
+            VK_CHECK(vkAllocateCommandBuffers(m_logical_device,
+                                              &command_buffer_allocate_info,
+                                              &command_buffer));
+            context.command_buffers.push_back(command_buffer);
+        }
+        VkCommandBuffer command_buffer = context.command_buffers[context.used_command_buffers++];
+
+        VkCommandBufferBeginInfo command_buffer_begin_info = {};
+        command_buffer_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        command_buffer_begin_info.pNext = nullptr;
+        command_buffer_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+        command_buffer_begin_info.pInheritanceInfo = &inheritance_info;
+        VK_CHECK(vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info));
+
+        uint32_t first = static_cast<uint32_t>(static_cast<uint64_t>(draw_count) * task / task_count);
+        uint32_t last = static_cast<uint32_t>(static_cast<uint64_t>(draw_count) * (task + 1) / task_count);
+        record(command_buffer, first, last);
+
+        VK_CHECK(vkEndCommandBuffer(command_buffer));
+        secondary_command_buffers[task] = command_buffer;
+    });
+
+    // executed in task order, so draw order matches the list
+    vkCmdExecuteCommands(m_frames[m_frame_index].command_buffer,
+                         static_cast<uint32_t>(secondary_command_buffers.size()),
+                         secondary_command_buffers.data());
+}
+
+uint32_t
+ex::vulkan::backend::begin_gpu_zone(VkCommandBuffer command_buffer, const char *name) {
+    if (!m_timestamps_supported) return invalid_gpu_zone;
+
+    frame_context &frame = m_frames[m_frame_index];
+    uint32_t zone = 0;
+    {
+        // recording threads open zones in their secondaries concurrently
+        std::lock_guard<std::mutex> lock(m_gpu_zone_mutex);
+        if (frame.gpu_zone_names.size() >= max_gpu_zones) return invalid_gpu_zone;
+        zone = static_cast<uint32_t>(frame.gpu_zone_names.size());
+        frame.gpu_zone_names.push_back(name);
+    }
+
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frame.timestamp_pool, zone * 2);
+    return zone;
+}
+
+void
+ex::vulkan::backend::end_gpu_zone(VkCommandBuffer command_buffer, uint32_t zone) {
+    if (zone == invalid_gpu_zone) return;
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_frames[m_frame_index].timestamp_pool, zone * 2 + 1);
+}
+
+void
+ex::vulkan::backend::print_gpu_zones() {
+    EXINFO("-=+GPU_ZONES+=-");
+    for (const gpu_zone_timing &timing : m_gpu_zone_timings) {
+        EXINFO("%-24s %8.3fms", timing.name, timing.ms);
+    }
 }
 
 void
@@ -229,10 +636,13 @@ ex::vulkan::backend::create_instance() {
 #endif
     
     // INSTANCE EXTENSIONS
-    std::vector<const char *> enabled_extensions = {
-        VK_KHR_SURFACE_EXTENSION_NAME,
-        VK_KHR_WIN32_SURFACE_EXTENSION_NAME,
-    };    
+    std::vector<const char *> enabled_extensions;
+    if (!m_headless) {
+        enabled_extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+#ifdef _WIN32
+        enabled_extensions.push_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
+#endif
+    }
 #ifdef EXCALIBUR_DEBUG
     enabled_extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
     enabled_extensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
@@ -263,7 +673,7 @@ ex::vulkan::backend::create_instance() {
     application_info.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     application_info.pEngineName = "EXCALIBUR ENGINE";
     application_info.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    application_info.apiVersion = VK_API_VERSION_1_0;
+    application_info.apiVersion = VK_API_VERSION_1_2;
 
     VkInstanceCreateInfo instance_create_info = {};
     instance_create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -323,10 +733,24 @@ ex::vulkan::backend::select_physical_device() {
                                         &physical_device_count,
                                         physical_devices.data()));
 
+    // discrete gpus first, anything else that can render is a fallback.
+    // software rasterizers like lavapipe report themselves as cpu devices
+    auto device_type_rank = [](VkPhysicalDeviceType type) {
+        switch (type) {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: return 4;
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return 3;
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: return 2;
+        case VK_PHYSICAL_DEVICE_TYPE_CPU: return 1;
+        default: return 0;
+        }
+    };
+
+    int32_t selected_rank = -1;
     for (uint32_t i = 0; i < physical_device_count; i++) {
         VkPhysicalDeviceProperties properties;
         vkGetPhysicalDeviceProperties(physical_devices[i], &properties);
-        if (properties.deviceType != VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
+        int32_t rank = device_type_rank(properties.deviceType);
+        if (rank <= selected_rank) {
             continue;
         }
         
@@ -344,16 +768,21 @@ ex::vulkan::backend::select_physical_device() {
         int32_t present_queue_index = -1;
         
         for (uint32_t queue_index = 0; queue_index < queue_family_property_count; queue_index++) {
-            if (queue_family_properties[queue_index].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+            if (graphics_queue_index < 0 && queue_family_properties[queue_index].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
                 graphics_queue_index = queue_index;
             }
 
+            // nothing is presented headless, the graphics queue stands in
             VkBool32 present_support = false;
-            vkGetPhysicalDeviceSurfaceSupportKHR(physical_devices[i],
-                                                 queue_index,
-                                                 m_surface,
-                                                 &present_support);
-            if (present_support) {
+            if (m_headless) {
+                present_support = (queue_family_properties[queue_index].queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+            } else {
+                vkGetPhysicalDeviceSurfaceSupportKHR(physical_devices[i],
+                                                     queue_index,
+                                                     m_surface,
+                                                     &present_support);
+            }
+            if (present_support && present_queue_index < 0) {
                 present_queue_index = queue_index;
             }
 
@@ -361,17 +790,22 @@ ex::vulkan::backend::select_physical_device() {
                 m_graphics_queue_index = graphics_queue_index;
                 m_present_queue_index = present_queue_index;
                 m_physical_device = physical_devices[i];
-                return true;
+                selected_rank = rank;
+                break;
             }        
         }
+    }
 
-        if (graphics_queue_index < 0 && present_queue_index < 0) {
-            EXERROR("Failed to find physical device graphics queue index");
-            return false;
-        }
+    if (selected_rank < 0) {
+        EXERROR("Failed to find physical device with graphics and present queues");
+        return false;
     }
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(m_physical_device, &properties);
+    EXINFO("Physical device: %s", properties.deviceName);
     
-    return false;
+    return true;
 }
 
 bool
@@ -426,14 +860,130 @@ ex::vulkan::backend::create_logical_device() {
     }
 #endif
 
-    std::vector<const char *> enabled_extensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+    std::vector<const char *> enabled_extensions;
+    if (!m_headless) {
+        enabled_extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    }
+
+    uint32_t available_extension_count = 0;
+    VK_CHECK(vkEnumerateDeviceExtensionProperties(m_physical_device,
+                                                  nullptr,
+                                                  &available_extension_count,
+                                                  nullptr));
+
+    std::vector<VkExtensionProperties> available_extensions(available_extension_count);
+    VK_CHECK(vkEnumerateDeviceExtensionProperties(m_physical_device,
+                                                  nullptr,
+                                                  &available_extension_count,
+                                                  available_extensions.data()));
+
+    m_memory_budget_supported = false;
+    for (uint32_t i = 0; i < available_extension_count; i++) {
+        if (!strcmp(available_extensions[i].extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME)) {
+            enabled_extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+            m_memory_budget_supported = true;
+            break;
+        }
+    }
+    if (!m_memory_budget_supported) {
+        EXWARN("VK_EXT_memory_budget not supported, budgets fall back to heap sizes");
+    }
+
+    // core in 1.2 but optional there, the extension makes it usable either way
+    m_draw_indirect_count = nullptr;
+    bool draw_indirect_count_supported = false;
+    for (uint32_t i = 0; i < available_extension_count; i++) {
+        if (!strcmp(available_extensions[i].extensionName, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME)) {
+            enabled_extensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+            draw_indirect_count_supported = true;
+            break;
+        }
+    }
+    if (!draw_indirect_count_supported) {
+        EXWARN("VK_KHR_draw_indirect_count not supported, indirect draws are not compacted");
+    }
+
+    vkGetPhysicalDeviceMemoryProperties(m_physical_device, &m_memory_properties);
+    m_memory_stats = {};
+    m_memory_stats.heap_count = m_memory_properties.memoryHeapCount;
+
+    VkPhysicalDeviceProperties device_properties;
+    vkGetPhysicalDeviceProperties(m_physical_device, &device_properties);
+
+    VkPhysicalDeviceFeatures supported_device_features = {};
+    vkGetPhysicalDeviceFeatures(m_physical_device, &supported_device_features);
 
     VkPhysicalDeviceFeatures physical_device_features = {};
-    physical_device_features.samplerAnisotropy = VK_TRUE;
     physical_device_features.fillModeNonSolid = VK_TRUE;
+
+    // samplers ask the backend, so a device without it still creates
+    physical_device_features.samplerAnisotropy = supported_device_features.samplerAnisotropy;
+    m_max_sampler_anisotropy = 1.0f;
+    if (physical_device_features.samplerAnisotropy) {
+        m_max_sampler_anisotropy = std::min(16.0f, device_properties.limits.maxSamplerAnisotropy);
+    } else {
+        EXWARN("samplerAnisotropy not supported, textures are filtered without it");
+    }
+
+    // gpu driven draws, first instance carries the object index
+    physical_device_features.multiDrawIndirect = supported_device_features.multiDrawIndirect;
+    physical_device_features.drawIndirectFirstInstance = supported_device_features.drawIndirectFirstInstance;
+    physical_device_features.shaderStorageBufferArrayDynamicIndexing = supported_device_features.shaderStorageBufferArrayDynamicIndexing;
+    m_enabled_features = physical_device_features;
+
+    // BINDLESS
+    VkPhysicalDeviceDescriptorIndexingFeatures descriptor_indexing_features = {};
+    descriptor_indexing_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+
+    // the indexing features are chained as core 1.2 structs, older devices only have the extension
+    bool bindless_supported = device_properties.apiVersion >= VK_API_VERSION_1_2;
+    if (m_bindless_requested && !bindless_supported) {
+        EXWARN("Physical device is older than Vulkan 1.2, bindless disabled");
+    }
+
+    m_bindless_enabled = false;
+    if (m_bindless_requested && bindless_supported) {
+        VkPhysicalDeviceDescriptorIndexingFeatures supported_indexing_features = {};
+        supported_indexing_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+
+        VkPhysicalDeviceFeatures2 supported_features = {};
+        supported_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        supported_features.pNext = &supported_indexing_features;
+        vkGetPhysicalDeviceFeatures2(m_physical_device, &supported_features);
+
+        if (supported_indexing_features.runtimeDescriptorArray &&
+            supported_indexing_features.descriptorBindingPartiallyBound &&
+            supported_indexing_features.descriptorBindingSampledImageUpdateAfterBind &&
+            supported_indexing_features.descriptorBindingStorageBufferUpdateAfterBind &&
+            supported_indexing_features.shaderSampledImageArrayNonUniformIndexing) {
+            descriptor_indexing_features.runtimeDescriptorArray = VK_TRUE;
+            descriptor_indexing_features.descriptorBindingPartiallyBound = VK_TRUE;
+            descriptor_indexing_features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+            descriptor_indexing_features.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+            descriptor_indexing_features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+            descriptor_indexing_features.shaderStorageBufferArrayNonUniformIndexing =
+                supported_indexing_features.shaderStorageBufferArrayNonUniformIndexing;
+            m_bindless_enabled = true;
+
+            VkPhysicalDeviceDescriptorIndexingProperties indexing_properties = {};
+            indexing_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+
+            VkPhysicalDeviceProperties2 properties = {};
+            properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+            properties.pNext = &indexing_properties;
+            vkGetPhysicalDeviceProperties2(m_physical_device, &properties);
+
+            uint32_t texture_capacity = std::min<uint32_t>(4096, indexing_properties.maxDescriptorSetUpdateAfterBindSampledImages);
+            uint32_t buffer_capacity = std::min<uint32_t>(1024, indexing_properties.maxDescriptorSetUpdateAfterBindStorageBuffers);
+            m_bindless.set_capacity(texture_capacity, buffer_capacity);
+        } else {
+            EXWARN("Physical device does not support descriptor indexing, bindless disabled");
+        }
+    }
     
     VkDeviceCreateInfo device_create_info = {};
     device_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    device_create_info.pNext = m_bindless_enabled ? &descriptor_indexing_features : nullptr;
     device_create_info.queueCreateInfoCount = static_cast<uint32_t>(device_queue_create_infos.size());
     device_create_info.pQueueCreateInfos = device_queue_create_infos.data();
     device_create_info.enabledLayerCount = static_cast<uint32_t>(enabled_layers.size());
@@ -455,6 +1005,10 @@ ex::vulkan::backend::create_logical_device() {
                      m_present_queue_index,
                      0,
                      &m_present_queue);
+
+    if (draw_indirect_count_supported) {
+        m_draw_indirect_count = (PFN_vkCmdDrawIndexedIndirectCountKHR)vkGetDeviceProcAddr(m_logical_device, "vkCmdDrawIndexedIndirectCountKHR");
+    }
     
     return true;
 }
@@ -520,37 +1074,30 @@ ex::vulkan::backend::create_swapchain(uint32_t width, uint32_t height) {
         EXWARN("Failed to find preferable swapchain image format");
     }
 
-    // find swapchain present mode
-    bool found_present_mode = false;
-    for (uint32_t i = 0; i < m_swapchain_present_modes.size(); i++) {
-        VkPresentModeKHR present_mode = m_swapchain_present_modes[i];
-        // if (present_mode == VK_PRESENT_MODE_MAILBOX_KHR) {
-        //            EXDEBUG("Present mode: MAILBOX");
-        if (present_mode == VK_PRESENT_MODE_IMMEDIATE_KHR) {
-            EXDEBUG("Present mode: IMMEDIATE");
-            m_swapchain_present_mode = present_mode;
-            found_present_mode = true;
-            break;
-        }
-    }
-    if (!found_present_mode) {
-        m_swapchain_present_mode = VK_PRESENT_MODE_FIFO_KHR;
-        EXWARN("Failed to find preferable present mode");
-        EXDEBUG("Present mode: V-Sync");
-    }
+    m_swapchain_present_mode = select_present_mode();
 
     // swapchain extent
+    m_swapchain_requested_extent = { width, height };
     m_swapchain_extent = { width, height };
     if (m_swapchain_capabilities.currentExtent.width != UINT32_MAX) {
         m_swapchain_extent = m_swapchain_capabilities.currentExtent;
     }
 
-    // swapchain min image count
-    uint32_t image_count = m_swapchain_capabilities.minImageCount + 1;
-    if (m_swapchain_capabilities.minImageCount > 0 && image_count > m_swapchain_capabilities.maxImageCount) {
+    // swapchain image count, low latency keeps the queue as short as the
+    // driver allows
+    uint32_t image_count = m_swapchain_image_count_requested;
+    if (image_count == 0) {
+        image_count = m_swapchain_capabilities.minImageCount;
+        if (m_present_policy != PRESENT_POLICY_LOW_LATENCY) image_count++;
+    }
+    image_count = std::max(image_count, m_swapchain_capabilities.minImageCount);
+    if (m_swapchain_capabilities.maxImageCount > 0 && image_count > m_swapchain_capabilities.maxImageCount) {
         image_count = m_swapchain_capabilities.maxImageCount;
     }
 
+    // how many frames the cpu may record ahead of the gpu
+    m_frames_in_flight = m_present_policy == PRESENT_POLICY_LOW_LATENCY ? m_frame_latency : 2;
+
     // create swapchain
     VkSwapchainCreateInfoKHR swapchain_create_info = {};
     swapchain_create_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
@@ -580,7 +1127,7 @@ ex::vulkan::backend::create_swapchain(uint32_t width, uint32_t height) {
     swapchain_create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
     swapchain_create_info.presentMode = m_swapchain_present_mode;
     swapchain_create_info.clipped = VK_TRUE;
-    swapchain_create_info.oldSwapchain = nullptr;
+    swapchain_create_info.oldSwapchain = m_swapchain;
 
     VK_CHECK(vkCreateSwapchainKHR(m_logical_device,
                                   &swapchain_create_info,
@@ -619,22 +1166,12 @@ ex::vulkan::backend::create_depth_resources() {
 
     VkImageTiling tiling = VK_IMAGE_TILING_OPTIMAL;
     VkFormatFeatureFlags feature = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    if (m_depth_sampled) feature |= VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
 
     // FIND SUPPORTED FORMAT
     bool found = false;
     for (uint32_t i = 0; i < formats.size(); ++i) {
-        VkFormatProperties format_properties;
-        vkGetPhysicalDeviceFormatProperties(m_physical_device,
-                                            formats[i],
-                                            &format_properties);
-        
-        if (tiling == VK_IMAGE_TILING_LINEAR &&
-            (format_properties.linearTilingFeatures & feature) == feature) {
-            m_depth_format = formats[i];
-            found = true;
-            break;
-        } else if (tiling == VK_IMAGE_TILING_OPTIMAL &&
-                   (format_properties.optimalTilingFeatures & feature) == feature) {
+        if (format_supported(formats[i], tiling, feature)) {
             m_depth_format = formats[i];
             found = true;
             break;
@@ -660,6 +1197,7 @@ ex::vulkan::backend::create_depth_resources() {
     image_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
     image_create_info.tiling = tiling;
     image_create_info.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    if (m_depth_sampled) image_create_info.usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
     image_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     image_create_info.queueFamilyIndexCount = 0;
     image_create_info.pQueueFamilyIndices = nullptr;
@@ -675,19 +1213,9 @@ ex::vulkan::backend::create_depth_resources() {
                                  &memory_requirements);
 
     VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
-    uint32_t memory_type_index = get_memory_type_index(memory_requirements, properties);
-    
-    VkMemoryAllocateInfo memory_allocate_info = {};
-    memory_allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    memory_allocate_info.pNext = nullptr;
-    memory_allocate_info.allocationSize = memory_requirements.size;
-    memory_allocate_info.memoryTypeIndex = memory_type_index;
-    VK_CHECK(vkAllocateMemory(m_logical_device,
-                              &memory_allocate_info,
-                              m_allocator,
-                              &m_depth_image_memory));
+    m_depth_image_memory = allocate_memory(memory_requirements, properties, MEMORY_CATEGORY_ATTACHMENT, MEMORY_RESOURCE_IMAGE);
 
-    vkBindImageMemory(m_logical_device, m_depth_image, m_depth_image_memory, 0);
+    vkBindImageMemory(m_logical_device, m_depth_image, m_depth_image_memory.memory, m_depth_image_memory.offset);
     
     VkImageViewCreateInfo image_view_create_info = {};
     image_view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -717,11 +1245,25 @@ void
 ex::vulkan::backend::destroy_depth_resources() {
     if (m_depth_image_view) vkDestroyImageView(m_logical_device, m_depth_image_view, m_allocator);
     if (m_depth_image) vkDestroyImage(m_logical_device, m_depth_image, m_allocator);
-    if (m_depth_image_memory) vkFreeMemory(m_logical_device, m_depth_image_memory, m_allocator);
+    if (m_depth_image_memory.memory) free_memory(m_depth_image_memory);
+    m_depth_image_memory = {};
 }
 
 void
 ex::vulkan::backend::create_render_pass() {
+    // headless frames are left ready to be copied out
+    VkImageLayout output_layout = m_headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    m_render_pass = create_main_render_pass(output_layout);
+
+    // same attachments as the main pass, so every pipeline works in both
+    if (m_dynamic_resolution) {
+        m_scene_render_pass = create_main_render_pass(VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        m_present_render_pass = create_present_render_pass();
+    }
+}
+
+VkRenderPass
+ex::vulkan::backend::create_main_render_pass(VkImageLayout color_final_layout) {
     VkAttachmentDescription color_attachment_description = {};
     color_attachment_description.flags = 0;
     color_attachment_description.format = m_swapchain_format.format;
@@ -731,14 +1273,14 @@ ex::vulkan::backend::create_render_pass() {
     color_attachment_description.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     color_attachment_description.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     color_attachment_description.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    color_attachment_description.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    color_attachment_description.finalLayout = color_final_layout;
 
     VkAttachmentDescription depth_attachment_description = {};
     depth_attachment_description.flags = 0;
     depth_attachment_description.format = m_depth_format;
     depth_attachment_description.samples = VK_SAMPLE_COUNT_1_BIT;
     depth_attachment_description.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    depth_attachment_description.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depth_attachment_description.storeOp = m_depth_sampled ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
     depth_attachment_description.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     depth_attachment_description.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     depth_attachment_description.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -777,6 +1319,26 @@ ex::vulkan::backend::create_render_pass() {
     subpass_dependency.srcAccessMask = 0;
     subpass_dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
     subpass_dependency.dependencyFlags = 0;
+
+    // a sampled colour output is read by the present pass right after
+    VkSubpassDependency sampled_dependency = {};
+    sampled_dependency.srcSubpass = 0;
+    sampled_dependency.dstSubpass = VK_SUBPASS_EXTERNAL;
+    sampled_dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    sampled_dependency.dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    sampled_dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    sampled_dependency.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    sampled_dependency.dependencyFlags = 0;
+
+    // and the previous frame's present pass has to be done reading it
+    // before the clear
+    bool sampled = color_final_layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    if (sampled) subpass_dependency.srcStageMask |= VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+
+    std::array<VkSubpassDependency, 2> dependencies = {
+        subpass_dependency,
+        sampled_dependency,
+    };
     
     VkRenderPassCreateInfo render_pass_create_info = {};
     render_pass_create_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
@@ -786,12 +1348,73 @@ ex::vulkan::backend::create_render_pass() {
     render_pass_create_info.pAttachments = attachments.data();
     render_pass_create_info.subpassCount = 1;
     render_pass_create_info.pSubpasses = &subpass_description;
+    render_pass_create_info.dependencyCount = sampled ? 2 : 1;
+    render_pass_create_info.pDependencies = dependencies.data();
+
+    VkRenderPass out_render_pass = VK_NULL_HANDLE;
+    VK_CHECK(vkCreateRenderPass(m_logical_device,
+                                &render_pass_create_info,
+                                m_allocator,
+                                &out_render_pass));
+    return out_render_pass;
+}
+
+VkRenderPass
+ex::vulkan::backend::create_present_render_pass() {
+    VkAttachmentDescription color_attachment_description = {};
+    color_attachment_description.flags = 0;
+    color_attachment_description.format = m_swapchain_format.format;
+    color_attachment_description.samples = VK_SAMPLE_COUNT_1_BIT;
+    color_attachment_description.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    color_attachment_description.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    color_attachment_description.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    color_attachment_description.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    color_attachment_description.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    color_attachment_description.finalLayout = m_headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+    VkAttachmentReference color_attachment_reference = {};
+    color_attachment_reference.attachment = 0;
+    color_attachment_reference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    VkSubpassDescription subpass_description = {};
+    subpass_description.flags = 0;
+    subpass_description.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass_description.inputAttachmentCount = 0;
+    subpass_description.pInputAttachments = nullptr;
+    subpass_description.colorAttachmentCount = 1;
+    subpass_description.pColorAttachments = &color_attachment_reference;
+    subpass_description.pResolveAttachments = nullptr;
+    subpass_description.pDepthStencilAttachment = nullptr;
+    subpass_description.preserveAttachmentCount = 0;
+    subpass_description.pPreserveAttachments  = nullptr;
+
+    // waits on the acquire semaphore like the main pass would
+    VkSubpassDependency subpass_dependency = {};
+    subpass_dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+    subpass_dependency.dstSubpass = 0;
+    subpass_dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    subpass_dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    subpass_dependency.srcAccessMask = 0;
+    subpass_dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    subpass_dependency.dependencyFlags = 0;
+
+    VkRenderPassCreateInfo render_pass_create_info = {};
+    render_pass_create_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    render_pass_create_info.pNext = nullptr;
+    render_pass_create_info.flags = 0;
+    render_pass_create_info.attachmentCount = 1;
+    render_pass_create_info.pAttachments = &color_attachment_description;
+    render_pass_create_info.subpassCount = 1;
+    render_pass_create_info.pSubpasses = &subpass_description;
     render_pass_create_info.dependencyCount = 1;
     render_pass_create_info.pDependencies = &subpass_dependency;
+
+    VkRenderPass out_render_pass = VK_NULL_HANDLE;
     VK_CHECK(vkCreateRenderPass(m_logical_device,
                                 &render_pass_create_info,
                                 m_allocator,
-                                &m_render_pass));
+                                &out_render_pass));
+    return out_render_pass;
 }
 
 void
@@ -820,58 +1443,229 @@ ex::vulkan::backend::create_framebuffers() {
     }
 }
 
+void
+ex::vulkan::backend::create_scene_targets() {
+    // full swapchain size, the render scale only changes the area drawn so
+    // nothing is reallocated while the controller moves it
+    VkImageCreateInfo image_create_info = {};
+    image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_create_info.pNext = nullptr;
+    image_create_info.flags = 0;
+    image_create_info.imageType = VK_IMAGE_TYPE_2D;
+    image_create_info.format = m_swapchain_format.format;
+    image_create_info.extent.width = m_swapchain_extent.width;
+    image_create_info.extent.height = m_swapchain_extent.height;
+    image_create_info.extent.depth = 1;
+    image_create_info.mipLevels = 1;
+    image_create_info.arrayLayers = 1;
+    image_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_create_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    image_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_create_info.queueFamilyIndexCount = 0;
+    image_create_info.pQueueFamilyIndices = nullptr;
+    image_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VK_CHECK(vkCreateImage(m_logical_device,
+                           &image_create_info,
+                           m_allocator,
+                           &m_scene_color_image));
+
+    VkMemoryRequirements memory_requirements;
+    vkGetImageMemoryRequirements(m_logical_device,
+                                 m_scene_color_image,
+                                 &memory_requirements);
+
+    m_scene_color_memory = allocate_memory(memory_requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MEMORY_CATEGORY_ATTACHMENT, MEMORY_RESOURCE_IMAGE);
+    vkBindImageMemory(m_logical_device, m_scene_color_image, m_scene_color_memory.memory, m_scene_color_memory.offset);
+
+    m_scene_color_view = create_image_view(m_scene_color_image,
+                                           VK_IMAGE_VIEW_TYPE_2D,
+                                           m_swapchain_format.format,
+                                           VK_IMAGE_ASPECT_COLOR_BIT);
+
+    std::array<VkImageView, 2> scene_attachments = {
+        m_scene_color_view,
+        m_depth_image_view,
+    };
+
+    VkFramebufferCreateInfo framebuffer_create_info = {};
+    framebuffer_create_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebuffer_create_info.pNext = nullptr;
+    framebuffer_create_info.flags = 0;
+    framebuffer_create_info.renderPass = m_scene_render_pass;
+    framebuffer_create_info.attachmentCount = static_cast<uint32_t>(scene_attachments.size());
+    framebuffer_create_info.pAttachments = scene_attachments.data();
+    framebuffer_create_info.width = m_swapchain_extent.width;
+    framebuffer_create_info.height = m_swapchain_extent.height;
+    framebuffer_create_info.layers = 1;
+    VK_CHECK(vkCreateFramebuffer(m_logical_device,
+                                 &framebuffer_create_info,
+                                 m_allocator,
+                                 &m_scene_framebuffer));
+
+    m_present_framebuffers.resize(m_swapchain_images.size());
+    for (uint32_t i = 0; i < m_swapchain_images.size(); i++) {
+        framebuffer_create_info.renderPass = m_present_render_pass;
+        framebuffer_create_info.attachmentCount = 1;
+        framebuffer_create_info.pAttachments = &m_swapchain_image_views[i];
+        VK_CHECK(vkCreateFramebuffer(m_logical_device,
+                                     &framebuffer_create_info,
+                                     m_allocator,
+                                     &m_present_framebuffers[i]));
+    }
+}
+
 void
 ex::vulkan::backend::create_sync_structures() {
     VkFenceCreateInfo fence_create_info = {};
     fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
     fence_create_info.pNext = nullptr;
     fence_create_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-    VK_CHECK(vkCreateFence(m_logical_device,
-                           &fence_create_info,
-                           m_allocator,
-                           &m_fence));
 
     VkSemaphoreCreateInfo semaphore_create_info = {};
     semaphore_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
     semaphore_create_info.pNext = nullptr; 
     semaphore_create_info.flags = 0;
-    VK_CHECK(vkCreateSemaphore(m_logical_device,
-                               &semaphore_create_info,
-                               m_allocator,
-                               &m_semaphore_present));
 
-    VK_CHECK(vkCreateSemaphore(m_logical_device,
-                               &semaphore_create_info,
+    // every slot exists up front so the policy can change the active count
+    for (frame_context &frame : m_frames) {
+        VK_CHECK(vkCreateFence(m_logical_device,
+                               &fence_create_info,
                                m_allocator,
-                               &m_semaphore_render));
+                               &frame.fence));
+
+        VK_CHECK(vkCreateSemaphore(m_logical_device,
+                                   &semaphore_create_info,
+                                   m_allocator,
+                                   &frame.semaphore_acquire));
+    }
+
+    // two timestamps per gpu zone
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(m_physical_device, &properties);
+    m_timestamp_period = properties.limits.timestampPeriod;
+
+    // the queue family decides how many bits of a timestamp are meaningful,
+    // zero means the queue doesn't write them at all
+    uint32_t queue_family_property_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(m_physical_device, &queue_family_property_count, nullptr);
+    std::vector<VkQueueFamilyProperties> queue_family_properties(queue_family_property_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(m_physical_device, &queue_family_property_count, queue_family_properties.data());
+    uint32_t timestamp_valid_bits = queue_family_properties[m_graphics_queue_index].timestampValidBits;
+    m_timestamp_mask = timestamp_valid_bits >= 64 ? UINT64_MAX : (uint64_t(1) << timestamp_valid_bits) - 1;
+    m_timestamps_supported = properties.limits.timestampComputeAndGraphics && timestamp_valid_bits != 0;
+    if (m_timestamps_supported) {
+        VkQueryPoolCreateInfo query_pool_create_info = {};
+        query_pool_create_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        query_pool_create_info.pNext = nullptr;
+        query_pool_create_info.flags = 0;
+        query_pool_create_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        query_pool_create_info.queryCount = max_gpu_zones * 2;
+        for (frame_context &frame : m_frames) {
+            VK_CHECK(vkCreateQueryPool(m_logical_device,
+                                       &query_pool_create_info,
+                                       m_allocator,
+                                       &frame.timestamp_pool));
+            frame.gpu_zone_names.reserve(max_gpu_zones);
+        }
+    } else {
+        EXWARN("Graphics queue does not support timestamps, gpu zones unavailable");
+    }
+
+    create_render_semaphores();
+}
+
+void
+ex::vulkan::backend::create_render_semaphores() {
+    VkSemaphoreCreateInfo semaphore_create_info = {};
+    semaphore_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphore_create_info.pNext = nullptr; 
+    semaphore_create_info.flags = 0;
+
+    m_semaphores_render.resize(m_swapchain_images.size());
+    for (VkSemaphore &semaphore : m_semaphores_render) {
+        VK_CHECK(vkCreateSemaphore(m_logical_device,
+                                   &semaphore_create_info,
+                                   m_allocator,
+                                   &semaphore));
+    }
+
+    m_image_fences.assign(m_swapchain_images.size(), VK_NULL_HANDLE);
+}
+
+void
+ex::vulkan::backend::destroy_render_semaphores() {
+    for (VkSemaphore semaphore : m_semaphores_render) {
+        vkDestroySemaphore(m_logical_device, semaphore, m_allocator);
+    }
+    m_semaphores_render.clear();
+    m_image_fences.clear();
 }
 
 void
 ex::vulkan::backend::allocate_command_buffers() {
-    m_command_buffers.resize(m_swapchain_images.size());
+    std::array<VkCommandBuffer, max_frames_in_flight> command_buffers;
     
     VkCommandBufferAllocateInfo command_buffer_allocate_info = {};
     command_buffer_allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     command_buffer_allocate_info.commandPool = m_command_pool;
     command_buffer_allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    command_buffer_allocate_info.commandBufferCount = static_cast<uint32_t>(m_command_buffers.size());
+    command_buffer_allocate_info.commandBufferCount = static_cast<uint32_t>(command_buffers.size());
     VK_CHECK(vkAllocateCommandBuffers(m_logical_device,
                                       &command_buffer_allocate_info,
-                                      m_command_buffers.data()));
+                                      command_buffers.data()));
+
+    for (uint32_t i = 0; i < max_frames_in_flight; i++) {
+        m_frames[i].command_buffer = command_buffers[i];
+    }
+}
+
+void
+ex::vulkan::backend::create_workers() {
+    // the calling thread waits in record_parallel, so it doesn't count
+    uint32_t worker_count = m_worker_count_requested;
+    if (worker_count == 0) {
+        uint32_t hardware_threads = std::thread::hardware_concurrency();
+        worker_count = hardware_threads > 1 ? hardware_threads - 1 : 1;
+    }
+
+    m_workers.resize(worker_count * max_frames_in_flight);
+    for (worker_context &worker : m_workers) {
+        VkCommandPoolCreateInfo command_pool_create_info = {};
+        command_pool_create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        command_pool_create_info.pNext = nullptr;
+        command_pool_create_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        command_pool_create_info.queueFamilyIndex = m_graphics_queue_index;
+        VK_CHECK(vkCreateCommandPool(m_logical_device,
+                                     &command_pool_create_info,
+                                     m_allocator,
+                                     &worker.command_pool));
+        worker.used_command_buffers = 0;
+    }
+
+    m_thread_pool.create(worker_count);
+    EXDEBUG("Command recording workers: %u", worker_count);
+}
+
+void
+ex::vulkan::backend::destroy_workers() {
+    m_thread_pool.destroy();
+    for (worker_context &worker : m_workers) {
+        // destroying the pool frees its command buffers
+        if (worker.command_pool) vkDestroyCommandPool(m_logical_device, worker.command_pool, m_allocator);
+    }
+    m_workers.clear();
 }
 
 uint32_t
 ex::vulkan::backend::get_memory_type_index(VkMemoryRequirements memory_requirements,
                                            VkMemoryPropertyFlags properties) {
-    VkPhysicalDeviceMemoryProperties memory_properties;
-    vkGetPhysicalDeviceMemoryProperties(m_physical_device, &memory_properties);
-    
     uint32_t index = 0;
     
     bool found = false;
-    for (uint32_t i = 0; i < memory_properties.memoryTypeCount; ++i) {
+    for (uint32_t i = 0; i < m_memory_properties.memoryTypeCount; ++i) {
         if ((memory_requirements.memoryTypeBits & (1 << i)) &&
-            (memory_properties.memoryTypes[i].propertyFlags & properties) == properties) {
+            (m_memory_properties.memoryTypes[i].propertyFlags & properties) == properties) {
             found = true;
             index = i;
             break;
@@ -885,6 +1679,569 @@ ex::vulkan::backend::get_memory_type_index(VkMemoryRequirements memory_requireme
     return index;
 }
 
+ex::vulkan::memory_allocation
+ex::vulkan::backend::allocate_memory(VkMemoryRequirements memory_requirements,
+                                     VkMemoryPropertyFlags properties,
+                                     ex::vulkan::memory_category category,
+                                     ex::vulkan::memory_resource resource) {
+    uint32_t memory_type_index = get_memory_type_index(memory_requirements, properties);
+    ex::vulkan::memory_allocation out_allocation = {};
+    
+    {
+        std::lock_guard<std::mutex> lock(m_memory_mutex);
+
+        memory_record record = {};
+        record.live = true;
+        record.size = memory_requirements.size;
+        record.alignment = memory_requirements.alignment;
+        record.memory_type_index = memory_type_index;
+        record.category = category;
+
+        // attachments get recreated with the swapchain and big resources
+        // would waste most of a block, both get their own memory
+        bool dedicated = category == MEMORY_CATEGORY_ATTACHMENT || memory_requirements.size > m_memory_block_size / 2;
+        void *mapped = nullptr;
+        
+        if (dedicated) {
+            record.memory = allocate_device_memory(memory_type_index, memory_requirements.size, &mapped);
+            record.offset = 0;
+        } else {
+            uint64_t offset = ex::range_allocator::invalid_offset;
+            for (auto &block : m_memory_blocks) {
+                if (block->memory_type_index != memory_type_index || block->resource != resource) continue;
+                offset = block->ranges.allocate(memory_requirements.size, memory_requirements.alignment);
+                if (offset != ex::range_allocator::invalid_offset) {
+                    record.block = block.get();
+                    break;
+                }
+            }
+
+            if (!record.block) {
+                auto block = std::make_unique<memory_block>();
+                block->memory = allocate_device_memory(memory_type_index, m_memory_block_size, &block->mapped);
+                block->memory_type_index = memory_type_index;
+                block->resource = resource;
+                block->allocation_count = 0;
+                block->pending_moves = 0;
+                block->ranges.create(m_memory_block_size);
+                offset = block->ranges.allocate(memory_requirements.size, memory_requirements.alignment);
+                record.block = block.get();
+                m_memory_blocks.push_back(std::move(block));
+                m_memory_stats.block_count++;
+                m_memory_stats.block_size += m_memory_block_size;
+            }
+
+            record.block->allocation_count++;
+            record.memory = record.block->memory;
+            record.offset = offset;
+            if (record.block->mapped) mapped = static_cast<uint8_t *>(record.block->mapped) + offset;
+            m_memory_stats.block_used += record.size;
+        }
+
+        uint32_t id;
+        if (!m_free_memory_records.empty()) {
+            id = m_free_memory_records.back();
+            m_free_memory_records.pop_back();
+            m_memory_records[id] = record;
+        } else {
+            id = static_cast<uint32_t>(m_memory_records.size());
+            m_memory_records.push_back(record);
+        }
+
+        memory_category_stats &stats = m_memory_stats.categories[category];
+        stats.usage += record.size;
+        stats.peak = std::max(stats.peak, stats.usage);
+        stats.allocation_count++;
+        stats.peak_allocation_count = std::max(stats.peak_allocation_count, stats.allocation_count);
+
+        m_memory_stats.total_usage += record.size;
+        m_memory_stats.total_peak = std::max(m_memory_stats.total_peak, m_memory_stats.total_usage);
+        m_memory_stats.allocation_count++;
+
+        out_allocation.memory = record.memory;
+        out_allocation.offset = record.offset;
+        out_allocation.size = record.size;
+        out_allocation.mapped = mapped;
+        out_allocation.id = id;
+    }
+
+    return out_allocation;
+}
+
+void
+ex::vulkan::backend::free_memory(const ex::vulkan::memory_allocation &allocation) {
+    std::lock_guard<std::mutex> lock(m_memory_mutex);
+
+    if (allocation.id >= m_memory_records.size() || !m_memory_records[allocation.id].live) {
+        EXWARN("Freeing untracked device memory");
+        return;
+    }
+
+    memory_record &record = m_memory_records[allocation.id];
+    m_memory_stats.categories[record.category].usage -= record.size;
+    m_memory_stats.categories[record.category].allocation_count--;
+    m_memory_stats.total_usage -= record.size;
+    m_memory_stats.allocation_count--;
+
+    if (!record.block) {
+        free_device_memory(record.memory, record.memory_type_index, record.size);
+    } else {
+        memory_block *block = record.block;
+        block->ranges.free(record.offset, record.size);
+        block->allocation_count--;
+        m_memory_stats.block_used -= record.size;
+
+        // keep one empty block per pool around so a free/allocate pair in
+        // the same frame doesn't hit vkAllocateMemory
+        bool has_sibling = false;
+        for (auto &other : m_memory_blocks) {
+            if (other.get() != block &&
+                other->memory_type_index == block->memory_type_index &&
+                other->resource == block->resource) {
+                has_sibling = true;
+                break;
+            }
+        }
+        
+        if (block->allocation_count == 0 && has_sibling) {
+            free_device_memory(block->memory, block->memory_type_index, block->ranges.size());
+            m_memory_stats.block_count--;
+            m_memory_stats.block_size -= block->ranges.size();
+            m_memory_blocks.erase(std::find_if(m_memory_blocks.begin(), m_memory_blocks.end(),
+                                               [block](const std::unique_ptr<memory_block> &other) { return other.get() == block; }));
+        }
+    }
+
+    record = {};
+    m_free_memory_records.push_back(allocation.id);
+
+    // the resource's handle value can come back for a new one, which must
+    // not hit a set written for the old
+    m_frames[m_frame_index].transient_sets.clear();
+}
+
+void
+ex::vulkan::backend::set_memory_block_size(VkDeviceSize block_size) {
+    m_memory_block_size = block_size;
+}
+
+void
+ex::vulkan::backend::set_memory_owner(const ex::vulkan::memory_allocation &allocation,
+                                      ex::vulkan::buffer *owner) {
+    std::lock_guard<std::mutex> lock(m_memory_mutex);
+    m_memory_records[allocation.id].buffer_owner = owner;
+}
+
+void
+ex::vulkan::backend::set_memory_owner(const ex::vulkan::memory_allocation &allocation,
+                                      ex::vulkan::image *owner) {
+    std::lock_guard<std::mutex> lock(m_memory_mutex);
+    m_memory_records[allocation.id].image_owner = owner;
+}
+
+VkDeviceMemory
+ex::vulkan::backend::allocate_device_memory(uint32_t memory_type_index,
+                                            VkDeviceSize size,
+                                            void **mapped) {
+    VkMemoryAllocateInfo memory_allocate_info = {};
+    memory_allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    memory_allocate_info.pNext = nullptr;
+    memory_allocate_info.allocationSize = size;
+    memory_allocate_info.memoryTypeIndex = memory_type_index;
+
+    VkDeviceMemory out_memory;
+    VK_CHECK(vkAllocateMemory(m_logical_device,
+                              &memory_allocate_info,
+                              m_allocator,
+                              &out_memory));
+
+    *mapped = nullptr;
+    if (m_memory_properties.memoryTypes[memory_type_index].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        VK_CHECK(vkMapMemory(m_logical_device, out_memory, 0, VK_WHOLE_SIZE, 0, mapped));
+    }
+
+    memory_heap_stats &heap = m_memory_stats.heaps[m_memory_properties.memoryTypes[memory_type_index].heapIndex];
+    heap.tracked_usage += size;
+    heap.tracked_peak = std::max(heap.tracked_peak, heap.tracked_usage);
+    heap.allocation_count++;
+
+    return out_memory;
+}
+
+void
+ex::vulkan::backend::free_device_memory(VkDeviceMemory memory,
+                                        uint32_t memory_type_index,
+                                        VkDeviceSize size) {
+    memory_heap_stats &heap = m_memory_stats.heaps[m_memory_properties.memoryTypes[memory_type_index].heapIndex];
+    heap.tracked_usage -= size;
+    heap.allocation_count--;
+
+    // freeing implicitly unmaps
+    vkFreeMemory(m_logical_device, memory, m_allocator);
+}
+
+void
+ex::vulkan::backend::set_defragmentation(bool enable,
+                                         VkDeviceSize bytes_per_frame,
+                                         float block_threshold) {
+    m_defrag_enabled = enable;
+    m_defrag_bytes_per_frame = bytes_per_frame;
+    m_defrag_block_threshold = block_threshold;
+}
+
+ex::vulkan::backend::memory_block *
+ex::vulkan::backend::find_defragment_source() {
+    // the emptiest sparse block whose allocations can all move, as long as
+    // the rest of its pool has room for them. emptying it lets it go back
+    // to the driver
+    memory_block *out_block = nullptr;
+    
+    for (auto &block : m_memory_blocks) {
+        if (block->allocation_count == 0 || block->pending_moves > 0) continue;
+        
+        float ratio = (float) block->ranges.used() / (float) block->ranges.size();
+        if (ratio >= m_defrag_block_threshold) continue;
+        if (out_block && block->ranges.used() >= out_block->ranges.used()) continue;
+
+        bool movable = true;
+        for (const memory_record &record : m_memory_records) {
+            if (record.live && record.block == block.get() && !record.buffer_owner && !record.image_owner) {
+                movable = false;
+                break;
+            }
+        }
+        if (!movable) continue;
+
+        VkDeviceSize pool_free = 0;
+        for (auto &other : m_memory_blocks) {
+            if (other.get() != block.get() &&
+                other->memory_type_index == block->memory_type_index &&
+                other->resource == block->resource) {
+                pool_free += other->ranges.size() - other->ranges.used();
+            }
+        }
+        if (pool_free < block->ranges.used()) continue;
+
+        out_block = block.get();
+    }
+
+    return out_block;
+}
+
+uint32_t
+ex::vulkan::backend::defragment(VkCommandBuffer command_buffer, VkDeviceSize max_bytes) {
+    EXPROFILE_FUNCTION();
+    struct move {
+        uint32_t id;
+        memory_block *destination;
+        VkDeviceSize offset;
+    };
+
+    std::vector<move> moves;
+    memory_block *source = nullptr;
+    VkDeviceSize moved_bytes = 0;
+    
+    {
+        std::lock_guard<std::mutex> lock(m_memory_mutex);
+        source = find_defragment_source();
+        if (!source) return 0;
+
+        // fullest blocks first so the live set packs into as few as possible
+        std::vector<memory_block *> destinations;
+        for (auto &block : m_memory_blocks) {
+            if (block.get() != source &&
+                block->memory_type_index == source->memory_type_index &&
+                block->resource == source->resource) {
+                destinations.push_back(block.get());
+            }
+        }
+        std::sort(destinations.begin(), destinations.end(), [](memory_block *a, memory_block *b) {
+            return a->ranges.used() > b->ranges.used();
+        });
+
+        for (uint32_t id = 0; id < m_memory_records.size(); id++) {
+            memory_record &record = m_memory_records[id];
+            if (!record.live || record.block != source) continue;
+            if (!moves.empty() && moved_bytes + record.size > max_bytes) break;
+
+            for (memory_block *destination : destinations) {
+                uint64_t offset = destination->ranges.allocate(record.size, record.alignment);
+                if (offset == ex::range_allocator::invalid_offset) continue;
+                moves.push_back({id, destination, offset});
+                moved_bytes += record.size;
+                break;
+            }
+        }
+    }
+    
+    if (moves.empty()) return 0;
+
+    // the copies go into the frame's own command buffer. earlier frames may
+    // still be writing the old ranges, so wait on everything submitted before
+    VkMemoryBarrier memory_barrier = {};
+    memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memory_barrier.pNext = nullptr;
+    memory_barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+    memory_barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(command_buffer,
+                         VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0,
+                         1, &memory_barrier,
+                         0, nullptr,
+                         0, nullptr);
+
+    // owners record their copies and defer_destroy the old handles, which
+    // other slots' frames may still be reading
+    for (const move &m : moves) {
+        memory_record &record = m_memory_records[m.id];
+        
+        ex::vulkan::memory_allocation allocation = {};
+        allocation.memory = m.destination->memory;
+        allocation.offset = m.offset;
+        allocation.size = record.size;
+        allocation.mapped = m.destination->mapped ? static_cast<uint8_t *>(m.destination->mapped) + m.offset : nullptr;
+        allocation.id = m.id;
+
+        if (record.buffer_owner) record.buffer_owner->relocate(this, command_buffer, allocation);
+        else if (record.image_owner) record.image_owner->relocate(this, command_buffer, allocation);
+    }
+
+    memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    memory_barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+    vkCmdPipelineBarrier(command_buffer,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                         0,
+                         1, &memory_barrier,
+                         0, nullptr,
+                         0, nullptr);
+
+    std::vector<std::pair<VkDeviceSize, VkDeviceSize>> old_ranges;
+    old_ranges.reserve(moves.size());
+    {
+        std::lock_guard<std::mutex> lock(m_memory_mutex);
+        for (const move &m : moves) {
+            memory_record &record = m_memory_records[m.id];
+            old_ranges.emplace_back(record.offset, record.size);
+            m.destination->allocation_count++;
+            record.block = m.destination;
+            record.memory = m.destination->memory;
+            record.offset = m.offset;
+        }
+        source->pending_moves++;
+
+        m_memory_stats.defrag_moves += static_cast<uint32_t>(moves.size());
+        m_memory_stats.defrag_bytes += moved_bytes;
+    }
+
+    // the old ranges stay allocated, and counted in the source, until this
+    // slot comes around again. by then every frame that could read them has
+    // finished, and the source goes back to the driver once it is empty
+    defer_destroy([this, source, old_ranges]() {
+        std::lock_guard<std::mutex> lock(m_memory_mutex);
+        for (const auto &range : old_ranges) {
+            source->ranges.free(range.first, range.second);
+        }
+        source->allocation_count -= static_cast<uint32_t>(old_ranges.size());
+        source->pending_moves--;
+
+        if (source->allocation_count == 0) {
+            VkDeviceSize block_size = source->ranges.size();
+            free_device_memory(source->memory, source->memory_type_index, block_size);
+            m_memory_stats.block_count--;
+            m_memory_stats.block_size -= block_size;
+            m_memory_blocks.erase(std::find_if(m_memory_blocks.begin(), m_memory_blocks.end(),
+                                               [source](const std::unique_ptr<memory_block> &other) { return other.get() == source; }));
+        }
+    });
+
+    // moved owners have new handles, sets written for the old ones go
+    m_frames[m_frame_index].transient_sets.clear();
+    for (auto &listener : m_relocation_listeners) {
+        listener.second();
+    }
+
+    EXDEBUG("Defragmented %u allocations, %.2f MiB", static_cast<uint32_t>(moves.size()),
+            (float) moved_bytes / (1024.0f * 1024.0f));
+    return static_cast<uint32_t>(moves.size());
+}
+
+uint32_t
+ex::vulkan::backend::add_relocation_listener(std::function<void()> listener) {
+    uint32_t id = m_next_relocation_listener++;
+    m_relocation_listeners[id] = listener;
+    return id;
+}
+
+void
+ex::vulkan::backend::remove_relocation_listener(uint32_t id) {
+    m_relocation_listeners.erase(id);
+}
+
+VkDescriptorSet
+ex::vulkan::backend::transient_set(VkDescriptorSetLayout layout,
+                                   ex::utils::span<const ex::vulkan::descriptor_set_cache::write> writes) {
+    frame_context &frame = m_frames[m_frame_index];
+    return frame.transient_sets.get(this, &frame.transient_descriptors, layout, writes);
+}
+
+void
+ex::vulkan::backend::defer_destroy(std::function<void()> destroy) {
+    // runs once the current slot's fence signals again, every frame
+    // submitted before that has finished by then
+    m_frames[m_frame_index].deferred_destroys.push_back(destroy);
+}
+
+void
+ex::vulkan::backend::flush_deferred_destroys() {
+    for (uint32_t i = 0; i < max_frames_in_flight; i++) {
+        flush_frame_destroys(i);
+    }
+}
+
+void
+ex::vulkan::backend::flush_frame_destroys(uint32_t frame) {
+    for (auto &destroy : m_frames[frame].deferred_destroys) {
+        destroy();
+    }
+    m_frames[frame].deferred_destroys.clear();
+}
+
+ex::vulkan::memory_stats
+ex::vulkan::backend::get_memory_stats() {
+    ex::vulkan::memory_stats out_stats;
+    {
+        std::lock_guard<std::mutex> lock(m_memory_mutex);
+        out_stats = m_memory_stats;
+    }
+
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budget_properties = {};
+    budget_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+    if (m_memory_budget_supported) {
+        VkPhysicalDeviceMemoryProperties2 memory_properties = {};
+        memory_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+        memory_properties.pNext = &budget_properties;
+        vkGetPhysicalDeviceMemoryProperties2(m_physical_device, &memory_properties);
+    }
+
+    out_stats.budget_available = m_memory_budget_supported;
+    out_stats.heap_count = m_memory_properties.memoryHeapCount;
+    for (uint32_t i = 0; i < out_stats.heap_count; i++) {
+        memory_heap_stats &heap = out_stats.heaps[i];
+        heap.flags = m_memory_properties.memoryHeaps[i].flags;
+        heap.size = m_memory_properties.memoryHeaps[i].size;
+        if (m_memory_budget_supported) {
+            heap.budget = budget_properties.heapBudget[i];
+            heap.usage = budget_properties.heapUsage[i];
+        } else {
+            heap.budget = heap.size;
+            heap.usage = heap.tracked_usage;
+        }
+    }
+
+    return out_stats;
+}
+
+void
+ex::vulkan::backend::print_memory_stats() {
+    ex::vulkan::memory_stats stats = get_memory_stats();
+    const float mib = 1024.0f * 1024.0f;
+
+    EXINFO("-+GPU_MEMORY+- %.2f MiB in %u allocations (peak %.2f MiB)%s",
+           (float) stats.total_usage / mib, stats.allocation_count, (float) stats.total_peak / mib,
+           stats.budget_available ? "" : " [no budget extension]");
+
+    for (uint32_t i = 0; i < stats.heap_count; i++) {
+        const memory_heap_stats &heap = stats.heaps[i];
+        EXINFO("  heap %u%s: %.2f / %.2f MiB budget (%.2f MiB heap), ours %.2f MiB in %u (peak %.2f MiB)",
+               i, (heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? " [device]" : " [host]",
+               (float) heap.usage / mib, (float) heap.budget / mib, (float) heap.size / mib,
+               (float) heap.tracked_usage / mib, heap.allocation_count, (float) heap.tracked_peak / mib);
+    }
+
+    if (stats.block_count > 0) {
+        EXINFO("  blocks: %u, %.2f / %.2f MiB used (%.0f%%), defrag moved %u (%.2f MiB)",
+               stats.block_count, (float) stats.block_used / mib, (float) stats.block_size / mib,
+               100.0f * (float) stats.block_used / (float) stats.block_size,
+               stats.defrag_moves, (float) stats.defrag_bytes / mib);
+    }
+
+    for (uint32_t i = 0; i < MEMORY_CATEGORY_MAX_COUNT; i++) {
+        const memory_category_stats &category = stats.categories[i];
+        if (category.peak == 0) continue;
+        EXINFO("  %-10s %.2f MiB in %u (peak %.2f MiB in %u)",
+               memory_category_name(static_cast<memory_category>(i)),
+               (float) category.usage / mib, category.allocation_count,
+               (float) category.peak / mib, category.peak_allocation_count);
+    }
+}
+
+void
+ex::vulkan::backend::set_memory_budget_callback(std::function<void(uint32_t, const ex::vulkan::memory_heap_stats &)> callback,
+                                                float threshold) {
+    m_memory_budget_callback = callback;
+    m_memory_budget_threshold = threshold;
+}
+
+void
+ex::vulkan::backend::check_memory_budget() {
+    // once a frame, the budget query is a driver call too slow to make on
+    // every allocation
+    ex::vulkan::memory_stats stats = get_memory_stats();
+
+    // report once per crossing, rearm when usage drops back a bit. the
+    // callback may allocate, so it runs outside the lock
+    uint32_t crossed = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_memory_mutex);
+        for (uint32_t i = 0; i < stats.heap_count; i++) {
+            const memory_heap_stats &heap = stats.heaps[i];
+            if (heap.budget == 0) continue;
+
+            float ratio = (float) heap.usage / (float) heap.budget;
+            if (ratio >= m_memory_budget_threshold && !m_memory_budget_exceeded[i]) {
+                m_memory_budget_exceeded[i] = true;
+                crossed |= 1u << i;
+            } else if (ratio < m_memory_budget_threshold * 0.95f) {
+                m_memory_budget_exceeded[i] = false;
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < stats.heap_count; i++) {
+        if (!(crossed & (1u << i))) continue;
+        const memory_heap_stats &heap = stats.heaps[i];
+        if (m_memory_budget_callback) {
+            m_memory_budget_callback(i, heap);
+        } else {
+            EXWARN("GPU memory heap %u at %.0f%% of its budget (%.2f / %.2f MiB)",
+                   i, 100.0f * (float) heap.usage / (float) heap.budget,
+                   (float) heap.usage / (1024.0f * 1024.0f),
+                   (float) heap.budget / (1024.0f * 1024.0f));
+        }
+    }
+}
+
+bool
+ex::vulkan::backend::format_supported(VkFormat format,
+                                      VkImageTiling tiling,
+                                      VkFormatFeatureFlags features) {
+    VkFormatProperties format_properties;
+    vkGetPhysicalDeviceFormatProperties(m_physical_device,
+                                        format,
+                                        &format_properties);
+
+    if (tiling == VK_IMAGE_TILING_LINEAR) {
+        return (format_properties.linearTilingFeatures & features) == features;
+    } else if (tiling == VK_IMAGE_TILING_OPTIMAL) {
+        return (format_properties.optimalTilingFeatures & features) == features;
+    }
+
+    return false;
+}
+
 float
 ex::vulkan::backend::get_swapchain_aspect_ratio() {
     return (float) m_swapchain_extent.width / (float) m_swapchain_extent.height;
@@ -892,34 +2249,210 @@ ex::vulkan::backend::get_swapchain_aspect_ratio() {
 
 void
 ex::vulkan::backend::recreate_swapchain(uint32_t width, uint32_t height) {
+    EXPROFILE_FUNCTION();
     if (width == 0 || height == 0) return;
     EXINFO("-+SWAPCHAIN_RECREATED+-");
     EXDEBUG("Width: %d -+- Height: %d", width, height);
 
-    // DESTROY
-    vkDeviceWaitIdle(m_logical_device);
+    // RETIRE
+    // frames still in flight render into the old images and the old
+    // semaphores may have presents waiting on them. nothing waits here,
+    // it all goes out with the current slot once its fence signals
+    std::vector<VkFramebuffer> old_framebuffers = std::move(m_swapchain_framebuffers);
+    std::vector<VkImageView> old_image_views = std::move(m_swapchain_image_views);
+    std::vector<VkSemaphore> old_semaphores = std::move(m_semaphores_render);
+    std::vector<VkImage> old_offscreen_images;
+    std::vector<ex::vulkan::memory_allocation> old_offscreen_memory;
+    if (m_headless) {
+        old_offscreen_images = std::move(m_swapchain_images);
+        old_offscreen_memory = std::move(m_offscreen_image_memory);
+    }
+    VkSwapchainKHR old_swapchain = m_swapchain;
+    m_swapchain_images.clear();
+    m_offscreen_image_memory.clear();
+    m_image_fences.clear();
+    VkExtent2D old_extent = m_swapchain_extent;
 
-    for (size_t i = 0; i < m_swapchain_framebuffers.size(); ++i) {
-        vkDestroyFramebuffer(m_logical_device, m_swapchain_framebuffers[i], m_allocator);
+    // RECREATE
+    // the old swapchain is handed over so the driver can reuse its images
+    // and the window never shows a gap
+    if (m_headless) {
+        create_offscreen_targets(width, height);
+    } else {
+        create_swapchain(width, height);
+    }
+    create_render_semaphores();
+
+    // the depth buffer only follows the extent, a present mode or image
+    // count change keeps it
+    bool depth_resized = m_swapchain_extent.width != old_extent.width || m_swapchain_extent.height != old_extent.height;
+    VkImage old_depth_image = VK_NULL_HANDLE;
+    VkImageView old_depth_image_view = VK_NULL_HANDLE;
+    ex::vulkan::memory_allocation old_depth_image_memory = {};
+    if (depth_resized) {
+        old_depth_image = m_depth_image;
+        old_depth_image_view = m_depth_image_view;
+        old_depth_image_memory = m_depth_image_memory;
+        m_depth_image = VK_NULL_HANDLE;
+        m_depth_image_view = VK_NULL_HANDLE;
+        m_depth_image_memory = {};
+        create_depth_resources();
     }
+    create_framebuffers();
 
-    destroy_depth_resources();
-    
-    for (size_t i = 0; i < m_swapchain_image_views.size(); ++i) {
-        vkDestroyImageView(m_logical_device, m_swapchain_image_views[i], m_allocator);
+    // the scene targets follow the extent and the present framebuffers the
+    // swapchain images, both are rebuilt every time
+    std::vector<VkFramebuffer> old_present_framebuffers = std::move(m_present_framebuffers);
+    VkFramebuffer old_scene_framebuffer = m_scene_framebuffer;
+    VkImageView old_scene_color_view = m_scene_color_view;
+    VkImage old_scene_color_image = m_scene_color_image;
+    ex::vulkan::memory_allocation old_scene_color_memory = m_scene_color_memory;
+    m_present_framebuffers.clear();
+    m_scene_framebuffer = VK_NULL_HANDLE;
+    m_scene_color_view = VK_NULL_HANDLE;
+    m_scene_color_image = VK_NULL_HANDLE;
+    m_scene_color_memory = {};
+    if (m_dynamic_resolution) create_scene_targets();
+
+    defer_destroy([this, old_framebuffers, old_image_views, old_semaphores, old_offscreen_images, old_offscreen_memory,
+                   old_swapchain, old_depth_image, old_depth_image_view, old_depth_image_memory,
+                   old_present_framebuffers, old_scene_framebuffer, old_scene_color_view, old_scene_color_image, old_scene_color_memory]() {
+        for (VkFramebuffer framebuffer : old_framebuffers) vkDestroyFramebuffer(m_logical_device, framebuffer, m_allocator);
+        for (VkImageView image_view : old_image_views) vkDestroyImageView(m_logical_device, image_view, m_allocator);
+        for (VkSemaphore semaphore : old_semaphores) vkDestroySemaphore(m_logical_device, semaphore, m_allocator);
+        for (VkImage image : old_offscreen_images) vkDestroyImage(m_logical_device, image, m_allocator);
+        for (const ex::vulkan::memory_allocation &allocation : old_offscreen_memory) free_memory(allocation);
+        if (old_swapchain) vkDestroySwapchainKHR(m_logical_device, old_swapchain, m_allocator);
+        if (old_depth_image_view) vkDestroyImageView(m_logical_device, old_depth_image_view, m_allocator);
+        if (old_depth_image) vkDestroyImage(m_logical_device, old_depth_image, m_allocator);
+        if (old_depth_image_memory.memory) free_memory(old_depth_image_memory);
+        for (VkFramebuffer framebuffer : old_present_framebuffers) vkDestroyFramebuffer(m_logical_device, framebuffer, m_allocator);
+        if (old_scene_framebuffer) vkDestroyFramebuffer(m_logical_device, old_scene_framebuffer, m_allocator);
+        if (old_scene_color_view) vkDestroyImageView(m_logical_device, old_scene_color_view, m_allocator);
+        if (old_scene_color_image) vkDestroyImage(m_logical_device, old_scene_color_image, m_allocator);
+        if (old_scene_color_memory.memory) free_memory(old_scene_color_memory);
+    });
+}
+
+void
+ex::vulkan::backend::create_offscreen_targets(uint32_t width, uint32_t height) {
+    // same format the swapchain prefers so pipelines and the render pass
+    // don't change between modes
+    m_swapchain_format.format = VK_FORMAT_B8G8R8A8_UNORM;
+    m_swapchain_format.colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+    m_swapchain_extent = { width, height };
+    m_frames_in_flight = 2;
+
+    m_swapchain_images.resize(m_frames_in_flight);
+    m_swapchain_image_views.resize(m_frames_in_flight);
+    m_offscreen_image_memory.resize(m_frames_in_flight);
+    for (uint32_t i = 0; i < m_frames_in_flight; i++) {
+        VkImageCreateInfo image_create_info = {};
+        image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        image_create_info.pNext = nullptr;
+        image_create_info.flags = 0;
+        image_create_info.imageType = VK_IMAGE_TYPE_2D;
+        image_create_info.format = m_swapchain_format.format;
+        image_create_info.extent.width = width;
+        image_create_info.extent.height = height;
+        image_create_info.extent.depth = 1;
+        image_create_info.mipLevels = 1;
+        image_create_info.arrayLayers = 1;
+        image_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+        image_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+        image_create_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        image_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        image_create_info.queueFamilyIndexCount = 0;
+        image_create_info.pQueueFamilyIndices = nullptr;
+        image_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VK_CHECK(vkCreateImage(m_logical_device,
+                               &image_create_info,
+                               m_allocator,
+                               &m_swapchain_images[i]));
+
+        VkMemoryRequirements memory_requirements;
+        vkGetImageMemoryRequirements(m_logical_device,
+                                     m_swapchain_images[i],
+                                     &memory_requirements);
+
+        m_offscreen_image_memory[i] = allocate_memory(memory_requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MEMORY_CATEGORY_ATTACHMENT, MEMORY_RESOURCE_IMAGE);
+        vkBindImageMemory(m_logical_device, m_swapchain_images[i], m_offscreen_image_memory[i].memory, m_offscreen_image_memory[i].offset);
+
+        m_swapchain_image_views[i] = create_image_view(m_swapchain_images[i],
+                                                       VK_IMAGE_VIEW_TYPE_2D,
+                                                       m_swapchain_format.format,
+                                                       VK_IMAGE_ASPECT_COLOR_BIT);
     }
-    
-    vkDestroySwapchainKHR(m_logical_device, m_swapchain, m_allocator);
+}
 
-    // RECREATE
-    create_swapchain(width, height);
-    create_depth_resources();
-    create_framebuffers();
+void
+ex::vulkan::backend::destroy_offscreen_targets() {
+    // the views go with the swapchain image views
+    for (uint32_t i = 0; i < m_swapchain_images.size(); i++) {
+        vkDestroyImage(m_logical_device, m_swapchain_images[i], m_allocator);
+        free_memory(m_offscreen_image_memory[i]);
+    }
+    m_swapchain_images.clear();
+    m_offscreen_image_memory.clear();
+}
+
+VkExtent2D
+ex::vulkan::backend::render_extent() {
+    if (!m_dynamic_resolution) return m_swapchain_extent;
+
+    VkExtent2D extent = {};
+    extent.width = std::max(static_cast<uint32_t>(static_cast<float>(m_swapchain_extent.width) * m_render_scale), 1u);
+    extent.height = std::max(static_cast<uint32_t>(static_cast<float>(m_swapchain_extent.height) * m_render_scale), 1u);
+    return extent;
+}
+
+VkExtent2D
+ex::vulkan::backend::target_extent() {
+    if (m_headless) return m_headless_extent;
+    return { m_pwindow->width(), m_pwindow->height() };
+}
+
+VkPresentModeKHR
+ex::vulkan::backend::select_present_mode() {
+    auto supported = [this](VkPresentModeKHR mode) {
+        return std::find(m_swapchain_present_modes.begin(), m_swapchain_present_modes.end(), mode) != m_swapchain_present_modes.end();
+    };
+
+    // fifo is the only mode every driver has to support
+    switch (m_present_policy) {
+    case PRESENT_POLICY_MAILBOX: {
+        if (supported(VK_PRESENT_MODE_MAILBOX_KHR)) {
+            EXDEBUG("Present mode: MAILBOX");
+            return VK_PRESENT_MODE_MAILBOX_KHR;
+        }
+    } break;
+    case PRESENT_POLICY_IMMEDIATE: {
+        if (supported(VK_PRESENT_MODE_IMMEDIATE_KHR)) {
+            EXDEBUG("Present mode: IMMEDIATE");
+            return VK_PRESENT_MODE_IMMEDIATE_KHR;
+        }
+        if (supported(VK_PRESENT_MODE_MAILBOX_KHR)) {
+            EXWARN("Immediate present mode unsupported, using mailbox");
+            return VK_PRESENT_MODE_MAILBOX_KHR;
+        }
+    } break;
+    case PRESENT_POLICY_LOW_LATENCY: {
+        EXDEBUG("Present mode: V-Sync, %u frame(s) in flight", m_frame_latency);
+        return VK_PRESENT_MODE_FIFO_KHR;
+    } break;
+    case PRESENT_POLICY_VSYNC: {
+    } break;
+    }
+
+    if (m_present_policy != PRESENT_POLICY_VSYNC) EXWARN("Failed to find preferable present mode");
+    EXDEBUG("Present mode: V-Sync");
+    return VK_PRESENT_MODE_FIFO_KHR;
 }
 
 
 VkCommandBuffer
 ex::vulkan::backend::begin_single_time_commands() {
+    EXPROFILE_FUNCTION();
     VkCommandBufferAllocateInfo command_buffer_allocate_info = {};
     command_buffer_allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     command_buffer_allocate_info.pNext = nullptr;
@@ -944,6 +2477,7 @@ ex::vulkan::backend::begin_single_time_commands() {
 
 void
 ex::vulkan::backend::end_single_time_commands(VkCommandBuffer command_buffer) {
+    EXPROFILE_FUNCTION();
     vkEndCommandBuffer(command_buffer);
 
     VkSubmitInfo submit_info = {};
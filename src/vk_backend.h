@@ -2,7 +2,9 @@
 
 #include "ex_platform.h"
 
+#ifdef _WIN32
 #define VK_USE_PLATFORM_WIN32_KHR
+#endif
 #include <vulkan/vulkan.h>
 
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -10,32 +12,180 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/rotate_vector.hpp>
 
+#include "vk_bindless.h"
+#include "vk_descriptor.h"
+#include "vk_memory.h"
+#include "ex_range_allocator.h"
+#include "ex_thread_pool.h"
+
 #include <vector>
 #include <memory>
+#include <functional>
+#include <unordered_map>
+#include <mutex>
+#include <array>
 
 namespace ex::vulkan {
+    class buffer;
+    class image;
+    
     class backend {
     public:
+        enum present_policy {
+            PRESENT_POLICY_VSYNC = 0,       // fifo, never tears
+            PRESENT_POLICY_MAILBOX = 1,     // newest frame replaces the queued one, no tearing
+            PRESENT_POLICY_IMMEDIATE = 2,   // no waiting on vblank, tears
+            PRESENT_POLICY_LOW_LATENCY = 3, // fifo with the queued frames capped by set_frame_latency
+        };
+
+        // cpu time spent blocked in the last frame. gpu_ms is the "frame"
+        // zone, it stays 0 if the queue can't write timestamps
+        struct frame_timings {
+            float fence_wait_ms;
+            float acquire_wait_ms;
+            float present_wait_ms;
+            float gpu_ms;
+        };
+
+        // gpu time between a begin_gpu_zone/end_gpu_zone pair
+        struct gpu_zone_timing {
+            const char *name;
+            float ms;
+        };
+
+        static constexpr uint32_t max_frames_in_flight = 3;
+        static constexpr uint32_t max_gpu_zones = 64;
+        static constexpr uint32_t invalid_gpu_zone = UINT32_MAX;
+        static constexpr float min_render_scale = 0.25f;
+        
+    public:
+        void set_bindless(bool enable);
+        void set_worker_count(uint32_t worker_count);
+        void set_present_policy(present_policy policy);
+        void set_frame_latency(uint32_t frames);
+        void set_swapchain_image_count(uint32_t image_count);
+        // keeps the main pass depth and makes it sampleable, for passes that
+        // read the previous frame's depth (hi-z)
+        void set_depth_sampled(bool sampled);
+        // the main pass draws into an offscreen colour target at
+        // render_scale of the swapchain extent instead of the swapchain
+        // image. the targets keep the full size, a smaller scale only
+        // shrinks the area drawn. the frame is brought to the swapchain
+        // between begin_present_pass and end_present_pass
+        void set_dynamic_resolution(bool enable);
+        // clamped to [min_render_scale, 1], takes effect at the next
+        // begin_main_pass
+        void set_render_scale(float scale);
         bool initialize(ex::platform::window *pwindow);
+        // no surface or swapchain, frames render into offscreen images and
+        // are never presented. for benchmarks and machines without a display
+        bool initialize_headless(uint32_t width, uint32_t height);
         void shutdown();
-        void begin_render();
+        void begin_render(VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
         void end_render();
+
+        // begin_render/end_render split in two, work recorded between
+        // begin_frame and begin_main_pass (render graph passes) runs before
+        // the swapchain pass
+        void begin_frame();
+        void begin_main_pass(VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
+        void end_main_pass();
+        // swapchain colour only, after end_main_pass with dynamic
+        // resolution. the scene colour is ready to be sampled
+        void begin_present_pass();
+        void end_present_pass();
+        void end_frame();
+
+        // splits [0, draw_count) over the workers. each range is recorded into
+        // a secondary command buffer that continues the current render pass,
+        // so record() has to bind everything it uses (pipeline, sets, dynamic
+        // state, vertex buffers). needs begin_render(SECONDARY_COMMAND_BUFFERS),
+        // with inline contents it records on the calling thread instead
+        void record_parallel(uint32_t draw_count,
+                             std::function<void(VkCommandBuffer, uint32_t, uint32_t)> record,
+                             uint32_t min_draws_per_task = 64);
         void wait_idle();
+
+        // timestamps around work recorded into any of this frame's command
+        // buffers, primary or secondary, from any thread. results are read
+        // when the slot comes around again so nothing waits on the gpu.
+        // names are kept by pointer and have to outlive the frame
+        uint32_t begin_gpu_zone(VkCommandBuffer command_buffer, const char *name);
+        void end_gpu_zone(VkCommandBuffer command_buffer, uint32_t zone);
+        // zones of the newest frame whose fence signalled, in begin order
+        const std::vector<gpu_zone_timing> &gpu_zone_timings() { return m_gpu_zone_timings; }
+        void print_gpu_zones();
         
         VkCommandBuffer begin_single_time_commands();
         void end_single_time_commands(VkCommandBuffer command_buffer);
 
         uint32_t get_memory_type_index(VkMemoryRequirements memory_requirements, VkMemoryPropertyFlags properties);
+        bool format_supported(VkFormat format, VkImageTiling tiling, VkFormatFeatureFlags features);
+
+        ex::vulkan::memory_allocation allocate_memory(VkMemoryRequirements memory_requirements, VkMemoryPropertyFlags properties, ex::vulkan::memory_category category, ex::vulkan::memory_resource resource);
+        void free_memory(const ex::vulkan::memory_allocation &allocation);
+        void set_memory_block_size(VkDeviceSize block_size);
+        void set_memory_owner(const ex::vulkan::memory_allocation &allocation, ex::vulkan::buffer *owner);
+        void set_memory_owner(const ex::vulkan::memory_allocation &allocation, ex::vulkan::image *owner);
+
+        void set_defragmentation(bool enable, VkDeviceSize bytes_per_frame, float block_threshold);
+        // records the moves into command_buffer, the old ranges are released
+        // once everything already in flight has finished with them
+        uint32_t defragment(VkCommandBuffer command_buffer, VkDeviceSize max_bytes);
+        uint32_t add_relocation_listener(std::function<void()> listener);
+        void remove_relocation_listener(uint32_t id);
+        void defer_destroy(std::function<void()> destroy);
+        ex::vulkan::memory_stats get_memory_stats();
+        void print_memory_stats();
+        void set_memory_budget_callback(std::function<void(uint32_t, const ex::vulkan::memory_heap_stats &)> callback, float threshold);
         float get_swapchain_aspect_ratio();
-        VkCommandBuffer current_frame() { return m_command_buffers[m_next_image_index]; }
+        VkCommandBuffer current_frame() { return m_frames[m_frame_index].command_buffer; }
+        uint32_t frame_index() { return m_frame_index; }
+        uint32_t frames_in_flight() { return m_frames_in_flight; }
+        present_policy get_present_policy() { return m_present_policy; }
+        bool headless() { return m_headless; }
+        const frame_timings &last_frame_timings() { return m_frame_timings; }
         
         VkAllocationCallbacks* allocator() { return m_allocator; }
         VkDevice& logical_device() { return m_logical_device; }
         VkExtent2D swapchain_extent() { return m_swapchain_extent; }
         VkRenderPass render_pass() { return m_render_pass; }
+        VkFormat swapchain_format() { return m_swapchain_format.format; }
+        VkFormat depth_format() { return m_depth_format; }
+        bool dynamic_resolution() { return m_dynamic_resolution; }
+        float render_scale() { return m_render_scale; }
+        // what the main pass draws into, viewports and scissors use it
+        VkExtent2D render_extent();
+        // what the last recorded main pass drew into, for passes reading
+        // its depth in the next frame
+        VkExtent2D last_render_extent() { return m_last_render_extent; }
+        VkRenderPass present_render_pass() { return m_present_render_pass; }
+        // replaced when the extent changes, compare handles between frames
+        VkImageView scene_color_view() { return m_scene_color_view; }
+        // replaced when the extent changes, compare handles between frames
+        VkImage depth_image() { return m_depth_image; }
+        VkImageView depth_image_view() { return m_depth_image_view; }
         uint32_t subpass() { return m_pipeline_subpass; }
+
+        uint32_t worker_count() { return m_thread_pool.thread_count(); }
+        bool bindless_enabled() { return m_bindless_enabled; }
+        ex::vulkan::bindless_table *bindless() { return &m_bindless; }
+        ex::vulkan::descriptor_layout_cache *descriptor_layouts() { return &m_descriptor_layouts; }
+        // sets that live as long as their owner wants, pools grow on demand
+        ex::vulkan::descriptor_allocator *descriptors() { return &m_descriptors; }
+        // sets for this frame only, recycled once the slot's fence signals
+        ex::vulkan::descriptor_allocator *transient_descriptors() { return &m_frames[m_frame_index].transient_descriptors; }
+        // a transient set for these writes, repeated lookups in one frame
+        // share it. thread safe
+        VkDescriptorSet transient_set(VkDescriptorSetLayout layout, ex::utils::span<const ex::vulkan::descriptor_set_cache::write> writes);
+        const VkPhysicalDeviceFeatures &enabled_features() { return m_enabled_features; }
+        // clamped to the device limit, 1 without samplerAnisotropy
+        float max_sampler_anisotropy() { return m_max_sampler_anisotropy; }
+        // null without VK_KHR_draw_indirect_count
+        PFN_vkCmdDrawIndexedIndirectCountKHR draw_indirect_count() { return m_draw_indirect_count; }
         
     private:
+        bool initialize_vulkan();
         bool create_instance();
         void setup_debug_messenger();
         bool select_physical_device();
@@ -44,17 +194,34 @@ namespace ex::vulkan {
 
         void create_swapchain(uint32_t width, uint32_t height);
         void recreate_swapchain(uint32_t width, uint32_t height);
+        void create_offscreen_targets(uint32_t width, uint32_t height);
+        void destroy_offscreen_targets();
+        VkExtent2D target_extent();
         bool create_depth_resources();
         void destroy_depth_resources();
         void create_render_pass();
+        VkRenderPass create_main_render_pass(VkImageLayout color_final_layout);
+        VkRenderPass create_present_render_pass();
         void create_framebuffers();
+        void create_scene_targets();
         void create_sync_structures();
         void allocate_command_buffers();
+        void create_workers();
+        void destroy_workers();
         
         VkImageView create_image_view(VkImage image, VkImageViewType type, VkFormat format, VkImageAspectFlags aspect_flags);
+        // from begin_frame, not per allocation
+        void check_memory_budget();
+        void flush_deferred_destroys();
+        void flush_frame_destroys(uint32_t frame);
+        void create_render_semaphores();
+        void destroy_render_semaphores();
+        VkPresentModeKHR select_present_mode();
 
     private:
         ex::platform::window *m_pwindow;
+        bool m_headless {false};
+        VkExtent2D m_headless_extent {};
         
         VkAllocationCallbacks *m_allocator;
         VkInstance m_instance;
@@ -71,31 +238,151 @@ namespace ex::vulkan {
         VkQueue m_present_queue;
 
         VkCommandPool m_command_pool;
-        std::vector<VkCommandBuffer> m_command_buffers;
+
+        // everything a frame in flight owns until its fence signals
+        struct frame_context {
+            VkCommandBuffer command_buffer;
+            VkFence fence;
+            VkSemaphore semaphore_acquire;
+            VkQueryPool timestamp_pool;
+            std::vector<const char *> gpu_zone_names;
+            std::vector<std::function<void()>> deferred_destroys;
+            ex::vulkan::descriptor_allocator transient_descriptors;
+            ex::vulkan::descriptor_set_cache transient_sets;
+        };
+
+        std::array<frame_context, max_frames_in_flight> m_frames {};
+        uint32_t m_frame_index {0};
+        uint32_t m_frames_in_flight {2};
+        frame_timings m_frame_timings {};
+        bool m_timestamps_supported {false};
+        float m_timestamp_period {1.0f};
+        uint64_t m_timestamp_mask {UINT64_MAX};
+        uint32_t m_frame_gpu_zone {invalid_gpu_zone};
+        std::mutex m_gpu_zone_mutex;
+        std::vector<gpu_zone_timing> m_gpu_zone_timings;
+
+        // one pool per recording thread and frame slot, reset once the slot's
+        // fence signals. indexed by frame * worker count + worker
+        struct worker_context {
+            VkCommandPool command_pool;
+            std::vector<VkCommandBuffer> command_buffers;
+            uint32_t used_command_buffers;
+        };
+
+        uint32_t m_worker_count_requested {0};
+        std::vector<worker_context> m_workers;
+        ex::thread_pool m_thread_pool;
+        VkSubpassContents m_subpass_contents {VK_SUBPASS_CONTENTS_INLINE};
 
         VkSurfaceCapabilitiesKHR m_swapchain_capabilities;
         std::vector<VkSurfaceFormatKHR> m_swapchain_formats;
         std::vector<VkPresentModeKHR> m_swapchain_present_modes;
         
-        VkSwapchainKHR m_swapchain;
+        VkSwapchainKHR m_swapchain {};
         VkSurfaceFormatKHR m_swapchain_format;
         VkPresentModeKHR m_swapchain_present_mode;
         VkExtent2D m_swapchain_extent;
+        VkExtent2D m_swapchain_requested_extent {};
         std::vector<VkImage> m_swapchain_images;
         std::vector<VkImageView> m_swapchain_image_views;
         std::vector<VkFramebuffer> m_swapchain_framebuffers;
         uint32_t m_next_image_index;
 
+        // headless stand-ins for the swapchain images, one per frame slot
+        std::vector<ex::vulkan::memory_allocation> m_offscreen_image_memory;
+
         VkImage m_depth_image;
-        VkDeviceMemory m_depth_image_memory;
+        ex::vulkan::memory_allocation m_depth_image_memory;
         VkImageView m_depth_image_view;
         VkFormat m_depth_format;
+        bool m_depth_sampled {false};
         VkRenderPass m_render_pass;
 
-        VkFence m_fence;
-        VkSemaphore m_semaphore_present;
-        VkSemaphore m_semaphore_render;
+        // dynamic resolution: the main pass renders the scene colour and
+        // depth, the present pass only has the swapchain colour
+        bool m_dynamic_resolution {false};
+        float m_render_scale {1.0f};
+        VkExtent2D m_last_render_extent {};
+        VkRenderPass m_scene_render_pass {};
+        VkRenderPass m_present_render_pass {};
+        VkImage m_scene_color_image {};
+        ex::vulkan::memory_allocation m_scene_color_memory {};
+        VkImageView m_scene_color_view {};
+        VkFramebuffer m_scene_framebuffer {};
+        std::vector<VkFramebuffer> m_present_framebuffers;
+
+        // render semaphores belong to swapchain images, the presentation
+        // engine holds on to them until the image comes back
+        std::vector<VkSemaphore> m_semaphores_render;
+        std::vector<VkFence> m_image_fences;
+
+        present_policy m_present_policy {PRESENT_POLICY_IMMEDIATE};
+        uint32_t m_frame_latency {1};
+        uint32_t m_swapchain_image_count_requested {0};
+        bool m_swapchain_dirty {false};
 
         uint32_t m_pipeline_subpass;
+
+        bool m_bindless_requested {false};
+        bool m_bindless_enabled {false};
+        ex::vulkan::bindless_table m_bindless;
+        ex::vulkan::descriptor_layout_cache m_descriptor_layouts;
+        ex::vulkan::descriptor_allocator m_descriptors;
+
+        VkPhysicalDeviceFeatures m_enabled_features {};
+        float m_max_sampler_anisotropy {1.0f};
+        PFN_vkCmdDrawIndexedIndirectCountKHR m_draw_indirect_count {nullptr};
+
+        // one VkDeviceMemory carved up by a range allocator, mapped once if
+        // the memory type is host visible
+        struct memory_block {
+            VkDeviceMemory memory;
+            uint32_t memory_type_index;
+            ex::vulkan::memory_resource resource;
+            void *mapped;
+            ex::range_allocator ranges;
+            // includes allocations moved out whose ranges wait on the frames
+            // still reading them
+            uint32_t allocation_count;
+            uint32_t pending_moves;
+        };
+
+        // records are indexed by memory_allocation::id. an owner marks the
+        // allocation as movable, block is null for dedicated allocations
+        struct memory_record {
+            bool live;
+            VkDeviceSize size;
+            VkDeviceSize alignment;
+            VkDeviceSize offset;
+            VkDeviceMemory memory;
+            uint32_t memory_type_index;
+            ex::vulkan::memory_category category;
+            memory_block *block;
+            ex::vulkan::buffer *buffer_owner;
+            ex::vulkan::image *image_owner;
+        };
+
+        VkDeviceMemory allocate_device_memory(uint32_t memory_type_index, VkDeviceSize size, void **mapped);
+        void free_device_memory(VkDeviceMemory memory, uint32_t memory_type_index, VkDeviceSize size);
+        memory_block *find_defragment_source();
+        
+        std::mutex m_memory_mutex;
+        std::vector<memory_record> m_memory_records;
+        std::vector<uint32_t> m_free_memory_records;
+        std::vector<std::unique_ptr<memory_block>> m_memory_blocks;
+        VkDeviceSize m_memory_block_size {64ull * 1024 * 1024};
+        ex::vulkan::memory_stats m_memory_stats;
+        VkPhysicalDeviceMemoryProperties m_memory_properties;
+        bool m_memory_budget_supported {false};
+        float m_memory_budget_threshold {0.9f};
+        std::array<bool, VK_MAX_MEMORY_HEAPS> m_memory_budget_exceeded {};
+        std::function<void(uint32_t, const ex::vulkan::memory_heap_stats &)> m_memory_budget_callback;
+
+        bool m_defrag_enabled {false};
+        VkDeviceSize m_defrag_bytes_per_frame {16ull * 1024 * 1024};
+        float m_defrag_block_threshold {0.5f};
+        uint32_t m_next_relocation_listener {0};
+        std::unordered_map<uint32_t, std::function<void()>> m_relocation_listeners;
     };
 }
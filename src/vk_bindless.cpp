@@ -0,0 +1,184 @@
+#include "vk_bindless.h"
+#include "vk_backend.h"
+#include "vk_common.h"
+
+#include <array>
+
+void
+ex::vulkan::bindless_table::set_capacity(uint32_t texture_capacity,
+                                         uint32_t buffer_capacity) {
+    m_texture_capacity = texture_capacity;
+    m_buffer_capacity = buffer_capacity;
+}
+
+void
+ex::vulkan::bindless_table::create(ex::vulkan::backend *backend) {
+    m_texture_count = 0;
+    m_buffer_count = 0;
+    m_free_textures.clear();
+    m_free_buffers.clear();
+
+    std::array<VkDescriptorSetLayoutBinding, 2> bindings = {};
+    bindings[BINDING_TEXTURES].binding = BINDING_TEXTURES;
+    bindings[BINDING_TEXTURES].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[BINDING_TEXTURES].descriptorCount = m_texture_capacity;
+    bindings[BINDING_TEXTURES].stageFlags = VK_SHADER_STAGE_ALL;
+    bindings[BINDING_TEXTURES].pImmutableSamplers = nullptr;
+
+    bindings[BINDING_BUFFERS].binding = BINDING_BUFFERS;
+    bindings[BINDING_BUFFERS].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[BINDING_BUFFERS].descriptorCount = m_buffer_capacity;
+    bindings[BINDING_BUFFERS].stageFlags = VK_SHADER_STAGE_ALL;
+    bindings[BINDING_BUFFERS].pImmutableSamplers = nullptr;
+
+    // slots may be empty and may be rewritten while the set is bound by a
+    // command buffer that is still being recorded
+    std::array<VkDescriptorBindingFlags, 2> binding_flags = {
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT,
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT,
+    };
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo binding_flags_create_info = {};
+    binding_flags_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    binding_flags_create_info.pNext = nullptr;
+    binding_flags_create_info.bindingCount = static_cast<uint32_t>(binding_flags.size());
+    binding_flags_create_info.pBindingFlags = binding_flags.data();
+
+    VkDescriptorSetLayoutCreateInfo descriptor_set_layout_create_info = {};
+    descriptor_set_layout_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    descriptor_set_layout_create_info.pNext = &binding_flags_create_info;
+    descriptor_set_layout_create_info.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    descriptor_set_layout_create_info.bindingCount = static_cast<uint32_t>(bindings.size());
+    descriptor_set_layout_create_info.pBindings = bindings.data();
+    VK_CHECK(vkCreateDescriptorSetLayout(backend->logical_device(),
+                                         &descriptor_set_layout_create_info,
+                                         backend->allocator(),
+                                         &m_layout));
+
+    std::array<VkDescriptorPoolSize, 2> pool_sizes = {};
+    pool_sizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    pool_sizes[0].descriptorCount = m_texture_capacity;
+    pool_sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pool_sizes[1].descriptorCount = m_buffer_capacity;
+
+    VkDescriptorPoolCreateInfo descriptor_pool_create_info = {};
+    descriptor_pool_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    descriptor_pool_create_info.pNext = nullptr;
+    descriptor_pool_create_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    descriptor_pool_create_info.maxSets = 1;
+    descriptor_pool_create_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+    descriptor_pool_create_info.pPoolSizes = pool_sizes.data();
+    VK_CHECK(vkCreateDescriptorPool(backend->logical_device(),
+                                    &descriptor_pool_create_info,
+                                    backend->allocator(),
+                                    &m_pool));
+
+    VkDescriptorSetAllocateInfo descriptor_set_allocate_info = {};
+    descriptor_set_allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    descriptor_set_allocate_info.pNext = nullptr;
+    descriptor_set_allocate_info.descriptorPool = m_pool;
+    descriptor_set_allocate_info.descriptorSetCount = 1;
+    descriptor_set_allocate_info.pSetLayouts = &m_layout;
+    VK_CHECK(vkAllocateDescriptorSets(backend->logical_device(),
+                                      &descriptor_set_allocate_info,
+                                      &m_handle));
+
+    EXDEBUG("Bindless table: %u textures, %u buffers", m_texture_capacity, m_buffer_capacity);
+}
+
+void
+ex::vulkan::bindless_table::destroy(ex::vulkan::backend *backend) {
+    if (m_pool) vkDestroyDescriptorPool(backend->logical_device(), m_pool, backend->allocator());
+    if (m_layout) vkDestroyDescriptorSetLayout(backend->logical_device(), m_layout, backend->allocator());
+    m_pool = VK_NULL_HANDLE;
+    m_layout = VK_NULL_HANDLE;
+    m_handle = VK_NULL_HANDLE;
+}
+
+uint32_t
+ex::vulkan::bindless_table::add_texture(ex::vulkan::backend *backend,
+                                        VkDescriptorImageInfo *image_info) {
+    uint32_t index = acquire_slot(m_free_textures, m_texture_count, m_texture_capacity);
+    if (index == invalid_index) {
+        EXERROR("Bindless table is out of texture slots (%u)", m_texture_capacity);
+        return invalid_index;
+    }
+
+    update_texture(backend, index, image_info);
+    return index;
+}
+
+uint32_t
+ex::vulkan::bindless_table::add_buffer(ex::vulkan::backend *backend,
+                                       VkDescriptorBufferInfo *buffer_info) {
+    uint32_t index = acquire_slot(m_free_buffers, m_buffer_count, m_buffer_capacity);
+    if (index == invalid_index) {
+        EXERROR("Bindless table is out of buffer slots (%u)", m_buffer_capacity);
+        return invalid_index;
+    }
+
+    update_buffer(backend, index, buffer_info);
+    return index;
+}
+
+void
+ex::vulkan::bindless_table::update_texture(ex::vulkan::backend *backend,
+                                           uint32_t index,
+                                           VkDescriptorImageInfo *image_info) {
+    VkWriteDescriptorSet write_descriptor_set = {};
+    write_descriptor_set.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write_descriptor_set.pNext = nullptr;
+    write_descriptor_set.dstSet = m_handle;
+    write_descriptor_set.dstBinding = BINDING_TEXTURES;
+    write_descriptor_set.dstArrayElement = index;
+    write_descriptor_set.descriptorCount = 1;
+    write_descriptor_set.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    write_descriptor_set.pImageInfo = image_info;
+    write_descriptor_set.pBufferInfo = nullptr;
+    write_descriptor_set.pTexelBufferView = nullptr;
+    vkUpdateDescriptorSets(backend->logical_device(), 1, &write_descriptor_set, 0, nullptr);
+}
+
+void
+ex::vulkan::bindless_table::update_buffer(ex::vulkan::backend *backend,
+                                          uint32_t index,
+                                          VkDescriptorBufferInfo *buffer_info) {
+    VkWriteDescriptorSet write_descriptor_set = {};
+    write_descriptor_set.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write_descriptor_set.pNext = nullptr;
+    write_descriptor_set.dstSet = m_handle;
+    write_descriptor_set.dstBinding = BINDING_BUFFERS;
+    write_descriptor_set.dstArrayElement = index;
+    write_descriptor_set.descriptorCount = 1;
+    write_descriptor_set.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    write_descriptor_set.pImageInfo = nullptr;
+    write_descriptor_set.pBufferInfo = buffer_info;
+    write_descriptor_set.pTexelBufferView = nullptr;
+    vkUpdateDescriptorSets(backend->logical_device(), 1, &write_descriptor_set, 0, nullptr);
+}
+
+void
+ex::vulkan::bindless_table::remove_texture(uint32_t index) {
+    if (index == invalid_index) return;
+    m_free_textures.push_back(index);
+}
+
+void
+ex::vulkan::bindless_table::remove_buffer(uint32_t index) {
+    if (index == invalid_index) return;
+    m_free_buffers.push_back(index);
+}
+
+uint32_t
+ex::vulkan::bindless_table::acquire_slot(std::vector<uint32_t> &free_slots,
+                                         uint32_t &count,
+                                         uint32_t capacity) {
+    if (!free_slots.empty()) {
+        uint32_t index = free_slots.back();
+        free_slots.pop_back();
+        return index;
+    }
+
+    if (count >= capacity) return invalid_index;
+    return count++;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <cstdint>
+
+namespace ex::vulkan {
+    class backend;
+
+    // One global update-after-bind descriptor set holding every sampled image
+    // and storage buffer. Resources get a stable index when they are added and
+    // shaders pick them through push constants or instance data.
+    class bindless_table {
+    public:
+        enum binding {
+            BINDING_TEXTURES = 0,
+            BINDING_BUFFERS = 1,
+        };
+
+        static constexpr uint32_t invalid_index = UINT32_MAX;
+
+    public:
+        void set_capacity(uint32_t texture_capacity, uint32_t buffer_capacity);
+        void create(ex::vulkan::backend *backend);
+        void destroy(ex::vulkan::backend *backend);
+
+        uint32_t add_texture(ex::vulkan::backend *backend, VkDescriptorImageInfo *image_info);
+        uint32_t add_buffer(ex::vulkan::backend *backend, VkDescriptorBufferInfo *buffer_info);
+        void update_texture(ex::vulkan::backend *backend, uint32_t index, VkDescriptorImageInfo *image_info);
+        void update_buffer(ex::vulkan::backend *backend, uint32_t index, VkDescriptorBufferInfo *buffer_info);
+        void remove_texture(uint32_t index);
+        void remove_buffer(uint32_t index);
+
+        VkDescriptorSetLayout& layout() { return m_layout; }
+        VkDescriptorSet handle() { return m_handle; }
+        uint32_t texture_count() { return m_texture_count - static_cast<uint32_t>(m_free_textures.size()); }
+        uint32_t buffer_count() { return m_buffer_count - static_cast<uint32_t>(m_free_buffers.size()); }
+
+    private:
+        uint32_t acquire_slot(std::vector<uint32_t> &free_slots, uint32_t &count, uint32_t capacity);
+
+    private:
+        VkDescriptorPool m_pool {};
+        VkDescriptorSetLayout m_layout {};
+        VkDescriptorSet m_handle {};
+
+        uint32_t m_texture_capacity {0};
+        uint32_t m_buffer_capacity {0};
+        uint32_t m_texture_count {0};
+        uint32_t m_buffer_count {0};
+        std::vector<uint32_t> m_free_textures;
+        std::vector<uint32_t> m_free_buffers;
+    };
+}
@@ -1,6 +1,7 @@
 #include "vk_buffer.h"
 #include "vk_common.h"
 #include <memory>
+#include <algorithm>
 
 void
 ex::vulkan::buffer::set_usage(VkBufferUsageFlags usage) {
@@ -15,57 +16,42 @@ ex::vulkan::buffer::set_properties(VkMemoryPropertyFlags properties) {
 void
 ex::vulkan::buffer::build(ex::vulkan::backend *backend, VkDeviceSize size) {
     m_size = size;
+
+    // device local buffers can be moved by the defragmenter, which copies
+    // them on the gpu
+    bool movable = !(m_properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+    if (movable) m_usage |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
     
-    VkBufferCreateInfo buffer_create_info = {};
-    buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    buffer_create_info.size = m_size;
-    buffer_create_info.usage = m_usage;
-    buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    buffer_create_info.queueFamilyIndexCount = 0;
-    buffer_create_info.pQueueFamilyIndices = nullptr;
-    VK_CHECK(vkCreateBuffer(backend->logical_device(),
-                            &buffer_create_info,
-                            backend->allocator(),
-                            &m_handle));
+    m_handle = create_handle(backend);
 
     VkMemoryRequirements memory_requirements;
     vkGetBufferMemoryRequirements(backend->logical_device(),
                                   m_handle,
                                   &memory_requirements);
 
-    uint32_t memory_type_index = backend->get_memory_type_index(memory_requirements, m_properties);
-    
-    VkMemoryAllocateInfo memory_allocate_info = {};
-    memory_allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    memory_allocate_info.allocationSize = memory_requirements.size;
-    memory_allocate_info.memoryTypeIndex = memory_type_index;
-    VK_CHECK(vkAllocateMemory(backend->logical_device(),
-                              &memory_allocate_info,
-                              backend->allocator(),
-                              &m_memory));
+    m_memory = backend->allocate_memory(memory_requirements,
+                                        m_properties,
+                                        ex::vulkan::buffer_memory_category(m_usage),
+                                        ex::vulkan::MEMORY_RESOURCE_BUFFER);
+    if (movable) backend->set_memory_owner(m_memory, this);
 }
 
 void
 ex::vulkan::buffer::bind(ex::vulkan::backend *backend, VkDeviceSize offset) {
     vkBindBufferMemory(backend->logical_device(),
                        m_handle,
-                       m_memory,
-                       offset);
+                       m_memory.memory,
+                       m_memory.offset + offset);
 }
 
 void
-ex::vulkan::buffer::map(ex::vulkan::backend *backend, VkDeviceSize offset) {
-    vkMapMemory(backend->logical_device(),
-                m_memory,
-                offset,
-                m_size,
-                0,
-                &m_mapped);
+ex::vulkan::buffer::map(ex::vulkan::backend * /*backend*/, VkDeviceSize offset) {
+    // host visible memory is mapped by the backend for its whole lifetime
+    m_mapped = static_cast<uint8_t *>(m_memory.mapped) + offset;
 }
 
 void
-ex::vulkan::buffer::unmap(ex::vulkan::backend *backend) {
-    vkUnmapMemory(backend->logical_device(), m_memory);
+ex::vulkan::buffer::unmap(ex::vulkan::backend * /*backend*/) {
     //m_mapped = nullptr;
 }
 
@@ -74,21 +60,70 @@ ex::vulkan::buffer::copy_to(void *data, VkDeviceSize size) {
     memcpy(m_mapped, data, (size_t) size);
 }
 
+void
+ex::vulkan::buffer::copy_from(void *data, VkDeviceSize size) {
+    memcpy(data, m_mapped, (size_t) size);
+}
+
 void
 ex::vulkan::buffer::copy_buffer(VkCommandBuffer command_buffer,
                                 VkBuffer buffer,
-                                VkDeviceSize size) {
+                                VkDeviceSize size,
+                                VkDeviceSize dst_offset,
+                                VkDeviceSize src_offset) {
     VkBufferCopy buffer_copy = {};
-    buffer_copy.srcOffset = 0;
-    buffer_copy.dstOffset = 0;
+    buffer_copy.srcOffset = src_offset;
+    buffer_copy.dstOffset = dst_offset;
     buffer_copy.size = size;
     vkCmdCopyBuffer(command_buffer, buffer, m_handle, 1, &buffer_copy);
 }
 
+void
+ex::vulkan::buffer::resize(ex::vulkan::backend *backend, VkDeviceSize size) {
+    VkBuffer old_handle = m_handle;
+    ex::vulkan::memory_allocation old_memory = m_memory;
+    VkDeviceSize copy_size = std::min(m_size, size);
+
+    build(backend, size);
+    bind(backend);
+
+    if (old_memory.mapped) {
+        memcpy(m_memory.mapped, old_memory.mapped, (size_t) copy_size);
+    } else {
+        // also waits for anything in flight still reading the old buffer
+        VkCommandBuffer command_buffer = backend->begin_single_time_commands();
+        copy_buffer(command_buffer, old_handle, copy_size);
+        backend->end_single_time_commands(command_buffer);
+    }
+
+    vkDestroyBuffer(backend->logical_device(), old_handle, backend->allocator());
+    backend->free_memory(old_memory);
+}
+
 void
 ex::vulkan::buffer::destroy(ex::vulkan::backend *backend) {
     if (m_handle) vkDestroyBuffer(backend->logical_device(), m_handle, backend->allocator());
-    if (m_memory) vkFreeMemory(backend->logical_device(), m_memory, backend->allocator());
+    if (m_memory.memory) backend->free_memory(m_memory);
+    m_handle = VK_NULL_HANDLE;
+    m_memory = {};
+}
+
+void
+ex::vulkan::buffer::relocate(ex::vulkan::backend *backend,
+                             VkCommandBuffer command_buffer,
+                             const ex::vulkan::memory_allocation &allocation) {
+    VkBuffer old_handle = m_handle;
+    
+    m_handle = create_handle(backend);
+    m_memory = allocation;
+    bind(backend);
+    copy_buffer(command_buffer, old_handle, m_size);
+
+    VkDevice device = backend->logical_device();
+    VkAllocationCallbacks *allocator = backend->allocator();
+    backend->defer_destroy([device, allocator, old_handle]() {
+        vkDestroyBuffer(device, old_handle, allocator);
+    });
 }
 
 VkDescriptorBufferInfo*
@@ -100,3 +135,21 @@ ex::vulkan::buffer::get_descriptor_info() {
 
     return &m_descriptor_info;
 }
+
+VkBuffer
+ex::vulkan::buffer::create_handle(ex::vulkan::backend *backend) {
+    VkBufferCreateInfo buffer_create_info = {};
+    buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_create_info.size = m_size;
+    buffer_create_info.usage = m_usage;
+    buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    buffer_create_info.queueFamilyIndexCount = 0;
+    buffer_create_info.pQueueFamilyIndices = nullptr;
+
+    VkBuffer out_handle;
+    VK_CHECK(vkCreateBuffer(backend->logical_device(),
+                            &buffer_create_info,
+                            backend->allocator(),
+                            &out_handle));
+    return out_handle;
+}
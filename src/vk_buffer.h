@@ -7,6 +7,8 @@
 #include <vector>
 
 namespace ex::vulkan {
+    // device local buffers are registered with the backend as movable, the
+    // defragmenter swaps m_handle under them, so don't copy a built buffer
     class buffer {
     public:
         void set_usage(VkBufferUsageFlags usage);
@@ -16,15 +18,22 @@ namespace ex::vulkan {
         void map(ex::vulkan::backend *backend, VkDeviceSize offset = 0);
         void unmap(ex::vulkan::backend *backend);
         void copy_to(void *data, VkDeviceSize size);
-        void copy_buffer(VkCommandBuffer command_buffer, VkBuffer buffer, VkDeviceSize size);
+        void copy_from(void *data, VkDeviceSize size);
+        void copy_buffer(VkCommandBuffer command_buffer, VkBuffer buffer, VkDeviceSize size, VkDeviceSize dst_offset = 0, VkDeviceSize src_offset = 0);
+        void resize(ex::vulkan::backend *backend, VkDeviceSize size);
         void destroy(ex::vulkan::backend *backend);
+        void relocate(ex::vulkan::backend *backend, VkCommandBuffer command_buffer, const ex::vulkan::memory_allocation &allocation);
         
         VkBuffer handle() { return m_handle; }
+        VkDeviceSize size() { return m_size; }
         VkDescriptorBufferInfo *get_descriptor_info();
         
+    private:
+        VkBuffer create_handle(ex::vulkan::backend *backend);
+        
     private:
         VkBuffer m_handle;
-        VkDeviceMemory m_memory;
+        ex::vulkan::memory_allocation m_memory;
         VkDescriptorBufferInfo m_descriptor_info;
         VkBufferUsageFlags m_usage;
         VkMemoryPropertyFlags m_properties;
@@ -0,0 +1,153 @@
+#include "vk_command_context.h"
+
+#include <algorithm>
+#include <cstring>
+
+ex::vulkan::command_context::command_context(VkCommandBuffer command_buffer)
+    : m_handle(command_buffer) {
+}
+
+void
+ex::vulkan::command_context::reset() {
+    m_bind_points = {};
+    m_viewport_valid = false;
+    m_scissor_valid = false;
+    m_vertex_bindings = {};
+    m_index_buffer = VK_NULL_HANDLE;
+}
+
+void
+ex::vulkan::command_context::bind_pipeline(VkPipelineBindPoint bind_point, VkPipeline pipeline) {
+    bind_point_state &state = get_bind_point(bind_point);
+    if (state.pipeline == pipeline) {
+        m_stats.skipped++;
+        return;
+    }
+
+    vkCmdBindPipeline(m_handle, bind_point, pipeline);
+    state.pipeline = pipeline;
+    m_stats.issued++;
+}
+
+void
+ex::vulkan::command_context::bind_descriptor_sets(VkPipelineBindPoint bind_point,
+                                                  VkPipelineLayout layout,
+                                                  uint32_t first_set,
+                                                  ex::utils::span<const VkDescriptorSet> descriptor_sets,
+                                                  ex::utils::span<const uint32_t> dynamic_offsets) {
+    bind_point_state &state = get_bind_point(bind_point);
+    uint32_t count = static_cast<uint32_t>(descriptor_sets.size());
+    bool tracked = first_set + count <= max_descriptor_sets && dynamic_offsets.size() <= max_dynamic_offsets;
+
+    if (tracked) {
+        bool redundant = true;
+        for (uint32_t i = 0; i < count && redundant; i++) {
+            const bound_set &bound = state.sets[first_set + i];
+            redundant = bound.layout == layout &&
+                bound.set == descriptor_sets[i] &&
+                bound.dynamic_offset_count == dynamic_offsets.size() &&
+                std::equal(dynamic_offsets.begin(), dynamic_offsets.end(), bound.dynamic_offsets.begin());
+        }
+        if (redundant) {
+            m_stats.skipped++;
+            return;
+        }
+    }
+
+    vkCmdBindDescriptorSets(m_handle,
+                            bind_point,
+                            layout,
+                            first_set,
+                            count,
+                            descriptor_sets.data(),
+                            static_cast<uint32_t>(dynamic_offsets.size()),
+                            dynamic_offsets.data());
+    m_stats.issued++;
+
+    // sets bound through another layout may be disturbed now, don't trust
+    // them to skip anything
+    for (bound_set &bound : state.sets) {
+        if (bound.layout != layout) bound = {};
+    }
+    for (uint32_t i = 0; i < count && first_set + i < max_descriptor_sets; i++) {
+        bound_set &bound = state.sets[first_set + i];
+        bound = {};
+        if (!tracked) continue;
+        bound.layout = layout;
+        bound.set = descriptor_sets[i];
+        bound.dynamic_offset_count = static_cast<uint32_t>(dynamic_offsets.size());
+        std::copy(dynamic_offsets.begin(), dynamic_offsets.end(), bound.dynamic_offsets.begin());
+    }
+}
+
+void
+ex::vulkan::command_context::set_viewport(const VkViewport &viewport) {
+    if (m_viewport_valid && memcmp(&m_viewport, &viewport, sizeof(VkViewport)) == 0) {
+        m_stats.skipped++;
+        return;
+    }
+
+    vkCmdSetViewport(m_handle, 0, 1, &viewport);
+    m_viewport = viewport;
+    m_viewport_valid = true;
+    m_stats.issued++;
+}
+
+void
+ex::vulkan::command_context::set_scissor(const VkRect2D &scissor) {
+    if (m_scissor_valid && memcmp(&m_scissor, &scissor, sizeof(VkRect2D)) == 0) {
+        m_stats.skipped++;
+        return;
+    }
+
+    vkCmdSetScissor(m_handle, 0, 1, &scissor);
+    m_scissor = scissor;
+    m_scissor_valid = true;
+    m_stats.issued++;
+}
+
+void
+ex::vulkan::command_context::bind_vertex_buffers(uint32_t first_binding,
+                                                 ex::utils::span<const VkBuffer> buffers,
+                                                 ex::utils::span<const VkDeviceSize> offsets) {
+    uint32_t count = static_cast<uint32_t>(std::min(buffers.size(), offsets.size()));
+    bool tracked = first_binding + count <= max_vertex_bindings;
+
+    if (tracked) {
+        bool redundant = true;
+        for (uint32_t i = 0; i < count && redundant; i++) {
+            const vertex_binding &bound = m_vertex_bindings[first_binding + i];
+            redundant = bound.buffer == buffers[i] && bound.offset == offsets[i];
+        }
+        if (redundant) {
+            m_stats.skipped++;
+            return;
+        }
+    }
+
+    vkCmdBindVertexBuffers(m_handle, first_binding, count, buffers.data(), offsets.data());
+    m_stats.issued++;
+
+    for (uint32_t i = 0; i < count && first_binding + i < max_vertex_bindings; i++) {
+        m_vertex_bindings[first_binding + i] = { buffers[i], offsets[i] };
+    }
+}
+
+void
+ex::vulkan::command_context::bind_index_buffer(VkBuffer buffer, VkDeviceSize offset, VkIndexType index_type) {
+    if (m_index_buffer == buffer && m_index_offset == offset && m_index_type == index_type) {
+        m_stats.skipped++;
+        return;
+    }
+
+    vkCmdBindIndexBuffer(m_handle, buffer, offset, index_type);
+    m_index_buffer = buffer;
+    m_index_offset = offset;
+    m_index_type = index_type;
+    m_stats.issued++;
+}
+
+ex::vulkan::command_context::bind_point_state &
+ex::vulkan::command_context::get_bind_point(VkPipelineBindPoint bind_point) {
+    return m_bind_points[bind_point == VK_PIPELINE_BIND_POINT_COMPUTE ? 1 : 0];
+}
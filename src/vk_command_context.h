@@ -0,0 +1,81 @@
+#pragma once
+
+#include "ex_utils.hpp"
+
+#include <vulkan/vulkan.h>
+#include <array>
+#include <cstdint>
+
+namespace ex::vulkan {
+    // Records into one command buffer and remembers what is bound, calls
+    // that wouldn't change anything are dropped. Fixed size state, lives on
+    // the recording thread's stack, nothing is allocated per draw. Starts
+    // from nothing bound, which is what a secondary inherits.
+    class command_context {
+    public:
+        static constexpr uint32_t max_descriptor_sets = 8;
+        static constexpr uint32_t max_dynamic_offsets = 8;
+        static constexpr uint32_t max_vertex_bindings = 8;
+
+        struct stats {
+            uint32_t issued;
+            uint32_t skipped;
+        };
+
+    public:
+        explicit command_context(VkCommandBuffer command_buffer);
+        // something recorded behind the context's back, forget everything
+        void reset();
+
+        void bind_pipeline(VkPipelineBindPoint bind_point, VkPipeline pipeline);
+        void bind_descriptor_sets(VkPipelineBindPoint bind_point,
+                                  VkPipelineLayout layout,
+                                  uint32_t first_set,
+                                  ex::utils::span<const VkDescriptorSet> descriptor_sets,
+                                  ex::utils::span<const uint32_t> dynamic_offsets = {});
+        void set_viewport(const VkViewport &viewport);
+        void set_scissor(const VkRect2D &scissor);
+        void bind_vertex_buffers(uint32_t first_binding,
+                                 ex::utils::span<const VkBuffer> buffers,
+                                 ex::utils::span<const VkDeviceSize> offsets);
+        void bind_index_buffer(VkBuffer buffer, VkDeviceSize offset, VkIndexType index_type);
+
+        VkCommandBuffer handle() { return m_handle; }
+        const stats &get_stats() { return m_stats; }
+
+    private:
+        struct bound_set {
+            VkPipelineLayout layout;
+            VkDescriptorSet set;
+            // offsets of the call that bound it, compared as a whole
+            uint32_t dynamic_offset_count;
+            std::array<uint32_t, max_dynamic_offsets> dynamic_offsets;
+        };
+
+        struct bind_point_state {
+            VkPipeline pipeline;
+            std::array<bound_set, max_descriptor_sets> sets;
+        };
+
+        struct vertex_binding {
+            VkBuffer buffer;
+            VkDeviceSize offset;
+        };
+
+        bind_point_state &get_bind_point(VkPipelineBindPoint bind_point);
+
+    private:
+        VkCommandBuffer m_handle {};
+        // graphics and compute
+        std::array<bind_point_state, 2> m_bind_points {};
+        bool m_viewport_valid {false};
+        VkViewport m_viewport {};
+        bool m_scissor_valid {false};
+        VkRect2D m_scissor {};
+        std::array<vertex_binding, max_vertex_bindings> m_vertex_bindings {};
+        VkBuffer m_index_buffer {};
+        VkDeviceSize m_index_offset {0};
+        VkIndexType m_index_type {VK_INDEX_TYPE_UINT32};
+        stats m_stats {};
+    };
+}
@@ -1,5 +1,9 @@
 #include "vk_descriptor.h"
+#include "vk_backend.h"
 #include "vk_common.h"
+#include "ex_logger.h"
+
+#include <algorithm>
 
 void
 ex::vulkan::descriptor_pool::add_size(VkDescriptorType type,
@@ -30,6 +34,236 @@ ex::vulkan::descriptor_pool::destroy(ex::vulkan::backend *backend) {
     if (m_handle) vkDestroyDescriptorPool(backend->logical_device(), m_handle, backend->allocator());
 }
 
+bool
+ex::vulkan::descriptor_layout_cache::layout_key::operator==(const layout_key &other) const {
+    return std::equal(bindings.begin(), bindings.end(), other.bindings.begin(), other.bindings.end(),
+                      [](const VkDescriptorSetLayoutBinding &a, const VkDescriptorSetLayoutBinding &b) {
+                          return a.binding == b.binding &&
+                              a.descriptorType == b.descriptorType &&
+                              a.descriptorCount == b.descriptorCount &&
+                              a.stageFlags == b.stageFlags &&
+                              a.pImmutableSamplers == b.pImmutableSamplers;
+                      });
+}
+
+std::size_t
+ex::vulkan::descriptor_layout_cache::layout_key_hash::operator()(const layout_key &key) const {
+    std::size_t seed = key.bindings.size();
+    for (const VkDescriptorSetLayoutBinding &binding : key.bindings) {
+        ex::utils::hash_combine(seed,
+                                binding.binding,
+                                static_cast<uint32_t>(binding.descriptorType),
+                                binding.descriptorCount,
+                                binding.stageFlags,
+                                binding.pImmutableSamplers);
+    }
+    return seed;
+}
+
+VkDescriptorSetLayout
+ex::vulkan::descriptor_layout_cache::get(ex::vulkan::backend *backend,
+                                         const std::vector<VkDescriptorSetLayoutBinding> &bindings) {
+    // sorted so the order bindings were added in doesn't split layouts
+    layout_key key = { bindings };
+    std::sort(key.bindings.begin(), key.bindings.end(), [](const VkDescriptorSetLayoutBinding &a, const VkDescriptorSetLayoutBinding &b) {
+        return a.binding < b.binding;
+    });
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto found = m_layouts.find(key);
+    if (found != m_layouts.end()) return found->second;
+
+    VkDescriptorSetLayoutCreateInfo descriptor_set_layout_create_info = {};
+    descriptor_set_layout_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    descriptor_set_layout_create_info.pNext = nullptr;
+    descriptor_set_layout_create_info.flags = 0;
+    descriptor_set_layout_create_info.bindingCount = static_cast<uint32_t>(key.bindings.size());
+    descriptor_set_layout_create_info.pBindings = key.bindings.data();
+
+    VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+    VK_CHECK(vkCreateDescriptorSetLayout(backend->logical_device(),
+                                         &descriptor_set_layout_create_info,
+                                         backend->allocator(),
+                                         &layout));
+
+    // every descriptor gets one slot, in binding order
+    layout_template update_template = {};
+    bool packable = true;
+    for (const VkDescriptorSetLayoutBinding &binding : key.bindings) {
+        switch (binding.descriptorType) {
+        case VK_DESCRIPTOR_TYPE_SAMPLER:
+        case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+        case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+        case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+        case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT:
+        case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
+        case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
+        case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+        case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+        case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC:
+        case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC:
+            break;
+        default:
+            packable = false;
+            break;
+        }
+        if (binding.descriptorCount == 0) continue;
+
+        VkDescriptorUpdateTemplateEntry descriptor_update_template_entry = {};
+        descriptor_update_template_entry.dstBinding = binding.binding;
+        descriptor_update_template_entry.dstArrayElement = 0;
+        descriptor_update_template_entry.descriptorCount = binding.descriptorCount;
+        descriptor_update_template_entry.descriptorType = binding.descriptorType;
+        descriptor_update_template_entry.offset = update_template.descriptor_count * sizeof(ex::vulkan::descriptor_info);
+        descriptor_update_template_entry.stride = sizeof(ex::vulkan::descriptor_info);
+        update_template.entries.push_back(descriptor_update_template_entry);
+        update_template.descriptor_count += binding.descriptorCount;
+    }
+
+    if (packable && !update_template.entries.empty()) {
+        VkDescriptorUpdateTemplateCreateInfo descriptor_update_template_create_info = {};
+        descriptor_update_template_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+        descriptor_update_template_create_info.pNext = nullptr;
+        descriptor_update_template_create_info.flags = 0;
+        descriptor_update_template_create_info.descriptorUpdateEntryCount = static_cast<uint32_t>(update_template.entries.size());
+        descriptor_update_template_create_info.pDescriptorUpdateEntries = update_template.entries.data();
+        descriptor_update_template_create_info.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+        descriptor_update_template_create_info.descriptorSetLayout = layout;
+        VK_CHECK(vkCreateDescriptorUpdateTemplate(backend->logical_device(),
+                                                  &descriptor_update_template_create_info,
+                                                  backend->allocator(),
+                                                  &update_template.handle));
+    }
+
+    m_templates.emplace(layout, std::move(update_template));
+    m_layouts.emplace(std::move(key), layout);
+    return layout;
+}
+
+const ex::vulkan::descriptor_layout_cache::layout_template *
+ex::vulkan::descriptor_layout_cache::get_template(VkDescriptorSetLayout layout) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto found = m_templates.find(layout);
+    if (found == m_templates.end() || !found->second.handle) return nullptr;
+    return &found->second;
+}
+
+void
+ex::vulkan::descriptor_layout_cache::destroy(ex::vulkan::backend *backend) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto &[layout, update_template] : m_templates) {
+        if (update_template.handle) vkDestroyDescriptorUpdateTemplate(backend->logical_device(), update_template.handle, backend->allocator());
+    }
+    for (auto &[key, layout] : m_layouts) vkDestroyDescriptorSetLayout(backend->logical_device(), layout, backend->allocator());
+    m_templates.clear();
+    m_layouts.clear();
+}
+
+void
+ex::vulkan::descriptor_allocator::add_size(VkDescriptorType type, float count_per_set) {
+    m_sizes.push_back({ type, count_per_set });
+}
+
+void
+ex::vulkan::descriptor_allocator::set_sets_per_pool(uint32_t sets_per_pool) {
+    m_sets_per_pool = std::clamp(sets_per_pool, 1u, max_sets_per_pool);
+}
+
+void
+ex::vulkan::descriptor_allocator::destroy(ex::vulkan::backend *backend) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (VkDescriptorPool pool : m_used_pools) vkDestroyDescriptorPool(backend->logical_device(), pool, backend->allocator());
+    for (VkDescriptorPool pool : m_free_pools) vkDestroyDescriptorPool(backend->logical_device(), pool, backend->allocator());
+    m_used_pools.clear();
+    m_free_pools.clear();
+}
+
+VkDescriptorSet
+ex::vulkan::descriptor_allocator::allocate(ex::vulkan::backend *backend, VkDescriptorSetLayout layout) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_used_pools.empty()) m_used_pools.push_back(next_pool(backend));
+
+    VkDescriptorSetAllocateInfo descriptor_set_allocate_info = {};
+    descriptor_set_allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    descriptor_set_allocate_info.pNext = nullptr;
+    descriptor_set_allocate_info.descriptorPool = m_used_pools.back();
+    descriptor_set_allocate_info.descriptorSetCount = 1;
+    descriptor_set_allocate_info.pSetLayouts = &layout;
+
+    VkDescriptorSet set = VK_NULL_HANDLE;
+    VkResult result = vkAllocateDescriptorSets(backend->logical_device(), &descriptor_set_allocate_info, &set);
+    if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL) {
+        // the full pool stays used until reset, the set goes to a fresh one
+        m_used_pools.push_back(next_pool(backend));
+        descriptor_set_allocate_info.descriptorPool = m_used_pools.back();
+        result = vkAllocateDescriptorSets(backend->logical_device(), &descriptor_set_allocate_info, &set);
+    }
+    VK_CHECK(result);
+    return set;
+}
+
+void
+ex::vulkan::descriptor_allocator::reset(ex::vulkan::backend *backend) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (VkDescriptorPool pool : m_used_pools) {
+        VK_CHECK(vkResetDescriptorPool(backend->logical_device(), pool, 0));
+        m_free_pools.push_back(pool);
+    }
+    m_used_pools.clear();
+}
+
+VkDescriptorPool
+ex::vulkan::descriptor_allocator::create_pool(ex::vulkan::backend *backend) {
+    // without sizes, something that covers the sets this engine builds
+    static const std::pair<VkDescriptorType, float> default_sizes[] = {
+        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.0f },
+        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.0f },
+        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2.0f },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.0f },
+        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1.0f },
+    };
+
+    std::vector<VkDescriptorPoolSize> pool_sizes;
+    auto add = [&](VkDescriptorType type, float count_per_set) {
+        VkDescriptorPoolSize descriptor_pool_size = {};
+        descriptor_pool_size.type = type;
+        descriptor_pool_size.descriptorCount = std::max(1u, static_cast<uint32_t>(count_per_set * static_cast<float>(m_sets_per_pool)));
+        pool_sizes.push_back(descriptor_pool_size);
+    };
+    if (m_sizes.empty()) for (const auto &[type, count_per_set] : default_sizes) add(type, count_per_set);
+    else for (const auto &[type, count_per_set] : m_sizes) add(type, count_per_set);
+
+    VkDescriptorPoolCreateInfo descriptor_pool_create_info = {};
+    descriptor_pool_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    descriptor_pool_create_info.pNext = nullptr;
+    descriptor_pool_create_info.flags = 0;
+    descriptor_pool_create_info.maxSets = m_sets_per_pool;
+    descriptor_pool_create_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+    descriptor_pool_create_info.pPoolSizes = pool_sizes.data();
+
+    VkDescriptorPool pool = VK_NULL_HANDLE;
+    VK_CHECK(vkCreateDescriptorPool(backend->logical_device(),
+                                    &descriptor_pool_create_info,
+                                    backend->allocator(),
+                                    &pool));
+    return pool;
+}
+
+VkDescriptorPool
+ex::vulkan::descriptor_allocator::next_pool(ex::vulkan::backend *backend) {
+    if (!m_free_pools.empty()) {
+        VkDescriptorPool pool = m_free_pools.back();
+        m_free_pools.pop_back();
+        return pool;
+    }
+
+    // every new pool is bigger, a busy allocator settles on a few pools
+    VkDescriptorPool pool = create_pool(backend);
+    EXDEBUG("Descriptor allocator: pool %u with %u sets", pool_count() + 1, m_sets_per_pool);
+    m_sets_per_pool = std::min(m_sets_per_pool * 2, max_sets_per_pool);
+    return pool;
+}
+
 void
 ex::vulkan::descriptor_set_layout::add_binding(uint32_t binding,
                                                VkDescriptorType type,
@@ -46,21 +280,13 @@ ex::vulkan::descriptor_set_layout::add_binding(uint32_t binding,
 
 void
 ex::vulkan::descriptor_set_layout::create(ex::vulkan::backend *backend) {
-    VkDescriptorSetLayoutCreateInfo descriptor_set_layout_create_info = {};
-    descriptor_set_layout_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    descriptor_set_layout_create_info.pNext = nullptr;
-    descriptor_set_layout_create_info.flags = 0;
-    descriptor_set_layout_create_info.bindingCount = static_cast<uint32_t>(m_bindings.size());
-    descriptor_set_layout_create_info.pBindings = m_bindings.data();
-    VK_CHECK(vkCreateDescriptorSetLayout(backend->logical_device(),
-                                         &descriptor_set_layout_create_info,
-                                         backend->allocator(),
-                                         &m_handle));
+    m_handle = backend->descriptor_layouts()->get(backend, m_bindings);
 }
 
 void
-ex::vulkan::descriptor_set_layout::destroy(ex::vulkan::backend *backend) {
-    if (m_handle) vkDestroyDescriptorSetLayout(backend->logical_device(), m_handle, backend->allocator());
+ex::vulkan::descriptor_set_layout::destroy(ex::vulkan::backend * /*backend*/) {
+    // the cache destroys it with the backend, others may share it
+    m_handle = VK_NULL_HANDLE;
 }
 
 void
@@ -76,6 +302,17 @@ ex::vulkan::descriptor_set::allocate(ex::vulkan::backend *backend,
     VK_CHECK(vkAllocateDescriptorSets(backend->logical_device(),
                                       &descriptor_set_allocate_info,
                                       &m_handle));
+    m_template = backend->descriptor_layouts()->get_template(set_layout->handle());
+    for (VkWriteDescriptorSet &write_descriptor_set : m_writes) write_descriptor_set.dstSet = m_handle;
+}
+
+void
+ex::vulkan::descriptor_set::allocate(ex::vulkan::backend *backend,
+                                     ex::vulkan::descriptor_allocator *allocator,
+                                     ex::vulkan::descriptor_set_layout *set_layout) {
+    m_handle = allocator->allocate(backend, set_layout->handle());
+    m_template = backend->descriptor_layouts()->get_template(set_layout->handle());
+    for (VkWriteDescriptorSet &write_descriptor_set : m_writes) write_descriptor_set.dstSet = m_handle;
 }
 
 void
@@ -93,7 +330,7 @@ ex::vulkan::descriptor_set::write_buffer(uint32_t binding,
     write_descriptor_set.pImageInfo = nullptr;
     write_descriptor_set.pBufferInfo = buffer_info;
     write_descriptor_set.pTexelBufferView = nullptr;
-    m_writes.push_back(write_descriptor_set);
+    set_write(write_descriptor_set);
 }
 
 void
@@ -111,13 +348,241 @@ ex::vulkan::descriptor_set::write_image(uint32_t binding,
     write_descriptor_set.pImageInfo = image_info;
     write_descriptor_set.pBufferInfo = nullptr;
     write_descriptor_set.pTexelBufferView = nullptr;
-    m_writes.push_back(write_descriptor_set);
+    set_write(write_descriptor_set);
 }
 
 void
 ex::vulkan::descriptor_set::update(ex::vulkan::backend *backend) {
+    if (m_writes.empty()) return;
+    if (pack_writes()) {
+        vkUpdateDescriptorSetWithTemplate(backend->logical_device(), m_handle, m_template->handle, m_packed.data());
+        return;
+    }
+
+    // a partly written set, the template would send the gaps too
     vkUpdateDescriptorSets(backend->logical_device(),
-                           m_writes.size(),
+                           static_cast<uint32_t>(m_writes.size()),
                            m_writes.data(),
                            0, nullptr);
 }
+
+bool
+ex::vulkan::descriptor_set::pack_writes() {
+    if (!m_template) return false;
+
+    uint32_t written = 0;
+    for (const VkWriteDescriptorSet &write_descriptor_set : m_writes) written += write_descriptor_set.descriptorCount;
+    if (written != m_template->descriptor_count) return false;
+
+    m_packed.resize(m_template->descriptor_count);
+    for (const VkWriteDescriptorSet &write_descriptor_set : m_writes) {
+        auto entry = std::find_if(m_template->entries.begin(), m_template->entries.end(), [&](const VkDescriptorUpdateTemplateEntry &template_entry) {
+            return template_entry.dstBinding == write_descriptor_set.dstBinding;
+        });
+        if (entry == m_template->entries.end() ||
+            entry->descriptorType != write_descriptor_set.descriptorType ||
+            write_descriptor_set.dstArrayElement + write_descriptor_set.descriptorCount > entry->descriptorCount) {
+            return false;
+        }
+
+        std::size_t slot = entry->offset / sizeof(ex::vulkan::descriptor_info) + write_descriptor_set.dstArrayElement;
+        for (uint32_t i = 0; i < write_descriptor_set.descriptorCount; i++) {
+            ex::vulkan::descriptor_info &info = m_packed[slot + i];
+            if (write_descriptor_set.pImageInfo) info.image = write_descriptor_set.pImageInfo[i];
+            else if (write_descriptor_set.pBufferInfo) info.buffer = write_descriptor_set.pBufferInfo[i];
+            else info.texel_buffer_view = write_descriptor_set.pTexelBufferView[i];
+        }
+    }
+    return true;
+}
+
+void
+ex::vulkan::descriptor_set::set_write(const VkWriteDescriptorSet &write_descriptor_set) {
+    auto found = std::find_if(m_writes.begin(), m_writes.end(), [&](const VkWriteDescriptorSet &write) {
+        return write.dstBinding == write_descriptor_set.dstBinding &&
+            write.dstArrayElement == write_descriptor_set.dstArrayElement;
+    });
+    if (found != m_writes.end()) *found = write_descriptor_set;
+    else m_writes.push_back(write_descriptor_set);
+}
+
+void
+ex::vulkan::descriptor_update_template::add_buffer(uint32_t binding,
+                                                   VkDescriptorType type,
+                                                   std::size_t offset,
+                                                   uint32_t count,
+                                                   std::size_t stride) {
+    VkDescriptorUpdateTemplateEntry descriptor_update_template_entry = {};
+    descriptor_update_template_entry.dstBinding = binding;
+    descriptor_update_template_entry.dstArrayElement = 0;
+    descriptor_update_template_entry.descriptorCount = count;
+    descriptor_update_template_entry.descriptorType = type;
+    descriptor_update_template_entry.offset = offset;
+    descriptor_update_template_entry.stride = stride;
+    m_entries.push_back(descriptor_update_template_entry);
+}
+
+void
+ex::vulkan::descriptor_update_template::add_image(uint32_t binding,
+                                                  VkDescriptorType type,
+                                                  std::size_t offset,
+                                                  uint32_t count,
+                                                  std::size_t stride) {
+    VkDescriptorUpdateTemplateEntry descriptor_update_template_entry = {};
+    descriptor_update_template_entry.dstBinding = binding;
+    descriptor_update_template_entry.dstArrayElement = 0;
+    descriptor_update_template_entry.descriptorCount = count;
+    descriptor_update_template_entry.descriptorType = type;
+    descriptor_update_template_entry.offset = offset;
+    descriptor_update_template_entry.stride = stride;
+    m_entries.push_back(descriptor_update_template_entry);
+}
+
+void
+ex::vulkan::descriptor_update_template::create(ex::vulkan::backend *backend,
+                                               ex::vulkan::descriptor_set_layout *set_layout) {
+    VkDescriptorUpdateTemplateCreateInfo descriptor_update_template_create_info = {};
+    descriptor_update_template_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+    descriptor_update_template_create_info.pNext = nullptr;
+    descriptor_update_template_create_info.flags = 0;
+    descriptor_update_template_create_info.descriptorUpdateEntryCount = static_cast<uint32_t>(m_entries.size());
+    descriptor_update_template_create_info.pDescriptorUpdateEntries = m_entries.data();
+    descriptor_update_template_create_info.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+    descriptor_update_template_create_info.descriptorSetLayout = set_layout->handle();
+    // only used by push descriptor templates
+    descriptor_update_template_create_info.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    descriptor_update_template_create_info.pipelineLayout = VK_NULL_HANDLE;
+    descriptor_update_template_create_info.set = 0;
+    VK_CHECK(vkCreateDescriptorUpdateTemplate(backend->logical_device(),
+                                              &descriptor_update_template_create_info,
+                                              backend->allocator(),
+                                              &m_handle));
+}
+
+void
+ex::vulkan::descriptor_update_template::destroy(ex::vulkan::backend *backend) {
+    if (m_handle) vkDestroyDescriptorUpdateTemplate(backend->logical_device(), m_handle, backend->allocator());
+    m_handle = VK_NULL_HANDLE;
+}
+
+void
+ex::vulkan::descriptor_update_template::update(ex::vulkan::backend *backend,
+                                               VkDescriptorSet set,
+                                               const void *data) {
+    vkUpdateDescriptorSetWithTemplate(backend->logical_device(), set, m_handle, data);
+}
+
+bool
+ex::vulkan::descriptor_set_cache::is_image_type(VkDescriptorType type) {
+    return type == VK_DESCRIPTOR_TYPE_SAMPLER ||
+        type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER ||
+        type == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE ||
+        type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE ||
+        type == VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+}
+
+bool
+ex::vulkan::descriptor_set_cache::set_key::operator==(const set_key &other) const {
+    return layout == other.layout &&
+        std::equal(writes.begin(), writes.end(), other.writes.begin(), other.writes.end(),
+                   [](const write &a, const write &b) {
+                       return a.binding == b.binding &&
+                           a.type == b.type &&
+                           a.buffer_info.buffer == b.buffer_info.buffer &&
+                           a.buffer_info.offset == b.buffer_info.offset &&
+                           a.buffer_info.range == b.buffer_info.range &&
+                           a.image_info.sampler == b.image_info.sampler &&
+                           a.image_info.imageView == b.image_info.imageView &&
+                           a.image_info.imageLayout == b.image_info.imageLayout;
+                   });
+}
+
+std::size_t
+ex::vulkan::descriptor_set_cache::set_key_hash::operator()(const set_key &key) const {
+    std::size_t seed = 0;
+    ex::utils::hash_combine(seed, key.layout);
+    for (const write &set_write : key.writes) {
+        ex::utils::hash_combine(seed,
+                                set_write.binding,
+                                static_cast<uint32_t>(set_write.type),
+                                set_write.buffer_info.buffer,
+                                set_write.buffer_info.offset,
+                                set_write.buffer_info.range,
+                                set_write.image_info.sampler,
+                                set_write.image_info.imageView,
+                                static_cast<uint32_t>(set_write.image_info.imageLayout));
+    }
+    return seed;
+}
+
+VkDescriptorSet
+ex::vulkan::descriptor_set_cache::get(ex::vulkan::backend *backend,
+                                      ex::vulkan::descriptor_allocator *allocator,
+                                      VkDescriptorSetLayout layout,
+                                      ex::utils::span<const write> writes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_lookup.layout = layout;
+    m_lookup.writes.assign(writes.begin(), writes.end());
+    auto found = m_sets.find(m_lookup);
+    if (found != m_sets.end()) return found->second;
+
+    VkDescriptorSet set = allocator->allocate(backend, layout);
+
+    // a miss writes every binding of the layout, through its template when
+    // there is one
+    const ex::vulkan::descriptor_layout_cache::layout_template *update_template = backend->descriptor_layouts()->get_template(layout);
+    if (update_template && update_template->descriptor_count == m_lookup.writes.size()) {
+        m_packed.assign(update_template->descriptor_count, {});
+        bool packed = true;
+        for (const write &set_write : m_lookup.writes) {
+            auto entry = std::find_if(update_template->entries.begin(), update_template->entries.end(), [&](const VkDescriptorUpdateTemplateEntry &template_entry) {
+                return template_entry.dstBinding == set_write.binding && template_entry.descriptorType == set_write.type;
+            });
+            if (entry == update_template->entries.end()) {
+                packed = false;
+                break;
+            }
+
+            ex::vulkan::descriptor_info &info = m_packed[entry->offset / sizeof(ex::vulkan::descriptor_info)];
+            if (is_image_type(set_write.type)) info.image = set_write.image_info;
+            else info.buffer = set_write.buffer_info;
+        }
+
+        if (packed) {
+            vkUpdateDescriptorSetWithTemplate(backend->logical_device(), set, update_template->handle, m_packed.data());
+            m_sets.emplace(m_lookup, set);
+            return set;
+        }
+    }
+
+    m_vk_writes.clear();
+    for (const write &set_write : m_lookup.writes) {
+        bool image = is_image_type(set_write.type);
+
+        VkWriteDescriptorSet write_descriptor_set = {};
+        write_descriptor_set.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write_descriptor_set.pNext = nullptr;
+        write_descriptor_set.dstSet = set;
+        write_descriptor_set.dstBinding = set_write.binding;
+        write_descriptor_set.dstArrayElement = 0;
+        write_descriptor_set.descriptorCount = 1;
+        write_descriptor_set.descriptorType = set_write.type;
+        write_descriptor_set.pImageInfo = image ? &set_write.image_info : nullptr;
+        write_descriptor_set.pBufferInfo = image ? nullptr : &set_write.buffer_info;
+        write_descriptor_set.pTexelBufferView = nullptr;
+        m_vk_writes.push_back(write_descriptor_set);
+    }
+    vkUpdateDescriptorSets(backend->logical_device(),
+                           static_cast<uint32_t>(m_vk_writes.size()),
+                           m_vk_writes.data(),
+                           0, nullptr);
+
+    m_sets.emplace(m_lookup, set);
+    return set;
+}
+
+void
+ex::vulkan::descriptor_set_cache::clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_sets.clear();
+}
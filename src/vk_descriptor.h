@@ -1,12 +1,16 @@
 #pragma once
 
-#include "vk_backend.h"
+#include "ex_utils.hpp"
 
 #include <vulkan/vulkan.h>
 #include <vector>
+#include <unordered_map>
+#include <mutex>
 #include <cstdint>
 
-namespace ex::vulkan {    
+namespace ex::vulkan {
+    class backend;
+
     class descriptor_pool {
     public:
         void add_size(VkDescriptorType type, uint32_t count);
@@ -14,36 +18,200 @@ namespace ex::vulkan {
         void destroy(ex::vulkan::backend *backend);
 
         VkDescriptorPool handle() { return m_handle; }
-            
+
     private:
-        VkDescriptorPool m_handle;
+        VkDescriptorPool m_handle {};
         std::vector<VkDescriptorPoolSize> m_pool_sizes;
     };
 
+    // one slot of the packed struct an update template reads
+    union descriptor_info {
+        VkDescriptorImageInfo image;
+        VkDescriptorBufferInfo buffer;
+        VkBufferView texel_buffer_view;
+    };
+
+    // Identical binding lists share one VkDescriptorSetLayout, whatever order
+    // the bindings were added in. Each layout also gets an update template
+    // covering all of its bindings. Both live until the cache is destroyed.
+    class descriptor_layout_cache {
+    public:
+        // descriptor i of an entry's binding sits in slot
+        // offset / sizeof(descriptor_info) + i. handle is null when the
+        // layout has a type templates here don't pack
+        struct layout_template {
+            VkDescriptorUpdateTemplate handle;
+            std::vector<VkDescriptorUpdateTemplateEntry> entries;
+            uint32_t descriptor_count;
+        };
+
+    public:
+        VkDescriptorSetLayout get(ex::vulkan::backend *backend, const std::vector<VkDescriptorSetLayoutBinding> &bindings);
+        // null for layouts that didn't come from the cache
+        const layout_template *get_template(VkDescriptorSetLayout layout);
+        void destroy(ex::vulkan::backend *backend);
+
+        uint32_t size() { return static_cast<uint32_t>(m_layouts.size()); }
+
+    private:
+        struct layout_key {
+            std::vector<VkDescriptorSetLayoutBinding> bindings;
+            bool operator==(const layout_key &other) const;
+        };
+
+        struct layout_key_hash {
+            std::size_t operator()(const layout_key &key) const;
+        };
+
+    private:
+        std::mutex m_mutex;
+        std::unordered_map<layout_key, VkDescriptorSetLayout, layout_key_hash> m_layouts;
+        std::unordered_map<VkDescriptorSetLayout, layout_template> m_templates;
+    };
+
+    // Hands out sets from a list of pools and adds a pool when the current
+    // one runs out, so nothing has to be counted up front. Sizes are per
+    // set and every pool holds room for its set count times each of them.
+    // Sets are never freed one by one, reset() recycles all pools at once.
+    class descriptor_allocator {
+    public:
+        static constexpr uint32_t max_sets_per_pool = 4096;
+
+    public:
+        void add_size(VkDescriptorType type, float count_per_set);
+        void set_sets_per_pool(uint32_t sets_per_pool);
+        void destroy(ex::vulkan::backend *backend);
+
+        // thread safe
+        VkDescriptorSet allocate(ex::vulkan::backend *backend, VkDescriptorSetLayout layout);
+        // every set allocated so far becomes invalid, the gpu has to be done
+        // with them
+        void reset(ex::vulkan::backend *backend);
+
+        uint32_t pool_count() { return static_cast<uint32_t>(m_used_pools.size() + m_free_pools.size()); }
+
+    private:
+        VkDescriptorPool create_pool(ex::vulkan::backend *backend);
+        VkDescriptorPool next_pool(ex::vulkan::backend *backend);
+
+    private:
+        std::mutex m_mutex;
+        std::vector<std::pair<VkDescriptorType, float>> m_sizes;
+        uint32_t m_sets_per_pool {64};
+        // the last used pool is the one allocations go to
+        std::vector<VkDescriptorPool> m_used_pools;
+        std::vector<VkDescriptorPool> m_free_pools;
+    };
+
     class descriptor_set_layout {
     public:
         void add_binding(uint32_t binding, VkDescriptorType type, uint32_t count, VkShaderStageFlags stage_flags);
+        // the handle comes from the backend's layout cache and stays owned
+        // by it
         void create(ex::vulkan::backend *backend);
         void destroy(ex::vulkan::backend *backend);
 
         VkDescriptorSetLayout& handle() { return m_handle; }
-        
+
     private:
-        VkDescriptorSetLayout m_handle;
+        VkDescriptorSetLayout m_handle {};
         std::vector<VkDescriptorSetLayoutBinding> m_bindings;
     };
-    
+
+    // Every write a set of one layout needs, compiled into a
+    // VkDescriptorUpdateTemplate. A set is then filled from one packed
+    // struct in a single call, no VkWriteDescriptorSet is built. Entries
+    // name the binding and where its infos sit in the struct, arrays are
+    // count infos stride bytes apart.
+    class descriptor_update_template {
+    public:
+        void add_buffer(uint32_t binding, VkDescriptorType type, std::size_t offset, uint32_t count = 1, std::size_t stride = sizeof(VkDescriptorBufferInfo));
+        void add_image(uint32_t binding, VkDescriptorType type, std::size_t offset, uint32_t count = 1, std::size_t stride = sizeof(VkDescriptorImageInfo));
+        void create(ex::vulkan::backend *backend, ex::vulkan::descriptor_set_layout *set_layout);
+        void destroy(ex::vulkan::backend *backend);
+
+        // thread safe, data is the packed struct
+        void update(ex::vulkan::backend *backend, VkDescriptorSet set, const void *data);
+
+        VkDescriptorUpdateTemplate handle() { return m_handle; }
+
+    private:
+        VkDescriptorUpdateTemplate m_handle {};
+        std::vector<VkDescriptorUpdateTemplateEntry> m_entries;
+    };
+
+    // Writes are kept with pointers to their info structs, update() sends
+    // all of them again so refreshed infos reach the set. Writing a binding
+    // that already has a write replaces it. Once the writes cover the whole
+    // layout they are packed and sent through the layout's template.
     class descriptor_set {
     public:
         void allocate(ex::vulkan::backend *backend, ex::vulkan::descriptor_pool *pool, ex::vulkan::descriptor_set_layout *set_layout);
+        void allocate(ex::vulkan::backend *backend, ex::vulkan::descriptor_allocator *allocator, ex::vulkan::descriptor_set_layout *set_layout);
         void write_buffer(uint32_t binding, VkDescriptorType type, VkDescriptorBufferInfo *buffer_info);
         void write_image(uint32_t binding, VkDescriptorType type, VkDescriptorImageInfo *image_info);
         void update(ex::vulkan::backend *backend);
 
         VkDescriptorSet handle() { return m_handle; }
-        
+
+    private:
+        void set_write(const VkWriteDescriptorSet &write_descriptor_set);
+        bool pack_writes();
+
     private:
-        VkDescriptorSet m_handle;
+        VkDescriptorSet m_handle {};
         std::vector<VkWriteDescriptorSet> m_writes;
+        const ex::vulkan::descriptor_layout_cache::layout_template *m_template {nullptr};
+        std::vector<ex::vulkan::descriptor_info> m_packed;
+    };
+
+    // Sets looked up by layout and write contents, materials pointing at the
+    // same resources share one set and a repeated lookup writes nothing.
+    // A cached set is never rewritten, a resource that moves gets a new set
+    // on its next lookup. Sets come from the allocator handed to get() and
+    // are only as valid as its pools, so whoever resets the allocator
+    // clears the cache with it. Entries match on raw handles, clear() also
+    // has to run when a resource is destroyed and its handle value may come
+    // back.
+    class descriptor_set_cache {
+    public:
+        struct write {
+            uint32_t binding;
+            VkDescriptorType type;
+            VkDescriptorBufferInfo buffer_info; // buffer types
+            VkDescriptorImageInfo image_info;   // image and sampler types
+        };
+
+    public:
+        // thread safe
+        VkDescriptorSet get(ex::vulkan::backend *backend,
+                            ex::vulkan::descriptor_allocator *allocator,
+                            VkDescriptorSetLayout layout,
+                            ex::utils::span<const write> writes);
+        // thread safe, forgets the sets without freeing them
+        void clear();
+
+        uint32_t size() { return static_cast<uint32_t>(m_sets.size()); }
+
+    private:
+        struct set_key {
+            VkDescriptorSetLayout layout;
+            std::vector<write> writes;
+            bool operator==(const set_key &other) const;
+        };
+
+        struct set_key_hash {
+            std::size_t operator()(const set_key &key) const;
+        };
+
+        static bool is_image_type(VkDescriptorType type);
+
+    private:
+        std::mutex m_mutex;
+        std::unordered_map<set_key, VkDescriptorSet, set_key_hash> m_sets;
+        // lookups build their key here, a hit allocates nothing
+        set_key m_lookup;
+        std::vector<VkWriteDescriptorSet> m_vk_writes;
+        std::vector<ex::vulkan::descriptor_info> m_packed;
     };
 }
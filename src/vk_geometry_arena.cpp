@@ -0,0 +1,171 @@
+#include "vk_geometry_arena.h"
+#include "vk_common.h"
+#include "ex_logger.h"
+
+#include <stdexcept>
+#include <algorithm>
+
+void
+ex::vulkan::geometry_arena::set_capacity(uint32_t vertex_capacity, uint32_t index_capacity) {
+    m_vertex_capacity = vertex_capacity;
+    m_index_capacity = index_capacity;
+}
+
+void
+ex::vulkan::geometry_arena::create(ex::vulkan::backend *backend) {
+    m_vertex_buffer.set_usage(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+    m_vertex_buffer.set_properties(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    m_vertex_buffer.build(backend, sizeof(ex::vertex) * static_cast<VkDeviceSize>(m_vertex_capacity));
+    m_vertex_buffer.bind(backend);
+
+    m_position_buffer.set_usage(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+    m_position_buffer.set_properties(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    m_position_buffer.build(backend, sizeof(glm::vec3) * static_cast<VkDeviceSize>(m_vertex_capacity));
+    m_position_buffer.bind(backend);
+
+    m_index_buffer.set_usage(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+    m_index_buffer.set_properties(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    m_index_buffer.build(backend, sizeof(uint32_t) * static_cast<VkDeviceSize>(m_index_capacity));
+    m_index_buffer.bind(backend);
+
+    m_vertices.create(m_vertex_capacity);
+    m_indices.create(m_index_capacity);
+}
+
+void
+ex::vulkan::geometry_arena::destroy(ex::vulkan::backend *backend) {
+    m_index_buffer.destroy(backend);
+    m_position_buffer.destroy(backend);
+    m_vertex_buffer.destroy(backend);
+}
+
+ex::vulkan::geometry_arena::range
+ex::vulkan::geometry_arena::allocate(ex::vulkan::backend *backend,
+                                     const std::vector<ex::vertex> &vertices,
+                                     const std::vector<uint32_t> &indices) {
+    range out_range = {};
+    // nothing to stage, and a zero-size copy isn't valid
+    if (vertices.empty() && indices.empty()) return out_range;
+
+    out_range.vertex_count = static_cast<uint32_t>(vertices.size());
+    out_range.index_count = static_cast<uint32_t>(indices.size());
+    out_range.first_vertex = static_cast<uint32_t>(allocate_range(backend, m_vertices, m_vertex_buffer, vertices.size(), sizeof(ex::vertex)));
+    out_range.first_index = static_cast<uint32_t>(allocate_range(backend, m_indices, m_index_buffer, indices.size(), sizeof(uint32_t)));
+
+    // the position stream follows the vertex ranges, grow it alongside
+    VkDeviceSize position_capacity = sizeof(glm::vec3) * static_cast<VkDeviceSize>(m_vertices.size());
+    if (m_position_buffer.size() < position_capacity) m_position_buffer.resize(backend, position_capacity);
+
+    std::vector<glm::vec3> positions(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++) positions[i] = vertices[i].position;
+
+    VkDeviceSize vertex_size = sizeof(ex::vertex) * static_cast<VkDeviceSize>(out_range.vertex_count);
+    VkDeviceSize position_size = sizeof(glm::vec3) * static_cast<VkDeviceSize>(out_range.vertex_count);
+    VkDeviceSize index_size = sizeof(uint32_t) * static_cast<VkDeviceSize>(out_range.index_count);
+
+    // one staging upload for all three streams
+    ex::vulkan::buffer staging_buffer;
+    staging_buffer.set_usage(VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+    staging_buffer.set_properties(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    staging_buffer.build(backend, vertex_size + position_size + index_size);
+
+    staging_buffer.bind(backend);
+    staging_buffer.map(backend);
+    staging_buffer.copy_to((void *) vertices.data(), vertex_size);
+    staging_buffer.map(backend, vertex_size);
+    staging_buffer.copy_to((void *) positions.data(), position_size);
+    staging_buffer.map(backend, vertex_size + position_size);
+    staging_buffer.copy_to((void *) indices.data(), index_size);
+    staging_buffer.unmap(backend);
+
+    VkCommandBuffer command_buffer = backend->begin_single_time_commands();
+    if (vertex_size > 0) {
+        m_vertex_buffer.copy_buffer(command_buffer,
+                                    staging_buffer.handle(),
+                                    vertex_size,
+                                    sizeof(ex::vertex) * static_cast<VkDeviceSize>(out_range.first_vertex));
+        m_position_buffer.copy_buffer(command_buffer,
+                                      staging_buffer.handle(),
+                                      position_size,
+                                      sizeof(glm::vec3) * static_cast<VkDeviceSize>(out_range.first_vertex),
+                                      vertex_size);
+    }
+    if (index_size > 0) {
+        m_index_buffer.copy_buffer(command_buffer,
+                                   staging_buffer.handle(),
+                                   index_size,
+                                   sizeof(uint32_t) * static_cast<VkDeviceSize>(out_range.first_index),
+                                   vertex_size + position_size);
+    }
+    backend->end_single_time_commands(command_buffer);
+    staging_buffer.destroy(backend);
+
+    return out_range;
+}
+
+void
+ex::vulkan::geometry_arena::free(const range &geometry) {
+    m_vertices.free(geometry.first_vertex, geometry.vertex_count);
+    m_indices.free(geometry.first_index, geometry.index_count);
+}
+
+void
+ex::vulkan::geometry_arena::bind(VkCommandBuffer command_buffer) {
+    VkBuffer vertex_buffers[] = { m_vertex_buffer.handle() };
+    VkDeviceSize offsets[] = { 0 };
+    vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_buffers, offsets);
+    vkCmdBindIndexBuffer(command_buffer, m_index_buffer.handle(), 0, VK_INDEX_TYPE_UINT32);
+}
+
+void
+ex::vulkan::geometry_arena::bind_positions(VkCommandBuffer command_buffer) {
+    VkBuffer vertex_buffers[] = { m_position_buffer.handle() };
+    VkDeviceSize offsets[] = { 0 };
+    vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_buffers, offsets);
+    vkCmdBindIndexBuffer(command_buffer, m_index_buffer.handle(), 0, VK_INDEX_TYPE_UINT32);
+}
+
+void
+ex::vulkan::geometry_arena::bind(ex::vulkan::command_context &context) {
+    VkBuffer vertex_buffers[] = { m_vertex_buffer.handle() };
+    VkDeviceSize offsets[] = { 0 };
+    context.bind_vertex_buffers(0, vertex_buffers, offsets);
+    context.bind_index_buffer(m_index_buffer.handle(), 0, VK_INDEX_TYPE_UINT32);
+}
+
+void
+ex::vulkan::geometry_arena::bind_positions(ex::vulkan::command_context &context) {
+    VkBuffer vertex_buffers[] = { m_position_buffer.handle() };
+    VkDeviceSize offsets[] = { 0 };
+    context.bind_vertex_buffers(0, vertex_buffers, offsets);
+    context.bind_index_buffer(m_index_buffer.handle(), 0, VK_INDEX_TYPE_UINT32);
+}
+
+uint64_t
+ex::vulkan::geometry_arena::allocate_range(ex::vulkan::backend *backend,
+                                           ex::range_allocator &ranges,
+                                           ex::vulkan::buffer &buffer,
+                                           uint64_t count,
+                                           VkDeviceSize element_size) {
+    if (count == 0) return 0;
+    
+    uint64_t offset = ranges.allocate(count);
+    if (offset != ex::range_allocator::invalid_offset) return offset;
+
+    // double until the request fits at the end, the old contents are copied
+    // over so existing ranges stay valid
+    uint64_t capacity = std::max<uint64_t>(ranges.size() * 2, 1);
+    while (capacity < ranges.size() + count) capacity *= 2;
+
+    EXDEBUG("Geometry arena grows from %llu to %llu elements",
+            (unsigned long long) ranges.size(), (unsigned long long) capacity);
+    buffer.resize(backend, element_size * capacity);
+    ranges.grow(capacity);
+
+    offset = ranges.allocate(count);
+    if (offset == ex::range_allocator::invalid_offset) {
+        EXFATAL("Failed to allocate geometry arena range");
+        throw std::runtime_error("Failed to allocate geometry arena range");
+    }
+    return offset;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "vk_backend.h"
+#include "vk_buffer.h"
+#include "vk_command_context.h"
+#include "ex_vertex.h"
+#include "ex_range_allocator.h"
+
+#include <vector>
+
+namespace ex::vulkan {
+    // One vertex buffer and one index buffer shared by every model. Models
+    // own a range of each and draw with firstIndex/vertexOffset, so a frame
+    // binds geometry once no matter how many models it draws. Positions are
+    // also kept deinterleaved in a parallel buffer at the same vertex
+    // offsets, depth only passes fetch 12 bytes a vertex instead of 44.
+    class geometry_arena {
+    public:
+        struct range {
+            uint32_t first_vertex;
+            uint32_t vertex_count;
+            uint32_t first_index;
+            uint32_t index_count;
+        };
+        
+    public:
+        void set_capacity(uint32_t vertex_capacity, uint32_t index_capacity);
+        void create(ex::vulkan::backend *backend);
+        void destroy(ex::vulkan::backend *backend);
+
+        range allocate(ex::vulkan::backend *backend, const std::vector<ex::vertex> &vertices, const std::vector<uint32_t> &indices);
+        void free(const range &geometry);
+        void bind(VkCommandBuffer command_buffer);
+        // position stream with the same index buffer, for depth only pipelines
+        void bind_positions(VkCommandBuffer command_buffer);
+        void bind(ex::vulkan::command_context &context);
+        void bind_positions(ex::vulkan::command_context &context);
+
+        VkBuffer vertex_buffer() { return m_vertex_buffer.handle(); }
+        VkBuffer position_buffer() { return m_position_buffer.handle(); }
+        VkBuffer index_buffer() { return m_index_buffer.handle(); }
+        uint32_t vertex_capacity() { return static_cast<uint32_t>(m_vertices.size()); }
+        uint32_t index_capacity() { return static_cast<uint32_t>(m_indices.size()); }
+        uint32_t vertex_count() { return static_cast<uint32_t>(m_vertices.used()); }
+        uint32_t index_count() { return static_cast<uint32_t>(m_indices.used()); }
+
+    private:
+        uint64_t allocate_range(ex::vulkan::backend *backend, ex::range_allocator &ranges, ex::vulkan::buffer &buffer, uint64_t count, VkDeviceSize element_size);
+        
+    private:
+        ex::vulkan::buffer m_vertex_buffer;
+        ex::vulkan::buffer m_position_buffer;
+        ex::vulkan::buffer m_index_buffer;
+        ex::range_allocator m_vertices;  // in vertices
+        ex::range_allocator m_indices;   // in indices
+        uint32_t m_vertex_capacity {65536};
+        uint32_t m_index_capacity {262144};
+    };
+}
@@ -1,6 +1,10 @@
 #include "vk_image.h"
 #include "vk_common.h"
 
+#include <array>
+#include <vector>
+#include <algorithm>
+
 void
 ex::vulkan::image::set_type(VkImageType type) {
     m_type = type;
@@ -31,30 +35,30 @@ ex::vulkan::image::set_layout(VkImageLayout layout) {
     m_layout = layout;
 }
 
+void
+ex::vulkan::image::set_swizzle(VkComponentMapping swizzle) {
+    m_swizzle = swizzle;
+}
+
+void
+ex::vulkan::image::set_mip_levels(uint32_t mip_levels) {
+    m_mip_levels = mip_levels;
+}
+
+void
+ex::vulkan::image::set_array_layers(uint32_t array_layers) {
+    m_array_layers = array_layers;
+}
+
 void
 ex::vulkan::image::create(ex::vulkan::backend *backend) {
-    VkImageCreateInfo image_create_info = {};
-    image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-    image_create_info.pNext = nullptr;
-    image_create_info.flags = 0;
-    image_create_info.imageType = m_type;
-    image_create_info.format = m_format;
-    image_create_info.extent.width = m_extent.width;
-    image_create_info.extent.height = m_extent.height;
-    image_create_info.extent.depth = 1;
-    image_create_info.mipLevels = 1;
-    image_create_info.arrayLayers = 1;
-    image_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
-    image_create_info.tiling = m_tiling;
-    image_create_info.usage = m_usage;
-    image_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    image_create_info.queueFamilyIndexCount = 0;
-    image_create_info.pQueueFamilyIndices = nullptr;
-    image_create_info.initialLayout = m_layout;
-    VK_CHECK(vkCreateImage(backend->logical_device(),
-                           &image_create_info,
-                           backend->allocator(),
-                           &m_handle));
+    // sampled images can be moved by the defragmenter, which copies them on
+    // the gpu. attachments get dedicated memory and stay put
+    ex::vulkan::memory_category category = ex::vulkan::image_memory_category(m_usage);
+    bool movable = category == ex::vulkan::MEMORY_CATEGORY_TEXTURE;
+    if (movable) m_usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    
+    m_handle = create_handle(backend, m_layout);
 
     VkMemoryRequirements memory_requirements;
     vkGetImageMemoryRequirements(backend->logical_device(),
@@ -62,29 +66,26 @@ ex::vulkan::image::create(ex::vulkan::backend *backend) {
                                  &memory_requirements);
 
     VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
-    uint32_t memory_type_index = backend->get_memory_type_index(memory_requirements, properties);
-    
-    VkMemoryAllocateInfo memory_allocate_info = {};
-    memory_allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    memory_allocate_info.pNext = nullptr;
-    memory_allocate_info.allocationSize = memory_requirements.size;
-    memory_allocate_info.memoryTypeIndex = memory_type_index;
-    VK_CHECK(vkAllocateMemory(backend->logical_device(),
-                              &memory_allocate_info,
-                              backend->allocator(),
-                              &m_memory));
+    m_memory = backend->allocate_memory(memory_requirements,
+                                        properties,
+                                        category,
+                                        ex::vulkan::MEMORY_RESOURCE_IMAGE);
+    if (movable) backend->set_memory_owner(m_memory, this);
 }
 
 void
 ex::vulkan::image::destroy(ex::vulkan::backend *backend) {
     if (m_view) vkDestroyImageView(backend->logical_device(), m_view, backend->allocator());
     if (m_handle) vkDestroyImage(backend->logical_device(), m_handle, backend->allocator());
-    if (m_memory) vkFreeMemory(backend->logical_device(), m_memory, backend->allocator());
+    if (m_memory.memory) backend->free_memory(m_memory);
+    m_view = VK_NULL_HANDLE;
+    m_handle = VK_NULL_HANDLE;
+    m_memory = {};
 }
 
 void
 ex::vulkan::image::bind(ex::vulkan::backend *backend) {
-    vkBindImageMemory(backend->logical_device(), m_handle, m_memory, 0);
+    vkBindImageMemory(backend->logical_device(), m_handle, m_memory.memory, m_memory.offset);
 }
 
 void
@@ -105,9 +106,9 @@ ex::vulkan::image::change_layout(VkCommandBuffer command_buffer,
     image_memory_barrier.image = m_handle;
     image_memory_barrier.subresourceRange.aspectMask = aspect_mask;
     image_memory_barrier.subresourceRange.baseMipLevel = 0;
-    image_memory_barrier.subresourceRange.levelCount = 1;
+    image_memory_barrier.subresourceRange.levelCount = m_mip_levels;
     image_memory_barrier.subresourceRange.baseArrayLayer = 0;
-    image_memory_barrier.subresourceRange.layerCount = 1;
+    image_memory_barrier.subresourceRange.layerCount = m_array_layers;
     vkCmdPipelineBarrier(command_buffer,
                          VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
                          VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
@@ -123,14 +124,16 @@ void
 ex::vulkan::image::copy_buffer_to(VkCommandBuffer command_buffer,
                                   VkBuffer buffer,
                                   VkImageAspectFlags aspect_mask,
-                                  VkExtent2D extent) {
+                                  VkExtent2D extent,
+                                  uint32_t layer,
+                                  VkDeviceSize buffer_offset) {
     VkBufferImageCopy buffer_image_copy = {};
-    buffer_image_copy.bufferOffset = 0;
+    buffer_image_copy.bufferOffset = buffer_offset;
     buffer_image_copy.bufferRowLength = 0;
     buffer_image_copy.bufferImageHeight = 0;
     buffer_image_copy.imageSubresource.aspectMask = aspect_mask;
     buffer_image_copy.imageSubresource.mipLevel = 0;
-    buffer_image_copy.imageSubresource.baseArrayLayer = 0;
+    buffer_image_copy.imageSubresource.baseArrayLayer = layer;
     buffer_image_copy.imageSubresource.layerCount = 1;
     buffer_image_copy.imageOffset = { 0, 0, 0 };
     buffer_image_copy.imageExtent.width = extent.width;
@@ -144,6 +147,91 @@ ex::vulkan::image::copy_buffer_to(VkCommandBuffer command_buffer,
                            &buffer_image_copy);
 }
 
+void
+ex::vulkan::image::generate_mipmaps(VkCommandBuffer command_buffer) {
+    // expects every level in TRANSFER_DST, leaves every level in SHADER_READ_ONLY
+    VkImageMemoryBarrier image_memory_barrier = {};
+    image_memory_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    image_memory_barrier.pNext = nullptr;
+    image_memory_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    image_memory_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    image_memory_barrier.image = m_handle;
+    image_memory_barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    image_memory_barrier.subresourceRange.levelCount = 1;
+    image_memory_barrier.subresourceRange.baseArrayLayer = 0;
+    image_memory_barrier.subresourceRange.layerCount = m_array_layers;
+
+    int32_t mip_width = static_cast<int32_t>(m_extent.width);
+    int32_t mip_height = static_cast<int32_t>(m_extent.height);
+
+    for (uint32_t level = 1; level < m_mip_levels; level++) {
+        image_memory_barrier.subresourceRange.baseMipLevel = level - 1;
+        image_memory_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        image_memory_barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        image_memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        image_memory_barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        vkCmdPipelineBarrier(command_buffer,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             0,
+                             0, nullptr,
+                             0, nullptr,
+                             1, &image_memory_barrier);
+
+        int32_t next_width = mip_width > 1 ? mip_width / 2 : 1;
+        int32_t next_height = mip_height > 1 ? mip_height / 2 : 1;
+
+        VkImageBlit image_blit = {};
+        image_blit.srcOffsets[0] = { 0, 0, 0 };
+        image_blit.srcOffsets[1] = { mip_width, mip_height, 1 };
+        image_blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        image_blit.srcSubresource.mipLevel = level - 1;
+        image_blit.srcSubresource.baseArrayLayer = 0;
+        image_blit.srcSubresource.layerCount = m_array_layers;
+        image_blit.dstOffsets[0] = { 0, 0, 0 };
+        image_blit.dstOffsets[1] = { next_width, next_height, 1 };
+        image_blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        image_blit.dstSubresource.mipLevel = level;
+        image_blit.dstSubresource.baseArrayLayer = 0;
+        image_blit.dstSubresource.layerCount = m_array_layers;
+        vkCmdBlitImage(command_buffer,
+                       m_handle, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                       m_handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                       1, &image_blit,
+                       VK_FILTER_LINEAR);
+
+        image_memory_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        image_memory_barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        image_memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        image_memory_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(command_buffer,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                             0,
+                             0, nullptr,
+                             0, nullptr,
+                             1, &image_memory_barrier);
+
+        mip_width = next_width;
+        mip_height = next_height;
+    }
+
+    image_memory_barrier.subresourceRange.baseMipLevel = m_mip_levels - 1;
+    image_memory_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    image_memory_barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    image_memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    image_memory_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(command_buffer,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                         0,
+                         0, nullptr,
+                         0, nullptr,
+                         1, &image_memory_barrier);
+
+    m_layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+}
+
 void
 ex::vulkan::image::create_view(ex::vulkan::backend *backend,
                                VkImageViewType view_type,
@@ -155,17 +243,132 @@ ex::vulkan::image::create_view(ex::vulkan::backend *backend,
     image_view_create_info.image = m_handle;
     image_view_create_info.viewType = view_type;
     image_view_create_info.format = m_format;
-    image_view_create_info.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
-    image_view_create_info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
-    image_view_create_info.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
-    image_view_create_info.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+    image_view_create_info.components = m_swizzle;
     image_view_create_info.subresourceRange.aspectMask = aspect_flags;
     image_view_create_info.subresourceRange.baseMipLevel = 0;
-    image_view_create_info.subresourceRange.levelCount = 1;
+    image_view_create_info.subresourceRange.levelCount = m_mip_levels;
     image_view_create_info.subresourceRange.baseArrayLayer = 0;
-    image_view_create_info.subresourceRange.layerCount = 1;
+    image_view_create_info.subresourceRange.layerCount = m_array_layers;
     VK_CHECK(vkCreateImageView(backend->logical_device(),
                                &image_view_create_info,
                                backend->allocator(),
                                &m_view));
+
+    m_view_type = view_type;
+    m_aspect_flags = aspect_flags;
+}
+
+void
+ex::vulkan::image::relocate(ex::vulkan::backend *backend,
+                            VkCommandBuffer command_buffer,
+                            const ex::vulkan::memory_allocation &allocation) {
+    VkImage old_handle = m_handle;
+    VkImageView old_view = m_view;
+    VkImageAspectFlags aspect_mask = m_view ? m_aspect_flags : VK_IMAGE_ASPECT_COLOR_BIT;
+
+    m_handle = create_handle(backend, VK_IMAGE_LAYOUT_UNDEFINED);
+    m_memory = allocation;
+    bind(backend);
+
+    std::array<VkImageMemoryBarrier, 2> image_memory_barriers = {};
+    for (VkImageMemoryBarrier &image_memory_barrier : image_memory_barriers) {
+        image_memory_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        image_memory_barrier.pNext = nullptr;
+        image_memory_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        image_memory_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        image_memory_barrier.subresourceRange.aspectMask = aspect_mask;
+        image_memory_barrier.subresourceRange.baseMipLevel = 0;
+        image_memory_barrier.subresourceRange.levelCount = m_mip_levels;
+        image_memory_barrier.subresourceRange.baseArrayLayer = 0;
+        image_memory_barrier.subresourceRange.layerCount = m_array_layers;
+    }
+    
+    image_memory_barriers[0].image = old_handle;
+    image_memory_barriers[0].oldLayout = m_layout;
+    image_memory_barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    image_memory_barriers[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    image_memory_barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    image_memory_barriers[1].image = m_handle;
+    image_memory_barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    image_memory_barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    image_memory_barriers[1].srcAccessMask = 0;
+    image_memory_barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(command_buffer,
+                         VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0,
+                         0, nullptr,
+                         0, nullptr,
+                         static_cast<uint32_t>(image_memory_barriers.size()), image_memory_barriers.data());
+
+    std::vector<VkImageCopy> image_copies(m_mip_levels);
+    for (uint32_t level = 0; level < m_mip_levels; level++) {
+        VkImageCopy &image_copy = image_copies[level];
+        image_copy = {};
+        image_copy.srcSubresource.aspectMask = aspect_mask;
+        image_copy.srcSubresource.mipLevel = level;
+        image_copy.srcSubresource.baseArrayLayer = 0;
+        image_copy.srcSubresource.layerCount = m_array_layers;
+        image_copy.srcOffset = { 0, 0, 0 };
+        image_copy.dstSubresource = image_copy.srcSubresource;
+        image_copy.dstOffset = { 0, 0, 0 };
+        image_copy.extent.width = std::max(m_extent.width >> level, 1u);
+        image_copy.extent.height = std::max(m_extent.height >> level, 1u);
+        image_copy.extent.depth = 1;
+    }
+    vkCmdCopyImage(command_buffer,
+                   old_handle, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                   m_handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                   static_cast<uint32_t>(image_copies.size()), image_copies.data());
+
+    // hand the copy back in whatever layout the old image was left in
+    image_memory_barriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    image_memory_barriers[1].newLayout = m_layout;
+    image_memory_barriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    image_memory_barriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(command_buffer,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                         0,
+                         0, nullptr,
+                         0, nullptr,
+                         1, &image_memory_barriers[1]);
+
+    if (old_view) create_view(backend, m_view_type, m_aspect_flags);
+
+    VkDevice device = backend->logical_device();
+    VkAllocationCallbacks *allocator = backend->allocator();
+    backend->defer_destroy([device, allocator, old_handle, old_view]() {
+        if (old_view) vkDestroyImageView(device, old_view, allocator);
+        vkDestroyImage(device, old_handle, allocator);
+    });
+}
+
+VkImage
+ex::vulkan::image::create_handle(ex::vulkan::backend *backend, VkImageLayout initial_layout) {
+    VkImageCreateInfo image_create_info = {};
+    image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_create_info.pNext = nullptr;
+    image_create_info.flags = 0;
+    image_create_info.imageType = m_type;
+    image_create_info.format = m_format;
+    image_create_info.extent.width = m_extent.width;
+    image_create_info.extent.height = m_extent.height;
+    image_create_info.extent.depth = 1;
+    image_create_info.mipLevels = m_mip_levels;
+    image_create_info.arrayLayers = m_array_layers;
+    image_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_create_info.tiling = m_tiling;
+    image_create_info.usage = m_usage;
+    image_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_create_info.queueFamilyIndexCount = 0;
+    image_create_info.pQueueFamilyIndices = nullptr;
+    image_create_info.initialLayout = initial_layout;
+
+    VkImage out_handle;
+    VK_CHECK(vkCreateImage(backend->logical_device(),
+                           &image_create_info,
+                           backend->allocator(),
+                           &out_handle));
+    return out_handle;
 }
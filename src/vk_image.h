@@ -3,6 +3,8 @@
 #include "vk_backend.h"
 
 namespace ex::vulkan {
+    // sampled images are registered with the backend as movable, the
+    // defragmenter swaps m_handle and m_view under them
     class image {
     public:
         void set_type(VkImageType type);
@@ -11,27 +13,43 @@ namespace ex::vulkan {
         void set_tiling(VkImageTiling tiling);
         void set_usage(VkImageUsageFlags usage);
         void set_layout(VkImageLayout layout);
+        void set_swizzle(VkComponentMapping swizzle);
+        void set_mip_levels(uint32_t mip_levels);
+        void set_array_layers(uint32_t array_layers);
         void create(ex::vulkan::backend *backend);
         void destroy(ex::vulkan::backend *backend);
 
         void bind(ex::vulkan::backend *backend);
         void change_layout(VkCommandBuffer command_buffer, VkImageLayout layout, VkImageAspectFlags aspect_mask);
-        void copy_buffer_to(VkCommandBuffer command_buffer, VkBuffer buffer, VkImageAspectFlags aspect_mask, VkExtent2D extent);
+        void copy_buffer_to(VkCommandBuffer command_buffer, VkBuffer buffer, VkImageAspectFlags aspect_mask, VkExtent2D extent, uint32_t layer = 0, VkDeviceSize buffer_offset = 0);
+        void generate_mipmaps(VkCommandBuffer command_buffer);
         void create_view(ex::vulkan::backend *backend, VkImageViewType view_type, VkImageAspectFlags aspect_flags);
+        void relocate(ex::vulkan::backend *backend, VkCommandBuffer command_buffer, const ex::vulkan::memory_allocation &allocation);
 
         VkImage handle() { return m_handle; }
         VkImageView view() { return m_view; }
         VkFormat format() { return m_format; }
+        VkExtent2D extent() { return m_extent; }
+        uint32_t mip_levels() { return m_mip_levels; }
+        uint32_t array_layers() { return m_array_layers; }
+        
+    private:
+        VkImage create_handle(ex::vulkan::backend *backend, VkImageLayout initial_layout);
         
     private:
         VkImage m_handle;
-        VkDeviceMemory m_memory;
+        ex::vulkan::memory_allocation m_memory;
         VkImageView m_view;
+        VkImageViewType m_view_type;
+        VkImageAspectFlags m_aspect_flags;
         VkImageType m_type;
         VkFormat m_format;
         VkExtent2D m_extent;
         VkImageTiling m_tiling;
         VkImageUsageFlags m_usage;
         VkImageLayout m_layout;
+        VkComponentMapping m_swizzle {};
+        uint32_t m_mip_levels {1};
+        uint32_t m_array_layers {1};
     };
 }
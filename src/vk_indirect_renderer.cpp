@@ -0,0 +1,268 @@
+#include "vk_indirect_renderer.h"
+#include "vk_common.h"
+#include "ex_logger.h"
+#include "ex_profiler.h"
+
+#include <algorithm>
+
+void
+ex::vulkan::indirect_renderer::set_max_objects(uint32_t max_objects) {
+    m_max_objects = std::max(max_objects, 1u);
+}
+
+void
+ex::vulkan::indirect_renderer::create(ex::vulkan::backend *backend, ex::vulkan::render_graph *graph) {
+    m_backend = backend;
+
+    const VkPhysicalDeviceFeatures &features = backend->enabled_features();
+    m_supported = backend->bindless_enabled() &&
+        features.drawIndirectFirstInstance &&
+        features.shaderStorageBufferArrayDynamicIndexing;
+    if (!m_supported) {
+        EXWARN("Indirect renderer: needs bindless, drawIndirectFirstInstance and storage buffer indexing, disabled");
+        return;
+    }
+    m_draw_indirect_count = backend->draw_indirect_count();
+    if (!features.multiDrawIndirect) EXWARN("Indirect renderer: multiDrawIndirect not supported, one call per object");
+
+    // buffers
+    for (uint32_t i = 0; i < ex::vulkan::backend::max_frames_in_flight; i++) {
+        m_object_buffers[i].set_usage(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+        m_object_buffers[i].set_properties(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        m_object_buffers[i].build(backend, sizeof(object_data) * static_cast<VkDeviceSize>(m_max_objects));
+        m_object_buffers[i].bind(backend);
+        m_bindless_indices[i] = backend->bindless()->add_buffer(backend, m_object_buffers[i].get_descriptor_info());
+
+        m_commands[i].set_usage(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+        m_commands[i].set_properties(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        m_commands[i].build(backend, sizeof(VkDrawIndexedIndirectCommand) * static_cast<VkDeviceSize>(m_max_objects));
+        m_commands[i].bind(backend);
+
+        m_counts[i].set_usage(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+        m_counts[i].set_properties(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        m_counts[i].build(backend, sizeof(uint32_t));
+        m_counts[i].bind(backend);
+    }
+
+    // descriptors
+    m_descriptor_pool.add_size(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, ex::vulkan::backend::max_frames_in_flight * 3);
+    m_descriptor_pool.create(backend, ex::vulkan::backend::max_frames_in_flight);
+
+    m_cull_layout.add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+    m_cull_layout.add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+    m_cull_layout.add_binding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+    m_cull_layout.create(backend);
+
+    for (uint32_t i = 0; i < ex::vulkan::backend::max_frames_in_flight; i++) {
+        m_cull_sets[i].allocate(backend, &m_descriptor_pool, &m_cull_layout);
+        m_cull_sets[i].write_buffer(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, m_object_buffers[i].get_descriptor_info());
+        m_cull_sets[i].write_buffer(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, m_commands[i].get_descriptor_info());
+        m_cull_sets[i].write_buffer(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, m_counts[i].get_descriptor_info());
+    }
+    for (uint32_t i = 0; i < ex::vulkan::backend::max_frames_in_flight; i++) update_set(i);
+    // other slots may still have a submit reading their set, each one is
+    // rewritten once its own fence has signalled
+    m_relocation_listener = backend->add_relocation_listener([this]() {
+        m_sets_dirty.fill(true);
+        update_set(m_backend->frame_index());
+    });
+
+    // pipeline
+    m_cull_pipeline.push_descriptor_set_layout(m_cull_layout.handle());
+    m_cull_pipeline.set_push_constant_range(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(cull_constants));
+    m_cull_pipeline.build_layout(backend);
+    m_cull_shader.create_compute(backend, "res/shaders/indirect_cull.comp.spv");
+    m_cull_pipeline.build_compute(backend, &m_cull_shader);
+    m_cull_shader.destroy(backend);
+
+    // only writes buffers, the graph can't see the main pass needs them
+    m_cull_pass = graph->add_pass("indirect cull", ex::vulkan::render_graph::PASS_COMPUTE, [this](VkCommandBuffer command_buffer) {
+        record_cull(command_buffer);
+    });
+    graph->set_side_effect(m_cull_pass);
+
+    EXDEBUG("Indirect renderer: %u objects, %s", m_max_objects, compacted() ? "compacted" : "in place");
+}
+
+void
+ex::vulkan::indirect_renderer::destroy(ex::vulkan::backend *backend) {
+    if (!m_supported) return;
+
+    if (m_relocation_listener != UINT32_MAX) backend->remove_relocation_listener(m_relocation_listener);
+    m_relocation_listener = UINT32_MAX;
+
+    m_cull_pipeline.destroy(backend);
+    m_cull_layout.destroy(backend);
+    m_descriptor_pool.destroy(backend);
+
+    for (uint32_t i = 0; i < ex::vulkan::backend::max_frames_in_flight; i++) {
+        backend->bindless()->remove_buffer(m_bindless_indices[i]);
+        m_bindless_indices[i] = ex::vulkan::bindless_table::invalid_index;
+        m_counts[i].destroy(backend);
+        m_commands[i].destroy(backend);
+        m_object_buffers[i].destroy(backend);
+    }
+}
+
+uint32_t
+ex::vulkan::indirect_renderer::add_object(ex::vulkan::model *model, const glm::mat4 &transform, uint32_t texture_index) {
+    if (m_objects.size() == m_max_objects) EXWARN("Indirect renderer: more than %u objects, the rest are not drawn", m_max_objects);
+
+    const ex::vulkan::geometry_arena::range &geometry = model->geometry();
+    object_data object = {};
+    object.model = transform;
+    object.sphere = model->bounding_sphere();
+    object.first_index = geometry.first_index;
+    object.index_count = geometry.index_count;
+    object.vertex_offset = static_cast<int32_t>(geometry.first_vertex);
+    object.texture_index = texture_index;
+    m_objects.push_back(object);
+    m_generation++;
+
+    return static_cast<uint32_t>(m_objects.size() - 1);
+}
+
+void
+ex::vulkan::indirect_renderer::set_transform(uint32_t object, const glm::mat4 &transform) {
+    if (m_objects[object].model == transform) return;
+    m_objects[object].model = transform;
+    m_generation++;
+}
+
+void
+ex::vulkan::indirect_renderer::set_texture(uint32_t object, uint32_t texture_index) {
+    if (m_objects[object].texture_index == texture_index) return;
+    m_objects[object].texture_index = texture_index;
+    m_generation++;
+}
+
+void
+ex::vulkan::indirect_renderer::update(const glm::mat4 &view_projection) {
+    EXPROFILE_FUNCTION();
+    if (!m_supported) return;
+    uint32_t frame = m_backend->frame_index();
+    if (m_sets_dirty[frame]) update_set(frame);
+
+    // the slot's fence has signalled, its count is final
+    m_draw_count = 0;
+    if (m_slot_culled[frame]) {
+        m_counts[frame].map(m_backend);
+        m_counts[frame].copy_from(&m_draw_count, sizeof(uint32_t));
+        m_counts[frame].unmap(m_backend);
+    }
+
+    m_view_projection = view_projection;
+
+    // static scenes upload once per slot and never again
+    if (m_slot_generations[frame] != m_generation) {
+        uint32_t object_count = std::min(static_cast<uint32_t>(m_objects.size()), m_max_objects);
+        m_object_buffers[frame].map(m_backend);
+        m_object_buffers[frame].copy_to(m_objects.data(), sizeof(object_data) * static_cast<VkDeviceSize>(object_count));
+        m_object_buffers[frame].unmap(m_backend);
+        m_slot_generations[frame] = m_generation;
+    }
+}
+
+void
+ex::vulkan::indirect_renderer::draw(VkCommandBuffer command_buffer) {
+    if (!m_culled) return;
+    uint32_t frame = m_backend->frame_index();
+    uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+
+    if (m_draw_indirect_count) {
+        m_draw_indirect_count(command_buffer, m_commands[frame].handle(), 0, m_counts[frame].handle(), 0, m_culled_count, stride);
+    } else if (m_backend->enabled_features().multiDrawIndirect) {
+        vkCmdDrawIndexedIndirect(command_buffer, m_commands[frame].handle(), 0, m_culled_count, stride);
+    } else {
+        for (uint32_t i = 0; i < m_culled_count; i++) {
+            vkCmdDrawIndexedIndirect(command_buffer, m_commands[frame].handle(), static_cast<VkDeviceSize>(i) * stride, 1, stride);
+        }
+    }
+}
+
+uint32_t
+ex::vulkan::indirect_renderer::object_buffer_index() {
+    return m_bindless_indices[m_backend->frame_index()];
+}
+
+void
+ex::vulkan::indirect_renderer::record_cull(VkCommandBuffer command_buffer) {
+    uint32_t frame = m_backend->frame_index();
+    m_culled = false;
+    m_slot_culled[frame] = false;
+
+    uint32_t object_count = std::min({ m_active_count, static_cast<uint32_t>(m_objects.size()), m_max_objects });
+    if (!m_enabled || object_count == 0) return;
+
+    vkCmdFillBuffer(command_buffer, m_counts[frame].handle(), 0, sizeof(uint32_t), 0);
+
+    VkBufferMemoryBarrier clear_barrier = {};
+    clear_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    clear_barrier.pNext = nullptr;
+    clear_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    clear_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    clear_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    clear_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    clear_barrier.buffer = m_counts[frame].handle();
+    clear_barrier.offset = 0;
+    clear_barrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(command_buffer,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0,
+                         0, nullptr,
+                         1, &clear_barrier,
+                         0, nullptr);
+
+    // gribb/hartmann planes, near is z >= 0 with zero to one depth
+    glm::mat4 &m = m_view_projection;
+    glm::vec4 row_x = glm::vec4(m[0][0], m[1][0], m[2][0], m[3][0]);
+    glm::vec4 row_y = glm::vec4(m[0][1], m[1][1], m[2][1], m[3][1]);
+    glm::vec4 row_z = glm::vec4(m[0][2], m[1][2], m[2][2], m[3][2]);
+    glm::vec4 row_w = glm::vec4(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+    cull_constants constants = {};
+    constants.planes[0] = row_w + row_x;
+    constants.planes[1] = row_w - row_x;
+    constants.planes[2] = row_w + row_y;
+    constants.planes[3] = row_w - row_y;
+    constants.planes[4] = row_z;
+    constants.planes[5] = row_w - row_z;
+    for (glm::vec4 &plane : constants.planes) plane /= glm::length(glm::vec3(plane));
+    constants.object_count = object_count;
+    constants.compact = compacted() ? 1 : 0;
+
+    VkDescriptorSet set = m_cull_sets[frame].handle();
+    m_cull_pipeline.bind(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_cull_pipeline.layout(), 0, 1, &set, 0, nullptr);
+    m_cull_pipeline.push_constants(command_buffer, VK_SHADER_STAGE_COMPUTE_BIT, &constants);
+    vkCmdDispatch(command_buffer, (object_count + 63) / 64, 1, 1);
+
+    // consumed by this frame's main pass, the count also on the cpu once
+    // the slot's fence signals
+    std::array<VkBufferMemoryBarrier, 2> draw_barriers = { clear_barrier, clear_barrier };
+    draw_barriers[0].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    draw_barriers[0].dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    draw_barriers[0].buffer = m_commands[frame].handle();
+    draw_barriers[1].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    draw_barriers[1].dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(command_buffer,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+                         0,
+                         0, nullptr,
+                         static_cast<uint32_t>(draw_barriers.size()), draw_barriers.data(),
+                         0, nullptr);
+
+    m_culled_count = object_count;
+    m_culled = true;
+    m_slot_culled[frame] = true;
+}
+
+void
+ex::vulkan::indirect_renderer::update_set(uint32_t frame) {
+    // the defragmenter hands the command buffers new handles
+    m_commands[frame].get_descriptor_info();
+    m_cull_sets[frame].update(m_backend);
+    m_sets_dirty[frame] = false;
+}
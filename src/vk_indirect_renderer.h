@@ -0,0 +1,114 @@
+#pragma once
+
+#include "vk_backend.h"
+#include "vk_buffer.h"
+#include "vk_shader.h"
+#include "vk_pipeline.h"
+#include "vk_descriptor.h"
+#include "vk_render_graph.h"
+#include "vk_model.h"
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <array>
+#include <cstdint>
+
+namespace ex::vulkan {
+    // GPU driven drawing for the bindless path. Objects sit in a storage
+    // buffer per frame slot that the cpu only rewrites when one of them
+    // changed, a compute pass in the render graph frustum culls them into
+    // indexed indirect commands and the main pass draws the lot with one
+    // call, so recording doesn't grow with the object count.
+    // Every command's first instance is its object's index, vertex shaders
+    // look the object up with gl_InstanceIndex in the bindless buffer from
+    // object_buffer_index. Without VK_KHR_draw_indirect_count culled objects
+    // stay in place as zero instance commands instead of being compacted.
+    class indirect_renderer {
+    public:
+        // std430, matches object_data in the shaders
+        struct object_data {
+            glm::mat4 model;
+            // model space, xyz center and w radius
+            glm::vec4 sphere;
+            uint32_t first_index;
+            uint32_t index_count;
+            int32_t vertex_offset;
+            uint32_t texture_index;
+        };
+
+    public:
+        void set_max_objects(uint32_t max_objects);
+        // adds the cull pass, call before the graph compiles. does nothing
+        // if the device can't draw this way, see supported()
+        void create(ex::vulkan::backend *backend, ex::vulkan::render_graph *graph);
+        void destroy(ex::vulkan::backend *backend);
+
+        uint32_t add_object(ex::vulkan::model *model, const glm::mat4 &transform, uint32_t texture_index);
+        void set_transform(uint32_t object, const glm::mat4 &transform);
+        void set_texture(uint32_t object, uint32_t texture_index);
+        // only the first count objects are culled and drawn
+        void set_active_count(uint32_t count) { m_active_count = count; }
+        void set_enabled(bool enabled) { m_enabled = enabled; }
+
+        // after begin_frame. uploads the objects if the slot's copy is stale
+        // and picks up the draw count the slot's last submit produced
+        void update(const glm::mat4 &view_projection);
+        // inside the main pass, with a pipeline reading the objects bound
+        void draw(VkCommandBuffer command_buffer);
+
+        bool supported() { return m_supported; }
+        bool enabled() { return m_supported && m_enabled; }
+        bool compacted() { return m_draw_indirect_count != nullptr; }
+        uint32_t object_count() { return static_cast<uint32_t>(m_objects.size()); }
+        // objects that survived culling a few frames ago
+        uint32_t draw_count() { return m_draw_count; }
+        uint32_t object_buffer_index();
+
+    private:
+        struct cull_constants {
+            glm::vec4 planes[6];
+            uint32_t object_count;
+            uint32_t compact;
+        };
+
+        void record_cull(VkCommandBuffer command_buffer);
+        // only while nothing in flight reads the slot's set
+        void update_set(uint32_t frame);
+
+    private:
+        ex::vulkan::backend *m_backend {nullptr};
+        uint32_t m_max_objects {16384};
+        bool m_supported {false};
+        bool m_enabled {true};
+        PFN_vkCmdDrawIndexedIndirectCountKHR m_draw_indirect_count {nullptr};
+
+        uint32_t m_cull_pass {ex::vulkan::render_graph::invalid_id};
+        ex::vulkan::shader m_cull_shader;
+        ex::vulkan::pipeline m_cull_pipeline;
+        ex::vulkan::descriptor_pool m_descriptor_pool;
+        ex::vulkan::descriptor_set_layout m_cull_layout;
+        std::array<ex::vulkan::descriptor_set, ex::vulkan::backend::max_frames_in_flight> m_cull_sets;
+        std::array<bool, ex::vulkan::backend::max_frames_in_flight> m_sets_dirty {};
+        // the command buffers are device local and can be moved
+        uint32_t m_relocation_listener {UINT32_MAX};
+
+        // objects are written by the cpu, counts are read back per slot
+        std::array<ex::vulkan::buffer, ex::vulkan::backend::max_frames_in_flight> m_object_buffers;
+        std::array<ex::vulkan::buffer, ex::vulkan::backend::max_frames_in_flight> m_commands;
+        std::array<ex::vulkan::buffer, ex::vulkan::backend::max_frames_in_flight> m_counts;
+        std::array<uint32_t, ex::vulkan::backend::max_frames_in_flight> m_bindless_indices {};
+
+        // bumped on every change, a slot whose copy is older uploads again
+        std::vector<object_data> m_objects;
+        uint64_t m_generation {1};
+        std::array<uint64_t, ex::vulkan::backend::max_frames_in_flight> m_slot_generations {};
+        std::array<bool, ex::vulkan::backend::max_frames_in_flight> m_slot_culled {};
+
+        uint32_t m_active_count {0};
+        uint32_t m_culled_count {0};
+        bool m_culled {false};
+        glm::mat4 m_view_projection {1.0f};
+        uint32_t m_draw_count {0};
+    };
+}
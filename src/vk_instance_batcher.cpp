@@ -0,0 +1,157 @@
+#include "vk_instance_batcher.h"
+#include "ex_logger.h"
+#include "ex_profiler.h"
+#include "ex_utils.hpp"
+
+#include <algorithm>
+
+std::size_t
+ex::vulkan::instance_batcher::group_key_hash::operator()(const group_key &key) const {
+    std::size_t seed = 0;
+    ex::utils::hash_combine(seed, key.model, key.texture_index);
+    return seed;
+}
+
+void
+ex::vulkan::instance_batcher::set_capacity(uint32_t instance_capacity) {
+    m_capacity = std::max(instance_capacity, 1u);
+}
+
+void
+ex::vulkan::instance_batcher::create(ex::vulkan::backend *backend) {
+    m_backend = backend;
+
+    for (ex::vulkan::buffer &buffer : m_buffers) {
+        buffer.set_usage(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+        buffer.set_properties(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        buffer.build(backend, sizeof(ex::instance) * static_cast<VkDeviceSize>(m_capacity));
+        buffer.bind(backend);
+    }
+}
+
+void
+ex::vulkan::instance_batcher::destroy(ex::vulkan::backend *backend) {
+    for (ex::vulkan::buffer &buffer : m_buffers) buffer.destroy(backend);
+    m_groups.clear();
+    m_items.clear();
+    m_lookup.clear();
+    m_generation = 1;
+}
+
+void
+ex::vulkan::instance_batcher::begin() {
+    m_groups.clear();
+    m_items.clear();
+    m_last_group = UINT32_MAX;
+
+    m_generation++;
+    if (m_generation == 0) {
+        // wrapped, old slots could look current again
+        for (lookup_slot &slot : m_lookup) slot.generation = 0;
+        m_generation = 1;
+    }
+}
+
+void
+ex::vulkan::instance_batcher::add(ex::vulkan::model *model, const glm::mat4 &transform, uint32_t texture_index) {
+    // runs of the same model skip the lookup
+    uint32_t group_index = m_last_group;
+    if (group_index == UINT32_MAX ||
+        m_groups[group_index].model != model ||
+        m_groups[group_index].texture_index != texture_index) {
+        group_index = find_group(model, texture_index);
+        m_last_group = group_index;
+    }
+
+    m_groups[group_index].instance_count++;
+    m_items.push_back({ group_index, transform });
+}
+
+void
+ex::vulkan::instance_batcher::end() {
+    EXPROFILE_FUNCTION();
+    uint32_t frame = m_backend->frame_index();
+    uint32_t count = static_cast<uint32_t>(m_items.size());
+    if (count == 0) return;
+
+    // counting sort by group, every group ends up contiguous
+    m_cursors.resize(m_groups.size());
+    uint32_t first_instance = 0;
+    for (uint32_t i = 0; i < m_groups.size(); i++) {
+        m_groups[i].first_instance = first_instance;
+        m_cursors[i] = first_instance;
+        first_instance += m_groups[i].instance_count;
+    }
+
+    m_instances.resize(count);
+    for (const item &instance_item : m_items) {
+        m_instances[m_cursors[instance_item.group]++] = ex::instance(instance_item.transform);
+    }
+
+    VkDeviceSize size = sizeof(ex::instance) * static_cast<VkDeviceSize>(count);
+    if (m_buffers[frame].size() < size) {
+        // the slot's fence has signalled, nothing reads the old buffer
+        VkDeviceSize grown = std::max(size, m_buffers[frame].size() * 2);
+        EXDEBUG("Instance batcher: growing slot %u to %llu bytes", frame, (unsigned long long) grown);
+        m_buffers[frame].resize(m_backend, grown);
+    }
+
+    m_buffers[frame].map(m_backend);
+    m_buffers[frame].copy_to(m_instances.data(), size);
+    m_buffers[frame].unmap(m_backend);
+}
+
+uint32_t
+ex::vulkan::instance_batcher::find_group(ex::vulkan::model *model, uint32_t texture_index) {
+    if ((m_groups.size() + 1) * 2 > m_lookup.size()) grow_lookup();
+
+    group_key key = { model, texture_index };
+    std::size_t mask = m_lookup.size() - 1;
+    std::size_t index = group_key_hash()(key) & mask;
+    while (true) {
+        lookup_slot &slot = m_lookup[index];
+        if (slot.generation != m_generation) {
+            slot = { key, static_cast<uint32_t>(m_groups.size()), m_generation };
+            m_groups.push_back({ model, texture_index, 0, 0 });
+            return slot.group;
+        }
+        if (slot.key == key) return slot.group;
+        index = (index + 1) & mask;
+    }
+}
+
+void
+ex::vulkan::instance_batcher::grow_lookup() {
+    // only when a frame has more groups than any before it
+    std::size_t size = std::max<std::size_t>(m_lookup.size() * 2, 64);
+    m_lookup.assign(size, {});
+    m_generation = 1;
+
+    std::size_t mask = size - 1;
+    for (uint32_t i = 0; i < m_groups.size(); i++) {
+        group_key key = { m_groups[i].model, m_groups[i].texture_index };
+        std::size_t index = group_key_hash()(key) & mask;
+        while (m_lookup[index].generation == m_generation) index = (index + 1) & mask;
+        m_lookup[index] = { key, i, m_generation };
+    }
+}
+
+void
+ex::vulkan::instance_batcher::bind(VkCommandBuffer command_buffer) {
+    VkBuffer instance_buffers[] = { m_buffers[m_backend->frame_index()].handle() };
+    VkDeviceSize offsets[] = { 0 };
+    vkCmdBindVertexBuffers(command_buffer, 1, 1, instance_buffers, offsets);
+}
+
+void
+ex::vulkan::instance_batcher::bind(ex::vulkan::command_context &context) {
+    VkBuffer instance_buffers[] = { m_buffers[m_backend->frame_index()].handle() };
+    VkDeviceSize offsets[] = { 0 };
+    context.bind_vertex_buffers(1, instance_buffers, offsets);
+}
+
+void
+ex::vulkan::instance_batcher::draw(VkCommandBuffer command_buffer, uint32_t group) {
+    const ex::vulkan::instance_batcher::group &draw_group = m_groups[group];
+    draw_group.model->draw_instanced(command_buffer, draw_group.instance_count, draw_group.first_instance);
+}
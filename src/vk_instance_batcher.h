@@ -0,0 +1,95 @@
+#pragma once
+
+#include "vk_backend.h"
+#include "vk_buffer.h"
+#include "vk_model.h"
+#include "vk_command_context.h"
+#include "ex_vertex.h"
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <array>
+#include <cstdint>
+
+namespace ex::vulkan {
+    // Groups draws that share a model and texture, writes their transforms
+    // and normal matrices into the frame slot's instance buffer and draws
+    // every group with one instanced call. For pipelines on
+    // pipeline_state::VERTEX_STREAM_INSTANCED, the texture index is left to
+    // the caller's push constants per group.
+    class instance_batcher {
+    public:
+        struct group {
+            ex::vulkan::model *model;
+            uint32_t texture_index;
+            uint32_t first_instance;
+            uint32_t instance_count;
+        };
+
+    public:
+        // initial instances per slot, a frame that needs more grows its slot
+        void set_capacity(uint32_t instance_capacity);
+        void create(ex::vulkan::backend *backend);
+        void destroy(ex::vulkan::backend *backend);
+
+        // after begin_frame, forgets the previous frame's instances
+        void begin();
+        void add(ex::vulkan::model *model, const glm::mat4 &transform, uint32_t texture_index);
+        // groups are contiguous in the slot's buffer after this
+        void end();
+
+        // binding 1, the geometry arena has binding 0
+        void bind(VkCommandBuffer command_buffer);
+        void bind(ex::vulkan::command_context &context);
+        void draw(VkCommandBuffer command_buffer, uint32_t group);
+
+        const std::vector<group> &groups() { return m_groups; }
+        uint32_t instance_count() { return static_cast<uint32_t>(m_items.size()); }
+
+    private:
+        struct group_key {
+            ex::vulkan::model *model;
+            uint32_t texture_index;
+
+            bool operator==(const group_key &other) const {
+                return model == other.model && texture_index == other.texture_index;
+            }
+        };
+
+        struct group_key_hash {
+            std::size_t operator()(const group_key &key) const;
+        };
+
+        struct item {
+            uint32_t group;
+            glm::mat4 transform;
+        };
+
+        // a slot only holds an entry while its generation is the current one
+        struct lookup_slot {
+            group_key key;
+            uint32_t group;
+            uint32_t generation;
+        };
+
+        uint32_t find_group(ex::vulkan::model *model, uint32_t texture_index);
+        void grow_lookup();
+
+    private:
+        ex::vulkan::backend *m_backend {nullptr};
+        uint32_t m_capacity {4096};
+        std::array<ex::vulkan::buffer, ex::vulkan::backend::max_frames_in_flight> m_buffers;
+
+        // cleared, not freed, every frame. capacity carries over
+        std::vector<group> m_groups;
+        std::vector<item> m_items;
+        std::vector<ex::instance> m_instances;
+        std::vector<uint32_t> m_cursors;
+        // open addressed, power of two and at most half full. begin() bumps
+        // the generation instead of touching the slots
+        std::vector<lookup_slot> m_lookup;
+        uint32_t m_generation {1};
+        uint32_t m_last_group {UINT32_MAX};
+    };
+}
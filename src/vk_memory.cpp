@@ -0,0 +1,35 @@
+#include "vk_memory.h"
+
+const char *
+ex::vulkan::memory_category_name(memory_category category) {
+    switch (category) {
+    case MEMORY_CATEGORY_VERTEX: return "vertex";
+    case MEMORY_CATEGORY_INDEX: return "index";
+    case MEMORY_CATEGORY_TEXTURE: return "texture";
+    case MEMORY_CATEGORY_UNIFORM: return "uniform";
+    case MEMORY_CATEGORY_STAGING: return "staging";
+    case MEMORY_CATEGORY_ATTACHMENT: return "attachment";
+    default:
+    case MEMORY_CATEGORY_OTHER: return "other";
+    }
+}
+
+ex::vulkan::memory_category
+ex::vulkan::buffer_memory_category(VkBufferUsageFlags usage) {
+    if (usage & VK_BUFFER_USAGE_VERTEX_BUFFER_BIT) return MEMORY_CATEGORY_VERTEX;
+    if (usage & VK_BUFFER_USAGE_INDEX_BUFFER_BIT) return MEMORY_CATEGORY_INDEX;
+    if (usage & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT) return MEMORY_CATEGORY_UNIFORM;
+    if (usage == VK_BUFFER_USAGE_TRANSFER_SRC_BIT) return MEMORY_CATEGORY_STAGING;
+    return MEMORY_CATEGORY_OTHER;
+}
+
+ex::vulkan::memory_category
+ex::vulkan::image_memory_category(VkImageUsageFlags usage) {
+    VkImageUsageFlags attachment_usage =
+        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+        VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+    if (usage & attachment_usage) return MEMORY_CATEGORY_ATTACHMENT;
+    if (usage & VK_IMAGE_USAGE_SAMPLED_BIT) return MEMORY_CATEGORY_TEXTURE;
+    return MEMORY_CATEGORY_OTHER;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <array>
+#include <cstdint>
+
+namespace ex::vulkan {
+    enum memory_category {
+        MEMORY_CATEGORY_VERTEX = 0,
+        MEMORY_CATEGORY_INDEX = 1,
+        MEMORY_CATEGORY_TEXTURE = 2,
+        MEMORY_CATEGORY_UNIFORM = 3,
+        MEMORY_CATEGORY_STAGING = 4,
+        MEMORY_CATEGORY_ATTACHMENT = 5,
+        MEMORY_CATEGORY_OTHER = 6,
+        MEMORY_CATEGORY_MAX_COUNT,
+    };
+
+    // buffers and optimal images never share a block, so
+    // bufferImageGranularity never has to be honoured between neighbours
+    enum memory_resource {
+        MEMORY_RESOURCE_BUFFER = 0,
+        MEMORY_RESOURCE_IMAGE = 1,
+    };
+
+    // a range of a VkDeviceMemory handed out by the backend. host visible
+    // memory stays mapped for its whole lifetime, mapped points at offset
+    struct memory_allocation {
+        VkDeviceMemory memory;
+        VkDeviceSize offset;
+        VkDeviceSize size;
+        void *mapped;
+        uint32_t id;
+    };
+
+    struct memory_heap_stats {
+        VkMemoryHeapFlags flags;
+        VkDeviceSize size;
+        VkDeviceSize budget;        // VK_EXT_memory_budget, heap size otherwise
+        VkDeviceSize usage;         // whole process as seen by the driver, tracked otherwise
+        VkDeviceSize tracked_usage; // device memory this backend allocated, blocks included
+        VkDeviceSize tracked_peak;
+        uint32_t allocation_count;  // VkDeviceMemory objects
+    };
+
+    struct memory_category_stats {
+        VkDeviceSize usage;
+        VkDeviceSize peak;
+        uint32_t allocation_count;
+        uint32_t peak_allocation_count;
+    };
+
+    struct memory_stats {
+        bool budget_available;
+        uint32_t heap_count;
+        std::array<memory_heap_stats, VK_MAX_MEMORY_HEAPS> heaps;
+        std::array<memory_category_stats, MEMORY_CATEGORY_MAX_COUNT> categories;
+        VkDeviceSize total_usage;   // bytes handed out to resources
+        VkDeviceSize total_peak;
+        uint32_t allocation_count;
+        uint32_t block_count;
+        VkDeviceSize block_size;    // bytes reserved by suballocation blocks
+        VkDeviceSize block_used;
+        uint32_t defrag_moves;
+        VkDeviceSize defrag_bytes;
+    };
+
+    const char *memory_category_name(memory_category category);
+    memory_category buffer_memory_category(VkBufferUsageFlags usage);
+    memory_category image_memory_category(VkImageUsageFlags usage);
+}
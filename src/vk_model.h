@@ -2,27 +2,27 @@
 
 #include "ex_mesh.h"
 #include "vk_backend.h"
-#include "vk_buffer.h"
+#include "vk_geometry_arena.h"
 
 namespace ex::vulkan {
     class model {
     public:
-        void create(ex::vulkan::backend *backend, ex::mesh *mesh);
+        void create(ex::vulkan::backend *backend, ex::vulkan::geometry_arena *arena, ex::mesh *mesh);
         void destroy(ex::vulkan::backend *backend);
         void bind(VkCommandBuffer command_bufer);
+        void bind(ex::vulkan::command_context &context);
         void draw(VkCommandBuffer command_buffer);
+        void draw_instanced(VkCommandBuffer command_buffer, uint32_t instance_count, uint32_t first_instance);
 
-        uint32_t vertex_count() { return m_vertex_count; }
-        uint32_t index_count() { return m_index_count; }
+        uint32_t vertex_count() { return m_geometry.vertex_count; }
+        uint32_t index_count() { return m_geometry.index_count; }
+        const ex::vulkan::geometry_arena::range &geometry() { return m_geometry; }
+        // model space, xyz center and w radius
+        glm::vec4 bounding_sphere() { return m_bounding_sphere; }
         
     private:
-        void create_vertex_buffer(ex::vulkan::backend *backend, std::vector<ex::vertex> vertices);
-        void create_index_buffer(ex::vulkan::backend *backend, std::vector<uint32_t> indices);
-        
-    private:
-        ex::vulkan::buffer m_vertex_buffer;
-        ex::vulkan::buffer m_index_buffer;
-        uint32_t m_vertex_count;
-        uint32_t m_index_count;
+        ex::vulkan::geometry_arena *m_arena {nullptr};
+        ex::vulkan::geometry_arena::range m_geometry {};
+        glm::vec4 m_bounding_sphere {0.0f};
     };
 }
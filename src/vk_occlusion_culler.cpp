@@ -0,0 +1,383 @@
+#include "vk_occlusion_culler.h"
+#include "vk_common.h"
+#include "ex_logger.h"
+#include "ex_profiler.h"
+
+#include <algorithm>
+#include <cmath>
+
+void
+ex::vulkan::occlusion_culler::set_max_objects(uint32_t max_objects) {
+    m_max_objects = std::max(max_objects, 1u);
+}
+
+void
+ex::vulkan::occlusion_culler::set_pyramid_extent(VkExtent2D extent) {
+    m_pyramid_extent.width = std::max(extent.width, 1u);
+    m_pyramid_extent.height = std::max(extent.height, 1u);
+}
+
+void
+ex::vulkan::occlusion_culler::create(ex::vulkan::backend *backend, ex::vulkan::render_graph *graph) {
+    m_backend = backend;
+    m_graph = graph;
+    m_mip_count = static_cast<uint32_t>(std::floor(std::log2(std::max(m_pyramid_extent.width, m_pyramid_extent.height)))) + 1;
+
+    // buffers
+    uint32_t visibility_words = (m_max_objects + 31) / 32;
+    for (uint32_t i = 0; i < ex::vulkan::backend::max_frames_in_flight; i++) {
+        m_bounds[i].set_usage(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+        m_bounds[i].set_properties(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        m_bounds[i].build(backend, sizeof(glm::vec4) * static_cast<VkDeviceSize>(m_max_objects));
+        m_bounds[i].bind(backend);
+
+        m_visibility[i].set_usage(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+        m_visibility[i].set_properties(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        m_visibility[i].build(backend, sizeof(uint32_t) * static_cast<VkDeviceSize>(visibility_words));
+        m_visibility[i].bind(backend);
+    }
+    m_visible_bits.resize(visibility_words);
+
+    VkSamplerCreateInfo sampler_create_info = {};
+    sampler_create_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_create_info.pNext = nullptr;
+    sampler_create_info.flags = 0;
+    sampler_create_info.magFilter = VK_FILTER_NEAREST;
+    sampler_create_info.minFilter = VK_FILTER_NEAREST;
+    sampler_create_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampler_create_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_create_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_create_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_create_info.minLod = 0.0f;
+    sampler_create_info.maxLod = static_cast<float>(m_mip_count);
+    sampler_create_info.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+    VK_CHECK(vkCreateSampler(backend->logical_device(), &sampler_create_info, backend->allocator(), &m_sampler));
+
+    // descriptors
+    uint32_t reduce_set_count = ex::vulkan::backend::max_frames_in_flight + m_mip_count - 1;
+    uint32_t cull_set_count = ex::vulkan::backend::max_frames_in_flight;
+    m_descriptor_pool.add_size(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, reduce_set_count + cull_set_count);
+    m_descriptor_pool.add_size(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, reduce_set_count);
+    m_descriptor_pool.add_size(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, cull_set_count * 2);
+    m_descriptor_pool.create(backend, reduce_set_count + cull_set_count);
+
+    m_reduce_layout.add_binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+    m_reduce_layout.add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+    m_reduce_layout.create(backend);
+
+    m_cull_layout.add_binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+    m_cull_layout.add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+    m_cull_layout.add_binding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+    m_cull_layout.create(backend);
+
+    // image infos are written through pointers, the vectors never resize
+    // after this
+    m_mip_sampled_infos.resize(m_mip_count);
+    m_mip_storage_infos.resize(m_mip_count);
+    m_mip_sets.resize(m_mip_count);
+    for (uint32_t mip = 1; mip < m_mip_count; mip++) {
+        m_mip_sets[mip].allocate(backend, &m_descriptor_pool, &m_reduce_layout);
+        m_mip_sets[mip].write_image(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &m_mip_sampled_infos[mip - 1]);
+        m_mip_sets[mip].write_image(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, &m_mip_storage_infos[mip]);
+    }
+
+    for (uint32_t i = 0; i < ex::vulkan::backend::max_frames_in_flight; i++) {
+        m_depth_sets[i].allocate(backend, &m_descriptor_pool, &m_reduce_layout);
+        m_depth_sets[i].write_image(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &m_depth_infos[i]);
+        m_depth_sets[i].write_image(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, &m_mip0_infos[i]);
+
+        m_cull_sets[i].allocate(backend, &m_descriptor_pool, &m_cull_layout);
+        m_cull_sets[i].write_image(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &m_pyramid_info);
+        m_cull_sets[i].write_buffer(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, m_bounds[i].get_descriptor_info());
+        m_cull_sets[i].write_buffer(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, m_visibility[i].get_descriptor_info());
+    }
+
+    // pipelines
+    m_reduce_pipeline.push_descriptor_set_layout(m_reduce_layout.handle());
+    m_reduce_pipeline.set_push_constant_range(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(reduce_constants));
+    m_reduce_pipeline.build_layout(backend);
+    m_reduce_shader.create_compute(backend, "res/shaders/hiz_reduce.comp.spv");
+    m_reduce_pipeline.build_compute(backend, &m_reduce_shader);
+    m_reduce_shader.destroy(backend);
+
+    m_cull_pipeline.push_descriptor_set_layout(m_cull_layout.handle());
+    m_cull_pipeline.set_push_constant_range(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(cull_constants));
+    m_cull_pipeline.build_layout(backend);
+    m_cull_shader.create_compute(backend, "res/shaders/hiz_cull.comp.spv");
+    m_cull_pipeline.build_compute(backend, &m_cull_shader);
+    m_cull_shader.destroy(backend);
+
+    // graph
+    ex::vulkan::render_graph::image_desc pyramid_desc = {};
+    pyramid_desc.format = VK_FORMAT_R32_SFLOAT;
+    pyramid_desc.extent = m_pyramid_extent;
+    pyramid_desc.mip_levels = m_mip_count;
+    m_pyramid = graph->create_image("hiz_pyramid", pyramid_desc);
+
+    m_pyramid_pass = graph->add_pass("hiz pyramid", ex::vulkan::render_graph::PASS_COMPUTE, [this](VkCommandBuffer command_buffer) {
+        record_pyramid(command_buffer);
+    });
+    graph->write(m_pyramid_pass, m_pyramid, ex::vulkan::render_graph::ACCESS_STORAGE_WRITE);
+
+    // only writes a buffer, the graph can't see anyone needs it
+    m_cull_pass = graph->add_pass("hiz cull", ex::vulkan::render_graph::PASS_COMPUTE, [this](VkCommandBuffer command_buffer) {
+        record_cull(command_buffer);
+    });
+    graph->read(m_cull_pass, m_pyramid, ex::vulkan::render_graph::ACCESS_SAMPLED_COMPUTE);
+    graph->set_side_effect(m_cull_pass);
+
+    EXDEBUG("Occlusion culler: %ux%u pyramid, %u mips, %u objects",
+            m_pyramid_extent.width, m_pyramid_extent.height, m_mip_count, m_max_objects);
+}
+
+void
+ex::vulkan::occlusion_culler::bind_graph(ex::vulkan::backend *backend) {
+    for (VkImageView view : m_mip_views) {
+        if (view) vkDestroyImageView(backend->logical_device(), view, backend->allocator());
+    }
+    m_mip_views.assign(m_mip_count, VK_NULL_HANDLE);
+
+    for (uint32_t mip = 0; mip < m_mip_count; mip++) {
+        VkImageViewCreateInfo image_view_create_info = {};
+        image_view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        image_view_create_info.pNext = nullptr;
+        image_view_create_info.flags = 0;
+        image_view_create_info.image = m_graph->image(m_pyramid);
+        image_view_create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        image_view_create_info.format = VK_FORMAT_R32_SFLOAT;
+        image_view_create_info.components = {};
+        image_view_create_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        image_view_create_info.subresourceRange.baseMipLevel = mip;
+        image_view_create_info.subresourceRange.levelCount = 1;
+        image_view_create_info.subresourceRange.baseArrayLayer = 0;
+        image_view_create_info.subresourceRange.layerCount = 1;
+        VK_CHECK(vkCreateImageView(backend->logical_device(),
+                                   &image_view_create_info,
+                                   backend->allocator(),
+                                   &m_mip_views[mip]));
+
+        // the pass keeps the whole pyramid in general, mips are read back
+        // as they are finished
+        m_mip_sampled_infos[mip] = { m_sampler, m_mip_views[mip], VK_IMAGE_LAYOUT_GENERAL };
+        m_mip_storage_infos[mip] = { VK_NULL_HANDLE, m_mip_views[mip], VK_IMAGE_LAYOUT_GENERAL };
+    }
+
+    for (uint32_t mip = 1; mip < m_mip_count; mip++) m_mip_sets[mip].update(backend);
+
+    m_pyramid_info = { m_sampler, m_graph->view(m_pyramid), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+    for (uint32_t i = 0; i < ex::vulkan::backend::max_frames_in_flight; i++) {
+        m_cull_sets[i].update(backend);
+        // rewritten with the depth view on the slot's next pyramid pass
+        m_mip0_infos[i] = m_mip_storage_infos[0];
+        m_depth_infos[i] = {};
+    }
+}
+
+void
+ex::vulkan::occlusion_culler::destroy(ex::vulkan::backend *backend) {
+    for (VkImageView view : m_mip_views) {
+        if (view) vkDestroyImageView(backend->logical_device(), view, backend->allocator());
+    }
+    m_mip_views.clear();
+
+    m_cull_pipeline.destroy(backend);
+    m_reduce_pipeline.destroy(backend);
+    m_cull_layout.destroy(backend);
+    m_reduce_layout.destroy(backend);
+    m_descriptor_pool.destroy(backend);
+    if (m_sampler) vkDestroySampler(backend->logical_device(), m_sampler, backend->allocator());
+    m_sampler = VK_NULL_HANDLE;
+
+    for (ex::vulkan::buffer &buffer : m_visibility) buffer.destroy(backend);
+    for (ex::vulkan::buffer &buffer : m_bounds) buffer.destroy(backend);
+}
+
+void
+ex::vulkan::occlusion_culler::update(const std::vector<glm::vec4> &spheres, const glm::mat4 &view_projection) {
+    EXPROFILE_FUNCTION();
+    uint32_t frame = m_backend->frame_index();
+
+    // the slot's fence has signalled, its bits are final
+    m_result_count = m_slot_object_counts[frame];
+    m_visible_count = 0;
+    if (m_result_count > 0) {
+        uint32_t words = (m_result_count + 31) / 32;
+        m_visibility[frame].map(m_backend);
+        m_visibility[frame].copy_from(m_visible_bits.data(), sizeof(uint32_t) * static_cast<VkDeviceSize>(words));
+        m_visibility[frame].unmap(m_backend);
+        for (uint32_t i = 0; i < words; i++) {
+            // bits past the tested count were never set
+            m_visible_count += static_cast<uint32_t>(__builtin_popcount(m_visible_bits[i]));
+        }
+    }
+
+    m_object_count = std::min(static_cast<uint32_t>(spheres.size()), m_max_objects);
+    if (spheres.size() > m_max_objects) EXWARN("Occlusion culler: %zu objects, only %u are tested", spheres.size(), m_max_objects);
+    m_view_projection = view_projection;
+
+    m_bounds[frame].map(m_backend);
+    m_bounds[frame].copy_to((void *) spheres.data(), sizeof(glm::vec4) * static_cast<VkDeviceSize>(m_object_count));
+    m_bounds[frame].unmap(m_backend);
+}
+
+bool
+ex::vulkan::occlusion_culler::visible(uint32_t object) {
+    if (object >= m_result_count) return true;
+    return (m_visible_bits[object / 32] >> (object % 32)) & 1u;
+}
+
+void
+ex::vulkan::occlusion_culler::record_pyramid(VkCommandBuffer command_buffer) {
+    uint32_t frame = m_backend->frame_index();
+    m_pyramid_recorded = false;
+
+    // a new depth image (first frame, resize) hasn't been drawn into, its
+    // contents and layout are undefined until the main pass ran once
+    VkImage depth_image = m_backend->depth_image();
+    bool depth_valid = depth_image == m_last_depth_image;
+    m_last_depth_image = depth_image;
+    if (!depth_valid || !m_enabled || m_object_count == 0) return;
+
+    // with dynamic resolution only a corner of the depth buffer was drawn
+    VkExtent2D depth_extent = m_backend->last_render_extent();
+    if (m_depth_infos[frame].imageView != m_backend->depth_image_view()) {
+        // the slot's previous submit is done with the set
+        m_depth_infos[frame] = { m_sampler, m_backend->depth_image_view(), VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL };
+        m_depth_sets[frame].update(m_backend);
+    }
+
+    VkImageAspectFlags depth_aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+    VkFormat depth_format = m_backend->depth_format();
+    if (depth_format == VK_FORMAT_D32_SFLOAT_S8_UINT || depth_format == VK_FORMAT_D24_UNORM_S8_UINT) {
+        depth_aspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+    }
+
+    // the previous main pass wrote it, read it in place
+    VkImageMemoryBarrier depth_barrier = {};
+    depth_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    depth_barrier.pNext = nullptr;
+    depth_barrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    depth_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    depth_barrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    depth_barrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    depth_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    depth_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    depth_barrier.image = depth_image;
+    depth_barrier.subresourceRange = { depth_aspect, 0, 1, 0, 1 };
+    vkCmdPipelineBarrier(command_buffer,
+                         VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0,
+                         0, nullptr,
+                         0, nullptr,
+                         1, &depth_barrier);
+
+    m_reduce_pipeline.bind(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE);
+    for (uint32_t mip = 0; mip < m_mip_count; mip++) {
+        reduce_constants constants = {};
+        VkExtent2D source_extent = mip == 0 ? depth_extent : mip_extent(mip - 1);
+        VkExtent2D destination_extent = mip_extent(mip);
+        constants.source_size = glm::ivec2(source_extent.width, source_extent.height);
+        constants.destination_size = glm::ivec2(destination_extent.width, destination_extent.height);
+
+        VkDescriptorSet set = mip == 0 ? m_depth_sets[frame].handle() : m_mip_sets[mip].handle();
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_reduce_pipeline.layout(), 0, 1, &set, 0, nullptr);
+        m_reduce_pipeline.push_constants(command_buffer, VK_SHADER_STAGE_COMPUTE_BIT, &constants);
+        vkCmdDispatch(command_buffer, (destination_extent.width + 7) / 8, (destination_extent.height + 7) / 8, 1);
+
+        // the next mip reads this one, the graph covers the last
+        if (mip + 1 == m_mip_count) break;
+        VkImageMemoryBarrier mip_barrier = {};
+        mip_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        mip_barrier.pNext = nullptr;
+        mip_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        mip_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        mip_barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+        mip_barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        mip_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        mip_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        mip_barrier.image = m_graph->image(m_pyramid);
+        mip_barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, mip, 1, 0, 1 };
+        vkCmdPipelineBarrier(command_buffer,
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             0,
+                             0, nullptr,
+                             0, nullptr,
+                             1, &mip_barrier);
+    }
+
+    // back for this frame's main pass, which has to wait for the reads
+    depth_barrier.srcAccessMask = 0;
+    depth_barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    depth_barrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    depth_barrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    vkCmdPipelineBarrier(command_buffer,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                         0,
+                         0, nullptr,
+                         0, nullptr,
+                         1, &depth_barrier);
+
+    m_pyramid_recorded = true;
+}
+
+void
+ex::vulkan::occlusion_culler::record_cull(VkCommandBuffer command_buffer) {
+    uint32_t frame = m_backend->frame_index();
+    m_slot_object_counts[frame] = 0;
+    if (!m_pyramid_recorded) return;
+
+    uint32_t words = (m_object_count + 31) / 32;
+    vkCmdFillBuffer(command_buffer, m_visibility[frame].handle(), 0, sizeof(uint32_t) * static_cast<VkDeviceSize>(words), 0);
+
+    VkBufferMemoryBarrier clear_barrier = {};
+    clear_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    clear_barrier.pNext = nullptr;
+    clear_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    clear_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    clear_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    clear_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    clear_barrier.buffer = m_visibility[frame].handle();
+    clear_barrier.offset = 0;
+    clear_barrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(command_buffer,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0,
+                         0, nullptr,
+                         1, &clear_barrier,
+                         0, nullptr);
+
+    cull_constants constants = {};
+    constants.view_projection = m_view_projection;
+    constants.pyramid_size = glm::vec2(m_pyramid_extent.width, m_pyramid_extent.height);
+    constants.object_count = m_object_count;
+    constants.mip_count = m_mip_count;
+
+    VkDescriptorSet set = m_cull_sets[frame].handle();
+    m_cull_pipeline.bind(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_cull_pipeline.layout(), 0, 1, &set, 0, nullptr);
+    m_cull_pipeline.push_constants(command_buffer, VK_SHADER_STAGE_COMPUTE_BIT, &constants);
+    vkCmdDispatch(command_buffer, (m_object_count + 63) / 64, 1, 1);
+
+    // read on the cpu once the slot's fence signals
+    VkBufferMemoryBarrier host_barrier = clear_barrier;
+    host_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    host_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(command_buffer,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_HOST_BIT,
+                         0,
+                         0, nullptr,
+                         1, &host_barrier,
+                         0, nullptr);
+
+    m_slot_object_counts[frame] = m_object_count;
+}
+
+VkExtent2D
+ex::vulkan::occlusion_culler::mip_extent(uint32_t mip) {
+    return { std::max(m_pyramid_extent.width >> mip, 1u), std::max(m_pyramid_extent.height >> mip, 1u) };
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "vk_backend.h"
+#include "vk_buffer.h"
+#include "vk_shader.h"
+#include "vk_pipeline.h"
+#include "vk_descriptor.h"
+#include "vk_render_graph.h"
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <array>
+#include <cstdint>
+
+namespace ex::vulkan {
+    // Hi-Z occlusion culling as two compute passes in the render graph. The
+    // depth buffer the previous frame left behind is reduced into a pyramid
+    // of farthest depths, then every object's bounding sphere is tested
+    // against it with the view projection that depth was rendered with.
+    // Results come back as a bitmask per frame slot, so draws use visibility
+    // that is a few frames old and newly revealed objects can pop in late.
+    // Needs the backend's depth sampled, see backend::set_depth_sampled.
+    class occlusion_culler {
+    public:
+        void set_max_objects(uint32_t max_objects);
+        // fixed size, any depth extent reduces into it so resizes don't
+        // recompile the graph
+        void set_pyramid_extent(VkExtent2D extent);
+        // adds the passes, call before the graph compiles
+        void create(ex::vulkan::backend *backend, ex::vulkan::render_graph *graph);
+        // per mip views of the graph's pyramid, after every graph compile
+        void bind_graph(ex::vulkan::backend *backend);
+        void destroy(ex::vulkan::backend *backend);
+
+        // after begin_frame. takes this frame's world space spheres (xyz
+        // center, w radius) and the view projection of the depth buffer the
+        // passes will read, and picks up what the slot tested last time
+        void update(const std::vector<glm::vec4> &spheres, const glm::mat4 &view_projection);
+        // anything without a result yet counts as visible
+        bool visible(uint32_t object);
+        void set_enabled(bool enabled) { m_enabled = enabled; }
+
+        bool enabled() { return m_enabled; }
+        uint32_t tested_count() { return m_result_count; }
+        uint32_t visible_count() { return m_visible_count; }
+        uint32_t mip_count() { return m_mip_count; }
+
+    private:
+        struct reduce_constants {
+            glm::ivec2 source_size;
+            glm::ivec2 destination_size;
+        };
+
+        struct cull_constants {
+            glm::mat4 view_projection;
+            glm::vec2 pyramid_size;
+            uint32_t object_count;
+            uint32_t mip_count;
+        };
+
+        void record_pyramid(VkCommandBuffer command_buffer);
+        void record_cull(VkCommandBuffer command_buffer);
+        VkExtent2D mip_extent(uint32_t mip);
+
+    private:
+        ex::vulkan::backend *m_backend {nullptr};
+        ex::vulkan::render_graph *m_graph {nullptr};
+        uint32_t m_max_objects {16384};
+        VkExtent2D m_pyramid_extent {512, 256};
+        uint32_t m_mip_count {1};
+        bool m_enabled {true};
+
+        uint32_t m_pyramid {ex::vulkan::render_graph::invalid_id};
+        uint32_t m_pyramid_pass {ex::vulkan::render_graph::invalid_id};
+        uint32_t m_cull_pass {ex::vulkan::render_graph::invalid_id};
+        std::vector<VkImageView> m_mip_views;
+        VkSampler m_sampler {};
+
+        ex::vulkan::shader m_reduce_shader;
+        ex::vulkan::shader m_cull_shader;
+        ex::vulkan::pipeline m_reduce_pipeline;
+        ex::vulkan::pipeline m_cull_pipeline;
+
+        ex::vulkan::descriptor_pool m_descriptor_pool;
+        ex::vulkan::descriptor_set_layout m_reduce_layout;
+        ex::vulkan::descriptor_set_layout m_cull_layout;
+        // mip 0 reads the depth buffer, whose view changes on resize
+        std::array<ex::vulkan::descriptor_set, ex::vulkan::backend::max_frames_in_flight> m_depth_sets;
+        std::array<VkDescriptorImageInfo, ex::vulkan::backend::max_frames_in_flight> m_depth_infos {};
+        std::array<VkDescriptorImageInfo, ex::vulkan::backend::max_frames_in_flight> m_mip0_infos {};
+        // set i reduces mip i - 1 into mip i
+        std::vector<ex::vulkan::descriptor_set> m_mip_sets;
+        std::vector<VkDescriptorImageInfo> m_mip_sampled_infos;
+        std::vector<VkDescriptorImageInfo> m_mip_storage_infos;
+        std::array<ex::vulkan::descriptor_set, ex::vulkan::backend::max_frames_in_flight> m_cull_sets;
+        VkDescriptorImageInfo m_pyramid_info {};
+
+        // written by the cpu and read back per frame slot
+        std::array<ex::vulkan::buffer, ex::vulkan::backend::max_frames_in_flight> m_bounds;
+        std::array<ex::vulkan::buffer, ex::vulkan::backend::max_frames_in_flight> m_visibility;
+        // objects the slot's last submit tested, 0 if it skipped
+        std::array<uint32_t, ex::vulkan::backend::max_frames_in_flight> m_slot_object_counts {};
+
+        // the depth image seen last frame, a new one hasn't been drawn yet
+        VkImage m_last_depth_image {};
+        bool m_pyramid_recorded {false};
+        uint32_t m_object_count {0};
+        glm::mat4 m_view_projection {1.0f};
+
+        std::vector<uint32_t> m_visible_bits;
+        uint32_t m_result_count {0};
+        uint32_t m_visible_count {0};
+    };
+}
@@ -1,8 +1,50 @@
 #include "vk_pipeline.h"
 #include "vk_common.h"
 #include "ex_vertex.h"
+#include "ex_utils.hpp"
+#include "ex_profiler.h"
 #include <vector>
 
+bool
+ex::vulkan::pipeline_state::operator==(const pipeline_state &other) const {
+    return vertex_module == other.vertex_module &&
+        fragment_module == other.fragment_module &&
+        stream == other.stream &&
+        topology == other.topology &&
+        polygon_mode == other.polygon_mode &&
+        cull_mode == other.cull_mode &&
+        front_face == other.front_face &&
+        depth_write == other.depth_write &&
+        depth_compare == other.depth_compare &&
+        color_write == other.color_write &&
+        layout == other.layout &&
+        render_pass == other.render_pass &&
+        subpass == other.subpass &&
+        constants == other.constants;
+}
+
+size_t
+ex::vulkan::pipeline_state_hash::operator()(const pipeline_state &state) const {
+    size_t seed = 0;
+    ex::utils::hash_combine(seed,
+                            reinterpret_cast<uintptr_t>(state.vertex_module),
+                            reinterpret_cast<uintptr_t>(state.fragment_module),
+                            static_cast<uint32_t>(state.stream),
+                            static_cast<uint32_t>(state.topology),
+                            static_cast<uint32_t>(state.polygon_mode),
+                            static_cast<uint32_t>(state.cull_mode),
+                            static_cast<uint32_t>(state.front_face),
+                            state.depth_write,
+                            static_cast<uint32_t>(state.depth_compare),
+                            state.color_write,
+                            reinterpret_cast<uintptr_t>(state.layout),
+                            reinterpret_cast<uintptr_t>(state.render_pass),
+                            state.subpass,
+                            state.constants.count);
+    for (uint32_t i = 0; i < state.constants.count; i++) ex::utils::hash_combine(seed, state.constants.values[i]);
+    return seed;
+}
+
 void
 ex::vulkan::pipeline::push_descriptor_set_layout(VkDescriptorSetLayout descriptor_set_layout) {
     m_descriptor_set_layouts.push_back(descriptor_set_layout);
@@ -53,21 +95,80 @@ ex::vulkan::pipeline::set_front_face(VkFrontFace front_face) {
     m_front_face = front_face;
 }
 
+void
+ex::vulkan::pipeline::set_depth(bool depth_write, VkCompareOp depth_compare) {
+    m_depth_write = depth_write;
+    m_depth_compare = depth_compare;
+}
+
+void
+ex::vulkan::pipeline::set_constant(uint32_t id, uint32_t value) {
+    m_constants.set(id, value);
+}
+
 void
 ex::vulkan::pipeline::build(ex::vulkan::backend *backend, ex::vulkan::shader *shader) {
-    auto shader_stage_create_info = create_shader_stages(shader->vertex_module(), shader->fragment_module());
+    m_handle = compile(backend, state(backend, shader));
+}
+
+void
+ex::vulkan::pipeline::build(ex::vulkan::backend *backend, const pipeline_state &state) {
+    m_handle = compile(backend, state);
+}
+
+ex::vulkan::pipeline_state
+ex::vulkan::pipeline::state(ex::vulkan::backend *backend, ex::vulkan::shader *shader) {
+    pipeline_state out_state = {};
+    out_state.vertex_module = shader->vertex_module();
+    out_state.fragment_module = shader->fragment_module();
+    out_state.stream = pipeline_state::VERTEX_STREAM_INTERLEAVED;
+    out_state.topology = m_topology;
+    out_state.polygon_mode = m_polygon_mode;
+    out_state.cull_mode = m_cull_mode;
+    out_state.front_face = m_front_face;
+    out_state.depth_write = m_depth_write;
+    out_state.depth_compare = m_depth_compare;
+    out_state.color_write = true;
+    out_state.layout = m_layout;
+    out_state.render_pass = backend->render_pass();
+    out_state.subpass = backend->subpass();
+    out_state.constants = m_constants;
+
+    return out_state;
+}
+
+VkPipeline
+ex::vulkan::pipeline::compile(ex::vulkan::backend *backend,
+                              const pipeline_state &state,
+                              VkPipelineCache cache) {
+    EXPROFILE_FUNCTION();
+    std::array<VkSpecializationMapEntry, ex::vulkan::shader_constants::max_constants> map_entries;
+    VkSpecializationInfo specialization_info = state.constants.specialization_info(map_entries);
+    auto shader_stage_create_info = create_shader_stages(state.vertex_module,
+                                                         state.fragment_module,
+                                                         state.constants.count > 0 ? &specialization_info : nullptr);
     
-    auto vertex_binding = ex::vertex::get_binding_descriptions();
-    auto vertex_attribute = ex::vertex::get_attribute_descriptions();
+    bool position_only = state.stream == pipeline_state::VERTEX_STREAM_POSITION;
+    auto vertex_binding = position_only ? ex::vertex::get_position_binding_descriptions() : ex::vertex::get_binding_descriptions();
+    auto vertex_attribute = position_only ? ex::vertex::get_position_attribute_descriptions() : ex::vertex::get_attribute_descriptions();
+    if (state.stream == pipeline_state::VERTEX_STREAM_INSTANCED) {
+        auto instance_binding = ex::instance::get_binding_descriptions();
+        auto instance_attribute = ex::instance::get_attribute_descriptions();
+        vertex_binding.insert(vertex_binding.end(), instance_binding.begin(), instance_binding.end());
+        vertex_attribute.insert(vertex_attribute.end(), instance_attribute.begin(), instance_attribute.end());
+    } else if (state.stream == pipeline_state::VERTEX_STREAM_NONE) {
+        vertex_binding.clear();
+        vertex_attribute.clear();
+    }
     auto vertex_input_state_create_info = create_vertex_input_state(vertex_binding, vertex_attribute);
     
-    auto input_assembly_state_create_info = create_input_assembly_state(m_topology);
-    auto viewport_state_create_info = create_viewport_state(backend->swapchain_extent());
-    auto rasterization_state_create_info = create_rasterization_state(m_polygon_mode, m_cull_mode, m_front_face);
+    auto input_assembly_state_create_info = create_input_assembly_state(state.topology);
+    auto viewport_state_create_info = create_viewport_state();
+    auto rasterization_state_create_info = create_rasterization_state(state.polygon_mode, state.cull_mode, state.front_face);
     auto multisample_state_create_info = create_multisample_state();
-    auto depth_stencil_state_create_info = create_depth_stencil_state();
+    auto depth_stencil_state_create_info = create_depth_stencil_state(state.depth_write, state.depth_compare);
     
-    auto color_blend_attachment_state = create_color_blend_attachment_state();
+    auto color_blend_attachment_state = create_color_blend_attachment_state(state.color_write);
     auto color_blend_state_create_info = create_color_blend_state(&color_blend_attachment_state);
 
     std::vector<VkDynamicState> dynamic_states = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR, };
@@ -88,17 +189,58 @@ ex::vulkan::pipeline::build(ex::vulkan::backend *backend, ex::vulkan::shader *sh
     graphics_pipeline_create_info.pDepthStencilState = &depth_stencil_state_create_info;
     graphics_pipeline_create_info.pColorBlendState = &color_blend_state_create_info;
     graphics_pipeline_create_info.pDynamicState = &dynamic_state_create_info;
-    graphics_pipeline_create_info.layout = m_layout;
-    graphics_pipeline_create_info.renderPass = backend->render_pass();
-    graphics_pipeline_create_info.subpass = backend->subpass();
+    graphics_pipeline_create_info.layout = state.layout;
+    graphics_pipeline_create_info.renderPass = state.render_pass;
+    graphics_pipeline_create_info.subpass = state.subpass;
     graphics_pipeline_create_info.basePipelineHandle = VK_NULL_HANDLE;
     graphics_pipeline_create_info.basePipelineIndex = 0;
+
+    VkPipeline out_pipeline = VK_NULL_HANDLE;
     VK_CHECK(vkCreateGraphicsPipelines(backend->logical_device(),
-                                       nullptr,
+                                       cache,
                                        1,
                                        &graphics_pipeline_create_info,
                                        backend->allocator(),
-                                       &m_handle));
+                                       &out_pipeline));
+    return out_pipeline;
+}
+
+void
+ex::vulkan::pipeline::build_compute(ex::vulkan::backend *backend, ex::vulkan::shader *shader) {
+    m_handle = compile_compute(backend, shader->compute_module(), m_layout);
+}
+
+VkPipeline
+ex::vulkan::pipeline::compile_compute(ex::vulkan::backend *backend,
+                                      VkShaderModule compute_module,
+                                      VkPipelineLayout layout,
+                                      VkPipelineCache cache) {
+    EXPROFILE_FUNCTION();
+    VkPipelineShaderStageCreateInfo shader_stage_create_info = {};
+    shader_stage_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shader_stage_create_info.pNext = nullptr;
+    shader_stage_create_info.flags = 0;
+    shader_stage_create_info.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    shader_stage_create_info.module = compute_module;
+    shader_stage_create_info.pName = "main";
+
+    VkComputePipelineCreateInfo compute_pipeline_create_info = {};
+    compute_pipeline_create_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    compute_pipeline_create_info.pNext = nullptr;
+    compute_pipeline_create_info.flags = 0;
+    compute_pipeline_create_info.stage = shader_stage_create_info;
+    compute_pipeline_create_info.layout = layout;
+    compute_pipeline_create_info.basePipelineHandle = VK_NULL_HANDLE;
+    compute_pipeline_create_info.basePipelineIndex = 0;
+
+    VkPipeline out_pipeline = VK_NULL_HANDLE;
+    VK_CHECK(vkCreateComputePipelines(backend->logical_device(),
+                                      cache,
+                                      1,
+                                      &compute_pipeline_create_info,
+                                      backend->allocator(),
+                                      &out_pipeline));
+    return out_pipeline;
 }
 
 void
@@ -115,12 +257,12 @@ ex::vulkan::pipeline::bind(VkCommandBuffer command_buffer, VkPipelineBindPoint b
 void
 ex::vulkan::pipeline::bind_descriptor_sets(VkCommandBuffer command_buffer,
                                            VkPipelineBindPoint bind_point,
-                                           std::vector<VkDescriptorSet> descriptor_sets) {
+                                           ex::utils::span<const VkDescriptorSet> descriptor_sets) {
     vkCmdBindDescriptorSets(command_buffer,
                             bind_point,
                             m_layout,
                             0,
-                            descriptor_sets.size(),
+                            static_cast<uint32_t>(descriptor_sets.size()),
                             descriptor_sets.data(),
                             0,
                             nullptr);
@@ -128,17 +270,49 @@ ex::vulkan::pipeline::bind_descriptor_sets(VkCommandBuffer command_buffer,
 
 void
 ex::vulkan::pipeline::update_dynamic(VkCommandBuffer command_buffer, VkExtent2D extent) {
-    m_viewport.x = 0.0f;
-    m_viewport.y = 0.0f;
-    m_viewport.width = static_cast<float>(extent.width);
-    m_viewport.height = static_cast<float>(extent.height);
-    m_viewport.minDepth = 0.0f;
-    m_viewport.maxDepth = 1.0f;
-    vkCmdSetViewport(command_buffer, 0, 1, &m_viewport);
+    // locals, this runs on the recording threads concurrently
+    VkViewport viewport = {};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = static_cast<float>(extent.width);
+    viewport.height = static_cast<float>(extent.height);
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+
+    VkRect2D scissor = {};
+    scissor.offset = { 0, 0 };
+    scissor.extent = extent;
+    vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+}
 
-    m_scissor.offset = { 0, 0 };
-    m_scissor.extent = extent;
-    vkCmdSetScissor(command_buffer, 0, 1, &m_scissor);
+void
+ex::vulkan::pipeline::bind(ex::vulkan::command_context &context, VkPipelineBindPoint bind_point) {
+    context.bind_pipeline(bind_point, m_handle);
+}
+
+void
+ex::vulkan::pipeline::bind_descriptor_sets(ex::vulkan::command_context &context,
+                                           VkPipelineBindPoint bind_point,
+                                           ex::utils::span<const VkDescriptorSet> descriptor_sets) {
+    context.bind_descriptor_sets(bind_point, m_layout, 0, descriptor_sets);
+}
+
+void
+ex::vulkan::pipeline::update_dynamic(ex::vulkan::command_context &context, VkExtent2D extent) {
+    VkViewport viewport = {};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = static_cast<float>(extent.width);
+    viewport.height = static_cast<float>(extent.height);
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    context.set_viewport(viewport);
+
+    VkRect2D scissor = {};
+    scissor.offset = { 0, 0 };
+    scissor.extent = extent;
+    context.set_scissor(scissor);
 }
 
 void
@@ -155,14 +329,18 @@ ex::vulkan::pipeline::push_constants(VkCommandBuffer command_buffer,
 
 std::vector<VkPipelineShaderStageCreateInfo>
 ex::vulkan::pipeline::create_shader_stages(VkShaderModule vertex_module,
-                                           VkShaderModule fragment_module) {
-    std::vector<VkPipelineShaderStageCreateInfo> out_shader_stages(2);
+                                           VkShaderModule fragment_module,
+                                           const VkSpecializationInfo *specialization_info) {
+    // depth only pipelines run without a fragment stage
+    std::vector<VkPipelineShaderStageCreateInfo> out_shader_stages(fragment_module ? 2 : 1);
     out_shader_stages[0].pNext = nullptr;
     out_shader_stages[0].flags = 0;
     out_shader_stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     out_shader_stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
     out_shader_stages[0].module = vertex_module;
     out_shader_stages[0].pName = "main";
+    out_shader_stages[0].pSpecializationInfo = specialization_info;
+    if (!fragment_module) return out_shader_stages;
     
     out_shader_stages[1].pNext = nullptr;
     out_shader_stages[1].flags = 0;
@@ -170,6 +348,7 @@ ex::vulkan::pipeline::create_shader_stages(VkShaderModule vertex_module,
     out_shader_stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
     out_shader_stages[1].module = fragment_module;
     out_shader_stages[1].pName = "main";
+    out_shader_stages[1].pSpecializationInfo = specialization_info;
 
     return out_shader_stages;
 }
@@ -200,25 +379,16 @@ ex::vulkan::pipeline::create_input_assembly_state(VkPrimitiveTopology topology)
 }
 
 VkPipelineViewportStateCreateInfo
-ex::vulkan::pipeline::create_viewport_state(VkExtent2D extent) {
-    m_viewport.x = 0.0f;
-    m_viewport.y = 0.0f;
-    m_viewport.width = static_cast<float>(extent.width);
-    m_viewport.height = static_cast<float>(extent.height);
-    m_viewport.minDepth = 0.0f;
-    m_viewport.maxDepth = 1.0f;
-
-    m_scissor.offset = { 0, 0 };
-    m_scissor.extent = extent;
-
+ex::vulkan::pipeline::create_viewport_state() {
+    // viewport and scissor are dynamic, only the counts matter here
     VkPipelineViewportStateCreateInfo out_viewport_state_create_info = {};
     out_viewport_state_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
     out_viewport_state_create_info.pNext = nullptr;
     out_viewport_state_create_info.flags = 0;
     out_viewport_state_create_info.viewportCount = 1;
-    out_viewport_state_create_info.pViewports = &m_viewport;
+    out_viewport_state_create_info.pViewports = nullptr;
     out_viewport_state_create_info.scissorCount = 1;
-    out_viewport_state_create_info.pScissors = &m_scissor;
+    out_viewport_state_create_info.pScissors = nullptr;
 
     return out_viewport_state_create_info;
 }
@@ -262,14 +432,14 @@ ex::vulkan::pipeline::create_multisample_state() {
 }
 
 VkPipelineDepthStencilStateCreateInfo
-ex::vulkan::pipeline::create_depth_stencil_state() {
+ex::vulkan::pipeline::create_depth_stencil_state(bool depth_write, VkCompareOp depth_compare) {
     VkPipelineDepthStencilStateCreateInfo out_depth_stencil_state_create_info = {};
     out_depth_stencil_state_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
     out_depth_stencil_state_create_info.pNext = nullptr;
     out_depth_stencil_state_create_info.flags = 0;
     out_depth_stencil_state_create_info.depthTestEnable = VK_TRUE;
-    out_depth_stencil_state_create_info.depthWriteEnable = VK_TRUE;
-    out_depth_stencil_state_create_info.depthCompareOp = VK_COMPARE_OP_LESS;
+    out_depth_stencil_state_create_info.depthWriteEnable = depth_write ? VK_TRUE : VK_FALSE;
+    out_depth_stencil_state_create_info.depthCompareOp = depth_compare;
     out_depth_stencil_state_create_info.depthBoundsTestEnable = VK_FALSE;
     out_depth_stencil_state_create_info.stencilTestEnable = VK_FALSE;
     out_depth_stencil_state_create_info.front = {};
@@ -281,7 +451,7 @@ ex::vulkan::pipeline::create_depth_stencil_state() {
 }
 
 VkPipelineColorBlendAttachmentState
-ex::vulkan::pipeline::create_color_blend_attachment_state() {
+ex::vulkan::pipeline::create_color_blend_attachment_state(bool color_write) {
     VkPipelineColorBlendAttachmentState out_color_blend_attachment_state = {};
     out_color_blend_attachment_state.blendEnable = VK_FALSE;
     out_color_blend_attachment_state.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
@@ -290,11 +460,11 @@ ex::vulkan::pipeline::create_color_blend_attachment_state() {
     out_color_blend_attachment_state.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
     out_color_blend_attachment_state.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
     out_color_blend_attachment_state.alphaBlendOp = VK_BLEND_OP_ADD;
-    out_color_blend_attachment_state.colorWriteMask =
+    out_color_blend_attachment_state.colorWriteMask = color_write ?
         VK_COLOR_COMPONENT_R_BIT |
         VK_COLOR_COMPONENT_G_BIT |
         VK_COLOR_COMPONENT_B_BIT |
-        VK_COLOR_COMPONENT_A_BIT;
+        VK_COLOR_COMPONENT_A_BIT : 0;
 
     return out_color_blend_attachment_state;
 }
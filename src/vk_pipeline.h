@@ -2,13 +2,50 @@
 
 #include "vk_backend.h"
 #include "vk_shader.h"
+#include "vk_command_context.h"
+#include "ex_utils.hpp"
 
 #include <vulkan/vulkan.h>
 #include <glm/glm.hpp>
 #include <vector>
 #include <array>
+#include <unordered_map>
 
 namespace ex::vulkan {
+    // everything that decides the compiled pipeline, equal states can share
+    // one VkPipeline
+    struct pipeline_state {
+        enum vertex_stream {
+            VERTEX_STREAM_INTERLEAVED = 0, // full ex::vertex
+            VERTEX_STREAM_POSITION = 1,    // arena position stream, depth only
+            VERTEX_STREAM_INSTANCED = 2,   // ex::vertex plus ex::instance at binding 1
+            VERTEX_STREAM_NONE = 3,        // no vertex input, positions come from gl_VertexIndex
+        };
+
+        VkShaderModule vertex_module;
+        VkShaderModule fragment_module; // null for depth only pipelines
+        vertex_stream stream;
+        VkPrimitiveTopology topology;
+        VkPolygonMode polygon_mode;
+        VkCullModeFlags cull_mode;
+        VkFrontFace front_face;
+        bool depth_write;
+        VkCompareOp depth_compare;
+        bool color_write;
+        VkPipelineLayout layout;
+        VkRenderPass render_pass;
+        uint32_t subpass;
+        // specialization for both stages, part of the key so every value
+        // set is its own pipeline
+        ex::vulkan::shader_constants constants;
+
+        bool operator==(const pipeline_state &other) const;
+    };
+
+    struct pipeline_state_hash {
+        size_t operator()(const pipeline_state &state) const;
+    };
+    
     class pipeline {
     public:
         void push_descriptor_set_layout(VkDescriptorSetLayout descriptor_set_layout);
@@ -19,35 +56,56 @@ namespace ex::vulkan {
         void set_polygon_mode(VkPolygonMode polygon_mode);
         void set_cull_mode(VkCullModeFlags cull_mode);
         void set_front_face(VkFrontFace front_face);
+        void set_depth(bool depth_write, VkCompareOp depth_compare);
+        void set_constant(uint32_t id, uint32_t value);
         void build(ex::vulkan::backend *backend, ex::vulkan::shader *shader);
+        // for states that differ from what the setters describe
+        void build(ex::vulkan::backend *backend, const pipeline_state &state);
+        // compute pipelines only need the layout and the compute module
+        void build_compute(ex::vulkan::backend *backend, ex::vulkan::shader *shader);
         void destroy(ex::vulkan::backend *backend);
+
+        // state for the pipeline manager, the layout has to be built first
+        pipeline_state state(ex::vulkan::backend *backend, ex::vulkan::shader *shader);
+
+        // thread safe, touches nothing but the arguments
+        static VkPipeline compile(ex::vulkan::backend *backend, const pipeline_state &state, VkPipelineCache cache = VK_NULL_HANDLE);
+        static VkPipeline compile_compute(ex::vulkan::backend *backend, VkShaderModule compute_module, VkPipelineLayout layout, VkPipelineCache cache = VK_NULL_HANDLE);
         
         void bind(VkCommandBuffer command_buffer, VkPipelineBindPoint bind_point);
-        void bind_descriptor_sets(VkCommandBuffer command_buffer, VkPipelineBindPoint bind_point, std::vector<VkDescriptorSet> descriptor_sets);
+        void bind_descriptor_sets(VkCommandBuffer command_buffer, VkPipelineBindPoint bind_point, ex::utils::span<const VkDescriptorSet> descriptor_sets);
         void update_dynamic(VkCommandBuffer command_buffer, VkExtent2D extent);
+        // same through a context, calls matching what is bound are dropped
+        void bind(ex::vulkan::command_context &context, VkPipelineBindPoint bind_point);
+        void bind_descriptor_sets(ex::vulkan::command_context &context, VkPipelineBindPoint bind_point, ex::utils::span<const VkDescriptorSet> descriptor_sets);
+        void update_dynamic(ex::vulkan::command_context &context, VkExtent2D extent);
         void push_constants(VkCommandBuffer command_buffer, VkShaderStageFlags stage_flags, const void *data);
+
+        VkPipeline handle() { return m_handle; }
+        VkPipelineLayout layout() { return m_layout; }
         
     private:
-        std::vector<VkPipelineShaderStageCreateInfo> create_shader_stages(VkShaderModule vertex_module, VkShaderModule fragment_module);
-        VkPipelineVertexInputStateCreateInfo create_vertex_input_state(std::vector<VkVertexInputBindingDescription> &vertex_input_bindings, std::vector<VkVertexInputAttributeDescription> &vertex_input_attributes);
-        VkPipelineInputAssemblyStateCreateInfo create_input_assembly_state(VkPrimitiveTopology topology);
-        VkPipelineViewportStateCreateInfo create_viewport_state(VkExtent2D extent);
-        VkPipelineRasterizationStateCreateInfo create_rasterization_state(VkPolygonMode polygon_mode, VkCullModeFlags cull_mode, VkFrontFace front_face);
-        VkPipelineMultisampleStateCreateInfo create_multisample_state();
-        VkPipelineDepthStencilStateCreateInfo create_depth_stencil_state();
-        VkPipelineColorBlendAttachmentState create_color_blend_attachment_state();
-        VkPipelineColorBlendStateCreateInfo create_color_blend_state(VkPipelineColorBlendAttachmentState *color_blend_attachment_state);
-        VkPipelineDynamicStateCreateInfo create_dynamic_state(std::vector<VkDynamicState> &dynamic_states);
+        static std::vector<VkPipelineShaderStageCreateInfo> create_shader_stages(VkShaderModule vertex_module, VkShaderModule fragment_module, const VkSpecializationInfo *specialization_info);
+        static VkPipelineVertexInputStateCreateInfo create_vertex_input_state(std::vector<VkVertexInputBindingDescription> &vertex_input_bindings, std::vector<VkVertexInputAttributeDescription> &vertex_input_attributes);
+        static VkPipelineInputAssemblyStateCreateInfo create_input_assembly_state(VkPrimitiveTopology topology);
+        static VkPipelineViewportStateCreateInfo create_viewport_state();
+        static VkPipelineRasterizationStateCreateInfo create_rasterization_state(VkPolygonMode polygon_mode, VkCullModeFlags cull_mode, VkFrontFace front_face);
+        static VkPipelineMultisampleStateCreateInfo create_multisample_state();
+        static VkPipelineDepthStencilStateCreateInfo create_depth_stencil_state(bool depth_write, VkCompareOp depth_compare);
+        static VkPipelineColorBlendAttachmentState create_color_blend_attachment_state(bool color_write);
+        static VkPipelineColorBlendStateCreateInfo create_color_blend_state(VkPipelineColorBlendAttachmentState *color_blend_attachment_state);
+        static VkPipelineDynamicStateCreateInfo create_dynamic_state(std::vector<VkDynamicState> &dynamic_states);
 
     private:        
-        VkPipeline m_handle;
-        VkPipelineLayout m_layout;
+        VkPipeline m_handle {};
+        VkPipelineLayout m_layout {};
         VkPrimitiveTopology m_topology;
         VkPolygonMode m_polygon_mode;
         VkCullModeFlags m_cull_mode;
         VkFrontFace m_front_face;
-        VkViewport m_viewport;
-        VkRect2D m_scissor;
+        bool m_depth_write {true};
+        VkCompareOp m_depth_compare {VK_COMPARE_OP_LESS};
+        ex::vulkan::shader_constants m_constants {};
         std::vector<VkDescriptorSetLayout> m_descriptor_set_layouts;
         VkPushConstantRange m_push_constant_range;
     };
@@ -0,0 +1,174 @@
+#include "vk_pipeline_manager.h"
+#include "vk_common.h"
+#include "ex_logger.h"
+#include "ex_profiler.h"
+
+#include <chrono>
+
+void
+ex::vulkan::pipeline_manager::set_thread_count(uint32_t thread_count) {
+    m_thread_count = thread_count;
+}
+
+void
+ex::vulkan::pipeline_manager::create(ex::vulkan::backend *backend) {
+    m_backend = backend;
+
+    // one cache shared by every compile, the driver synchronizes it
+    VkPipelineCacheCreateInfo pipeline_cache_create_info = {};
+    pipeline_cache_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    pipeline_cache_create_info.pNext = nullptr;
+    pipeline_cache_create_info.flags = 0;
+    pipeline_cache_create_info.initialDataSize = 0;
+    pipeline_cache_create_info.pInitialData = nullptr;
+    VK_CHECK(vkCreatePipelineCache(backend->logical_device(),
+                                   &pipeline_cache_create_info,
+                                   backend->allocator(),
+                                   &m_cache));
+
+    m_running = true;
+    for (uint32_t i = 0; i < m_thread_count; i++) {
+        m_threads.emplace_back(&ex::vulkan::pipeline_manager::worker_main, this);
+    }
+
+    EXDEBUG("Pipeline manager: %u compile thread(s)", m_thread_count);
+}
+
+void
+ex::vulkan::pipeline_manager::destroy(ex::vulkan::backend *backend) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running = false;
+        m_pending_count -= static_cast<uint32_t>(m_queue.size());
+        m_queue.clear();
+    }
+    m_work_condition.notify_all();
+
+    for (std::thread &thread : m_threads) {
+        if (thread.joinable()) thread.join();
+    }
+    m_threads.clear();
+
+    for (auto &pipeline_entry : m_entries) {
+        VkPipeline handle = pipeline_entry->handle.load();
+        if (handle) vkDestroyPipeline(backend->logical_device(), handle, backend->allocator());
+    }
+    m_entries.clear();
+    m_lookup.clear();
+
+    if (m_cache) vkDestroyPipelineCache(backend->logical_device(), m_cache, backend->allocator());
+    m_cache = VK_NULL_HANDLE;
+}
+
+uint32_t
+ex::vulkan::pipeline_manager::request(const pipeline_state &state, uint32_t fallback) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    auto found = m_lookup.find(state);
+    if (found != m_lookup.end()) {
+        m_cache_hits++;
+        return found->second;
+    }
+
+    uint32_t id = static_cast<uint32_t>(m_entries.size());
+    std::unique_ptr<entry> new_entry = std::make_unique<entry>();
+    new_entry->state = state;
+    new_entry->fallback = fallback;
+    new_entry->handle = VK_NULL_HANDLE;
+    m_entries.push_back(std::move(new_entry));
+    m_lookup[state] = id;
+
+    m_pending_count++;
+    if (m_threads.empty()) {
+        // no compile threads, behave like pipeline::build
+        lock.unlock();
+        VkPipeline handle = ex::vulkan::pipeline::compile(m_backend, state, m_cache);
+        get_entry(id)->handle = handle;
+        m_pending_count--;
+        return id;
+    }
+
+    m_queue.push_back(id);
+    lock.unlock();
+    m_work_condition.notify_one();
+
+    return id;
+}
+
+bool
+ex::vulkan::pipeline_manager::bind(VkCommandBuffer command_buffer, uint32_t id) {
+    VkPipeline handle = this->handle(id);
+    if (!handle) return false;
+
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, handle);
+    return true;
+}
+
+bool
+ex::vulkan::pipeline_manager::bind(ex::vulkan::command_context &context, uint32_t id) {
+    VkPipeline handle = this->handle(id);
+    if (!handle) return false;
+
+    // a fallback standing in for several ids is only bound once
+    context.bind_pipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, handle);
+    return true;
+}
+
+bool
+ex::vulkan::pipeline_manager::ready(uint32_t id) {
+    entry *pipeline_entry = get_entry(id);
+    return pipeline_entry && pipeline_entry->handle.load() != VK_NULL_HANDLE;
+}
+
+VkPipeline
+ex::vulkan::pipeline_manager::handle(uint32_t id) {
+    // follow the fallback chain until something is compiled
+    for (uint32_t depth = 0; depth < 8; depth++) {
+        entry *pipeline_entry = get_entry(id);
+        if (!pipeline_entry) return VK_NULL_HANDLE;
+
+        VkPipeline handle = pipeline_entry->handle.load();
+        if (handle) return handle;
+        id = pipeline_entry->fallback;
+    }
+
+    return VK_NULL_HANDLE;
+}
+
+void
+ex::vulkan::pipeline_manager::wait_idle() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle_condition.wait(lock, [this]() { return m_pending_count.load() == 0; });
+}
+
+void
+ex::vulkan::pipeline_manager::worker_main() {
+    EXPROFILE_THREAD("pipeline compiler");
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_work_condition.wait(lock, [this]() { return !m_running || !m_queue.empty(); });
+        if (!m_running) return;
+
+        uint32_t id = m_queue.front();
+        m_queue.pop_front();
+        entry *pipeline_entry = m_entries[id].get();
+        lock.unlock();
+
+        auto start = std::chrono::steady_clock::now();
+        VkPipeline handle = ex::vulkan::pipeline::compile(m_backend, pipeline_entry->state, m_cache);
+        auto end = std::chrono::steady_clock::now();
+        pipeline_entry->handle = handle;
+        EXDEBUG("Pipeline %u compiled in %.2fms", id, std::chrono::duration<float, std::milli>(end - start).count());
+
+        lock.lock();
+        if (--m_pending_count == 0) m_idle_condition.notify_all();
+    }
+}
+
+ex::vulkan::pipeline_manager::entry *
+ex::vulkan::pipeline_manager::get_entry(uint32_t id) {
+    // requests may grow the list while recording threads look things up
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (id >= m_entries.size()) return nullptr;
+    return m_entries[id].get();
+}
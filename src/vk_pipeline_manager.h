@@ -0,0 +1,75 @@
+#pragma once
+
+#include "vk_backend.h"
+#include "vk_pipeline.h"
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+
+namespace ex::vulkan {
+    // Deduplicates pipelines by their full state and compiles misses on
+    // background threads. Requests return at once, the draw side asks bind()
+    // every frame and gets the fallback (or nothing) until the compile lands.
+    class pipeline_manager {
+    public:
+        static constexpr uint32_t invalid_id = UINT32_MAX;
+
+    public:
+        void set_thread_count(uint32_t thread_count);
+        void create(ex::vulkan::backend *backend);
+        void destroy(ex::vulkan::backend *backend);
+
+        // equal states return the same id, the fallback has to share the
+        // layout so bound descriptor sets and push constants stay valid
+        uint32_t request(const pipeline_state &state, uint32_t fallback = invalid_id);
+
+        // binds the pipeline or its fallback, false means skip the draw
+        bool bind(VkCommandBuffer command_buffer, uint32_t id);
+        bool bind(ex::vulkan::command_context &context, uint32_t id);
+        bool ready(uint32_t id);
+        VkPipeline handle(uint32_t id);
+
+        // blocks until the queue is empty, for loading screens and shutdown
+        void wait_idle();
+
+        uint32_t pipeline_count() { return static_cast<uint32_t>(m_entries.size()); }
+        uint32_t pending_count() { return m_pending_count.load(); }
+        uint32_t cache_hits() { return m_cache_hits; }
+
+    private:
+        struct entry {
+            pipeline_state state;
+            uint32_t fallback;
+            std::atomic<VkPipeline> handle;
+        };
+
+        void worker_main();
+        entry *get_entry(uint32_t id);
+
+    private:
+        ex::vulkan::backend *m_backend {nullptr};
+        VkPipelineCache m_cache {};
+        uint32_t m_thread_count {1};
+
+        // entries are never moved, the workers write handles in place
+        std::vector<std::unique_ptr<entry>> m_entries;
+        std::unordered_map<pipeline_state, uint32_t, pipeline_state_hash> m_lookup;
+        uint32_t m_cache_hits {0};
+
+        std::vector<std::thread> m_threads;
+        std::mutex m_mutex;
+        std::condition_variable m_work_condition;
+        std::condition_variable m_idle_condition;
+        std::deque<uint32_t> m_queue;
+        std::atomic<uint32_t> m_pending_count {0};
+        bool m_running {false};
+    };
+}
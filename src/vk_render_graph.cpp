@@ -0,0 +1,702 @@
+#include "vk_render_graph.h"
+#include "vk_common.h"
+#include "ex_logger.h"
+#include "ex_profiler.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+uint32_t
+ex::vulkan::render_graph::create_image(const char *name, const image_desc &desc) {
+    image_resource resource = {};
+    resource.name = name;
+    resource.desc = desc;
+    resource.imported = false;
+    resource.initial_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    m_images.push_back(resource);
+
+    return static_cast<uint32_t>(m_images.size() - 1);
+}
+
+uint32_t
+ex::vulkan::render_graph::import_image(const char *name,
+                                       VkImage image,
+                                       VkImageView view,
+                                       VkFormat format,
+                                       VkExtent2D extent,
+                                       VkImageLayout initial_layout) {
+    image_resource resource = {};
+    resource.name = name;
+    resource.desc.format = format;
+    resource.desc.extent = extent;
+    resource.desc.mip_levels = 1;
+    resource.imported = true;
+    resource.initial_layout = initial_layout;
+    resource.handle = image;
+    resource.view = view;
+    m_images.push_back(resource);
+
+    return static_cast<uint32_t>(m_images.size() - 1);
+}
+
+uint32_t
+ex::vulkan::render_graph::add_pass(const char *name,
+                                   pass_type type,
+                                   std::function<void(VkCommandBuffer)> execute) {
+    pass graph_pass = {};
+    graph_pass.name = name;
+    graph_pass.type = type;
+    graph_pass.execute = execute;
+    m_passes.push_back(graph_pass);
+
+    return static_cast<uint32_t>(m_passes.size() - 1);
+}
+
+void
+ex::vulkan::render_graph::read(uint32_t pass, uint32_t image, access_type access) {
+    m_passes[pass].uses.push_back({ image, access, false, {} });
+}
+
+void
+ex::vulkan::render_graph::write(uint32_t pass, uint32_t image, access_type access) {
+    m_passes[pass].uses.push_back({ image, access, false, {} });
+}
+
+void
+ex::vulkan::render_graph::write(uint32_t pass,
+                                uint32_t image,
+                                access_type access,
+                                VkClearValue clear_value) {
+    m_passes[pass].uses.push_back({ image, access, true, clear_value });
+}
+
+void
+ex::vulkan::render_graph::set_side_effect(uint32_t pass) {
+    m_passes[pass].side_effect = true;
+}
+
+void
+ex::vulkan::render_graph::set_output(uint32_t image, access_type access) {
+    m_images[image].has_output = true;
+    m_images[image].output_access = access;
+}
+
+void
+ex::vulkan::render_graph::compile(ex::vulkan::backend *backend) {
+    EXPROFILE_FUNCTION();
+    // the caller makes sure the gpu is done with the previous compile
+    release(backend);
+    m_backend = backend;
+
+    cull_passes();
+    compute_lifetimes();
+    create_images(backend);
+    for (uint32_t i = 0; i < m_passes.size(); i++) {
+        if (m_passes[i].alive && m_passes[i].type == PASS_GRAPHICS) {
+            create_render_pass(backend, m_passes[i], i);
+        }
+    }
+    build_barriers();
+
+    EXDEBUG("Render graph: %u passes (%u culled), %.2f MiB transient memory (%.2f MiB unaliased)",
+            static_cast<uint32_t>(m_passes.size()), m_culled_pass_count,
+            (float) m_memory_size / (1024.0f * 1024.0f),
+            (float) m_unaliased_memory_size / (1024.0f * 1024.0f));
+}
+
+void
+ex::vulkan::render_graph::execute(VkCommandBuffer command_buffer) {
+    EXPROFILE_FUNCTION();
+    for (pass &graph_pass : m_passes) {
+        if (!graph_pass.alive) continue;
+
+        uint32_t zone = m_backend->begin_gpu_zone(command_buffer, graph_pass.name.c_str());
+        if (!graph_pass.barriers.empty()) {
+            vkCmdPipelineBarrier(command_buffer,
+                                 graph_pass.src_stage,
+                                 graph_pass.dst_stage,
+                                 0,
+                                 0, nullptr,
+                                 0, nullptr,
+                                 static_cast<uint32_t>(graph_pass.barriers.size()),
+                                 graph_pass.barriers.data());
+        }
+
+        if (graph_pass.type == PASS_GRAPHICS) {
+            VkRenderPassBeginInfo render_pass_begin_info = {};
+            render_pass_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+            render_pass_begin_info.pNext = nullptr;
+            render_pass_begin_info.renderPass = graph_pass.render_pass;
+            render_pass_begin_info.framebuffer = graph_pass.framebuffer;
+            render_pass_begin_info.renderArea.offset = { 0, 0 };
+            render_pass_begin_info.renderArea.extent = graph_pass.extent;
+            render_pass_begin_info.clearValueCount = static_cast<uint32_t>(graph_pass.clear_values.size());
+            render_pass_begin_info.pClearValues = graph_pass.clear_values.data();
+            vkCmdBeginRenderPass(command_buffer, &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+        }
+
+        graph_pass.execute(command_buffer);
+
+        if (graph_pass.type == PASS_GRAPHICS) {
+            vkCmdEndRenderPass(command_buffer);
+        }
+        m_backend->end_gpu_zone(command_buffer, zone);
+    }
+
+    if (!m_output_barriers.empty()) {
+        vkCmdPipelineBarrier(command_buffer,
+                             m_output_src_stage,
+                             m_output_dst_stage,
+                             0,
+                             0, nullptr,
+                             0, nullptr,
+                             static_cast<uint32_t>(m_output_barriers.size()),
+                             m_output_barriers.data());
+    }
+}
+
+void
+ex::vulkan::render_graph::destroy(ex::vulkan::backend *backend) {
+    release(backend);
+    m_images.clear();
+    m_passes.clear();
+}
+
+ex::vulkan::render_graph::access_info
+ex::vulkan::render_graph::get_access_info(access_type access) {
+    switch (access) {
+    case ACCESS_COLOR_ATTACHMENT:
+        return { VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                 VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                 VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                 VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+                 true };
+    case ACCESS_DEPTH_ATTACHMENT:
+        return { VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                 VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                 VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                 VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+                 true };
+    case ACCESS_DEPTH_READ:
+        return { VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+                 VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                 VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+                 VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+                 false };
+    case ACCESS_SAMPLED_FRAGMENT:
+        return { VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                 VK_ACCESS_SHADER_READ_BIT,
+                 VK_IMAGE_USAGE_SAMPLED_BIT,
+                 false };
+    case ACCESS_SAMPLED_COMPUTE:
+        return { VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                 VK_ACCESS_SHADER_READ_BIT,
+                 VK_IMAGE_USAGE_SAMPLED_BIT,
+                 false };
+    case ACCESS_STORAGE_READ:
+        return { VK_IMAGE_LAYOUT_GENERAL,
+                 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                 VK_ACCESS_SHADER_READ_BIT,
+                 VK_IMAGE_USAGE_STORAGE_BIT,
+                 false };
+    case ACCESS_STORAGE_WRITE:
+        return { VK_IMAGE_LAYOUT_GENERAL,
+                 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                 VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                 VK_IMAGE_USAGE_STORAGE_BIT,
+                 true };
+    case ACCESS_TYPE_MAX_COUNT:
+        break;
+    }
+
+    return { VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, false };
+}
+
+bool
+ex::vulkan::render_graph::is_depth_format(VkFormat format) {
+    return format == VK_FORMAT_D16_UNORM ||
+        format == VK_FORMAT_D32_SFLOAT ||
+        format == VK_FORMAT_D16_UNORM_S8_UINT ||
+        format == VK_FORMAT_D24_UNORM_S8_UINT ||
+        format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+}
+
+void
+ex::vulkan::render_graph::cull_passes() {
+    // walk backwards from the outputs, a pass survives if something later
+    // needs what it writes
+    std::vector<bool> needed(m_images.size(), false);
+    for (uint32_t i = 0; i < m_images.size(); i++) {
+        needed[i] = m_images[i].has_output;
+    }
+
+    m_culled_pass_count = 0;
+    for (uint32_t i = static_cast<uint32_t>(m_passes.size()); i-- > 0;) {
+        pass &graph_pass = m_passes[i];
+        bool alive = graph_pass.side_effect;
+        for (const image_use &use : graph_pass.uses) {
+            if (get_access_info(use.access).write && needed[use.image]) alive = true;
+        }
+
+        graph_pass.alive = alive;
+        if (!alive) {
+            m_culled_pass_count++;
+            EXDEBUG("Render graph: culled pass %s", graph_pass.name.c_str());
+            continue;
+        }
+
+        // cleared attachments and storage writes replace the old contents,
+        // reads and loading attachments depend on an earlier writer
+        for (const image_use &use : graph_pass.uses) {
+            if (get_access_info(use.access).write) needed[use.image] = false;
+        }
+        for (const image_use &use : graph_pass.uses) {
+            bool loads = use.access != ACCESS_STORAGE_WRITE && !use.clear;
+            if (!get_access_info(use.access).write || loads) needed[use.image] = true;
+        }
+    }
+}
+
+void
+ex::vulkan::render_graph::compute_lifetimes() {
+    for (image_resource &resource : m_images) {
+        resource.first_pass = invalid_id;
+        resource.last_pass = 0;
+        resource.all_stages = 0;
+        resource.all_writes = 0;
+        resource.usage = 0;
+    }
+
+    for (uint32_t i = 0; i < m_passes.size(); i++) {
+        if (!m_passes[i].alive) continue;
+        for (const image_use &use : m_passes[i].uses) {
+            image_resource &resource = m_images[use.image];
+            access_info info = get_access_info(use.access);
+            resource.first_pass = std::min(resource.first_pass, i);
+            resource.last_pass = std::max(resource.last_pass, i);
+            resource.all_stages |= info.stage;
+            if (info.write) resource.all_writes |= info.access;
+            resource.usage |= info.usage;
+        }
+    }
+
+    for (image_resource &resource : m_images) {
+        if (!resource.has_output) continue;
+        // whatever comes after the graph keeps it alive to the end
+        resource.last_pass = static_cast<uint32_t>(m_passes.size());
+        resource.usage |= get_access_info(resource.output_access).usage;
+    }
+}
+
+void
+ex::vulkan::render_graph::create_images(ex::vulkan::backend *backend) {
+    std::vector<uint32_t> transients;
+    m_unaliased_memory_size = 0;
+    m_memory_size = 0;
+
+    for (uint32_t i = 0; i < m_images.size(); i++) {
+        image_resource &resource = m_images[i];
+        resource.aspect = is_depth_format(resource.desc.format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+        resource.memory_slot = invalid_id;
+        if (resource.imported || resource.first_pass == invalid_id) continue;
+
+        VkImageCreateInfo image_create_info = {};
+        image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        image_create_info.pNext = nullptr;
+        image_create_info.flags = 0;
+        image_create_info.imageType = VK_IMAGE_TYPE_2D;
+        image_create_info.format = resource.desc.format;
+        image_create_info.extent = { resource.desc.extent.width, resource.desc.extent.height, 1 };
+        image_create_info.mipLevels = resource.desc.mip_levels;
+        image_create_info.arrayLayers = 1;
+        image_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+        image_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+        image_create_info.usage = resource.usage;
+        image_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        image_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VK_CHECK(vkCreateImage(backend->logical_device(),
+                               &image_create_info,
+                               backend->allocator(),
+                               &resource.handle));
+
+        vkGetImageMemoryRequirements(backend->logical_device(), resource.handle, &resource.memory_requirements);
+        m_unaliased_memory_size += resource.memory_requirements.size;
+        transients.push_back(i);
+    }
+
+    // greedy interval packing, an image moves into a slot whose previous
+    // tenant is dead before the image's first pass
+    std::sort(transients.begin(), transients.end(), [this](uint32_t a, uint32_t b) {
+        return m_images[a].first_pass < m_images[b].first_pass;
+    });
+
+    for (uint32_t index : transients) {
+        image_resource &resource = m_images[index];
+        const VkMemoryRequirements &requirements = resource.memory_requirements;
+
+        uint32_t best_slot = invalid_id;
+        for (uint32_t i = 0; i < m_memory_slots.size(); i++) {
+            memory_slot &slot = m_memory_slots[i];
+            // outputs are read after the graph, their memory stays theirs
+            if (resource.has_output || slot.last_pass >= resource.first_pass) continue;
+            if ((slot.requirements.memoryTypeBits & requirements.memoryTypeBits) == 0) continue;
+
+            // prefer the slot that grows the least
+            if (best_slot == invalid_id) {
+                best_slot = i;
+                continue;
+            }
+            VkDeviceSize best_growth = requirements.size > m_memory_slots[best_slot].requirements.size ? requirements.size - m_memory_slots[best_slot].requirements.size : 0;
+            VkDeviceSize growth = requirements.size > slot.requirements.size ? requirements.size - slot.requirements.size : 0;
+            if (growth < best_growth) best_slot = i;
+        }
+
+        if (best_slot == invalid_id) {
+            memory_slot slot = {};
+            slot.requirements = requirements;
+            m_memory_slots.push_back(slot);
+            best_slot = static_cast<uint32_t>(m_memory_slots.size() - 1);
+        }
+
+        memory_slot &slot = m_memory_slots[best_slot];
+        slot.requirements.size = std::max(slot.requirements.size, requirements.size);
+        slot.requirements.alignment = std::max(slot.requirements.alignment, requirements.alignment);
+        slot.requirements.memoryTypeBits &= requirements.memoryTypeBits;
+        slot.last_pass = resource.has_output ? UINT32_MAX : resource.last_pass;
+        slot.images.push_back(index);
+        resource.memory_slot = best_slot;
+    }
+
+    for (memory_slot &slot : m_memory_slots) {
+        slot.memory = backend->allocate_memory(slot.requirements,
+                                               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                               ex::vulkan::MEMORY_CATEGORY_ATTACHMENT,
+                                               ex::vulkan::MEMORY_RESOURCE_IMAGE);
+        m_memory_size += slot.requirements.size;
+
+        for (uint32_t index : slot.images) {
+            image_resource &resource = m_images[index];
+            VK_CHECK(vkBindImageMemory(backend->logical_device(),
+                                       resource.handle,
+                                       slot.memory.memory,
+                                       slot.memory.offset));
+
+            VkImageViewCreateInfo image_view_create_info = {};
+            image_view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            image_view_create_info.pNext = nullptr;
+            image_view_create_info.flags = 0;
+            image_view_create_info.image = resource.handle;
+            image_view_create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            image_view_create_info.format = resource.desc.format;
+            image_view_create_info.components = {};
+            image_view_create_info.subresourceRange.aspectMask = resource.aspect;
+            image_view_create_info.subresourceRange.baseMipLevel = 0;
+            image_view_create_info.subresourceRange.levelCount = resource.desc.mip_levels;
+            image_view_create_info.subresourceRange.baseArrayLayer = 0;
+            image_view_create_info.subresourceRange.layerCount = 1;
+            VK_CHECK(vkCreateImageView(backend->logical_device(),
+                                       &image_view_create_info,
+                                       backend->allocator(),
+                                       &resource.view));
+        }
+    }
+}
+
+void
+ex::vulkan::render_graph::create_render_pass(ex::vulkan::backend *backend,
+                                             pass &graph_pass,
+                                             uint32_t pass_index) {
+    std::vector<VkAttachmentDescription> attachments;
+    std::vector<VkAttachmentReference> color_references;
+    std::vector<VkImageView> views;
+    VkAttachmentReference depth_reference = {};
+    bool has_depth = false;
+    graph_pass.extent = {};
+    graph_pass.clear_values.clear();
+
+    for (const image_use &use : graph_pass.uses) {
+        if (use.access != ACCESS_COLOR_ATTACHMENT &&
+            use.access != ACCESS_DEPTH_ATTACHMENT &&
+            use.access != ACCESS_DEPTH_READ) continue;
+
+        image_resource &resource = m_images[use.image];
+        access_info info = get_access_info(use.access);
+
+        // layouts are handled by the graph's barriers, the render pass only
+        // decides what happens to the contents
+        bool contents_valid = written_before(use.image, pass_index) ||
+            (resource.imported && resource.initial_layout != VK_IMAGE_LAYOUT_UNDEFINED);
+        bool keep = use.access == ACCESS_DEPTH_READ || resource.imported || resource.has_output ||
+            used_after(use.image, pass_index);
+
+        VkAttachmentDescription attachment_description = {};
+        attachment_description.flags = 0;
+        attachment_description.format = resource.desc.format;
+        attachment_description.samples = VK_SAMPLE_COUNT_1_BIT;
+        attachment_description.loadOp = use.clear ? VK_ATTACHMENT_LOAD_OP_CLEAR :
+            contents_valid ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        attachment_description.storeOp = keep ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        attachment_description.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        attachment_description.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        attachment_description.initialLayout = info.layout;
+        attachment_description.finalLayout = info.layout;
+
+        VkAttachmentReference reference = {};
+        reference.attachment = static_cast<uint32_t>(attachments.size());
+        reference.layout = info.layout;
+        if (use.access == ACCESS_COLOR_ATTACHMENT) {
+            color_references.push_back(reference);
+        } else {
+            depth_reference = reference;
+            has_depth = true;
+        }
+
+        attachments.push_back(attachment_description);
+        views.push_back(resource.view);
+        graph_pass.clear_values.push_back(use.clear_value);
+        if (graph_pass.extent.width == 0) graph_pass.extent = resource.desc.extent;
+    }
+
+    if (attachments.empty()) {
+        EXFATAL("Render graph pass %s has no attachments", graph_pass.name.c_str());
+        throw std::runtime_error("Render graph pass has no attachments");
+    }
+
+    VkSubpassDescription subpass_description = {};
+    subpass_description.flags = 0;
+    subpass_description.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass_description.inputAttachmentCount = 0;
+    subpass_description.pInputAttachments = nullptr;
+    subpass_description.colorAttachmentCount = static_cast<uint32_t>(color_references.size());
+    subpass_description.pColorAttachments = color_references.data();
+    subpass_description.pResolveAttachments = nullptr;
+    subpass_description.pDepthStencilAttachment = has_depth ? &depth_reference : nullptr;
+    subpass_description.preserveAttachmentCount = 0;
+    subpass_description.pPreserveAttachments = nullptr;
+
+    VkRenderPassCreateInfo render_pass_create_info = {};
+    render_pass_create_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    render_pass_create_info.pNext = nullptr;
+    render_pass_create_info.flags = 0;
+    render_pass_create_info.attachmentCount = static_cast<uint32_t>(attachments.size());
+    render_pass_create_info.pAttachments = attachments.data();
+    render_pass_create_info.subpassCount = 1;
+    render_pass_create_info.pSubpasses = &subpass_description;
+    render_pass_create_info.dependencyCount = 0;
+    render_pass_create_info.pDependencies = nullptr;
+    VK_CHECK(vkCreateRenderPass(backend->logical_device(),
+                                &render_pass_create_info,
+                                backend->allocator(),
+                                &graph_pass.render_pass));
+
+    VkFramebufferCreateInfo framebuffer_create_info = {};
+    framebuffer_create_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebuffer_create_info.pNext = nullptr;
+    framebuffer_create_info.flags = 0;
+    framebuffer_create_info.renderPass = graph_pass.render_pass;
+    framebuffer_create_info.attachmentCount = static_cast<uint32_t>(views.size());
+    framebuffer_create_info.pAttachments = views.data();
+    framebuffer_create_info.width = graph_pass.extent.width;
+    framebuffer_create_info.height = graph_pass.extent.height;
+    framebuffer_create_info.layers = 1;
+    VK_CHECK(vkCreateFramebuffer(backend->logical_device(),
+                                 &framebuffer_create_info,
+                                 backend->allocator(),
+                                 &graph_pass.framebuffer));
+}
+
+void
+ex::vulkan::render_graph::build_barriers() {
+    // per image: current layout, the last write and the stages that already
+    // see it, so read after read in the same layout needs nothing
+    struct image_state {
+        bool touched;
+        VkImageLayout layout;
+        VkPipelineStageFlags write_stage;
+        VkAccessFlags write_access;
+        VkPipelineStageFlags read_stages;
+        VkPipelineStageFlags visible_stages;
+        VkAccessFlags visible_access;
+    };
+    std::vector<image_state> states(m_images.size(), image_state {});
+
+    for (uint32_t i = 0; i < m_images.size(); i++) {
+        image_resource &resource = m_images[i];
+        image_state &state = states[i];
+        if (resource.has_output) {
+            // the previous frame left it in the output state
+            access_info output = get_access_info(resource.output_access);
+            state.layout = output.layout;
+            state.write_stage = output.write ? output.stage : 0;
+            state.write_access = output.write ? output.access : 0;
+            state.read_stages = output.stage;
+        } else if (resource.imported) {
+            state.layout = resource.initial_layout;
+            state.write_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+            state.write_access = VK_ACCESS_MEMORY_WRITE_BIT;
+        } else if (resource.memory_slot != invalid_id) {
+            // the memory was last used by the slot's previous tenant, for the
+            // first tenant that is the last one of the previous frame
+            const std::vector<uint32_t> &tenants = m_memory_slots[resource.memory_slot].images;
+            auto it = std::find(tenants.begin(), tenants.end(), i);
+            uint32_t previous = it == tenants.begin() ? tenants.back() : *(it - 1);
+            state.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+            state.write_stage = m_images[previous].all_stages;
+            state.write_access = m_images[previous].all_writes;
+        }
+    }
+
+    auto transition = [this, &states](uint32_t image,
+                                      const access_info &dst,
+                                      bool discard,
+                                      std::vector<VkImageMemoryBarrier> &barriers,
+                                      VkPipelineStageFlags &src_stage,
+                                      VkPipelineStageFlags &dst_stage) {
+        image_state &state = states[image];
+        VkImageLayout old_layout = discard ? VK_IMAGE_LAYOUT_UNDEFINED : state.layout;
+        bool layout_change = old_layout != dst.layout || !state.touched;
+        bool visible = (dst.stage & ~state.visible_stages) == 0 && (dst.access & ~state.visible_access) == 0;
+
+        if (layout_change || dst.write || !visible) {
+            VkPipelineStageFlags src = state.write_stage;
+            // layout transitions and writes also wait for earlier reads
+            if (layout_change || dst.write) src |= state.read_stages;
+            src_stage |= src ? src : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+            dst_stage |= dst.stage;
+            barriers.push_back(make_barrier(image, state.write_access, old_layout, dst));
+
+            state.visible_stages = 0;
+            state.visible_access = 0;
+            if (layout_change || dst.write) state.read_stages = 0;
+        }
+
+        state.touched = true;
+        state.layout = dst.layout;
+        if (dst.write) {
+            state.write_stage = dst.stage;
+            state.write_access = dst.access;
+            state.read_stages = 0;
+            state.visible_stages = 0;
+            state.visible_access = 0;
+        } else {
+            state.read_stages |= dst.stage;
+            state.visible_stages |= dst.stage;
+            state.visible_access |= dst.access;
+        }
+    };
+
+    for (uint32_t i = 0; i < m_passes.size(); i++) {
+        pass &graph_pass = m_passes[i];
+        graph_pass.barriers.clear();
+        graph_pass.src_stage = 0;
+        graph_pass.dst_stage = 0;
+        if (!graph_pass.alive) continue;
+
+        for (const image_use &use : graph_pass.uses) {
+            access_info dst = get_access_info(use.access);
+
+            // first use this frame and the old contents aren't loaded, they
+            // can go
+            bool loads = !dst.write || (use.access != ACCESS_STORAGE_WRITE && !use.clear);
+            bool discard = !states[use.image].touched && !loads;
+            transition(use.image, dst, discard, graph_pass.barriers, graph_pass.src_stage, graph_pass.dst_stage);
+        }
+    }
+
+    m_output_barriers.clear();
+    m_output_src_stage = 0;
+    m_output_dst_stage = 0;
+    for (uint32_t i = 0; i < m_images.size(); i++) {
+        image_resource &resource = m_images[i];
+        if (resource.first_pass == invalid_id) continue;
+
+        if (resource.has_output) {
+            access_info dst = get_access_info(resource.output_access);
+            transition(i, dst, false, m_output_barriers, m_output_src_stage, m_output_dst_stage);
+        } else if (resource.imported && resource.initial_layout != VK_IMAGE_LAYOUT_UNDEFINED) {
+            // imports without an output go back to how they came in
+            access_info dst = { resource.initial_layout, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_ACCESS_MEMORY_READ_BIT, 0, false };
+            transition(i, dst, false, m_output_barriers, m_output_src_stage, m_output_dst_stage);
+        }
+    }
+}
+
+VkImageMemoryBarrier
+ex::vulkan::render_graph::make_barrier(uint32_t image,
+                                       VkAccessFlags src_access,
+                                       VkImageLayout old_layout,
+                                       const access_info &dst) {
+    image_resource &resource = m_images[image];
+
+    VkImageAspectFlags aspect = resource.aspect;
+    if (resource.desc.format == VK_FORMAT_D16_UNORM_S8_UINT ||
+        resource.desc.format == VK_FORMAT_D24_UNORM_S8_UINT ||
+        resource.desc.format == VK_FORMAT_D32_SFLOAT_S8_UINT) {
+        aspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+    }
+
+    VkImageMemoryBarrier out_barrier = {};
+    out_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    out_barrier.pNext = nullptr;
+    out_barrier.srcAccessMask = src_access;
+    out_barrier.dstAccessMask = dst.access;
+    out_barrier.oldLayout = old_layout;
+    out_barrier.newLayout = dst.layout;
+    out_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    out_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    out_barrier.image = resource.handle;
+    out_barrier.subresourceRange.aspectMask = aspect;
+    out_barrier.subresourceRange.baseMipLevel = 0;
+    out_barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+    out_barrier.subresourceRange.baseArrayLayer = 0;
+    out_barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+
+    return out_barrier;
+}
+
+bool
+ex::vulkan::render_graph::used_after(uint32_t image, uint32_t pass_index) {
+    for (uint32_t i = pass_index + 1; i < m_passes.size(); i++) {
+        if (!m_passes[i].alive) continue;
+        for (const image_use &use : m_passes[i].uses) {
+            if (use.image == image) return true;
+        }
+    }
+    return false;
+}
+
+bool
+ex::vulkan::render_graph::written_before(uint32_t image, uint32_t pass_index) {
+    for (uint32_t i = 0; i < pass_index; i++) {
+        if (!m_passes[i].alive) continue;
+        for (const image_use &use : m_passes[i].uses) {
+            if (use.image == image && get_access_info(use.access).write) return true;
+        }
+    }
+    return false;
+}
+
+void
+ex::vulkan::render_graph::release(ex::vulkan::backend *backend) {
+    for (pass &graph_pass : m_passes) {
+        if (graph_pass.framebuffer) vkDestroyFramebuffer(backend->logical_device(), graph_pass.framebuffer, backend->allocator());
+        if (graph_pass.render_pass) vkDestroyRenderPass(backend->logical_device(), graph_pass.render_pass, backend->allocator());
+        graph_pass.framebuffer = VK_NULL_HANDLE;
+        graph_pass.render_pass = VK_NULL_HANDLE;
+    }
+
+    for (image_resource &resource : m_images) {
+        if (resource.imported) continue;
+        if (resource.view) vkDestroyImageView(backend->logical_device(), resource.view, backend->allocator());
+        if (resource.handle) vkDestroyImage(backend->logical_device(), resource.handle, backend->allocator());
+        resource.view = VK_NULL_HANDLE;
+        resource.handle = VK_NULL_HANDLE;
+    }
+
+    for (memory_slot &slot : m_memory_slots) {
+        backend->free_memory(slot.memory);
+    }
+    m_memory_slots.clear();
+}
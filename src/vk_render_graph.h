@@ -0,0 +1,163 @@
+#pragma once
+
+#include "vk_backend.h"
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <string>
+#include <functional>
+#include <cstdint>
+
+namespace ex::vulkan {
+    // Passes declare how they touch each image, compile() turns that into
+    // render passes, barriers and memory. Passes nothing depends on are
+    // culled and transient images whose lifetimes don't overlap share memory.
+    // The graph is declared once and compiled once, execute() only replays
+    // what compile() derived. Images have fixed extents, nothing here
+    // follows the swapchain.
+    class render_graph {
+    public:
+        enum pass_type {
+            PASS_GRAPHICS = 0,
+            PASS_COMPUTE = 1,
+        };
+
+        enum access_type {
+            ACCESS_COLOR_ATTACHMENT = 0,  // color target
+            ACCESS_DEPTH_ATTACHMENT = 1,  // depth test and write
+            ACCESS_DEPTH_READ = 2,        // depth test only
+            ACCESS_SAMPLED_FRAGMENT = 3,  // texture in a fragment shader
+            ACCESS_SAMPLED_COMPUTE = 4,   // texture in a compute shader
+            ACCESS_STORAGE_READ = 5,      // storage image read in compute
+            ACCESS_STORAGE_WRITE = 6,     // storage image written in compute
+            ACCESS_TYPE_MAX_COUNT,
+        };
+
+        struct image_desc {
+            VkFormat format;
+            VkExtent2D extent;
+            uint32_t mip_levels {1};
+        };
+
+        static constexpr uint32_t invalid_id = UINT32_MAX;
+
+    public:
+        uint32_t create_image(const char *name, const image_desc &desc);
+        // images owned elsewhere, the handles have to stay valid until the
+        // next compile
+        uint32_t import_image(const char *name, VkImage image, VkImageView view, VkFormat format, VkExtent2D extent, VkImageLayout initial_layout);
+
+        uint32_t add_pass(const char *name, pass_type type, std::function<void(VkCommandBuffer)> execute);
+        void read(uint32_t pass, uint32_t image, access_type access);
+        void write(uint32_t pass, uint32_t image, access_type access);
+        void write(uint32_t pass, uint32_t image, access_type access, VkClearValue clear_value);
+        // kept even when nothing reads what it writes
+        void set_side_effect(uint32_t pass);
+        // the state an image is left in for whoever uses it after the graph
+        void set_output(uint32_t image, access_type access);
+
+        void compile(ex::vulkan::backend *backend);
+        void execute(VkCommandBuffer command_buffer);
+        void destroy(ex::vulkan::backend *backend);
+
+        VkImage image(uint32_t image) { return m_images[image].handle; }
+        VkImageView view(uint32_t image) { return m_images[image].view; }
+        VkRenderPass render_pass(uint32_t pass) { return m_passes[pass].render_pass; }
+        bool pass_enabled(uint32_t pass) { return m_passes[pass].alive; }
+
+        uint32_t culled_pass_count() { return m_culled_pass_count; }
+        VkDeviceSize memory_size() { return m_memory_size; }
+        VkDeviceSize unaliased_memory_size() { return m_unaliased_memory_size; }
+
+    private:
+        struct access_info {
+            VkImageLayout layout;
+            VkPipelineStageFlags stage;
+            VkAccessFlags access;
+            VkImageUsageFlags usage;
+            bool write;
+        };
+
+        struct image_use {
+            uint32_t image;
+            access_type access;
+            bool clear;
+            VkClearValue clear_value;
+        };
+
+        struct image_resource {
+            std::string name;
+            image_desc desc;
+            bool imported;
+            VkImageLayout initial_layout;
+            bool has_output;
+            access_type output_access;
+
+            VkImage handle;
+            VkImageView view;
+            VkImageAspectFlags aspect;
+            VkImageUsageFlags usage;
+            VkMemoryRequirements memory_requirements;
+            uint32_t memory_slot;
+            uint32_t first_pass;
+            uint32_t last_pass;
+            VkPipelineStageFlags all_stages;
+            VkAccessFlags all_writes;
+        };
+
+        struct pass {
+            std::string name;
+            pass_type type;
+            std::function<void(VkCommandBuffer)> execute;
+            std::vector<image_use> uses;
+            bool side_effect;
+            bool alive;
+
+            VkRenderPass render_pass;
+            VkFramebuffer framebuffer;
+            VkExtent2D extent;
+            std::vector<VkClearValue> clear_values;
+
+            std::vector<VkImageMemoryBarrier> barriers;
+            VkPipelineStageFlags src_stage;
+            VkPipelineStageFlags dst_stage;
+        };
+
+        // transient images sharing one allocation
+        struct memory_slot {
+            ex::vulkan::memory_allocation memory;
+            VkMemoryRequirements requirements;
+            uint32_t last_pass;
+            std::vector<uint32_t> images;
+        };
+
+        static access_info get_access_info(access_type access);
+        static bool is_depth_format(VkFormat format);
+        void cull_passes();
+        void compute_lifetimes();
+        void create_images(ex::vulkan::backend *backend);
+        void create_render_pass(ex::vulkan::backend *backend, pass &graph_pass, uint32_t pass_index);
+        void build_barriers();
+        VkImageMemoryBarrier make_barrier(uint32_t image, VkAccessFlags src_access, VkImageLayout old_layout, const access_info &dst);
+        bool used_after(uint32_t image, uint32_t pass_index);
+        bool written_before(uint32_t image, uint32_t pass_index);
+        void release(ex::vulkan::backend *backend);
+
+    private:
+        std::vector<image_resource> m_images;
+        std::vector<pass> m_passes;
+        std::vector<memory_slot> m_memory_slots;
+
+        // passes are timed as gpu zones under their names
+        ex::vulkan::backend *m_backend {nullptr};
+
+        // transitions into the output states after the last pass
+        std::vector<VkImageMemoryBarrier> m_output_barriers;
+        VkPipelineStageFlags m_output_src_stage {0};
+        VkPipelineStageFlags m_output_dst_stage {0};
+
+        uint32_t m_culled_pass_count {0};
+        VkDeviceSize m_memory_size {0};
+        VkDeviceSize m_unaliased_memory_size {0};
+    };
+}
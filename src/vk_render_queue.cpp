@@ -0,0 +1,156 @@
+#include "vk_render_queue.h"
+#include "ex_logger.h"
+#include "ex_profiler.h"
+
+#include <algorithm>
+#include <array>
+
+namespace {
+    // bits from the top: 4 pass, 12 pipeline, 16 material, 16 mesh, 16 depth
+    constexpr uint32_t pass_shift = 60;
+    constexpr uint32_t pipeline_shift = 48;
+    constexpr uint32_t material_shift = 32;
+    constexpr uint32_t mesh_shift = 16;
+    constexpr uint64_t pipeline_mask = 0xfff;
+    constexpr uint64_t field_mask = 0xffff;
+}
+
+void
+ex::vulkan::render_queue::create(ex::vulkan::pipeline_manager *pipelines, ex::vulkan::geometry_arena *geometry) {
+    m_pipelines = pipelines;
+    m_geometry = geometry;
+}
+
+void
+ex::vulkan::render_queue::destroy() {
+    m_draws.clear();
+    m_sorted.clear();
+    m_scratch.clear();
+    m_mesh_ids.clear();
+}
+
+void
+ex::vulkan::render_queue::clear() {
+    m_draws.clear();
+    m_sorted.clear();
+    m_draw_count = 0;
+    m_pipeline_binds = 0;
+    m_vertex_binds = 0;
+    m_material_changes = 0;
+}
+
+void
+ex::vulkan::render_queue::push(pass_type pass,
+                               uint32_t pipeline_id,
+                               ex::vulkan::pipeline_state::vertex_stream stream,
+                               uint32_t material,
+                               ex::vulkan::model *model,
+                               const glm::mat4 &transform,
+                               float depth) {
+    // transparent draws blend over what is behind them, far ones first
+    float key_depth = std::clamp(depth, 0.0f, 1.0f);
+    if (pass == PASS_TRANSPARENT) key_depth = 1.0f - key_depth;
+
+    // the fields only order draws, ids past their bits still draw with
+    // the right state, they just sort less well
+    uint64_t key = 0;
+    key |= static_cast<uint64_t>(pass) << pass_shift;
+    key |= (static_cast<uint64_t>(pipeline_id) & pipeline_mask) << pipeline_shift;
+    key |= (static_cast<uint64_t>(material) & field_mask) << material_shift;
+    key |= (static_cast<uint64_t>(mesh_id(model)) & field_mask) << mesh_shift;
+    key |= static_cast<uint64_t>(key_depth * static_cast<float>(field_mask));
+
+    m_draws.push_back({ key, pipeline_id, stream, material, model, transform });
+}
+
+void
+ex::vulkan::render_queue::sort() {
+    EXPROFILE_FUNCTION();
+    uint32_t count = static_cast<uint32_t>(m_draws.size());
+    m_sorted.resize(count);
+    m_scratch.resize(count);
+    for (uint32_t i = 0; i < count; i++) m_sorted[i] = { m_draws[i].key, i };
+    if (count == 0) return;
+
+    // lsd radix, a byte per pass. stable, so equal keys keep push order
+    for (uint32_t shift = 0; shift < 64; shift += 8) {
+        std::array<uint32_t, 256> offsets {};
+        for (const sort_entry &entry : m_sorted) offsets[(entry.key >> shift) & 0xff]++;
+
+        // every key has the same byte, the pass wouldn't move anything
+        if (offsets[(m_sorted[0].key >> shift) & 0xff] == count) continue;
+
+        uint32_t offset = 0;
+        for (uint32_t &bucket : offsets) {
+            uint32_t bucket_count = bucket;
+            bucket = offset;
+            offset += bucket_count;
+        }
+        for (const sort_entry &entry : m_sorted) m_scratch[offsets[(entry.key >> shift) & 0xff]++] = entry;
+        m_sorted.swap(m_scratch);
+    }
+}
+
+void
+ex::vulkan::render_queue::record(ex::vulkan::command_context &context, uint32_t first, uint32_t last, const record_function &record_draw) {
+    // the context drops repeated binds, the ids here only feed the stats
+    // and skip the pipeline lookup
+    uint32_t bound_pipeline = ex::vulkan::pipeline_manager::invalid_id;
+    bool pipeline_ready = false;
+    int32_t bound_stream = -1;
+    uint32_t bound_material = UINT32_MAX;
+    stats slice = {};
+
+    for (uint32_t i = first; i < last; i++) {
+        const draw &queued = m_draws[m_sorted[i].draw];
+
+        if (queued.pipeline_id != bound_pipeline) {
+            bound_pipeline = queued.pipeline_id;
+            pipeline_ready = m_pipelines->bind(context, bound_pipeline);
+            if (pipeline_ready) slice.pipeline_binds++;
+        }
+        // still compiling and no fallback, its draws are skipped
+        if (!pipeline_ready) continue;
+
+        if (static_cast<int32_t>(queued.stream) != bound_stream) {
+            bound_stream = static_cast<int32_t>(queued.stream);
+            if (queued.stream == ex::vulkan::pipeline_state::VERTEX_STREAM_POSITION) m_geometry->bind_positions(context);
+            else m_geometry->bind(context);
+            slice.vertex_binds++;
+        }
+
+        if (queued.material != bound_material) {
+            bound_material = queued.material;
+            slice.material_changes++;
+        }
+
+        record_draw(context.handle(), queued);
+        slice.draws++;
+    }
+
+    m_draw_count += slice.draws;
+    m_pipeline_binds += slice.pipeline_binds;
+    m_vertex_binds += slice.vertex_binds;
+    m_material_changes += slice.material_changes;
+}
+
+ex::vulkan::render_queue::stats
+ex::vulkan::render_queue::get_stats() {
+    stats out = {};
+    out.draws = m_draw_count.load();
+    out.pipeline_binds = m_pipeline_binds.load();
+    out.vertex_binds = m_vertex_binds.load();
+    out.material_changes = m_material_changes.load();
+    return out;
+}
+
+uint32_t
+ex::vulkan::render_queue::mesh_id(ex::vulkan::model *model) {
+    auto found = m_mesh_ids.find(model);
+    if (found != m_mesh_ids.end()) return found->second;
+
+    uint32_t id = static_cast<uint32_t>(m_mesh_ids.size());
+    if (id == field_mask + 1) EXWARN("Render queue: more than %u meshes, mesh order is no longer exact", (uint32_t) field_mask + 1);
+    m_mesh_ids.emplace(model, id);
+    return id;
+}
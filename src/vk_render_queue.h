@@ -0,0 +1,99 @@
+#pragma once
+
+#include "vk_backend.h"
+#include "vk_pipeline.h"
+#include "vk_pipeline_manager.h"
+#include "vk_geometry_arena.h"
+#include "vk_model.h"
+#include "vk_command_context.h"
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <atomic>
+#include <cstdint>
+
+namespace ex::vulkan {
+    // Draws are pushed in any order with a 64 bit sort key, radix sorted
+    // once per frame and recorded with state only bound when it changes.
+    // From the top the key holds pass, pipeline, material, mesh and depth,
+    // so a pass finishes before the next one starts and draws sharing a
+    // pipeline and material sit together. Every pipeline has to share one
+    // layout, descriptor sets are bound by the caller.
+    class render_queue {
+    public:
+        enum pass_type {
+            PASS_DEPTH = 0,       // depth pre-pass, front to back
+            PASS_OPAQUE = 1,      // front to back
+            PASS_TRANSPARENT = 2, // back to front
+        };
+
+        struct draw {
+            uint64_t key;
+            uint32_t pipeline_id;
+            ex::vulkan::pipeline_state::vertex_stream stream;
+            uint32_t material;
+            ex::vulkan::model *model;
+            glm::mat4 transform;
+        };
+
+        struct stats {
+            uint32_t draws;
+            uint32_t pipeline_binds;
+            uint32_t vertex_binds;
+            uint32_t material_changes;
+        };
+
+        // per draw once its state is bound, pushes constants and draws
+        using record_function = std::function<void(VkCommandBuffer, const draw &)>;
+
+    public:
+        void create(ex::vulkan::pipeline_manager *pipelines, ex::vulkan::geometry_arena *geometry);
+        void destroy();
+
+        // also resets the stats
+        void clear();
+        // depth is 0 at the camera and 1 at the far plane, clamped
+        void push(pass_type pass,
+                  uint32_t pipeline_id,
+                  ex::vulkan::pipeline_state::vertex_stream stream,
+                  uint32_t material,
+                  ex::vulkan::model *model,
+                  const glm::mat4 &transform,
+                  float depth);
+        void sort();
+        // records sorted draws [first, last) through the secondary's context,
+        // call once per secondary from any thread
+        void record(ex::vulkan::command_context &context, uint32_t first, uint32_t last, const record_function &record_draw);
+
+        uint32_t size() { return static_cast<uint32_t>(m_draws.size()); }
+        // totals of every record since clear
+        stats get_stats();
+
+    private:
+        struct sort_entry {
+            uint64_t key;
+            uint32_t draw;
+        };
+
+        uint32_t mesh_id(ex::vulkan::model *model);
+
+    private:
+        ex::vulkan::pipeline_manager *m_pipelines {nullptr};
+        ex::vulkan::geometry_arena *m_geometry {nullptr};
+
+        // kept between frames so a steady scene stops allocating
+        std::vector<draw> m_draws;
+        std::vector<sort_entry> m_sorted;
+        std::vector<sort_entry> m_scratch;
+        // small stable ids so meshes fit their key bits
+        std::unordered_map<ex::vulkan::model *, uint32_t> m_mesh_ids;
+
+        std::atomic<uint32_t> m_draw_count {0};
+        std::atomic<uint32_t> m_pipeline_binds {0};
+        std::atomic<uint32_t> m_vertex_binds {0};
+        std::atomic<uint32_t> m_material_changes {0};
+    };
+}
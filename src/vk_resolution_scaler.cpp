@@ -0,0 +1,149 @@
+#include "vk_resolution_scaler.h"
+#include "vk_common.h"
+#include "ex_logger.h"
+#include "ex_profiler.h"
+
+#include <algorithm>
+#include <cmath>
+
+void
+ex::vulkan::resolution_scaler::set_target_frame_time(float ms) {
+    m_target_ms = std::max(ms, 0.1f);
+}
+
+void
+ex::vulkan::resolution_scaler::set_scale_range(float min_scale, float max_scale) {
+    m_min_scale = std::clamp(min_scale, ex::vulkan::backend::min_render_scale, 1.0f);
+    m_max_scale = std::clamp(max_scale, m_min_scale, 1.0f);
+}
+
+void
+ex::vulkan::resolution_scaler::set_sharpness(float sharpness) {
+    m_sharpness = std::max(sharpness, 0.0f);
+}
+
+void
+ex::vulkan::resolution_scaler::create(ex::vulkan::backend *backend) {
+    m_backend = backend;
+    m_scale = m_max_scale;
+    m_backend->set_render_scale(m_scale);
+
+    VkSamplerCreateInfo sampler_create_info = {};
+    sampler_create_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_create_info.pNext = nullptr;
+    sampler_create_info.flags = 0;
+    sampler_create_info.magFilter = VK_FILTER_LINEAR;
+    sampler_create_info.minFilter = VK_FILTER_LINEAR;
+    sampler_create_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampler_create_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_create_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_create_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_create_info.minLod = 0.0f;
+    sampler_create_info.maxLod = 0.0f;
+    sampler_create_info.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK;
+    VK_CHECK(vkCreateSampler(backend->logical_device(), &sampler_create_info, backend->allocator(), &m_sampler));
+
+    // descriptors
+    m_layout.add_binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT);
+    m_layout.create(backend);
+    for (uint32_t i = 0; i < ex::vulkan::backend::max_frames_in_flight; i++) {
+        m_sets[i].allocate(backend, backend->descriptors(), &m_layout);
+        m_sets[i].write_image(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &m_scene_infos[i]);
+    }
+
+    // pipeline, a fullscreen triangle into the colour only present pass
+    m_pipeline.push_descriptor_set_layout(m_layout.handle());
+    m_pipeline.set_push_constant_range(VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(upscale_constants));
+    m_pipeline.build_layout(backend);
+    m_pipeline.set_topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+    m_pipeline.set_polygon_mode(VK_POLYGON_MODE_FILL);
+    m_pipeline.set_cull_mode(VK_CULL_MODE_NONE);
+    m_pipeline.set_front_face(VK_FRONT_FACE_CLOCKWISE);
+    m_pipeline.set_depth(false, VK_COMPARE_OP_ALWAYS);
+
+    m_shader.create(backend, "res/shaders/upscale.vert.spv", "res/shaders/upscale.frag.spv");
+    ex::vulkan::pipeline_state state = m_pipeline.state(backend, &m_shader);
+    state.stream = ex::vulkan::pipeline_state::VERTEX_STREAM_NONE;
+    state.render_pass = backend->present_render_pass();
+    state.subpass = 0;
+    m_pipeline.build(backend, state);
+    m_shader.destroy(backend);
+
+    EXDEBUG("Resolution scaler: %.2fms target, scale %.2f-%.2f, sharpness %.2f",
+            m_target_ms, m_min_scale, m_max_scale, m_sharpness);
+}
+
+void
+ex::vulkan::resolution_scaler::destroy(ex::vulkan::backend *backend) {
+    // the sets go back with the backend's allocator
+    m_pipeline.destroy(backend);
+    m_layout.destroy(backend);
+    if (m_sampler) vkDestroySampler(backend->logical_device(), m_sampler, backend->allocator());
+    m_sampler = VK_NULL_HANDLE;
+}
+
+void
+ex::vulkan::resolution_scaler::update(float gpu_ms) {
+    EXPROFILE_FUNCTION();
+    if (!m_enabled || gpu_ms <= 0.0f) return;
+
+    // the newest time belongs to a frame recorded frames_in_flight ago
+    if (m_settle_frames > 0) {
+        m_settle_frames--;
+        return;
+    }
+
+    m_samples[m_sample_count++] = gpu_ms;
+    if (m_sample_count < sample_window) return;
+    m_sample_count = 0;
+
+    float average = 0.0f;
+    for (float sample : m_samples) average += sample;
+    average /= static_cast<float>(sample_window);
+
+    // stay put while inside the band, scaling up wants some headroom so
+    // the two directions don't chase each other
+    float ratio = m_target_ms / average;
+    if (ratio > 0.95f && ratio < 1.15f) return;
+
+    // gpu time follows the pixel count, the square of the scale. move half
+    // of the way there
+    float wanted = m_scale * std::sqrt(ratio);
+    float scale = std::clamp(m_scale + (wanted - m_scale) * 0.5f, m_min_scale, m_max_scale);
+    if (std::fabs(scale - m_scale) < 0.01f) return;
+
+    m_scale = scale;
+    m_backend->set_render_scale(m_scale);
+    m_settle_frames = m_backend->frames_in_flight();
+}
+
+void
+ex::vulkan::resolution_scaler::record(VkCommandBuffer command_buffer) {
+    EXPROFILE_FUNCTION();
+    if (!m_backend->dynamic_resolution()) return;
+
+    uint32_t frame = m_backend->frame_index();
+    if (m_scene_infos[frame].imageView != m_backend->scene_color_view()) {
+        // the slot's previous submit is done with the set
+        m_scene_infos[frame] = { m_sampler, m_backend->scene_color_view(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+        m_sets[frame].update(m_backend);
+    }
+
+    VkExtent2D extent = m_backend->swapchain_extent();
+    VkExtent2D render_extent = m_backend->last_render_extent();
+
+    upscale_constants constants = {};
+    constants.uv_scale = glm::vec2(static_cast<float>(render_extent.width) / static_cast<float>(extent.width),
+                                   static_cast<float>(render_extent.height) / static_cast<float>(extent.height));
+    constants.texel_size = glm::vec2(1.0f / static_cast<float>(extent.width), 1.0f / static_cast<float>(extent.height));
+    constants.sharpness = m_sharpness;
+
+    VkDescriptorSet set = m_sets[frame].handle();
+    m_backend->begin_present_pass();
+    m_pipeline.bind(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS);
+    m_pipeline.update_dynamic(command_buffer, extent);
+    m_pipeline.bind_descriptor_sets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, { &set, 1 });
+    m_pipeline.push_constants(command_buffer, VK_SHADER_STAGE_FRAGMENT_BIT, &constants);
+    vkCmdDraw(command_buffer, 3, 1, 0, 0);
+    m_backend->end_present_pass();
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "vk_backend.h"
+#include "vk_shader.h"
+#include "vk_pipeline.h"
+#include "vk_descriptor.h"
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+#include <array>
+#include <cstdint>
+
+namespace ex::vulkan {
+    // Keeps the gpu frame time near a target by moving the backend's render
+    // scale, and brings the scaled scene to the swapchain with a bilinear
+    // upscale and an optional sharpen. The gpu time read back is a few
+    // frames old, so samples are averaged over a window and the frames
+    // still in flight at the old scale are skipped after every change.
+    // Needs the backend's dynamic resolution, see
+    // backend::set_dynamic_resolution.
+    class resolution_scaler {
+    public:
+        static constexpr uint32_t sample_window = 8;
+
+    public:
+        void set_target_frame_time(float ms);
+        // clamped to [backend::min_render_scale, 1]
+        void set_scale_range(float min_scale, float max_scale);
+        // 0 turns the sharpen off
+        void set_sharpness(float sharpness);
+        void create(ex::vulkan::backend *backend);
+        void destroy(ex::vulkan::backend *backend);
+
+        // after begin_frame, before anything is recorded. takes the newest
+        // gpu time, 0 (no timestamps) leaves the scale alone
+        void update(float gpu_ms);
+        // after end_main_pass, records the present pass
+        void record(VkCommandBuffer command_buffer);
+        // a disabled scaler still upscales, at whatever scale it left
+        void set_enabled(bool enabled) { m_enabled = enabled; }
+
+        bool enabled() { return m_enabled; }
+        float scale() { return m_scale; }
+        float target_frame_time() { return m_target_ms; }
+
+    private:
+        struct upscale_constants {
+            glm::vec2 uv_scale;
+            glm::vec2 texel_size;
+            float sharpness;
+        };
+
+    private:
+        ex::vulkan::backend *m_backend {nullptr};
+        float m_target_ms {16.0f};
+        float m_min_scale {0.5f};
+        float m_max_scale {1.0f};
+        float m_sharpness {0.25f};
+        bool m_enabled {true};
+
+        float m_scale {1.0f};
+        std::array<float, sample_window> m_samples {};
+        uint32_t m_sample_count {0};
+        // samples still measuring frames recorded before the last change
+        uint32_t m_settle_frames {0};
+
+        VkSampler m_sampler {};
+        ex::vulkan::shader m_shader;
+        ex::vulkan::pipeline m_pipeline;
+        ex::vulkan::descriptor_set_layout m_layout;
+        // the scene view changes on resize, each slot picks it up once its
+        // previous submit is done
+        std::array<ex::vulkan::descriptor_set, ex::vulkan::backend::max_frames_in_flight> m_sets;
+        std::array<VkDescriptorImageInfo, ex::vulkan::backend::max_frames_in_flight> m_scene_infos {};
+    };
+}
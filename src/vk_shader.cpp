@@ -2,11 +2,45 @@
 #include "vk_common.h"
 #include "ex_logger.h"
 #include <fstream>
+#include <algorithm>
+
+void
+ex::vulkan::shader_constants::set(uint32_t id, uint32_t value) {
+    if (id >= max_constants) {
+        EXWARN("[SHADER] Constant id %u out of range", id);
+        return;
+    }
+
+    for (uint32_t i = count; i < id; i++) values[i] = 0;
+    values[id] = value;
+    count = std::max(count, id + 1);
+}
+
+VkSpecializationInfo
+ex::vulkan::shader_constants::specialization_info(std::array<VkSpecializationMapEntry, max_constants> &map_entries) const {
+    for (uint32_t i = 0; i < count; i++) {
+        map_entries[i].constantID = i;
+        map_entries[i].offset = i * sizeof(uint32_t);
+        map_entries[i].size = sizeof(uint32_t);
+    }
+
+    VkSpecializationInfo out_specialization_info = {};
+    out_specialization_info.mapEntryCount = count;
+    out_specialization_info.pMapEntries = map_entries.data();
+    out_specialization_info.dataSize = count * sizeof(uint32_t);
+    out_specialization_info.pData = values.data();
+
+    return out_specialization_info;
+}
+
+bool
+ex::vulkan::shader_constants::operator==(const shader_constants &other) const {
+    return count == other.count && std::equal(values.begin(), values.begin() + count, other.values.begin());
+}
 
 void
 ex::vulkan::shader::create(ex::vulkan::backend *backend, std::string vertex_path, std::string fragment_path) {
     std::vector<char> vertex_code = read_file(vertex_path);
-    std::vector<char> fragment_code = read_file(fragment_path);
 
     VkShaderModuleCreateInfo vertex_module_create_info = {};
     vertex_module_create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
@@ -16,7 +50,9 @@ ex::vulkan::shader::create(ex::vulkan::backend *backend, std::string vertex_path
                                   &vertex_module_create_info,
                                   backend->allocator(),
                                   &m_vertex_module));
-    
+    if (fragment_path.empty()) return;
+
+    std::vector<char> fragment_code = read_file(fragment_path);
     VkShaderModuleCreateInfo fragment_module_create_info = {};
     fragment_module_create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
     fragment_module_create_info.codeSize = static_cast<size_t>(fragment_code.size());
@@ -27,6 +63,20 @@ ex::vulkan::shader::create(ex::vulkan::backend *backend, std::string vertex_path
                                   &m_fragment_module));
 }
 
+void
+ex::vulkan::shader::create_compute(ex::vulkan::backend *backend, std::string compute_path) {
+    std::vector<char> compute_code = read_file(compute_path);
+
+    VkShaderModuleCreateInfo compute_module_create_info = {};
+    compute_module_create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    compute_module_create_info.codeSize = static_cast<size_t>(compute_code.size());
+    compute_module_create_info.pCode = reinterpret_cast<const uint32_t *>(compute_code.data());
+    VK_CHECK(vkCreateShaderModule(backend->logical_device(),
+                                  &compute_module_create_info,
+                                  backend->allocator(),
+                                  &m_compute_module));
+}
+
 void
 ex::vulkan::shader::destroy(ex::vulkan::backend *backend) {
     if (m_vertex_module) {
@@ -40,6 +90,12 @@ ex::vulkan::shader::destroy(ex::vulkan::backend *backend) {
                               m_fragment_module,
                               backend->allocator());
     }
+
+    if (m_compute_module) {
+        vkDestroyShaderModule(backend->logical_device(),
+                              m_compute_module,
+                              backend->allocator());
+    }
 }
 
 std::vector<char>
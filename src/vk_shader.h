@@ -4,22 +4,46 @@
 
 #include <vulkan/vulkan.h>
 #include <vector>
+#include <array>
 #include <string>
+#include <cstdint>
 
 namespace ex::vulkan {
+    // values for a shader's specialization constants, constant_id i gets
+    // values[i] and every id below count is set. one module compiles into
+    // as many variants as there are value sets, branches on a constant are
+    // folded away by the driver. stages ignore ids they don't declare
+    struct shader_constants {
+        static constexpr uint32_t max_constants = 8;
+
+        uint32_t count;
+        std::array<uint32_t, max_constants> values;
+
+        // ids past the current count are filled with 0
+        void set(uint32_t id, uint32_t value);
+        // points into map_entries and values, both have to outlive it
+        VkSpecializationInfo specialization_info(std::array<VkSpecializationMapEntry, max_constants> &map_entries) const;
+
+        bool operator==(const shader_constants &other) const;
+    };
+
     class shader {
     public:
+        // an empty fragment path builds a vertex only shader for depth passes
         void create(ex::vulkan::backend *backend, std::string vertex_path, std::string fragment_path);
+        void create_compute(ex::vulkan::backend *backend, std::string compute_path);
         void destroy(ex::vulkan::backend *backend);
 
         VkShaderModule vertex_module() { return m_vertex_module; }
         VkShaderModule fragment_module() { return m_fragment_module; }
+        VkShaderModule compute_module() { return m_compute_module; }
         
     private:
         std::vector<char> read_file(std::string file_path);
         
     private:
-        VkShaderModule m_vertex_module;
-        VkShaderModule m_fragment_module;
+        VkShaderModule m_vertex_module {};
+        VkShaderModule m_fragment_module {};
+        VkShaderModule m_compute_module {};
     };
 }
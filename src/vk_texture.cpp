@@ -1,15 +1,28 @@
 #include "vk_texture.h"
 #include "vk_common.h"
 #include "ex_logger.h"
+#include "ex_profiler.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb/stb_image.h>
 #include <stdexcept>
 
 void
-ex::vulkan::texture::create(ex::vulkan::backend *backend, const char *file_path) {
+ex::vulkan::texture::create(ex::vulkan::backend *backend, const char *file_path, usage texture_usage) {
+    EXPROFILE_FUNCTION();
     int width, height, channels;
-    stbi_uc *texture_data = stbi_load(file_path, &width, &height, &channels, STBI_rgb_alpha);
+    if (!stbi_info(file_path, &width, &height, &channels)) {
+        EXFATAL("Failed to load texture image");
+        throw std::runtime_error("Failed to load texture image");
+    }
+
+    // grey and grey+alpha colour sources keep their channel count
+    texture_format format = select_format(backend, texture_usage, static_cast<uint32_t>(channels));
+    
+    // normal maps keep red/green of an rgb source, everything else lets stb
+    // do the conversion (luminance for masks)
+    int load_channels = texture_usage == USAGE_NORMAL ? STBI_rgb_alpha : static_cast<int>(format.load_channels);
+    stbi_uc *texture_data = stbi_load(file_path, &width, &height, &channels, load_channels);
     if (!texture_data) {
         EXFATAL("Failed to load texture image");
         throw std::runtime_error("Failed to load texture image");
@@ -17,7 +30,15 @@ ex::vulkan::texture::create(ex::vulkan::backend *backend, const char *file_path)
 
     uint32_t texture_width = static_cast<uint32_t>(width);
     uint32_t texture_height = static_cast<uint32_t>(height);
-    VkDeviceSize texture_size = sizeof(uint32_t) * texture_width * texture_height;
+    VkDeviceSize texture_size = static_cast<VkDeviceSize>(format.texel_size) * texture_width * texture_height;
+
+    if (texture_usage == USAGE_NORMAL && format.texel_size == 2) {
+        uint32_t texel_count = texture_width * texture_height;
+        for (uint32_t i = 0; i < texel_count; i++) {
+            texture_data[i * 2 + 0] = texture_data[i * 4 + 0];
+            texture_data[i * 2 + 1] = texture_data[i * 4 + 1];
+        }
+    }
 
     ex::vulkan::buffer staging_buffer;
     staging_buffer.set_usage(VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
@@ -30,8 +51,15 @@ ex::vulkan::texture::create(ex::vulkan::backend *backend, const char *file_path)
     staging_buffer.unmap(backend);
     stbi_image_free(texture_data);
 
+    m_memory_size = texture_size;
+    VkDeviceSize rgba_size = sizeof(uint32_t) * texture_width * texture_height;
+    EXDEBUG("Texture %s: %ux%u, %u source channels, %u bytes/texel, %.1f KiB (saves %.1f KiB over RGBA8)",
+            file_path, texture_width, texture_height, static_cast<uint32_t>(channels), format.texel_size,
+            (float) texture_size / 1024.0f, (float) (rgba_size - texture_size) / 1024.0f);
+
     m_image.set_type(VK_IMAGE_TYPE_2D);
-    m_image.set_format(VK_FORMAT_R8G8B8A8_UNORM);
+    m_image.set_format(format.format);
+    m_image.set_swizzle(format.swizzle);
     m_image.set_extent({texture_width, texture_height});
     m_image.set_tiling(VK_IMAGE_TILING_OPTIMAL);
     m_image.set_usage(VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
@@ -72,8 +100,8 @@ ex::vulkan::texture::create(ex::vulkan::backend *backend, const char *file_path)
     sampler_create_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
     sampler_create_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
     sampler_create_info.mipLodBias = 0.0f;
-    sampler_create_info.anisotropyEnable = VK_TRUE;
-    sampler_create_info.maxAnisotropy = 16;
+    sampler_create_info.anisotropyEnable = backend->enabled_features().samplerAnisotropy;
+    sampler_create_info.maxAnisotropy = backend->max_sampler_anisotropy();
     sampler_create_info.compareEnable = VK_FALSE;
     sampler_create_info.compareOp = VK_COMPARE_OP_ALWAYS;
     sampler_create_info.minLod = 0.0f;
@@ -84,10 +112,22 @@ ex::vulkan::texture::create(ex::vulkan::backend *backend, const char *file_path)
                              &sampler_create_info,
                              backend->allocator(),
                              &m_sampler));
+
+    if (backend->bindless_enabled()) {
+        m_bindless_index = backend->bindless()->add_texture(backend, get_descriptor_info());
+        // the defragmenter may move the image, which gives it a new view
+        m_relocation_listener = backend->add_relocation_listener([this, backend]() {
+            backend->bindless()->update_texture(backend, m_bindless_index, get_descriptor_info());
+        });
+    }
 }
 
 void
 ex::vulkan::texture::destroy(ex::vulkan::backend *backend) {
+    if (backend->bindless_enabled()) backend->bindless()->remove_texture(m_bindless_index);
+    m_bindless_index = ex::vulkan::bindless_table::invalid_index;
+    if (m_relocation_listener != UINT32_MAX) backend->remove_relocation_listener(m_relocation_listener);
+    m_relocation_listener = UINT32_MAX;
     if (m_sampler) vkDestroySampler(backend->logical_device(), m_sampler, backend->allocator());
     m_image.destroy(backend);
 }
@@ -101,3 +141,59 @@ ex::vulkan::texture::get_descriptor_info() {
     
     return &m_descriptor_info;
 }
+
+ex::vulkan::texture::texture_format
+ex::vulkan::texture::select_format(ex::vulkan::backend *backend,
+                                   usage texture_usage,
+                                   uint32_t channels) {
+    const VkComponentMapping identity = {
+        VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY,
+        VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY,
+    };
+    // single channel reads back as grey, grey+alpha as grey with alpha
+    const VkComponentMapping grey = {
+        VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_R,
+        VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_ONE,
+    };
+    const VkComponentMapping grey_alpha = {
+        VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_R,
+        VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G,
+    };
+    // tangent space normals: z is close to one, shaders that care rebuild it
+    const VkComponentMapping normal = {
+        VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G,
+        VK_COMPONENT_SWIZZLE_ONE, VK_COMPONENT_SWIZZLE_ONE,
+    };
+
+    bool srgb = texture_usage == USAGE_COLOR_SRGB;
+    VkFormat rgba_format = srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+    texture_format out_format = { rgba_format, identity, 4, 4 };
+
+    VkFormat r8_format = srgb ? VK_FORMAT_R8_SRGB : VK_FORMAT_R8_UNORM;
+    VkFormat r8g8_format = srgb ? VK_FORMAT_R8G8_SRGB : VK_FORMAT_R8G8_UNORM;
+    VkFormatFeatureFlags features = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_TRANSFER_DST_BIT;
+
+    switch (texture_usage) {
+    case USAGE_MASK: {
+        if (backend->format_supported(VK_FORMAT_R8_UNORM, VK_IMAGE_TILING_OPTIMAL, features)) {
+            out_format = { VK_FORMAT_R8_UNORM, grey, 1, 1 };
+        }
+    } break;
+    case USAGE_NORMAL: {
+        if (backend->format_supported(VK_FORMAT_R8G8_UNORM, VK_IMAGE_TILING_OPTIMAL, features)) {
+            out_format = { VK_FORMAT_R8G8_UNORM, normal, 4, 2 };
+        }
+    } break;
+    default:
+    case USAGE_COLOR:
+    case USAGE_COLOR_SRGB: {
+        if (channels == 1 && backend->format_supported(r8_format, VK_IMAGE_TILING_OPTIMAL, features)) {
+            out_format = { r8_format, grey, 1, 1 };
+        } else if (channels == 2 && backend->format_supported(r8g8_format, VK_IMAGE_TILING_OPTIMAL, features)) {
+            out_format = { r8g8_format, grey_alpha, 2, 2 };
+        }
+    } break;
+    }
+
+    return out_format;
+}
@@ -4,16 +4,39 @@
 #include "vk_image.h"
 
 namespace ex::vulkan {
-    class texture {        
+    class texture {
     public:
-        void create(ex::vulkan::backend *backend, const char *file_path);
+        enum usage {
+            USAGE_COLOR = 0,      // unorm, matches the unorm swapchain
+            USAGE_COLOR_SRGB = 1, // srgb, decoded to linear on sample
+            USAGE_MASK = 2,       // single channel r8 (roughness, masks)
+            USAGE_NORMAL = 3,     // two channel r8g8 tangent space normal
+        };
+        
+    public:
+        void create(ex::vulkan::backend *backend, const char *file_path, usage texture_usage = USAGE_COLOR);
         void destroy(ex::vulkan::backend *backend);
         
         VkDescriptorImageInfo *get_descriptor_info();
+        uint32_t bindless_index() { return m_bindless_index; }
+        VkDeviceSize memory_size() { return m_memory_size; }
+        
+    private:
+        struct texture_format {
+            VkFormat format;
+            VkComponentMapping swizzle;
+            uint32_t load_channels;
+            uint32_t texel_size;
+        };
+        
+        texture_format select_format(ex::vulkan::backend *backend, usage texture_usage, uint32_t channels);
         
     private:
         ex::vulkan::image m_image;
         VkSampler m_sampler;
         VkDescriptorImageInfo m_descriptor_info;
+        uint32_t m_bindless_index {ex::vulkan::bindless_table::invalid_index};
+        uint32_t m_relocation_listener {UINT32_MAX};
+        VkDeviceSize m_memory_size;
     };
 }
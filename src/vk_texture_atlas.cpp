@@ -0,0 +1,279 @@
+#include "vk_texture_atlas.h"
+#include "vk_common.h"
+#include "ex_logger.h"
+
+#include <stb/stb_image.h>
+#include <algorithm>
+#include <numeric>
+#include <cstring>
+#include <stdexcept>
+
+void
+ex::vulkan::texture_atlas::set_page_size(uint32_t page_size) {
+    m_page_size = page_size;
+}
+
+void
+ex::vulkan::texture_atlas::set_padding(uint32_t padding) {
+    m_padding = padding;
+}
+
+void
+ex::vulkan::texture_atlas::set_mip_levels(uint32_t mip_levels) {
+    m_mip_levels = mip_levels;
+}
+
+void
+ex::vulkan::texture_atlas::set_mode(layout_mode mode) {
+    m_mode = mode;
+}
+
+uint32_t
+ex::vulkan::texture_atlas::add(const char *file_path) {
+    int width, height, channels;
+    stbi_uc *pixels = stbi_load(file_path, &width, &height, &channels, STBI_rgb_alpha);
+    if (!pixels) {
+        EXFATAL("Failed to load atlas image: %s", file_path);
+        throw std::runtime_error("Failed to load atlas image");
+    }
+
+    source src = {};
+    src.file_path = file_path;
+    src.pixels = pixels;
+    src.width = static_cast<uint32_t>(width);
+    src.height = static_cast<uint32_t>(height);
+    m_sources.push_back(src);
+
+    return static_cast<uint32_t>(m_sources.size() - 1);
+}
+
+void
+ex::vulkan::texture_atlas::build(ex::vulkan::backend *backend) {
+    // no pages would mean an empty image and staging buffer
+    if (m_sources.empty()) {
+        EXWARN("Texture atlas: nothing was added, not building");
+        return;
+    }
+
+    // every rectangle starts on a multiple of the coarsest mip's footprint, so
+    // each level still maps whole texels to a single source image, and the
+    // gutter is wide enough to leave at least one texel on the last level
+    uint32_t max_mip_levels = 1;
+    while ((m_page_size >> max_mip_levels) > 0) max_mip_levels++;
+    m_mip_levels = std::clamp<uint32_t>(m_mip_levels, 1, max_mip_levels);
+
+    uint32_t alignment = 1u << (m_mip_levels - 1);
+    uint32_t padding = std::max(m_padding, alignment);
+
+    m_entries.resize(m_sources.size());
+    m_rects.resize(m_sources.size());
+    m_pages.clear();
+
+    // tallest first keeps the skyline flat
+    std::vector<uint32_t> order(m_sources.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+        return m_sources[a].height > m_sources[b].height;
+    });
+
+    for (uint32_t id : order) {
+        place(id, alignment, padding);
+    }
+
+    uint32_t page_count = static_cast<uint32_t>(m_pages.size());
+    VkDeviceSize page_bytes = static_cast<VkDeviceSize>(m_page_size) * m_page_size * 4;
+    VkDeviceSize atlas_size = page_bytes * page_count;
+
+    std::vector<uint8_t> pixels(static_cast<size_t>(atlas_size), 0);
+    for (uint32_t id = 0; id < m_sources.size(); id++) {
+        uint8_t *page = pixels.data() + page_bytes * m_entries[id].layer;
+        blit(m_sources[id], page, m_rects[id].x, m_rects[id].y, padding);
+        stbi_image_free(m_sources[id].pixels);
+        m_sources[id].pixels = nullptr;
+    }
+
+    ex::vulkan::buffer staging_buffer;
+    staging_buffer.set_usage(VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+    staging_buffer.set_properties(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    staging_buffer.build(backend, atlas_size);
+
+    staging_buffer.bind(backend);
+    staging_buffer.map(backend);
+    staging_buffer.copy_to(pixels.data(), atlas_size);
+    staging_buffer.unmap(backend);
+
+    m_image.set_type(VK_IMAGE_TYPE_2D);
+    m_image.set_format(VK_FORMAT_R8G8B8A8_UNORM);
+    m_image.set_extent({m_page_size, m_page_size});
+    m_image.set_tiling(VK_IMAGE_TILING_OPTIMAL);
+    m_image.set_usage(VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+    m_image.set_layout(VK_IMAGE_LAYOUT_UNDEFINED);
+    m_image.set_mip_levels(m_mip_levels);
+    m_image.set_array_layers(page_count);
+    m_image.create(backend);
+
+    m_image.bind(backend);
+    VkCommandBuffer cmd_layout_transfer = backend->begin_single_time_commands();
+    m_image.change_layout(cmd_layout_transfer,
+                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                          VK_IMAGE_ASPECT_COLOR_BIT);
+    backend->end_single_time_commands(cmd_layout_transfer);
+
+    VkCommandBuffer cmd_copy_buffer = backend->begin_single_time_commands();
+    for (uint32_t layer = 0; layer < page_count; layer++) {
+        m_image.copy_buffer_to(cmd_copy_buffer,
+                               staging_buffer.handle(),
+                               VK_IMAGE_ASPECT_COLOR_BIT,
+                               {m_page_size, m_page_size},
+                               layer,
+                               page_bytes * layer);
+    }
+    m_image.generate_mipmaps(cmd_copy_buffer);
+    backend->end_single_time_commands(cmd_copy_buffer);
+    staging_buffer.destroy(backend);
+
+    VkImageViewType view_type = m_mode == LAYOUT_ARRAY ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+    m_image.create_view(backend, view_type, VK_IMAGE_ASPECT_COLOR_BIT);
+
+    VkSamplerCreateInfo sampler_create_info = {};
+    sampler_create_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_create_info.pNext = nullptr;
+    sampler_create_info.flags = 0;
+    sampler_create_info.magFilter = VK_FILTER_LINEAR;
+    sampler_create_info.minFilter = VK_FILTER_LINEAR;
+    sampler_create_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    sampler_create_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_create_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_create_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_create_info.mipLodBias = 0.0f;
+    sampler_create_info.anisotropyEnable = backend->enabled_features().samplerAnisotropy;
+    sampler_create_info.maxAnisotropy = backend->max_sampler_anisotropy();
+    sampler_create_info.compareEnable = VK_FALSE;
+    sampler_create_info.compareOp = VK_COMPARE_OP_ALWAYS;
+    sampler_create_info.minLod = 0.0f;
+    sampler_create_info.maxLod = static_cast<float>(m_mip_levels);
+    sampler_create_info.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+    sampler_create_info.unnormalizedCoordinates = VK_FALSE;
+    VK_CHECK(vkCreateSampler(backend->logical_device(),
+                             &sampler_create_info,
+                             backend->allocator(),
+                             &m_sampler));
+
+    // the bindless table declares sampler2D, array pages can't live there
+    if (backend->bindless_enabled() && m_mode == LAYOUT_SINGLE) {
+        m_bindless_index = backend->bindless()->add_texture(backend, get_descriptor_info());
+        // the defragmenter may move the image, which gives it a new view
+        m_relocation_listener = backend->add_relocation_listener([this, backend]() {
+            backend->bindless()->update_texture(backend, m_bindless_index, get_descriptor_info());
+        });
+    }
+
+    float occupancy = 0.0f;
+    for (uint32_t i = 0; i < page_count; i++) occupancy += m_pages[i].occupancy();
+    EXDEBUG("Texture atlas: %u images, %u pages of %upx, %.1f%% used",
+            static_cast<uint32_t>(m_sources.size()), page_count, m_page_size,
+            100.0f * occupancy / (float) page_count);
+}
+
+void
+ex::vulkan::texture_atlas::destroy(ex::vulkan::backend *backend) {
+    if (backend->bindless_enabled()) backend->bindless()->remove_texture(m_bindless_index);
+    m_bindless_index = ex::vulkan::bindless_table::invalid_index;
+    if (m_relocation_listener != UINT32_MAX) backend->remove_relocation_listener(m_relocation_listener);
+    m_relocation_listener = UINT32_MAX;
+
+    if (m_sampler) vkDestroySampler(backend->logical_device(), m_sampler, backend->allocator());
+    m_image.destroy(backend);
+
+    for (source &src : m_sources) {
+        if (src.pixels) stbi_image_free(src.pixels);
+    }
+    m_sources.clear();
+}
+
+void
+ex::vulkan::texture_atlas::apply(uint32_t id, ex::mesh *mesh) {
+    const entry &atlas_entry = m_entries[id];
+    mesh->remap_uvs(atlas_entry.uv_transform);
+    mesh->set_texture_layer(atlas_entry.layer);
+}
+
+VkDescriptorImageInfo *
+ex::vulkan::texture_atlas::get_descriptor_info() {
+    m_descriptor_info = {};
+    m_descriptor_info.sampler = m_sampler;
+    m_descriptor_info.imageView = m_image.view();
+    m_descriptor_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    return &m_descriptor_info;
+}
+
+void
+ex::vulkan::texture_atlas::place(uint32_t id, uint32_t alignment, uint32_t padding) {
+    const source &src = m_sources[id];
+    uint32_t width = (src.width + 2 * padding + alignment - 1) & ~(alignment - 1);
+    uint32_t height = (src.height + 2 * padding + alignment - 1) & ~(alignment - 1);
+
+    ex::atlas_packer::rect rect = {};
+    uint32_t layer = 0;
+    bool placed = false;
+
+    // the packer works in alignment units so every placement stays aligned
+    for (; layer < m_pages.size(); layer++) {
+        if (m_pages[layer].pack(width / alignment, height / alignment, &rect)) {
+            placed = true;
+            break;
+        }
+    }
+
+    if (!placed) {
+        if (m_mode == LAYOUT_SINGLE && !m_pages.empty()) {
+            EXFATAL("Texture atlas page is full: %s", src.file_path.c_str());
+            throw std::runtime_error("Texture atlas page is full");
+        }
+
+        ex::atlas_packer page;
+        page.create(m_page_size / alignment, m_page_size / alignment);
+        if (!page.pack(width / alignment, height / alignment, &rect)) {
+            EXFATAL("Image is too large for the texture atlas: %s", src.file_path.c_str());
+            throw std::runtime_error("Image is too large for the texture atlas");
+        }
+        m_pages.push_back(page);
+        layer = static_cast<uint32_t>(m_pages.size() - 1);
+    }
+
+    m_rects[id] = { rect.x * alignment, rect.y * alignment, width, height };
+
+    float page_size = static_cast<float>(m_page_size);
+    entry &out_entry = m_entries[id];
+    out_entry.uv_transform = glm::vec4((float) src.width / page_size,
+                                       (float) src.height / page_size,
+                                       (float) (m_rects[id].x + padding) / page_size,
+                                       (float) (m_rects[id].y + padding) / page_size);
+    out_entry.layer = layer;
+    out_entry.width = src.width;
+    out_entry.height = src.height;
+}
+
+void
+ex::vulkan::texture_atlas::blit(const source &src,
+                                uint8_t *page,
+                                uint32_t x,
+                                uint32_t y,
+                                uint32_t padding) {
+    // the gutter repeats the edge texels so filtering and mips never pull in
+    // a neighbour
+    uint32_t padded_width = src.width + 2 * padding;
+    uint32_t padded_height = src.height + 2 * padding;
+
+    for (uint32_t py = 0; py < padded_height; py++) {
+        int32_t sy = std::clamp<int32_t>(static_cast<int32_t>(py) - static_cast<int32_t>(padding), 0, static_cast<int32_t>(src.height) - 1);
+        uint8_t *dst_row = page + (static_cast<size_t>(y + py) * m_page_size + x) * 4;
+
+        for (uint32_t px = 0; px < padded_width; px++) {
+            int32_t sx = std::clamp<int32_t>(static_cast<int32_t>(px) - static_cast<int32_t>(padding), 0, static_cast<int32_t>(src.width) - 1);
+            const uint8_t *src_texel = src.pixels + (static_cast<size_t>(sy) * src.width + sx) * 4;
+            memcpy(dst_row + px * 4, src_texel, 4);
+        }
+    }
+}
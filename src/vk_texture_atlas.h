@@ -0,0 +1,76 @@
+#pragma once
+
+#include "vk_buffer.h"
+#include "vk_image.h"
+#include "ex_atlas_packer.h"
+#include "ex_mesh.h"
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <string>
+
+namespace ex::vulkan {
+    // Packs many small images into one image. In LAYOUT_SINGLE everything must
+    // fit one page and the result is a plain 2D texture, LAYOUT_ARRAY opens a
+    // new VK_IMAGE_VIEW_TYPE_2D_ARRAY layer whenever a page is full.
+    class texture_atlas {
+    public:
+        enum layout_mode {
+            LAYOUT_SINGLE = 0,
+            LAYOUT_ARRAY = 1,
+        };
+        
+        struct entry {
+            glm::vec4 uv_transform; // xy scale, zw offset
+            uint32_t layer;
+            uint32_t width;
+            uint32_t height;
+        };
+        
+    public:
+        void set_page_size(uint32_t page_size);
+        void set_padding(uint32_t padding);
+        void set_mip_levels(uint32_t mip_levels);
+        void set_mode(layout_mode mode);
+        uint32_t add(const char *file_path);
+        // warns and builds nothing without any add()
+        void build(ex::vulkan::backend *backend);
+        void destroy(ex::vulkan::backend *backend);
+        // moves the mesh's uvs into the entry's rectangle and hands it the
+        // entry's layer, after build()
+        void apply(uint32_t id, ex::mesh *mesh);
+
+        entry get_entry(uint32_t id) { return m_entries[id]; }
+        uint32_t page_count() { return static_cast<uint32_t>(m_pages.size()); }
+        uint32_t bindless_index() { return m_bindless_index; }
+        VkDescriptorImageInfo *get_descriptor_info();
+        
+    private:
+        struct source {
+            std::string file_path;
+            uint8_t *pixels;
+            uint32_t width;
+            uint32_t height;
+        };
+        
+        void place(uint32_t id, uint32_t alignment, uint32_t padding);
+        void blit(const source &src, uint8_t *page, uint32_t x, uint32_t y, uint32_t padding);
+        
+    private:
+        ex::vulkan::image m_image;
+        VkSampler m_sampler {};
+        VkDescriptorImageInfo m_descriptor_info {};
+        uint32_t m_bindless_index {ex::vulkan::bindless_table::invalid_index};
+        uint32_t m_relocation_listener {UINT32_MAX};
+
+        layout_mode m_mode {LAYOUT_SINGLE};
+        uint32_t m_page_size {1024};
+        uint32_t m_padding {4};
+        uint32_t m_mip_levels {3};
+        
+        std::vector<source> m_sources;
+        std::vector<entry> m_entries;
+        std::vector<ex::atlas_packer> m_pages;
+        std::vector<ex::atlas_packer::rect> m_rects;
+    };
+}